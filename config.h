@@ -0,0 +1,2 @@
+#define HAVE_MTIO_H 1
+#define HAVE_ZSTD 1
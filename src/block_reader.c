@@ -0,0 +1,310 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "config.h"
+
+#include "block_reader.h"
+
+/* pos is the starting offset, or < 0 if fd can't seek */
+static int br_setup(struct block_reader *br, int fd, size_t bufsz,
+    off64_t pos) {
+  struct stat st;
+  void *buf;
+  
+  memset(br, 0, sizeof(*br));
+  br->fd = fd;
+  br->align = sysconf(_SC_PAGESIZE);
+  br->direct = p_get_direct(fd);
+  
+  if (fstat(fd, &st) == 0 && (S_ISREG(st.st_mode) || S_ISBLK(st.st_mode))) {
+    if (pos >= 0) {
+      br->seekable = 1;
+      br->pos = pos;
+      if (S_ISREG(st.st_mode)) {
+        br->filesize = st.st_size;
+      } else {
+        br->filesize = p_lseek64(fd, 0, SEEK_END);
+        if (br->filesize < 0 || p_lseek64(fd, pos, SEEK_SET) != pos)
+          br->seekable = 0;
+      }
+    }
+    if (br->seekable && S_ISREG(st.st_mode) && !br->direct) {
+      /* map lazily, from the current offset */
+      br->mapoff = pos;
+      br->head = 0;
+      br->maplen = 0;
+      br->map = MAP_FAILED;
+      return 0;
+    }
+  }
+  
+  /* whole blocks, and whole pages so direct reads stay aligned */
+  br->bufsz = bufsz > 0 ? bufsz : BR_BUFSZ;
+  br->bufsz += (br->align - br->bufsz % br->align) % br->align;
+  if (posix_memalign(&buf, br->align, br->bufsz) != 0)
+    return -1;
+  br->buf = buf;
+  /* direct reads have to start out aligned */
+  if (br->seekable && br->direct && pos % br->align != 0) {
+    br->skip = pos % br->align;
+    br->pos = pos - br->skip;
+  }
+  return 0;
+}
+
+int br_init_stream(struct block_reader *br, t_streamp tsp, size_t bufsz) {
+  void *buf;
+  
+  memset(br, 0, sizeof(*br));
+  br->fd = tsp->fd;
+  br->tsp = tsp;
+  br->align = sysconf(_SC_PAGESIZE);
+  br->bufsz = bufsz > 0 ? bufsz : BR_BUFSZ;
+  if (posix_memalign(&buf, br->align, br->bufsz) != 0)
+    return -1;
+  br->buf = buf;
+  return 0;
+}
+
+int br_init(struct block_reader *br, int fd, size_t bufsz) {
+  return br_setup(br, fd, bufsz, p_lseek64(fd, 0, SEEK_CUR));
+}
+
+int br_init_at(struct block_reader *br, int fd, size_t bufsz,
+    off64_t offset) {
+  return br_setup(br, fd, bufsz, offset);
+}
+
+/* map the window holding the next block, falling back to reads if the
+ * mapping fails */
+static int br_remap(struct block_reader *br) {
+  off64_t cur = br->mapoff + br->head;
+  off64_t base = cur - cur % br->align;
+  size_t len = BR_MAP_WINDOW;
+  void *map;
+  
+  if (br->map != MAP_FAILED && br->maplen > 0)
+    munmap(br->map, br->maplen);
+  br->map = MAP_FAILED;
+  br->maplen = 0;
+  
+  if (base + (off64_t)len > br->filesize)
+    len = br->filesize - base;
+  map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, br->fd, base);
+  if (map == MAP_FAILED) {
+    void *buf;
+    if (posix_memalign(&buf, br->align, BR_BUFSZ) != 0)
+      return -1;
+    br->buf = buf;
+    br->pos = cur;
+    br->bufsz = BR_BUFSZ;
+    br->head = br->tail = 0;
+    return 0;
+  }
+  madvise(map, len, MADV_SEQUENTIAL);
+  br->map = map;
+  br->maplen = len;
+  br->head = cur - base;
+  br->mapoff = base;
+  return 0;
+}
+
+int br_set_async(struct block_reader *br, int nbufs) {
+  if (br->buf == NULL || br->tsp != NULL || br->pipe != NULL || nbufs < 2)
+    return 0;
+  br->pipe = iop_start_reader(br->fd, br->seekable, br->pos, br->bufsz,
+    nbufs, br->align);
+  return br->pipe != NULL ? 0 : -1;
+}
+
+union tar_block *br_next(struct block_reader *br) {
+  union tar_block *blk;
+  
+  /* already hit the end */
+  if (br->partial > 0)
+    return NULL;
+  
+  if (br->buf == NULL) {
+    /* mmap mode */
+    off64_t cur = br->mapoff + br->head;
+    if (cur + TARBLKSZ > br->filesize) {
+      br->partial = br->filesize > cur ? br->filesize - cur : 0;
+      br->eof = 1;
+      return NULL;
+    }
+    if (br->head + TARBLKSZ > br->maplen) {
+      if (br_remap(br) != 0) {
+        br->err = errno;
+        return NULL;
+      }
+      /* the mapping failed and we're reading instead */
+      if (br->buf != NULL)
+        return br_next(br);
+    }
+    blk = (union tar_block*)(br->map + br->head);
+    br->head += TARBLKSZ;
+    return blk;
+  }
+  
+  while (br->tail - br->head < TARBLKSZ && !br->eof) {
+    ssize_t nread;
+    /* carry over the partial block to the front, this is less than a
+     * block, and only happens when a read ends mid block */
+    if (br->head > 0) {
+      memmove(br->buf, br->buf + br->head, br->tail - br->head);
+      br->tail -= br->head;
+      br->head = 0;
+    }
+    /* direct reads only come up short at the end of the file */
+    if (br->direct && br->tail % br->align != 0) {
+      br->eof = 1;
+      break;
+    }
+    if (br->tsp != NULL) {
+      nread = ts_read(br->tsp, br->buf + br->tail, br->bufsz - br->tail);
+      if (nread < -1) {
+        /* zlib trouble, the caller can look at the stream */
+        errno = EIO;
+        nread = -1;
+      }
+    } else if (br->pipe != NULL) {
+      /* fills the buffer but at the end, as direct reads do */
+      nread = iop_read(br->pipe, br->buf + br->tail, br->bufsz - br->tail);
+      if (nread > 0)
+        br->pos += nread;
+    } else if (br->seekable) {
+      nread = p_pread64(br->fd, br->buf + br->tail, br->bufsz - br->tail,
+        br->pos);
+      if (nread > 0)
+        br->pos += nread;
+    } else {
+      nread = read(br->fd, br->buf + br->tail, br->bufsz - br->tail);
+    }
+    if (nread < 0) {
+      if (errno == EINTR)
+        continue;
+      br->err = errno;
+      return NULL;
+    }
+    if (nread == 0)
+      br->eof = 1;
+    br->tail += nread;
+    if (br->skip > 0) {
+      size_t drop = br->tail - br->head;
+      if (drop > br->skip)
+        drop = br->skip;
+      br->head += drop;
+      br->skip -= drop;
+      if (br->head == br->tail)
+        br->head = br->tail = 0;
+    }
+  }
+  if (br->tail - br->head < TARBLKSZ) {
+    br->partial = br->tail - br->head;
+    return NULL;
+  }
+  
+  blk = (union tar_block*)(br->buf + br->head);
+  br->head += TARBLKSZ;
+  return blk;
+}
+
+int br_skip(struct block_reader *br, off64_t nblocks) {
+  off64_t bytes = nblocks * TARBLKSZ;
+  off64_t cur, target, base;
+  
+  if (br->buf == NULL) {
+    /* mmap mode: just move along, the window follows on the next read */
+    cur = br->mapoff + br->head;
+    target = cur + bytes;
+    if (target > br->filesize) {
+      br->partial = br->filesize - cur > 0 ? br->filesize - cur : 1;
+      return -1;
+    }
+    if (br->head + bytes <= br->maplen) {
+      br->head += bytes;
+    } else {
+      if (br->map != MAP_FAILED && br->maplen > 0)
+        munmap(br->map, br->maplen);
+      br->map = MAP_FAILED;
+      br->maplen = 0;
+      br->mapoff = target;
+      br->head = 0;
+    }
+    return 0;
+  }
+  
+  /* read mode: use up what is buffered, seek over the rest */
+  if (bytes <= br->tail - br->head) {
+    br->head += bytes;
+    return 0;
+  }
+  bytes -= br->tail - br->head;
+  /* what was read ahead is of no use after a seek */
+  if (br->pipe != NULL) {
+    iop_end(br->pipe);
+    br->pipe = NULL;
+  }
+  cur = br->pos;
+  target = cur + br->skip + bytes;
+  if (target > br->filesize) {
+    br->partial = br->filesize - cur > 0 ? br->filesize - cur : 1;
+    return -1;
+  }
+  /* direct i/o has to start reading at an aligned offset */
+  base = target - target % br->align;
+  br->pos = base;
+  br->head = br->tail = 0;
+  br->skip = target - base;
+  br->eof = 0;
+  return 0;
+}
+
+void br_free(struct block_reader *br) {
+  iop_end(br->pipe);
+  if (br->map != MAP_FAILED && br->map != NULL && br->maplen > 0)
+    munmap(br->map, br->maplen);
+  free(br->buf);
+  memset(br, 0, sizeof(*br));
+}
+
+int br_is_null(const union tar_block *blk) {
+  const char *p = blk->buffer;
+  int i, j;
+  /* in 64 byte chunks, which the compiler can vectorize, bailing out at
+   * the first chunk with anything in it */
+  for (i = 0; i < TARBLKSZ; i += 64) {
+    uint64_t acc = 0, w;
+    for (j = 0; j < 64; j += 8) {
+      memcpy(&w, p + i + j, sizeof(w));
+      acc |= w;
+    }
+    if (acc != 0)
+      return 0;
+  }
+  return 1;
+}
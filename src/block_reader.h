@@ -0,0 +1,111 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __BLOCK_READER_H__
+#define __BLOCK_READER_H__
+
+/* hands out the blocks of a tar stream by pointer, reading the input in
+ * big chunks (or mapping it, for regular files) instead of making a system
+ * call per block */
+
+#include <stddef.h>
+
+#include "io_pipe.h"
+#include "portability.h"
+#include "tar.h"
+#include "tstream.h"
+
+/* default read size */
+#define BR_BUFSZ (1 << 20)
+/* size of the mmap window on regular files */
+#define BR_MAP_WINDOW (64 << 20)
+
+struct block_reader {
+  int fd;
+  /* if set, the input comes from this read stream instead of fd */
+  t_streamp tsp;
+  /* read(2) mode: unconsumed input is buf[head, tail) */
+  char *buf;
+  size_t bufsz;
+  size_t head;
+  size_t tail;
+  /* file offset of the next read, seekable inputs are read with pread so
+   * that several readers can share an fd */
+  off64_t pos;
+  /* mmap mode: map covers file offsets [mapoff, mapoff + maplen), the
+   * next block is at map + head */
+  char *map;
+  size_t maplen;
+  off64_t mapoff;
+  /* size of the input, if seekable */
+  off64_t filesize;
+  /* fd has O_DIRECT set, reads must stay aligned */
+  int direct;
+  /* input is a regular file or block device, and br_skip can seek */
+  int seekable;
+  /* bytes to drop from the next read, after an aligned-down seek */
+  size_t skip;
+  size_t align;
+  int eof;
+  /* errno of a failed read, 0 if none */
+  int err;
+  /* bytes left over at the end of the input that don't make a block */
+  size_t partial;
+  /* read(2) mode: the thread reading ahead, see br_set_async */
+  struct io_pipe *pipe;
+};
+
+/* Set up a reader on fd, starting at its current offset.  bufsz is the
+ * read size, 0 for BR_BUFSZ.  Regular files are mapped, unless fd has
+ * O_DIRECT set.  Returns 0, or -1 if memory couldn't be allocated. */
+int br_init(struct block_reader *br, int fd, size_t bufsz);
+
+/* Like br_init, but start at offset (a multiple of TARBLKSZ) instead of
+ * the current offset.  Only for seekable inputs. */
+int br_init_at(struct block_reader *br, int fd, size_t bufsz, off64_t offset);
+
+/* Set up a reader taking its input from a read stream, such as a gzip
+ * file being decompressed.  Not seekable. */
+int br_init_stream(struct block_reader *br, t_streamp tsp, size_t bufsz);
+
+/* Read the input ahead in a thread, nbufs buffers of bufsz, so that the
+ * reads overlap with the work done on the blocks.  Only for fd inputs in
+ * read(2) mode, before the first br_next; mapped files get read ahead by
+ * the kernel already, and the call does nothing for them or for stream
+ * inputs.  A br_skip that seeks stops the read-ahead.  Returns 0, or -1
+ * (with errno set) if the thread couldn't be started. */
+int br_set_async(struct block_reader *br, int nbufs);
+
+/* Returns the next block, or NULL at the end of the input or on errors
+ * (see err and partial).  The block stays valid until the next call. */
+union tar_block *br_next(struct block_reader *br);
+
+/* Skip nblocks blocks without reading them, seeking if need be.  Only
+ * valid if seekable is set.  Returns 0, or -1 (setting err or partial) if
+ * that goes past the end of the input or the seek fails. */
+int br_skip(struct block_reader *br, off64_t nblocks);
+
+/* Release the buffers / mapping (does not close the fd). */
+void br_free(struct block_reader *br);
+
+/* Test for an all zero block, a word at a time. */
+int br_is_null(const union tar_block *blk);
+
+#endif /* __BLOCK_READER_H__ */
@@ -17,47 +17,314 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
-/* crc32 code from RFC-1952 */
+/* crc32 (the gzip/RFC-1952 polynomial), computed eight bytes at a time
+ * from tables, or with the carry-less multiply / crc instructions of the
+ * cpu when they are available.  The implementation is picked once, the
+ * first time the tables are needed.
+ */
 
 #include "config.h"
 
-/* Table of CRCs of all 8-bit messages. */
-unsigned long crc_table[256];
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 
-/* Flag: has the table been computed? Initially false. */
-int crc_table_computed = 0;
+#include "portability.h"
+#include "crc32.h"
 
-void make_crc_table(void) {
-  unsigned long c;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define CRC32_PCLMUL 1
+# include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__linux__)
+# define CRC32_ARMV8 1
+# include <arm_acle.h>
+# include <sys/auxv.h>
+# ifndef HWCAP_CRC32
+#  define HWCAP_CRC32 (1 << 7)
+# endif
+#endif
+
+#define CRC32_POLY 0xedb88320UL
+
+/* crc_table[0] is the classic RFC-1952 table, crc_table[k][n] is the crc
+ * of byte n followed by k zero bytes */
+static uint32_t crc_table[8][256];
+
+/* the crc routines below work on the pre-conditioned (inverted) crc */
+typedef uint32_t (*crc_func_t)(uint32_t c, const unsigned char *buf,
+  size_t len);
+
+static uint32_t crc32_slice8(uint32_t c, const unsigned char *buf,
+  size_t len);
+
+static crc_func_t crc_func = crc32_slice8;
+static const char *crc_func_name = "slice-by-8";
+
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static uint32_t crc32_slice8(uint32_t c, const unsigned char *buf,
+    size_t len) {
+  /* align to 4 bytes so the loads below can be merged by the compiler */
+  while (len > 0 && ((uintptr_t)buf & 3) != 0) {
+    c = crc_table[0][(c ^ *buf++) & 0xff] ^ (c >> 8);
+    --len;
+  }
+
+  while (len >= 8) {
+    /* assemble the words bytewise, this is endian neutral */
+    uint32_t one = c ^ ((uint32_t)buf[0] | (uint32_t)buf[1] << 8
+      | (uint32_t)buf[2] << 16 | (uint32_t)buf[3] << 24);
+    uint32_t two = (uint32_t)buf[4] | (uint32_t)buf[5] << 8
+      | (uint32_t)buf[6] << 16 | (uint32_t)buf[7] << 24;
+    c = crc_table[7][one & 0xff]
+      ^ crc_table[6][(one >> 8) & 0xff]
+      ^ crc_table[5][(one >> 16) & 0xff]
+      ^ crc_table[4][one >> 24]
+      ^ crc_table[3][two & 0xff]
+      ^ crc_table[2][(two >> 8) & 0xff]
+      ^ crc_table[1][(two >> 16) & 0xff]
+      ^ crc_table[0][two >> 24];
+    buf += 8;
+    len -= 8;
+  }
+
+  while (len-- > 0)
+    c = crc_table[0][(c ^ *buf++) & 0xff] ^ (c >> 8);
+
+  return c;
+}
+
+#ifdef CRC32_PCLMUL
+/* folding with carry-less multiplication, after Intel's "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction".  The
+ * constants are the bit-reflected x^n mod P(x) values from that paper. */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul_blocks(uint32_t c, const unsigned char *buf,
+    size_t len) {
+  static const uint64_t k1k2[2] __attribute__((aligned(16))) =
+    { 0x0154442bd4ULL, 0x01c6e41596ULL };
+  static const uint64_t k3k4[2] __attribute__((aligned(16))) =
+    { 0x01751997d0ULL, 0x00ccaa009eULL };
+  static const uint64_t k5k0[2] __attribute__((aligned(16))) =
+    { 0x0163cd6124ULL, 0x0000000000ULL };
+  static const uint64_t poly[2] __attribute__((aligned(16))) =
+    { 0x01db710641ULL, 0x01f7011641ULL };
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
 
+  /* len is a multiple of 16, and at least 64 */
+  x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+  x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+  x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+  x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(c));
+  x0 = _mm_load_si128((const __m128i*)k1k2);
+  buf += 64;
+  len -= 64;
+
+  /* fold four lanes in parallel */
+  while (len >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+    y5 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+    y6 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+    y7 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+    y8 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+    buf += 64;
+    len -= 64;
+  }
+
+  /* fold the four lanes into one */
+  x0 = _mm_load_si128((const __m128i*)k3k4);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  /* remaining 16 byte blocks */
+  while (len >= 16) {
+    x2 = _mm_loadu_si128((const __m128i*)buf);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    buf += 16;
+    len -= 16;
+  }
+
+  /* 128 bits down to 64 */
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_srli_si128(x1, 8);
+  x1 = _mm_xor_si128(x1, x2);
+  x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, x3);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  /* Barrett reduction to 32 bits */
+  x0 = _mm_load_si128((const __m128i*)poly);
+  x2 = _mm_and_si128(x1, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32_pclmul(uint32_t c, const unsigned char *buf,
+    size_t len) {
+  /* not worth the setup for short buffers */
+  if (len >= 64) {
+    size_t blocks = len & ~(size_t)15;
+    c = crc32_pclmul_blocks(c, buf, blocks);
+    buf += blocks;
+    len -= blocks;
+  }
+  return crc32_slice8(c, buf, len);
+}
+#endif /* CRC32_PCLMUL */
+
+#ifdef CRC32_ARMV8
+__attribute__((target("+crc")))
+static uint32_t crc32_armv8(uint32_t c, const unsigned char *buf,
+    size_t len) {
+  while (len > 0 && ((uintptr_t)buf & 7) != 0) {
+    c = __crc32b(c, *buf++);
+    --len;
+  }
+  while (len >= 8) {
+    c = __crc32d(c, *(const uint64_t*)buf);
+    buf += 8;
+    len -= 8;
+  }
+  while (len-- > 0)
+    c = __crc32b(c, *buf++);
+  return c;
+}
+#endif /* CRC32_ARMV8 */
+
+static void crc_init(void) {
+  uint32_t c;
   int n, k;
+
+  for (n = 0; n < 256; n++) {
+    c = (uint32_t)n;
+    for (k = 0; k < 8; k++)
+      c = c & 1 ? CRC32_POLY ^ (c >> 1) : c >> 1;
+    crc_table[0][n] = c;
+  }
   for (n = 0; n < 256; n++) {
-    c = (unsigned long) n;
-    for (k = 0; k < 8; k++) {
-      if (c & 1) {
-        c = 0xedb88320L ^ (c >> 1);
-      } else {
-        c = c >> 1;
-      }
+    c = crc_table[0][n];
+    for (k = 1; k < 8; k++) {
+      c = crc_table[0][c & 0xff] ^ (c >> 8);
+      crc_table[k][n] = c;
     }
-    crc_table[n] = c;
   }
-  crc_table_computed = 1;
-}
 
-unsigned long update_crc(unsigned long crc, unsigned char *buf, int len) {
-  unsigned long c = crc ^ 0xffffffffL;
-  int n;
+#ifdef CRC32_PCLMUL
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+    crc_func = crc32_pclmul;
+    crc_func_name = "pclmulqdq";
+  }
+#endif
+#ifdef CRC32_ARMV8
+  if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+    crc_func = crc32_armv8;
+    crc_func_name = "armv8-crc32";
+  }
+#endif
+}
 
-  if (!crc_table_computed)
-    make_crc_table();
+void make_crc_table(void) {
+  pthread_once(&crc_once, crc_init);
+}
 
-  for (n = 0; n < len; n++)
-    c = crc_table[(c ^ buf[n]) & 0xff] ^ (c >> 8);
+const char *crc_impl(void) {
+  make_crc_table();
+  return crc_func_name;
+}
 
-  return c ^ 0xffffffffL;
+unsigned long update_crc(unsigned long crc, unsigned char *buf, int len) {
+  if (len <= 0)
+    return crc;
+  make_crc_table();
+  return crc_func((uint32_t)crc ^ 0xffffffffUL, buf, len) ^ 0xffffffffUL;
 }
 
 unsigned long crc(unsigned char *buf, int len) {
   return update_crc(0L, buf, len);
 }
+
+/* combine_crc is zlib's crc32_combine: appending len2 zero bytes to a crc
+ * is a linear operation over GF(2), done here by repeated squaring of the
+ * 32x32 operator matrix for one zero bit */
+
+static uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec) {
+  uint32_t sum = 0;
+  while (vec) {
+    if (vec & 1)
+      sum ^= *mat;
+    vec >>= 1;
+    mat++;
+  }
+  return sum;
+}
+
+static void gf2_matrix_square(uint32_t *square, const uint32_t *mat) {
+  int n;
+  for (n = 0; n < 32; n++)
+    square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+unsigned long combine_crc(unsigned long crc1, unsigned long crc2,
+    off64_t len2) {
+  uint32_t even[32], odd[32], row, c1 = crc1;
+  int n;
+
+  if (len2 <= 0)
+    return crc1;
+
+  /* operator for one zero bit */
+  odd[0] = CRC32_POLY;
+  row = 1;
+  for (n = 1; n < 32; n++) {
+    odd[n] = row;
+    row <<= 1;
+  }
+  /* two zero bits, then four */
+  gf2_matrix_square(even, odd);
+  gf2_matrix_square(odd, even);
+
+  /* apply len2 zero bytes, starting with one byte (eight bits) */
+  do {
+    gf2_matrix_square(even, odd);
+    if (len2 & 1)
+      c1 = gf2_matrix_times(even, c1);
+    len2 >>= 1;
+    if (len2 == 0)
+      break;
+    gf2_matrix_square(odd, even);
+    if (len2 & 1)
+      c1 = gf2_matrix_times(odd, c1);
+    len2 >>= 1;
+  } while (len2 != 0);
+
+  return c1 ^ (uint32_t)crc2;
+}
@@ -20,11 +20,18 @@
 #ifndef __CRC32_H__
 #define __CRC32_H__
 
-/* crc32 code from RFC-1952 */
+/* crc32 as used by gzip (RFC-1952) */
 
-/* Make the table for a fast CRC. */
+#include "portability.h"
+
+/* Make the tables for a fast CRC and pick the fastest implementation the
+ * cpu supports.  Safe to call from several threads, and called implicitly
+ * by update_crc, so there is no need to call it directly. */
 void make_crc_table(void);
 
+/* Name of the implementation in use, for diagnostics. */
+const char *crc_impl(void);
+
 /* Update a running crc with the bytes buf[0..len-1] and return the updated
  * crc. The crc should be initialized to zero. Pre- and post-conditioning
  * (one's complement) is performed within this function so it shouldn't be
@@ -43,4 +50,11 @@ unsigned long update_crc(unsigned long crc, unsigned char *buf, int len);
 /* Return the CRC of the bytes buf[0..len-1]. */
 unsigned long crc(unsigned char *buf, int len);
 
+/* Given crc1 of a block A and crc2 of a block B of len2 bytes, return the
+ * crc of A followed by B, without needing the data.  This lets pieces of a
+ * stream be checksummed independently and stitched together afterwards.
+ * Named so as not to collide with zlib's crc32_combine. */
+unsigned long combine_crc(unsigned long crc1, unsigned long crc2,
+  off64_t len2);
+
 #endif /* __CRC32_H__ */
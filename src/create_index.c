@@ -17,187 +17,1111 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include <errno.h>
+#include <libgen.h>
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "config.h"
 
+#include "block_reader.h"
 #include "debug.h"
+#include "gzindex.h"
+#include "index_parser.h"
+#include "io_pipe.h"
+#include "pax.h"
 #include "portability.h"
+#include "sparse.h"
 #include "tar.h"
 #include "tarix.h"
+#include "tarnum.h"
 #include "tstream.h"
 
 enum blocks_type {
   BT_FILEDATA,
   BT_LONGNAME,
-  BT_LONGLINK
+  BT_LONGLINK,
+  /* extended header payload */
+  BT_PAX,
+  /* global extended header payload, which is not used */
+  BT_PAXGLOBAL,
+  /* old GNU sparse extension headers */
+  BT_SPARSEEXT,
+  /* PAX 1.0 sparse map at the start of the member data */
+  BT_SPARSEMAP
 };
 
+/* start of an index record seen by a parallel scan */
+struct scan_mark {
+  blknum_t blocknum;
+  /* offset of the record's index lines in the scan's output */
+  long textoff;
+  /* no extended header values are waiting for this record */
+  int clean;
+};
+
+/* state of the index record parser, which gets fed one block at a time */
+struct index_scan {
+  FILE *indexf;
+  t_streamp tsp;
+  int debug_messages;
+  blknum_t blocknum;
+  blknum_t filestart;
+  blknum_t blocks_left;
+  int blocks_left_type;
+  char *fullfname;
+  int fullfname_sz;
+  /* sparse map of the current member, if any */
+  struct sparse_map sparse;
+  int sparse_active;
+  /* GNU.sparse values from an extended header, for the next member */
+  struct sparse_pax spax;
+  /* and values standing in for its header fields */
+  struct pax_override pax;
+  /* index line of a sparse member waiting for its extension headers */
+  char pending_type;
+  blknum_t pending_blocks;
+  /* extended header payload, or a PAX 1.0 sparse map */
+  char *auxbuf;
+  size_t auxlen, auxsz, auxsize;
+  /* actual offset for checkpoint */
+  off64_t cp_offset;
+  /* what the header of the current member says, for its #:st record */
+  struct index_st st;
+  /* checkpoints in member data every cp_blocks blocks (0 for none), and
+   * the data blocks of the current member so far */
+  blknum_t cp_blocks;
+  blknum_t data_blocks;
+  /* parallel scans stop at the first clean record start at or after
+   * stop_at (0 for never), and remember where records start */
+  blknum_t stop_at;
+  int want_marks;
+  struct scan_mark *marks;
+  size_t nmarks, marksz;
+  /* durable progress points every progress_interval bytes of tar data (0
+   * for none), recorded in the sidecar progress_file */
+  long long progress_interval;
+  off64_t progress_next;
+  const char *progress_file;
+  int level;
+};
+
+/* results of scan_block, besides 0 */
+#define SCAN_STOP 1
+#define SCAN_ERR 2
+
+/* append a block to a growable buffer */
+static void append_block(char **buf, size_t *len, size_t *sz,
+    const char *block) {
+  if (*len + TARBLKSZ > *sz) {
+    *sz = (*len + TARBLKSZ) * 2;
+    *buf = realloc(*buf, *sz);
+  }
+  memcpy(*buf + *len, block, TARBLKSZ);
+  *len += TARBLKSZ;
+}
+
+static void scan_init(struct index_scan *sc, FILE *indexf, t_streamp tsp,
+    int debug_messages) {
+  memset(sc, 0, sizeof(*sc));
+  sc->indexf = indexf;
+  sc->tsp = tsp;
+  sc->debug_messages = debug_messages;
+  sc->blocks_left_type = BT_FILEDATA;
+  // pre-allocate a reasonable filename size, zero'd
+  sc->fullfname = (char*)calloc(TARBLKSZ, 1);
+  sc->fullfname_sz = TARBLKSZ;
+  sparse_init(&sc->sparse);
+}
+
+static void scan_free(struct index_scan *sc) {
+  sparse_free(&sc->sparse);
+  sparse_pax_free(&sc->spax);
+  pax_override_free(&sc->pax);
+  free(sc->auxbuf);
+  free(sc->fullfname);
+  free(sc->marks);
+}
+
+/* the #:st record of the member whose index line was just written */
+static void write_st_ext(struct index_scan *sc, off64_t size) {
+  fprintf(sc->indexf, INDEX_EXT_PREFIX INDEX_EXT_ST " %o %lu %lu %lld %lld\n",
+    sc->st.mode, sc->st.uid, sc->st.gid, (long long)size, sc->st.mtime);
+}
+
+/* Resuming: with a progress interval, every so often at a record
+ * boundary the index and the archive are synced to disk, and how far
+ * they got is recorded in a sidecar next to the index.  After a crash,
+ * -R cuts both back to that point and carries on reading the tar file
+ * from there.  The sidecar goes away once the archive is complete. */
+
+#define RESUME_SUFFIX ".resume"
+#define RESUME_MAGIC "TARIX RESUME v1"
+
+struct resume_point {
+  /* length of the index, of the tar data read and of the archive */
+  off64_t index_bytes;
+  off64_t raw_bytes;
+  off64_t out_bytes;
+  /* crc32 of the tar data, for the gzip trailer */
+  unsigned long crc32;
+  /* what the archive is compressed with, and the progress interval */
+  char codec[16];
+  int level;
+  long long interval;
+};
+
+static char *resume_sidecar_name(const char *indexfile) {
+  char *name = malloc(strlen(indexfile) + strlen(RESUME_SUFFIX) + 1);
+  if (name != NULL)
+    strcat(strcpy(name, indexfile), RESUME_SUFFIX);
+  return name;
+}
+
+/* replace the sidecar with one for rp, durably; returns 0 or -1 */
+static int resume_write(const char *name, const struct resume_point *rp) {
+  char *tmpname = malloc(strlen(name) + 5);
+  char *dir;
+  FILE *f;
+  int fd, res = -1;
+  
+  strcat(strcpy(tmpname, name), ".new");
+  if ((f = fopen(tmpname, "w")) == NULL) {
+    perror("open progress file");
+    goto out;
+  }
+  fprintf(f, RESUME_MAGIC "\n%lld %lld %lld %lu %s %d %lld\n",
+    (long long)rp->index_bytes, (long long)rp->raw_bytes,
+    (long long)rp->out_bytes, rp->crc32, rp->codec, rp->level,
+    rp->interval);
+  if (fflush(f) != 0 || fsync(fileno(f)) != 0) {
+    perror("write progress file");
+    fclose(f);
+    goto out;
+  }
+  fclose(f);
+  if (rename(tmpname, name) != 0) {
+    perror("rename progress file");
+    goto out;
+  }
+  /* and the rename itself */
+  dir = strdup(name);
+  if ((fd = open(dirname(dir), O_RDONLY)) >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+  free(dir);
+  res = 0;
+out:
+  free(tmpname);
+  return res;
+}
+
+/* read the sidecar into rp; returns 0, or -1 if there is no good one */
+static int resume_read(const char *name, struct resume_point *rp) {
+  char magic[sizeof(RESUME_MAGIC) + 1];
+  long long index_bytes, raw_bytes, out_bytes;
+  FILE *f;
+  int n;
+  
+  if ((f = fopen(name, "r")) == NULL) {
+    fprintf(stderr, "No progress to resume from: %s: %s\n", name,
+      strerror(errno));
+    return -1;
+  }
+  n = fgets(magic, sizeof(magic), f) != NULL
+    && !strcmp(magic, RESUME_MAGIC "\n")
+    && fscanf(f, "%lld %lld %lld %lu %15s %d %lld", &index_bytes, &raw_bytes,
+      &out_bytes, &rp->crc32, rp->codec, &rp->level, &rp->interval) == 7;
+  fclose(f);
+  if (!n || index_bytes <= 0 || raw_bytes < 0 || raw_bytes % TARBLKSZ != 0
+      || out_bytes < 0) {
+    fprintf(stderr, "Bad progress file %s\n", name);
+    return -1;
+  }
+  rp->index_bytes = index_bytes;
+  rp->raw_bytes = raw_bytes;
+  rp->out_bytes = out_bytes;
+  return 0;
+}
+
+/* sync the index and the archive, which is at a checkpoint, and record
+ * the point in the sidecar */
+static int write_progress(struct index_scan *sc) {
+  int debug_messages = sc->debug_messages;
+  struct resume_point rp;
+  off64_t tmp;
+  
+  if (fflush(sc->indexf) != 0 || fsync(fileno(sc->indexf)) != 0) {
+    perror("sync index");
+    return SCAN_ERR;
+  }
+  if ((tmp = ts_sync(sc->tsp)) != 0) {
+    ptserror("sync archive", tmp, sc->tsp);
+    return SCAN_ERR;
+  }
+  memset(&rp, 0, sizeof(rp));
+  rp.index_bytes = p_lseek64(fileno(sc->indexf), 0, SEEK_CUR);
+  rp.raw_bytes = sc->tsp->raw_bytes;
+  rp.out_bytes = sc->tsp->codec != NULL ? sc->tsp->zlib_bytes
+    : sc->tsp->raw_bytes;
+  rp.crc32 = sc->tsp->crc32;
+  strcpy(rp.codec, sc->tsp->codec != NULL ? sc->tsp->codec->name : "none");
+  rp.level = sc->level;
+  rp.interval = sc->progress_interval;
+  DMSG("progress at %lld, archive %lld, index %lld\n",
+    (long long)rp.raw_bytes, (long long)rp.out_bytes,
+    (long long)rp.index_bytes);
+  if (resume_write(sc->progress_file, &rp) != 0)
+    return SCAN_ERR;
+  sc->progress_next = rp.raw_bytes + sc->progress_interval;
+  return 0;
+}
+
+/* are values from an extended header waiting for the next member? */
+static int scan_pax_pending(const struct index_scan *sc) {
+  return sc->spax.seen || sc->pax.have_size;
+}
+
+static int scan_pax_record(const char *keyword, const char *value,
+    size_t valuelen, void *data) {
+  struct index_scan *sc = (struct index_scan*)data;
+  int rv = pax_override_record(keyword, value, valuelen, &sc->pax);
+  return rv != 0 ? rv : sparse_pax_record(keyword, value, valuelen, &sc->spax);
+}
+
+/* make room for and copy in a file name from elsewhere than the header */
+static void scan_set_name(struct index_scan *sc, const char *name) {
+  size_t len = strlen(name);
+  
+  if (len >= sc->fullfname_sz) {
+    sc->fullfname_sz = (len / TARBLKSZ + 1) * TARBLKSZ;
+    sc->fullfname = realloc(sc->fullfname, sc->fullfname_sz);
+  }
+  memcpy(sc->fullfname, name, len + 1);
+}
+
+/* the file name from the header itself; the fields are not terminated
+ * when they are full */
+static void scan_header_name(struct index_scan *sc, union tar_block *inbuf) {
+  size_t nlen = strnlen(inbuf->header.name, sizeof(inbuf->header.name));
+  size_t plen = 0;
+  
+  /* GNU archives have other things where the prefix would be */
+  if (!IS_OLDGNU_HEADER(inbuf))
+    plen = strnlen(inbuf->header.prefix, sizeof(inbuf->header.prefix));
+  /* both fit in the TARBLKSZ the buffer starts at */
+  if (plen > 0) {
+    memcpy(sc->fullfname, inbuf->header.prefix, plen);
+    sc->fullfname[plen++] = '/';
+  }
+  memcpy(sc->fullfname + plen, inbuf->header.name, nlen);
+  sc->fullfname[plen + nlen] = 0;
+}
+
+/* handle the first block of a record, which is a header */
+static int scan_header(struct index_scan *sc, union tar_block *inbuf) {
+  int debug_messages = sc->debug_messages;
+  long long size_tmp, realsize;
+  
+  /* just got the first block from a new record, unless it follows a long
+   * name or an extended header, which go with the member after them */
+  if (sc->blocks_left_type != BT_LONGNAME
+      && sc->blocks_left_type != BT_LONGLINK
+      && sc->blocks_left_type != BT_PAX
+      && sc->blocks_left_type != BT_PAXGLOBAL) {
+    if (sc->stop_at > 0 && sc->blocknum >= sc->stop_at
+        && !scan_pax_pending(sc))
+      return SCAN_STOP;
+    sc->filestart = sc->blocknum;
+    sc->fullfname[0] = 0; /* clear file name for new one */
+    if (sc->want_marks) {
+      if (sc->nmarks == sc->marksz) {
+        sc->marksz = sc->marksz ? sc->marksz * 2 : 1024;
+        sc->marks = realloc(sc->marks, sc->marksz * sizeof(*sc->marks));
+      }
+      sc->marks[sc->nmarks].blocknum = sc->blocknum;
+      sc->marks[sc->nmarks].textoff = ftell(sc->indexf);
+      sc->marks[sc->nmarks].clean = !scan_pax_pending(sc);
+      ++sc->nmarks;
+    }
+    /* checkpoint output stream */
+    if (sc->tsp != NULL) {
+      DMSG("cp before new rec\n");
+      sc->cp_offset = ts_checkpoint(sc->tsp);
+      if (sc->cp_offset < 0) {
+        ptserror("ts_checkpoint", sc->cp_offset, sc->tsp);
+        return SCAN_ERR;
+      }
+      DMSG("cp done at %lld\n", (long long)sc->cp_offset);
+      /* nothing from before is needed from here on, unless an extended
+       * header left values for this record */
+      if (sc->progress_interval > 0 && !scan_pax_pending(sc)
+          && sc->tsp->raw_bytes >= sc->progress_next
+          && write_progress(sc) != 0)
+        return SCAN_ERR;
+    } else {
+      sc->cp_offset = sc->filestart * TARBLKSZ;
+    }
+  }
+  
+  /* compute data size from header block (octal or base-256), or the
+   * extended header before it */
+  if (sc->pax.have_size && inbuf->header.typeflag != GNUTYPE_LONGLINK
+      && inbuf->header.typeflag != GNUTYPE_LONGNAME
+      && inbuf->header.typeflag != XHDTYPE
+      && inbuf->header.typeflag != XGLTYPE) {
+    size_tmp = sc->pax.size;
+    sc->pax.have_size = 0;
+  } else if (TAR_SIZE(inbuf->header.size, &size_tmp) != 0) {
+    /* a size we can't trust leaves nowhere to look for the next header */
+    fprintf(stderr, "bad header at block %" PRIu64 "\n", sc->blocknum);
+    return SCAN_ERR;
+  }
+  sc->data_blocks = 0;
+  sc->blocks_left = size_tmp / 512;
+  if (size_tmp % 512 > 0) /* get the extra partial block */
+    ++sc->blocks_left;
+  DMSG("have %lld blocks to pass\n", size_tmp);
+  
+  switch(inbuf->header.typeflag) {
+    case GNUTYPE_LONGLINK:
+      sc->blocks_left_type = BT_LONGLINK;
+      break;
+    case GNUTYPE_LONGNAME:
+      sc->blocks_left_type = BT_LONGNAME;
+      break;
+    case XHDTYPE:
+      /* the payload is parsed for the next member */
+      sc->blocks_left_type = BT_PAX;
+      sc->auxlen = 0;
+      sc->auxsize = size_tmp;
+      sparse_pax_free(&sc->spax);
+      pax_override_free(&sc->pax);
+      break;
+    case XGLTYPE:
+      sc->blocks_left_type = BT_PAXGLOBAL;
+      break;
+    default: {
+      blknum_t reclen;
+      /* anything else we treat as filedata, which triggers writing
+       * a record, but whose data is ignored */
+      sc->blocks_left_type = BT_FILEDATA;
+      /* write out the index record */
+      /* get the file name from the file record if there wasn't a 
+       * long name record previously */
+      if (sc->spax.seen && sc->spax.name != NULL) {
+        /* PAX sparse members carry their real name separately */
+        scan_set_name(sc, sc->spax.name);
+      } else if (sc->pax.path != NULL) {
+        scan_set_name(sc, sc->pax.path);
+      } else if (sc->fullfname[0] == 0) {
+        /* get filename from tar record */
+        scan_header_name(sc, inbuf);
+      }
+      reclen = sc->blocknum - sc->filestart + 1 + sc->blocks_left;
+      sc->st.mode = TAR_FIELD(inbuf->header.mode) & 07777;
+      sc->st.uid = TAR_FIELD(inbuf->header.uid);
+      sc->st.gid = TAR_FIELD(inbuf->header.gid);
+      sc->st.size = size_tmp;
+      sc->st.mtime = sc->pax.have_mtime ? sc->pax.mtime
+        : TAR_FIELD(inbuf->header.mtime);
+      pax_override_free(&sc->pax);
+      
+      switch (inbuf->header.typeflag) {
+        case GNUTYPE_SPARSE:
+          sparse_free(&sc->sparse);
+          sc->sparse_active = 1;
+          if (TAR_SIZE(inbuf->oldgnu_header.realsize, &realsize) != 0) {
+            fprintf(stderr, "bad header at block %" PRIu64 "\n",
+              sc->blocknum);
+            return SCAN_ERR;
+          }
+          sc->sparse.realsize = realsize;
+          if (sparse_add_gnu(&sc->sparse, inbuf->oldgnu_header.sp,
+              SPARSES_IN_OLDGNU_HEADER) != 0)
+            fprintf(stderr, "WARN: bad sparse map for %s\n", sc->fullfname);
+          if (inbuf->oldgnu_header.isextended) {
+            /* extension headers come before the data, and are not
+             * included in the size, so the index line has to wait */
+            sc->blocks_left_type = BT_SPARSEEXT;
+            sc->pending_type = inbuf->header.typeflag;
+            sc->pending_blocks = sc->blocks_left;
+            sc->blocks_left = 1;
+            reclen = 0;
+          } else {
+            sc->sparse.datablock = sc->blocknum - sc->filestart + 1;
+          }
+          break;
+        default:
+          if (sc->spax.seen) {
+            sparse_free(&sc->sparse);
+            sc->sparse_active = 1;
+            if (sc->spax.major >= 1) {
+              /* map is at the start of the data */
+              sc->sparse.realsize = sc->spax.map.realsize;
+              sc->blocks_left_type = BT_SPARSEMAP;
+              sc->auxlen = 0;
+            } else {
+              /* 0.x: map was in the extended header */
+              sc->sparse = sc->spax.map;
+              sparse_init(&sc->spax.map);
+              sc->sparse.datablock = sc->blocknum - sc->filestart + 1;
+            }
+            sparse_pax_free(&sc->spax);
+          }
+          break;
+      }
+      
+      if (reclen > 0) {
+        //          LONG* items        hdr     data
+        DMSG("got filename %s, reclen %" PRIu64 "\n", sc->fullfname, reclen);
+        /* cast to long long to avoid compiler warn on 64bit */
+        fprintf(sc->indexf, "%c %" PRIu64 " %lld %" PRIu64 " %s\n",
+          inbuf->header.typeflag,
+          sc->filestart, (long long)sc->cp_offset, reclen, sc->fullfname);
+        /* PAX 1.0 maps are written once they have been read, and the
+         * metadata after them */
+        if (sc->sparse_active && sc->blocks_left_type != BT_SPARSEMAP) {
+          sparse_write_ext(sc->indexf, &sc->sparse);
+          write_st_ext(sc, sc->sparse.realsize);
+        } else if (!sc->sparse_active)
+          write_st_ext(sc, sc->st.size);
+      }
+      sc->sparse_active = 0;
+      break;
+    }
+  }
+  return 0;
+}
+
+/* a checkpoint before the block at sc->blocknum, in the middle of member
+ * data, so that reads from there don't have to start at the member */
+static int scan_data_cp(struct index_scan *sc) {
+  int debug_messages = sc->debug_messages;
+  off64_t offset;
+  
+  DMSG("cp in member data\n");
+  if ((offset = ts_checkpoint(sc->tsp)) < 0) {
+    ptserror("ts_checkpoint", offset, sc->tsp);
+    return SCAN_ERR;
+  }
+  fprintf(sc->indexf, INDEX_EXT_PREFIX INDEX_EXT_CP " %" PRIu64 " %lld\n",
+    sc->blocknum - sc->filestart, (long long)offset);
+  return 0;
+}
+
+/* feed the block at sc->blocknum to the parser, returns 0, SCAN_STOP if
+ * it is the record stop_at asked for, or SCAN_ERR */
+static int scan_block(struct index_scan *sc, union tar_block *inbuf) {
+  int debug_messages = sc->debug_messages;
+  int tmp;
+  
+  if (sc->blocks_left > 0) {
+    /* we are in the middle of a file record */
+    switch(sc->blocks_left_type) {
+      case BT_LONGNAME:
+        if (sc->fullfname_sz - strlen(sc->fullfname) - 1 < TARBLKSZ) {
+          sc->fullfname_sz += TARBLKSZ;
+          sc->fullfname = realloc(sc->fullfname, sc->fullfname_sz);
+        }
+        strncat(sc->fullfname, inbuf->buffer, TARBLKSZ);
+        DMSG("got long filename %s\n", sc->fullfname);
+        break;
+      case BT_PAX:
+        append_block(&sc->auxbuf, &sc->auxlen, &sc->auxsz, inbuf->buffer);
+        if (sc->blocks_left == 1) {
+          /* got the whole payload */
+          if (pax_parse(sc->auxbuf, sc->auxsize, scan_pax_record, sc) != 0)
+            fprintf(stderr, "WARN: bad extended header at block %" PRIu64
+              "\n",
+              sc->filestart);
+        }
+        break;
+      case BT_SPARSEEXT:
+        if (sparse_add_gnu(&sc->sparse, inbuf->sparse_header.sp,
+            SPARSES_IN_SPARSE_HEADER) != 0)
+          fprintf(stderr, "WARN: bad sparse map for %s\n", sc->fullfname);
+        if (inbuf->sparse_header.isextended) {
+          /* yet another extension header follows */
+          ++sc->blocks_left;
+        } else {
+          /* the data comes next, now the record length is known */
+          sc->sparse.datablock = sc->blocknum - sc->filestart + 1;
+          sc->blocks_left = sc->pending_blocks + 1;
+          sc->blocks_left_type = BT_FILEDATA;
+          DMSG("got filename %s, reclen %" PRIu64 "\n", sc->fullfname,
+            sc->sparse.datablock + sc->pending_blocks);
+          fprintf(sc->indexf, "%c %" PRIu64 " %lld %" PRIu64 " %s\n",
+            sc->pending_type,
+            sc->filestart, (long long)sc->cp_offset,
+            sc->sparse.datablock + sc->pending_blocks, sc->fullfname);
+          sparse_write_ext(sc->indexf, &sc->sparse);
+          write_st_ext(sc, sc->sparse.realsize);
+        }
+        break;
+      case BT_SPARSEMAP: {
+        size_t used;
+        append_block(&sc->auxbuf, &sc->auxlen, &sc->auxsz, inbuf->buffer);
+        tmp = sparse_parse_map10(&sc->sparse, sc->auxbuf, sc->auxlen, &used);
+        if (tmp > 0) {
+          /* the map is padded out to a block boundary */
+          sc->sparse.datablock = sc->blocknum - sc->filestart + 1;
+          sparse_write_ext(sc->indexf, &sc->sparse);
+          write_st_ext(sc, sc->sparse.realsize);
+          sc->blocks_left_type = BT_FILEDATA;
+        } else if (tmp < 0 || sc->blocks_left == 1) {
+          fprintf(stderr, "WARN: bad sparse map for %s\n", sc->fullfname);
+          write_st_ext(sc, sc->st.size);
+          sc->blocks_left_type = BT_FILEDATA;
+        }
+        break;
+      }
+      case BT_FILEDATA:
+        if (sc->cp_blocks > 0 && sc->data_blocks > 0
+            && sc->data_blocks % sc->cp_blocks == 0
+            && (tmp = scan_data_cp(sc)) != 0)
+          return tmp;
+        ++sc->data_blocks;
+        break;
+      case BT_LONGLINK:
+      case BT_PAXGLOBAL:
+        /* don't do anything with these currently */
+        break;
+    }
+    --sc->blocks_left;
+    return 0;
+  }
+  /* ignore totally null blocks that come when we're not in the middle
+   * of anything */
+  if (br_is_null(inbuf))
+    return 0;
+  return scan_header(sc, inbuf);
+}
+
+/* move on to the next block, seeking over member data if nothing needs
+ * it; returns -1 if the seek failed */
+static int scan_advance(struct index_scan *sc, struct block_reader *br,
+    int pass_through) {
+  int debug_messages = sc->debug_messages;
+  
+  ++sc->blocknum;
+  
+  /* index only: nothing needs the member data, so seek over it */
+  if (!pass_through && br->seekable && sc->blocks_left > 0
+      && (sc->blocks_left_type == BT_FILEDATA
+        || sc->blocks_left_type == BT_LONGLINK
+        || sc->blocks_left_type == BT_PAXGLOBAL)) {
+    DMSG("skipping %" PRIu64 " blocks\n", sc->blocks_left);
+    if (br_skip(br, sc->blocks_left) != 0)
+      return -1;
+    sc->blocknum += sc->blocks_left;
+    sc->blocks_left = 0;
+  }
+  return 0;
+}
+
+/* Parallel scanning: the archive is cut into chunks, and each chunk gets
+ * a thread that looks for the first block that checksums as a header,
+ * then parses records from there (seeking over data) until it is past the
+ * end of its chunk.  The guess can be wrong (a tar file stored in the
+ * archive, say), so the outputs are only trusted from a record start that
+ * the chunk before also arrived at, with the same (empty) parser state.
+ * From there on both parse the same blocks the same way, so the pieces
+ * add up to what a serial scan writes.  Where that doesn't happen the
+ * chunk is scanned again from the right place. */
+
+/* don't bother with chunks smaller than this */
+#define SCAN_MIN_CHUNK (1 << 20)
+
+struct scan_chunk {
+  int fd;
+  size_t bufsz;
+  int debug_messages;
+  /* first block to look at, and the start of the next chunk (0 for the
+   * last chunk) */
+  blknum_t start;
+  blknum_t end;
+  /* start is not known to be a record start, look for a header */
+  int search;
+  /* index lines, and where records start in them */
+  char *text;
+  size_t textlen;
+  struct scan_mark *marks;
+  size_t nmarks;
+  /* first record start at or after end, if not at_end */
+  blknum_t exit;
+  /* ran into the end of the archive (or a read error) */
+  int at_end;
+  int err;
+  size_t partial;
+  int failed;
+  /* has a thread to join */
+  int threaded;
+};
+
+/* does blk checksum as a tar header? */
+static int header_checksum_ok(const union tar_block *blk) {
+  const unsigned char *p = (const unsigned char*)blk->buffer;
+  char field[sizeof(blk->header.chksum) + 1];
+  unsigned long usum = 0;
+  long ssum = 0, want;
+  char *end;
+  int i;
+  
+  memcpy(field, blk->header.chksum, sizeof(blk->header.chksum));
+  field[sizeof(blk->header.chksum)] = 0;
+  want = strtol(field, &end, 8);
+  if (end == field || (*end != 0 && *end != ' '))
+    return 0;
+  for (i = 0; i < TARBLKSZ; ++i) {
+    unsigned char c = p[i];
+    if (i >= 148 && i < 156)
+      c = ' ';
+    usum += c;
+    /* some old tars summed signed chars */
+    ssum += (signed char)c;
+  }
+  return (long)usum == want || ssum == want;
+}
+
+static void *scan_chunk_run(void *arg) {
+  struct scan_chunk *ch = arg;
+  struct block_reader br;
+  struct index_scan sc;
+  union tar_block *inbuf;
+  FILE *out;
+  int tmp = 0;
+  
+  ch->text = NULL;
+  ch->textlen = 0;
+  ch->marks = NULL;
+  ch->nmarks = 0;
+  ch->at_end = 0;
+  ch->err = 0;
+  ch->partial = 0;
+  
+  if ((out = open_memstream(&ch->text, &ch->textlen)) == NULL) {
+    ch->failed = 1;
+    return NULL;
+  }
+  if (br_init_at(&br, ch->fd, ch->bufsz, (off64_t)ch->start * TARBLKSZ)
+      != 0) {
+    fclose(out);
+    ch->failed = 1;
+    return NULL;
+  }
+  scan_init(&sc, out, NULL, ch->debug_messages);
+  sc.blocknum = ch->start;
+  sc.stop_at = ch->end;
+  sc.want_marks = 1;
+  
+  inbuf = br_next(&br);
+  if (ch->search) {
+    /* speculate: the first thing that looks like a header is one */
+    while (inbuf != NULL && (br_is_null(inbuf)
+        || !header_checksum_ok(inbuf))) {
+      if (++sc.blocknum >= ch->end && ch->end > 0) {
+        inbuf = NULL;
+        break;
+      }
+      inbuf = br_next(&br);
+    }
+    if (inbuf == NULL) {
+      /* nothing to offer, the stitching will rescan if needed */
+      ch->at_end = 1;
+      goto done;
+    }
+  }
+  
+  while (inbuf != NULL) {
+    tmp = scan_block(&sc, inbuf);
+    if (tmp != 0)
+      break;
+    if (scan_advance(&sc, &br, 0) != 0)
+      break;
+    inbuf = br_next(&br);
+  }
+  if (tmp == SCAN_STOP) {
+    ch->exit = sc.blocknum;
+  } else {
+    ch->at_end = 1;
+    ch->err = br.err;
+    ch->partial = br.partial;
+  }
+  
+done:
+  br_free(&br);
+  ch->marks = sc.marks;
+  ch->nmarks = sc.nmarks;
+  sc.marks = NULL;
+  scan_free(&sc);
+  if (fclose(out) != 0)
+    ch->failed = 1;
+  return NULL;
+}
+
+/* the clean record start at blocknum in ch, or NULL */
+static struct scan_mark *scan_find_mark(struct scan_chunk *ch,
+    blknum_t blocknum) {
+  size_t lo = 0, hi = ch->nmarks;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (ch->marks[mid].blocknum < blocknum)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo < ch->nmarks && ch->marks[lo].blocknum == blocknum
+      && ch->marks[lo].clean)
+    return &ch->marks[lo];
+  return NULL;
+}
+
+/* Write the index records of the (seekable) tar on fd using jobs threads.
+ * Returns 0, 2 on read errors (like the serial scan), or -1 if the
+ * parallel scan couldn't be set up and the caller should do it serially. */
+static int scan_parallel(FILE *indexf, int fd, off64_t filesize,
+    blknum_t first, size_t bufsz, int jobs, int debug_messages) {
+  blknum_t nblocks = filesize / TARBLKSZ - first;
+  struct scan_chunk *chunks;
+  pthread_t *threads;
+  int nchunks, i, cur, res = 0;
+  long from;
+  
+  if ((off64_t)nblocks * TARBLKSZ / jobs < SCAN_MIN_CHUNK)
+    jobs = (off64_t)nblocks * TARBLKSZ / SCAN_MIN_CHUNK;
+  if (jobs < 2)
+    return -1;
+  nchunks = jobs;
+  chunks = calloc(nchunks, sizeof(*chunks));
+  threads = calloc(nchunks, sizeof(*threads));
+  for (i = 0; i < nchunks; ++i) {
+    chunks[i].fd = fd;
+    chunks[i].bufsz = bufsz;
+    chunks[i].debug_messages = debug_messages;
+    chunks[i].start = first + nblocks / nchunks * i;
+    chunks[i].end = i + 1 < nchunks ? first + nblocks / nchunks * (i + 1) : 0;
+    chunks[i].search = i > 0;
+  }
+  DMSG("scanning %d chunks of %" PRIu64 " blocks\n", nchunks,
+    nblocks / nchunks);
+  
+  for (i = 0; i < nchunks; ++i) {
+    if (pthread_create(&threads[i], NULL, scan_chunk_run, &chunks[i]) == 0)
+      chunks[i].threaded = 1;
+    else
+      /* do it here instead */
+      scan_chunk_run(&chunks[i]);
+  }
+  for (i = 0; i < nchunks; ++i)
+    if (chunks[i].threaded)
+      pthread_join(threads[i], NULL);
+  
+  /* stitch: chunk 0 starts at a real record, follow the chain */
+  cur = 0;
+  from = 0;
+  while (1) {
+    struct scan_chunk *ch = &chunks[cur];
+    struct scan_mark *mark;
+    int next;
+    
+    if (ch->failed) {
+      fprintf(stderr, "parallel scan failed\n");
+      res = 2;
+      break;
+    }
+    if (fwrite(ch->text + from, 1, ch->textlen - from, indexf)
+        < ch->textlen - from) {
+      perror("write index");
+      res = 2;
+      break;
+    }
+    if (ch->at_end) {
+      if (ch->err != 0) {
+        errno = ch->err;
+        perror("read tarfile");
+        res = 2;
+      } else if (ch->partial > 0) {
+        fprintf(stderr, "didn't get enough bytes on read\n");
+        res = 2;
+      }
+      break;
+    }
+    /* big members can reach over more than one chunk */
+    for (next = cur + 1; next + 1 < nchunks
+        && chunks[next + 1].start <= ch->exit; ++next)
+      ;
+    if ((mark = scan_find_mark(&chunks[next], ch->exit)) != NULL) {
+      DMSG("chunk %d joins chunk %d at block %" PRIu64 "\n", cur, next,
+        ch->exit);
+      from = mark->textoff;
+    } else {
+      /* the speculation went wrong, redo it from where we know a record
+       * starts */
+      DMSG("chunk %d rescanned from block %" PRIu64 "\n", next, ch->exit);
+      free(chunks[next].text);
+      free(chunks[next].marks);
+      chunks[next].start = ch->exit;
+      chunks[next].search = 0;
+      scan_chunk_run(&chunks[next]);
+      from = 0;
+    }
+    cur = next;
+  }
+  
+  for (i = 0; i < nchunks; ++i) {
+    free(chunks[i].text);
+    free(chunks[i].marks);
+  }
+  free(chunks);
+  free(threads);
+  return res;
+}
+
+/* give the output stream the preset dictionary from dictfile: its last
+ * TS_DICT_MAX bytes, which is all compression can use */
+static int set_dictionary(t_streamp tsp, const char *dictfile) {
+  Bytef dict[TS_DICT_MAX];
+  int fd, nread, len = 0;
+  off64_t size;
+  
+  if ((fd = open(dictfile, O_RDONLY|P_O_LARGEFILE)) < 0) {
+    perror("open dictionary");
+    return 1;
+  }
+  if ((size = p_lseek64(fd, 0, SEEK_END)) < 0
+      || p_lseek64(fd, size > TS_DICT_MAX ? size - TS_DICT_MAX : 0,
+        SEEK_SET) < 0) {
+    perror("seek dictionary");
+    close(fd);
+    return 1;
+  }
+  while (len < TS_DICT_MAX
+      && (nread = read(fd, dict + len, TS_DICT_MAX - len)) > 0)
+    len += nread;
+  if (nread < 0)
+    perror("read dictionary");
+  close(fd);
+  if (nread < 0)
+    return 1;
+  if (len == 0) {
+    fprintf(stderr, "dictionary %s is empty\n", dictfile);
+    return 1;
+  }
+  
+  if (ts_set_dictionary(tsp, dict, len) != 0) {
+    fprintf(stderr, "%s dictionary error: %s\n", tsp->codec->name,
+      ts_strerror(tsp));
+    return 1;
+  }
+  return 0;
+}
+
 int create_index(const char *indexfile, const char *tarfile,
-    int pass_through, int zlib_level, int debug_messages) {
+    const char *outfile, const struct create_options *opts) {
   const char *headerstring;
   int headerlen;
-  union tar_block inbuf;
-  char *fullfname;
-  int fullfname_sz;
+  union tar_block *inbuf;
+  struct block_reader br;
+  struct index_scan sc;
   int index, tar;
   FILE *indexf;
   int tmp;
-  unsigned long blocknum = 0;
-  unsigned long filestart = 0;
-  unsigned long blocks_left = 0;
-  int blocks_left_type = BT_FILEDATA;
-  unsigned long long size_tmp;
-  int blockallnull = 0;
   t_streamp tsp = NULL;
   /* file descriptor for pass through data */
   int pass_fd = 1;
-  /* actual offset for checkpoint */
-  off64_t cp_offset = 0;
+  /* decompression of an ordinary gzip file, and its access points */
+  t_streamp gzsp = NULL;
+  struct gz_index gzi;
+  /* progress sidecar, and the point to resume from */
+  char *progress_file = resume_sidecar_name(indexfile);
+  struct resume_point rp;
+  /* index only with -Z, and the interval resumed with */
+  int pass_through = opts->pass_through;
+  long long progress_interval = opts->progress_interval;
+  int debug_messages = opts->debug_messages;
   
   headerstring = "TARIX INDEX v" TARIX_FORMAT_STRING " GENERATED BY tarix-" TARIX_VERSION "\n";
   headerlen = strlen(headerstring);
   
+  memset(&rp, 0, sizeof(rp));
+  if (opts->resume) {
+    if (resume_read(progress_file, &rp) != 0)
+      return 1;
+    if (strcmp(rp.codec, opts->zlib_level > 0 ? opts->codec->name : "none")
+        || rp.level != opts->zlib_level) {
+      fprintf(stderr, "Resume with the compression the archive was started"
+        " with (%s, level %d)\n", rp.codec, rp.level);
+      return 1;
+    }
+    if (progress_interval == 0)
+      progress_interval = rp.interval;
+  } else if (unlink(progress_file) != 0 && errno != ENOENT) {
+    /* a stale one would resume into the wrong archive */
+    perror("remove old progress file");
+    return 1;
+  }
+  
   /* prep, open output, etc. */
-  if ((index = open(indexfile, O_CREAT|O_TRUNC|O_WRONLY, 0666)) < 0) {
+  if ((index = open(indexfile, opts->resume ? O_WRONLY
+      : O_CREAT|O_TRUNC|O_WRONLY, 0666)) < 0) {
     perror("open indexfile");
     return 1;
   }
+  /* what was written after the progress point goes */
+  if (opts->resume && (ftruncate(index, rp.index_bytes) != 0
+      || p_lseek64(index, 0, SEEK_END) != rp.index_bytes)) {
+    perror("truncate index");
+    return 1;
+  }
   if ((indexf = fdopen(index, "w")) == NULL) {
     perror("fdopen index");
     return 1;
   }
+  if (outfile != NULL) {
+    if ((pass_fd = open(outfile, opts->resume ? O_WRONLY|P_O_LARGEFILE
+        : O_CREAT|O_TRUNC|O_WRONLY|P_O_LARGEFILE, 0666)) < 0) {
+      perror("open archive");
+      return 1;
+    }
+    if (opts->resume && (ftruncate(pass_fd, rp.out_bytes) != 0
+        || p_lseek64(pass_fd, 0, SEEK_END) != rp.out_bytes)) {
+      perror("truncate archive");
+      return 1;
+    }
+  }
   if (tarfile == NULL) {
     /* stdin */
     tar = 0;
   } else {
-    if ((tar = open(tarfile, O_RDONLY|P_O_LARGEFILE)) < 0) {
+    if ((tar = p_open(tarfile, O_RDONLY|P_O_LARGEFILE, 0,
+        opts->use_direct)) < 0) {
       perror("open tarfile");
       return 1;
     }
   }
 
-  if ((tmp = fprintf(indexf, "%s", headerstring)) < headerlen) {
+  if (!opts->resume
+      && (tmp = fprintf(indexf, "%s", headerstring)) < headerlen) {
     perror((tmp >= 0) ? "partial header write" : "write header");
     return 1;
   }
   
-  // pre-allocate a reasonable filename size, zero'd
-  fullfname = (char*)calloc(TARBLKSZ, 1);
-  fullfname_sz = TARBLKSZ;
-  
   /* init the output stream */
   if (pass_through) {
-    tsp = init_tws(NULL, pass_fd, 0, 0, zlib_level);
+    if (opts->use_direct)
+      p_want_direct(pass_fd, "stdout");
+    tsp = init_tws_codec(NULL, pass_fd, 0, 0, opts->bufsz, opts->zlib_level,
+      opts->zlib_level > 0 ? opts->codec : NULL);
     if (tsp->zlib_err != Z_OK) {
-      printf("zlib init error: %d - %s\n", tsp->zlib_err, tsp->zsp->msg);
+      printf("%s init error: %d - %s\n", tsp->codec->name, tsp->zlib_err,
+        ts_strerror(tsp));
+      return 1;
+    }
+    if (opts->member_size > 0
+        && ts_set_members(tsp, opts->member_size) != 0) {
+      fprintf(stderr, "gzip member setup error: %d\n", tsp->zlib_err);
+      return 1;
+    }
+    if (opts->dictfile != NULL && set_dictionary(tsp, opts->dictfile) != 0)
+      return 1;
+    /* compressing with threads too, but zlib members keep to one */
+    if (opts->jobs > 1 && opts->zlib_level > 0
+        && (tmp = ts_set_jobs(tsp, opts->jobs)) != 0
+        && tmp != TS_ERR_BADMODE) {
+      ptserror("compression threads", tmp, tsp);
+      return 1;
+    }
+    if (opts->resume && (tmp = ts_resume(tsp, rp.raw_bytes, rp.out_bytes,
+        rp.crc32)) != 0) {
+      ptserror("resume archive", tmp, tsp);
+      return 1;
+    }
+    /* the output is written while the next blocks are compressed */
+    if ((tmp = ts_set_async(tsp, IOP_NBUFS)) != 0) {
+      ptserror("start output thread", tmp, tsp);
       return 1;
     }
   }
   
-  /* read tar blocks */
-  while ((tmp = read(tar, inbuf.buffer, TARBLKSZ)) == TARBLKSZ) {
-    /* check to see if the block is all zeros, in which case it will
-     * be skipped & ignored later on */
-    blockallnull = 1;
-    for (tmp = 0; tmp < TARBLKSZ; ++tmp) {
-      if (inbuf.buffer[tmp] > 0) {
-        blockallnull = 0;
-        break;
-      }
+  if (opts->gzip_input) {
+    /* the data is not ours to pass on, just index it */
+    pass_through = 0;
+    gzi_init(&gzi, 0, 1);
+    gzsp = init_gzrs(NULL, tar, opts->bufsz, &gzi);
+    if (gzsp->zlib_err != Z_OK) {
+      fprintf(stderr, "zlib init error: %d\n", gzsp->zlib_err);
+      return 1;
     }
-    if (blocks_left > 0) {
-      /* we are in the middle of a file record */
-      switch(blocks_left_type) {
-        case BT_LONGNAME:
-          if (fullfname_sz - strlen(fullfname) - 1 < TARBLKSZ) {
-            fullfname_sz += TARBLKSZ;
-            fullfname = realloc(fullfname, fullfname_sz);
-          }
-          strncat(fullfname, inbuf.buffer, TARBLKSZ);
-          DMSG("got long filename %s\n", fullfname);
-          break;
-        case BT_LONGLINK:
-        case BT_FILEDATA:
-          /* don't do anything with these currently */
-          break;
-      }
-      --blocks_left;
-    }
-    /* ignore totally null blocks that come when we're not in the middle
-     * of anything */
-    else if (!blockallnull) {
-
-      /* just got the first block from a new record */
-      if (blocks_left_type == BT_FILEDATA) {
-        filestart = blocknum;
-        fullfname[0] = 0; /* clear file name for new one */
-        /* checkpoint output stream */
-        if (tsp != NULL) {
-          DMSG("cp before new rec\n");
-          cp_offset = ts_checkpoint(tsp);
-          if (cp_offset < 0) {
-            ptserror("ts_checkpoint", cp_offset, tsp);
-            return 2;
-          }
-          DMSG("cp done at %lld\n", (long long)cp_offset);
-        } else {
-          cp_offset = filestart * TARBLKSZ;
-        }
-      }
-      
-      /* compute data size from header block (octal string) */
-      size_tmp = strtoull(inbuf.header.size, NULL, 8);
-      blocks_left = size_tmp / 512;
-      if (size_tmp % 512 > 0) /* get the extra partial block */
-        ++blocks_left;
-      DMSG("have %llu blocks to pass\n", size_tmp);
-      
-      switch(inbuf.header.typeflag) {
-        case GNUTYPE_LONGLINK:
-          blocks_left_type = BT_LONGLINK;
-          break;
-        case GNUTYPE_LONGNAME:
-          blocks_left_type = BT_LONGNAME;
-          break;
-        default: {
-          unsigned long reclen;
-          /* anything else we treat as filedata, which triggers writing
-           * a record, but whose data is ignored */
-          blocks_left_type = BT_FILEDATA;
-          /* write out the index record */
-          /* get the file name from the file record if there wasn't a 
-           * long name record previously */
-          if (fullfname[0] == 0) {
-            /* get filename from tar record */
-            if (strncmp(inbuf.header.magic, OLDGNU_MAGIC, OLDGNU_MAGLEN) == 0)
-              /* GNU archive */
-              strcpy(fullfname, inbuf.header.name);
-            else /* assume POSIX archive (is this good?) */
-              strcat(strcpy(fullfname, inbuf.header.prefix),
-                inbuf.header.name);
-          }
-          reclen = blocknum - filestart + 1 + blocks_left;
-          //          LONG* items        hdr     data
-          DMSG("got filename %s, reclen %ld\n", fullfname, reclen);
-          /* cast to long long to avoid compiler warn on 64bit */
-          fprintf(indexf, "%c %ld %lld %ld %s\n", inbuf.header.typeflag,
-            filestart, (long long)cp_offset, reclen, fullfname);
-          break;
-        }
+    tmp = br_init_stream(&br, gzsp, opts->bufsz);
+  } else if (opts->resume) {
+    /* carry on reading where the archive left off */
+    tmp = br_init_at(&br, tar, opts->bufsz, rp.raw_bytes);
+  } else {
+    tmp = br_init(&br, tar, opts->bufsz);
+  }
+  if (tmp != 0) {
+    perror("allocate read buffer");
+    return 1;
+  }
+  if (opts->resume && (!br.seekable || br.filesize < rp.raw_bytes)) {
+    fprintf(stderr, "Can only resume from the tar file that was being read\n");
+    return 1;
+  }
+  
+  /* index only on a file: the threads can take it from here */
+  if (!pass_through && opts->jobs > 1 && br.seekable
+      && p_lseek64(tar, 0, SEEK_CUR) == 0) {
+    tmp = scan_parallel(indexf, tar, br.filesize, 0, opts->bufsz,
+      opts->jobs, debug_messages);
+    if (tmp >= 0) {
+      br_free(&br);
+      if (fclose(indexf) != 0) {
+        perror("close index");
+        return 2;
       }
+      return tmp;
     }
+    DMSG("archive too small for a parallel scan\n");
+  }
+  
+  /* and the input read while these blocks are worked on, unless index
+   * only mode is going to seek over most of it */
+  if ((pass_through || !br.seekable) && br_set_async(&br, IOP_NBUFS) != 0) {
+    perror("start input thread");
+    return 1;
+  }
+  
+  scan_init(&sc, indexf, tsp, debug_messages);
+  if (pass_through && opts->zlib_level > 0)
+    sc.cp_blocks = (opts->cp_interval + TARBLKSZ - 1) / TARBLKSZ;
+  sc.blocknum = rp.raw_bytes / TARBLKSZ;
+  if (pass_through && progress_interval > 0) {
+    sc.progress_interval = progress_interval;
+    sc.progress_next = rp.raw_bytes + progress_interval;
+    sc.progress_file = progress_file;
+    sc.level = opts->zlib_level;
+  }
+  
+  /* read tar blocks */
+  while ((inbuf = br_next(&br)) != NULL) {
+    if (scan_block(&sc, inbuf) != 0)
+      return 2;
     
     if (pass_through) {
-      DMSG("passing block %ld to tsp\n", blocknum);
-      if ((tmp = ts_write(tsp, inbuf.buffer, TARBLKSZ)) < TARBLKSZ) {
+      DMSG("passing block %" PRIu64 " to tsp\n", sc.blocknum);
+      if ((tmp = ts_write(tsp, inbuf->buffer, TARBLKSZ)) < TARBLKSZ) {
         if (tmp == TS_ERR_ZLIB)
-          fprintf(stderr, "zlib error: %s\n", tsp->zsp->msg);
+          fprintf(stderr, "%s error: %s\n", tsp->codec->name,
+            ts_strerror(tsp));
         else if (tmp >= 0)
           perror("partial block write");
         else /* tmp < 0 */
@@ -205,18 +1129,332 @@ int create_index(const char *indexfile, const char *tarfile,
         return 2;
       }
     }
-    ++blocknum;
+    
+    if (scan_advance(&sc, &br, pass_through) != 0)
+      break;
   }
   
-  if (tmp > 0) {
-    perror("didn't get enough bytes on read");
+  if (br.err != 0) {
+    if (gzsp != NULL && gzsp->zlib_err != Z_OK
+        && gzsp->zlib_err != Z_STREAM_END) {
+      fprintf(stderr, "read tarfile: zlib error: %d: %s\n", gzsp->zlib_err,
+        gzsp->zsp->msg != NULL ? gzsp->zsp->msg : "unexpected end of data");
+    } else {
+      errno = br.err;
+      perror("read tarfile");
+    }
+    return 2;
+  }
+  if (br.partial > 0) {
+    fprintf(stderr, "didn't get enough bytes on read\n");
     return 2;
   }
+  br_free(&br);
+  
+  scan_free(&sc);
+  
+  if (gzsp != NULL) {
+    char *sidecar = gzi_sidecar_name(indexfile);
+    DMSG("saving %lu access points\n", (unsigned long)gzi.npoints);
+    if (gzi_write(&gzi, sidecar) != 0) {
+      perror("write access points");
+      return 2;
+    }
+    free(sidecar);
+    ts_close(gzsp, 1);
+    gzi_free(&gzi);
+  }
   
   tmp = ts_close(tsp, 1 /* free tsp */);
   if (tmp < 0)
     /* FIXME: warning about tsp contents may fail when tsp is free'd */
     ptserror("close error", tmp, tsp);
   
+  if (progress_interval > 0) {
+    /* the archive is complete once it is all on disk */
+    if (tmp < 0 || fsync(pass_fd) != 0 || fflush(indexf) != 0
+        || fsync(index) != 0) {
+      perror("sync archive and index");
+      return 2;
+    }
+    unlink(progress_file);
+  }
+  free(progress_file);
+  
   return 0;
 }
+
+/* Appending to an index, after the archive grew with tar -r (or got
+ * another archive concatenated to it): the index already covers the
+ * archive up to the end of its last entry, so only the blocks from there
+ * on need scanning.  The first and the last records are scanned again
+ * first and have to come out as the index has them, so that the index
+ * isn't appended to from the wrong file. */
+
+/* the start of the next line after the one at line that isn't a comment
+ * or extension record, or end */
+static const char *next_entry_line(const char *line, const char *end) {
+  do {
+    line = (const char*)memchr(line, '\n', end - line) + 1;
+  } while (line < end && *line == '#');
+  return line;
+}
+
+/* the start of the last line before the one at line that isn't a comment
+ * or extension record; there has to be one after the header line */
+static const char *prev_entry_line(const char *line) {
+  const char *nl = line - 1;
+  do {
+    for (--nl; *nl != '\n'; --nl)
+      ;
+  } while (nl[1] == '#');
+  return nl + 1;
+}
+
+/* parse the entry line at line, all but its name; returns 0, or -1 on
+ * errors */
+static int parse_entry_at(struct index_parser_state *ipstate,
+    const char *line, const char *end, struct index_entry *entry) {
+  const char *nl = memchr(line, '\n', end - line);
+  char *text = strndup(line, nl - line);
+  int tmp;
+  
+  memset(entry, 0, sizeof(*entry));
+  tmp = parse_index_line(ipstate, text, entry);
+  entry->filename = NULL;
+  free(text);
+  return tmp == 0 ? 0 : -1;
+}
+
+/* scan the archive from block from up to the first record at or after
+ * block to, and compare what that writes with len bytes of index text;
+ * returns 0 if they are the same, 1 if not, -1 on errors */
+static int append_check(int fd, size_t bufsz, blknum_t from,
+    blknum_t to, const char *text, size_t len, int debug_messages) {
+  struct block_reader br;
+  struct index_scan sc;
+  union tar_block *inbuf;
+  char *out = NULL;
+  size_t outlen = 0;
+  FILE *outf;
+  int res;
+  
+  if ((outf = open_memstream(&out, &outlen)) == NULL) {
+    perror("open_memstream");
+    return -1;
+  }
+  if (br_init_at(&br, fd, bufsz, (off64_t)from * TARBLKSZ) != 0) {
+    perror("allocate read buffer");
+    fclose(outf);
+    free(out);
+    return -1;
+  }
+  scan_init(&sc, outf, NULL, debug_messages);
+  sc.blocknum = from;
+  sc.stop_at = to;
+  res = 0;
+  while ((inbuf = br_next(&br)) != NULL) {
+    /* from the wrong file this can be anything, not just headers */
+    if (sc.blocks_left == 0 && !br_is_null(inbuf)
+        && !header_checksum_ok(inbuf)) {
+      DMSG("no header at block %" PRIu64 "\n", sc.blocknum);
+      res = 1;
+      break;
+    }
+    if (scan_block(&sc, inbuf) != 0 || scan_advance(&sc, &br, 0) != 0)
+      break;
+  }
+  scan_free(&sc);
+  br_free(&br);
+  if (fclose(outf) != 0) {
+    free(out);
+    return -1;
+  }
+  /* indexes from before #:st records were written don't have them */
+  if (outlen > 0 && !memmem(text, len, "\n" INDEX_EXT_PREFIX INDEX_EXT_ST " ",
+      strlen(INDEX_EXT_PREFIX INDEX_EXT_ST) + 2)) {
+    char *from, *to, *nl;
+    for (from = to = out; from < out + outlen; from = nl + 1) {
+      nl = memchr(from, '\n', out + outlen - from);
+      if (strncmp(from, INDEX_EXT_PREFIX INDEX_EXT_ST " ",
+          strlen(INDEX_EXT_PREFIX INDEX_EXT_ST) + 1)) {
+        memmove(to, from, nl + 1 - from);
+        to += nl + 1 - from;
+      }
+    }
+    outlen = to - out;
+  }
+  res = res || outlen != len || memcmp(out, text, len) != 0;
+  if (res)
+    DMSG("index has:\n%.*sarchive has:\n%s", (int)len, text, out);
+  free(out);
+  return res;
+}
+
+int append_index(const char *indexfile, const char *tarfile,
+    const struct create_options *opts) {
+  struct index_parser_state ipstate;
+  struct index_entry first, last;
+  struct block_reader br;
+  struct index_scan sc;
+  union tar_block *inbuf;
+  struct stat st;
+  const char *text, *end, *firstline, *firstend, *lastline, *nl;
+  char *header, *sidecar;
+  blknum_t start = 0;
+  int index, tar;
+  FILE *indexf;
+  int tmp;
+  int debug_messages = opts->debug_messages;
+  
+  if ((index = open(indexfile, O_RDONLY)) < 0) {
+    perror("open indexfile");
+    return 1;
+  }
+  if (fstat(index, &st) != 0) {
+    perror("stat indexfile");
+    return 1;
+  }
+  if (st.st_size == 0 || (text = mmap(NULL, st.st_size, PROT_READ,
+      MAP_PRIVATE, index, 0)) == MAP_FAILED) {
+    fprintf(stderr, "Cannot map index file: %s\n", st.st_size == 0
+      ? "empty" : strerror(errno));
+    return 1;
+  }
+  close(index);
+  end = text + st.st_size;
+  if (end[-1] != '\n') {
+    fprintf(stderr, "Index file is incomplete, it needs to be recreated\n");
+    return 1;
+  }
+  
+  nl = memchr(text, '\n', end - text);
+  header = strndup(text, nl - text);
+  tmp = init_index_parser(&ipstate, header);
+  free(header);
+  if (tmp != 0)
+    return 1;
+  if (ipstate.version != TARIX_FORMAT_VERSION) {
+    fprintf(stderr, "Cannot append to a version %d index, it needs to be"
+      " recreated\n", ipstate.version);
+    return 1;
+  }
+  ipstate.allocate_filename = 0;
+  
+  /* the first entry, and the last one, looking back from the end so that
+   * a big index isn't read in full */
+  firstline = nl + 1;
+  if (*firstline == '#')
+    firstline = next_entry_line(firstline, end);
+  firstend = lastline = end;
+  if (firstline < end) {
+    firstend = next_entry_line(firstline, end);
+    lastline = prev_entry_line(end);
+    if (parse_entry_at(&ipstate, firstline, end, &first) != 0
+        || parse_entry_at(&ipstate, lastline, end, &last) != 0) {
+      fprintf(stderr, "Bad entry in the index\n");
+      return 1;
+    }
+    /* offsets are block positions only in uncompressed archives */
+    if (first.offset != (off64_t)first.blocknum * TARBLKSZ
+        || last.offset != (off64_t)last.blocknum * TARBLKSZ) {
+      fprintf(stderr, "Can only append to the index of an uncompressed"
+        " archive\n");
+      return 1;
+    }
+    start = last.blocknum + last.blocklength;
+    /* older versions gave an extended header an entry of its own, which
+     * goes with the member after it */
+    if (lastline > firstline) {
+      struct index_entry xhd;
+      nl = prev_entry_line(lastline);
+      if (*nl == XHDTYPE && parse_entry_at(&ipstate, nl, end, &xhd) == 0
+          && xhd.blocknum + xhd.blocklength == last.blocknum) {
+        lastline = nl;
+        last.blocknum = xhd.blocknum;
+      }
+    }
+  }
+  sidecar = gzi_sidecar_name(indexfile);
+  tmp = access(sidecar, F_OK);
+  free(sidecar);
+  if (tmp == 0) {
+    fprintf(stderr, "Can only append to the index of an uncompressed"
+      " archive\n");
+    return 1;
+  }
+  
+  if (tarfile == NULL) {
+    /* stdin */
+    tar = 0;
+  } else {
+    if ((tar = p_open(tarfile, O_RDONLY|P_O_LARGEFILE, 0,
+        opts->use_direct)) < 0) {
+      perror("open tarfile");
+      return 1;
+    }
+  }
+  if (br_init_at(&br, tar, opts->bufsz, (off64_t)start * TARBLKSZ) != 0) {
+    perror("allocate read buffer");
+    return 1;
+  }
+  if (!br.seekable) {
+    fprintf(stderr, "Can only append from an archive file\n");
+    return 1;
+  }
+  if (br.filesize < (off64_t)start * TARBLKSZ) {
+    fprintf(stderr, "The archive is shorter than the index says\n");
+    return 1;
+  }
+  if (firstline < end && ((tmp = append_check(tar, opts->bufsz,
+      first.blocknum, first.blocknum + first.blocklength, firstline,
+      firstend - firstline, debug_messages)) != 0
+      || (tmp = append_check(tar, opts->bufsz, last.blocknum, start,
+      lastline, end - lastline, debug_messages)) != 0)) {
+    if (tmp > 0)
+      fprintf(stderr, "The archive doesn't match the index\n");
+    return 1;
+  }
+  munmap((void*)text, st.st_size);
+  DMSG("appending from block %" PRIu64 " of %lld\n", start,
+    (long long)(br.filesize / TARBLKSZ));
+  
+  if ((indexf = fopen(indexfile, "a")) == NULL) {
+    perror("open indexfile");
+    return 1;
+  }
+  
+  tmp = -1;
+  if (opts->jobs > 1)
+    tmp = scan_parallel(indexf, tar, br.filesize, start, opts->bufsz,
+      opts->jobs, debug_messages);
+  if (tmp < 0) {
+    scan_init(&sc, indexf, NULL, debug_messages);
+    sc.blocknum = start;
+    tmp = 0;
+    while ((inbuf = br_next(&br)) != NULL) {
+      if (scan_block(&sc, inbuf) != 0) {
+        tmp = 2;
+        break;
+      }
+      if (scan_advance(&sc, &br, 0) != 0)
+        break;
+    }
+    scan_free(&sc);
+    if (tmp == 0 && br.err != 0) {
+      errno = br.err;
+      perror("read tarfile");
+      tmp = 2;
+    } else if (tmp == 0 && br.partial > 0) {
+      fprintf(stderr, "didn't get enough bytes on read\n");
+      tmp = 2;
+    }
+  }
+  br_free(&br);
+  
+  if (fclose(indexf) != 0) {
+    perror("close index");
+    return 2;
+  }
+  return tmp;
+}
@@ -24,18 +24,44 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <fnmatch.h>
 
 #include "config.h"
 
 #include "debug.h"
+#include "gzindex.h"
 #include "index_parser.h"
 #include "lineloop.h"
+#include "member.h"
 #include "portability.h"
+#include "sparse.h"
 #include "tar.h"
 #include "tarix.h"
 #include "tstream.h"
 
+/* entries to extract are read in one go if their data is at most this
+ * big, and would need a seek anyways */
+#define EXTRACT_SEGMENT_MAX (4 << 20)
+
+/* buffer for copying file contents in cat mode */
+#define CAT_BUFSZ (64 << 10)
+
+/* a matched index entry: extraction waits for the next entry, whose
+ * offset tells how much compressed data this one has */
+struct pending_entry
+{
+  int valid;
+  off64_t offset;
+  blknum_t blocknum;
+  blknum_t blocklength;
+  /* for cat mode, from its extension records: the size is -1 without a
+   * metadata record, which has it where the header can't (pax) */
+  struct sparse_map sparse;
+  int sparse_valid;
+  off64_t st_size;
+  struct index_cp *cps;
+  int ncps, cpsz;
+};
+
 struct extract_files_state
 {
   int gotheader;
@@ -45,109 +71,261 @@ struct extract_files_state
   off64_t curpos;
   int zlib_level;
   t_streamp tsp;
-  int outfd;
-  /* flags to pass to fnmatch, if 0, don't use fnmatch */
-  int glob_flags;
-  /* if set, then matched items are excluded */
-  int exclude_mode;
-  int exact_match;
+  /* output goes through a plain write stream, for the buffering */
+  t_streamp outs;
+  /* which entries files_list picks */
+  struct match_options match;
   const struct files_list_state *files_list;
+  struct pending_entry pending;
+  /* whole entries read with ts_read_segment */
+  char *segbuf;
+  size_t segbufsz;
+  /* write only file contents, range_len bytes (-1 for the rest) from
+   * range_off (from the end if negative) of each */
+  int cat_mode;
+  off64_t range_off;
+  off64_t range_len;
 };
 
-int extract_files_lineloop_processor(char *line, void *data)
+static int write_out(struct extract_files_state *state, char *buf, int len)
+{
+  int n;
+  if ((n = ts_write(state->outs, buf, len)) < len)
+  {
+    if (n >= 0)
+      perror("partial tarfile write");
+    else
+      ptserror("write tarfile", n, state->outs);
+    return 2;
+  }
+  return 0;
+}
+
+/* read len bytes on from the stream into buf */
+static int cat_read(void *data, void *buf, size_t len)
 {
   struct extract_files_state *state = (struct extract_files_state*)data;
-  const struct files_list_state* files_list = state->files_list;
+  int n;
   
-  size_t i;
-  /* for the DMSG macro */
-  int debug_messages = state->debug_messages;
-  off64_t destoff;
+  if ((n = ts_read(state->tsp, buf, len)) < (int)len)
+  {
+    if (n >= 0)
+      fprintf(stderr, "unexpected end of tarfile\n");
+    else
+      ptserror("read tarfile", n, state->tsp);
+    return 2;
+  }
+  return 0;
+}
+
+/* read len bytes on from the stream, and write them out if out is set */
+static int cat_copy(struct extract_files_state *state, off64_t len, int out)
+{
+  char buf[CAT_BUFSZ];
+  int rv;
   
-  if (!state->gotheader)
+  while (len > 0)
   {
-    if (init_index_parser(&state->ipstate, line) != 0)
-      return 1;
-    state->ipstate.allocate_filename = 0;
-    state->gotheader = 1;
-    return 0;
+    int n = len < CAT_BUFSZ ? len : CAT_BUFSZ;
+    if ((rv = cat_read(state, buf, n)) != 0)
+      return rv;
+    if (out && (rv = write_out(state, buf, n)) != 0)
+      return rv;
+    len -= n;
   }
+  return 0;
+}
 
-  int extract = 0;
-  int parse_result;
-  struct index_entry entry;
-  memset(&entry, 0, sizeof(entry));
+static int cat_zeros(struct extract_files_state *state, off64_t len)
+{
+  char buf[CAT_BUFSZ];
+  int rv;
   
-  parse_result = parse_index_line(&state->ipstate, line, &entry);
-  if (parse_result < 0)
-    /* error */
+  memset(buf, 0, len < CAT_BUFSZ ? len : CAT_BUFSZ);
+  while (len > 0)
+  {
+    int n = len < CAT_BUFSZ ? len : CAT_BUFSZ;
+    if ((rv = write_out(state, buf, n)) != 0)
+      return rv;
+    len -= n;
+  }
+  return 0;
+}
+
+/* get the stream from byte *cur to byte pos of the pending entry's stored
+ * data, seeking where member_seek_point says and reading on from there */
+static int cat_seek(struct extract_files_state *state,
+  const struct member_data *md, off64_t pos, off64_t *cur)
+{
+  off64_t offset;
+  int rv;
+  
+  if (member_seek_point(md, pos, cur, &offset)
+      && (rv = ts_seek(state->tsp, offset)) != 0)
+  {
+    ptserror("seek tarfile", rv, state->tsp);
     return 1;
-  if (parse_result > 0)
-    /* comment line */
-    return 0;
+  }
+  if ((rv = cat_copy(state, pos - *cur, 0)) != 0)
+    return rv;
+  *cur = pos;
+  return 0;
+}
 
-  /* take action on the line */
-  for (i = 0; i < files_list->argc; ++i)
+/* write the contents of the pending entry, or the range of it asked for,
+ * if it is a regular file */
+static int cat_pending(struct extract_files_state *state)
+{
+  struct pending_entry *entry = &state->pending;
+  const struct sparse_map *sparse = entry->sparse_valid ? &entry->sparse
+    : NULL;
+  struct member_header mh;
+  struct member_data md;
+  off64_t size, start, end, cur;
+  char typeflag;
+  int rv;
+  
+  /* where the stream ends up isn't worth keeping track of */
+  if (state->curpos != entry->blocknum && (rv = ts_seek(state->tsp,
+      state->zlib_level ? entry->offset
+      : (off64_t)entry->blocknum * TARBLKSZ)) != 0)
   {
-    if (state->glob_flags)
-    {
-      /* use fnmatch to test, instead of a simple compare */
-      int mr = fnmatch(files_list->argv[i], entry.filename, state->glob_flags);
-      if (mr == 0)
-      {
-        extract = 1;
+    ptserror("seek tarfile", rv, state->tsp);
+    return 1;
+  }
+  state->curpos = -1;
+  /* past long names and extended headers; the index has what they say */
+  rv = member_read_header(&mh, cat_read, state);
+  typeflag = mh.hdr.header.typeflag;
+  size = member_size(&mh, entry->st_size, sparse);
+  md.datablock = member_data_block(&mh, sparse);
+  /* a sparse file's data is after any sparse headers or map that the
+   * stream is still in front of */
+  cur = -(off64_t)(md.datablock - mh.hdrblocks) * TARBLKSZ;
+  member_header_free(&mh);
+  if (rv == MEMBER_ERR_CORRUPT)
+    fprintf(stderr, "damaged header in tarfile\n");
+  if (rv != 0)
+    return 2;
+  
+  switch (typeflag)
+  {
+    case REGTYPE:
+    case AREGTYPE:
+    case CONTTYPE:
+      break;
+    case GNUTYPE_SPARSE:
+      if (sparse != NULL)
         break;
-      }
-      if (mr != FNM_NOMATCH)
-      {
-        /* error in fnmatch */
-        perror("glob match error");
-        return 1;
-      }
+      fprintf(stderr, "no sparse map for a file, the index needs to be"
+        " recreated\n");
+      return 1;
+    default:
+      /* only files have contents */
+      return 0;
+  }
+  
+  md.offset = state->zlib_level ? entry->offset
+    : (off64_t)entry->blocknum * TARBLKSZ;
+  md.compressed = state->zlib_level != 0;
+  md.cps = entry->cps;
+  md.ncps = entry->ncps;
+  
+  start = state->range_off < 0 ? size + state->range_off : state->range_off;
+  if (start < 0)
+    start = 0;
+  if (start > size)
+    start = size;
+  end = state->range_len < 0 || state->range_len > size - start
+    ? size : start + state->range_len;
+  
+  if (sparse == NULL)
+  {
+    if ((rv = cat_seek(state, &md, start, &cur)) != 0)
+      return rv;
+    return cat_copy(state, end - start, 1);
+  }
+  else
+  {
+    struct member_sparse_walk walk;
+    off64_t zeros, pos, len;
+    member_sparse_start(&walk, sparse, start, end);
+    while (member_sparse_next(&walk, &zeros, &pos, &len))
+    {
+      if ((rv = cat_zeros(state, zeros)) != 0
+          || (rv = cat_seek(state, &md, pos, &cur)) != 0
+          || (rv = cat_copy(state, len, 1)) != 0)
+        return rv;
+      cur += len;
     }
-    /* does the item match an extract arg? */
-    else if (state->exact_match)
+    return cat_zeros(state, zeros);
+  }
+}
+
+/* extract the pending entry, whose compressed data is zlen bytes (0 if
+ * not known) */
+static int extract_pending(struct extract_files_state *state, off64_t zlen)
+{
+  struct pending_entry *entry = &state->pending;
+  /* for the DMSG macro */
+  int debug_messages = state->debug_messages;
+  off64_t len = (off64_t)entry->blocklength * TARBLKSZ;
+  off64_t destoff;
+  char passbuf[TARBLKSZ];
+  int n;
+  
+  if (!entry->valid)
+    return 0;
+  entry->valid = 0;
+  if (state->cat_mode)
+    return cat_pending(state);
+  destoff = state->zlib_level ? entry->offset
+    : (off64_t)entry->blocknum * TARBLKSZ;
+  
+  /* a small entry somewhere else: read it all at once */
+  if (state->curpos != entry->blocknum && state->zlib_level && zlen > 0
+      && len <= EXTRACT_SEGMENT_MAX)
+  {
+    if (len > state->segbufsz)
     {
-      if (strcmp(files_list->argv[i], entry.filename) == 0)
+      free(state->segbuf);
+      if ((state->segbuf = malloc(len)) == NULL)
       {
-        extract = 1;
-        break;
+        perror("allocate segment buffer");
+        return 2;
       }
+      state->segbufsz = len;
     }
-    /* does the start of the item match an extract arg? */
-    else if (strncmp(files_list->argv[i], entry.filename, files_list->arglens[i]) == 0)
+    DMSG("reading %" PRIu64 " records at %lld, %lld compressed bytes\n",
+      entry->blocklength, (long long)destoff, (long long)zlen);
+    if ((n = ts_read_segment(state->tsp, destoff, zlen, state->segbuf,
+        len)) < (int)len)
     {
-      extract = 1;
-      break;
+      if (n >= 0)
+        perror("partial tarfile read");
+      else
+        ptserror("read tarfile", n, state->tsp);
+      return 2;
     }
+    state->curpos = entry->blocknum + entry->blocklength;
+    return write_out(state, state->segbuf, len);
   }
   
-  if (state->exclude_mode)
-    extract = !extract;
-  
-  if (!extract)
-    return 0;
-    
-  char passbuf[TARBLKSZ];
-  
-  DMSG("extracting %s\n", entry.filename);
   /* seek to the record start and then pass the record through */
   /* don't actually seek if we're already there */
-  if (state->curpos != entry.blocknum)
+  if (state->curpos != entry->blocknum)
   {
-    destoff = state->zlib_level ? entry.offset : entry.blocknum * TARBLKSZ;
     DMSG("seeking to %lld\n", (long long)destoff);
     if (ts_seek(state->tsp, destoff) != 0)
     {
       fprintf(stderr, "seek error\n");
       return 1;
     }
-    state->curpos = entry.blocknum;
+    state->curpos = entry->blocknum;
   }
-  DMSG("reading %ld records\n", entry.blocklength);
-  for (unsigned long bnum = 0; bnum < entry.blocklength; ++bnum)
+  DMSG("reading %" PRIu64 " records\n", entry->blocklength);
+  for (blknum_t bnum = 0; bnum < entry->blocklength; ++bnum)
   {
-    int n;
     if ((n = ts_read(state->tsp, passbuf, TARBLKSZ)) < TARBLKSZ)
     {
       if (n >= 0)
@@ -156,29 +334,115 @@ int extract_files_lineloop_processor(char *line, void *data)
         ptserror("read tarfile", n, state->tsp);
       return 2;
     }
-    DMSG("read a rec, now at %lld, %ld left\n",
-      (long long)state->curpos, entry.blocklength - bnum - 1);
+    DMSG("read a rec, now at %lld, %" PRIu64 " left\n",
+      (long long)state->curpos, entry->blocklength - bnum - 1);
     ++state->curpos;
-    if ((n = write(state->outfd, passbuf, TARBLKSZ)) < TARBLKSZ)
+    if ((n = write_out(state, passbuf, TARBLKSZ)) != 0)
+      return n;
+    DMSG("wrote rec\n");
+  }
+  
+  return 0;
+}
+
+int extract_files_lineloop_processor(char *line, void *data)
+{
+  struct extract_files_state *state = (struct extract_files_state*)data;
+  const struct files_list_state* files_list = state->files_list;
+  
+  /* for the DMSG macro */
+  int debug_messages = state->debug_messages;
+  
+  if (!state->gotheader)
+  {
+    if (init_index_parser(&state->ipstate, line) != 0)
+      return 1;
+    state->ipstate.allocate_filename = 0;
+    state->gotheader = 1;
+    return 0;
+  }
+
+  int extract = 0;
+  int parse_result;
+  struct index_entry entry;
+  memset(&entry, 0, sizeof(entry));
+  
+  parse_result = parse_index_line(&state->ipstate, line, &entry);
+  if (parse_result < 0)
+    /* error */
+    return 1;
+  if (parse_result == 2 && state->cat_mode && state->pending.valid)
+  {
+    /* cat mode needs the sparse map and checkpoints of what it extracts */
+    struct pending_entry *pe = &state->pending;
+    struct index_cp cp;
+    struct index_st st;
+    int rv = sparse_parse_ext(entry.filename, &pe->sparse);
+    if (rv == 0)
+      pe->sparse_valid = 1;
+    else if (rv > 0 && (rv = parse_index_st(entry.filename, &st)) == 0)
+      pe->st_size = st.size;
+    else if (rv > 0 && (rv = parse_index_cp(entry.filename, &cp)) == 0)
     {
-      perror((n > 0) ? "partial tarfile write" : "write tarfile");
-      return 2;
+      if (pe->ncps == pe->cpsz)
+      {
+        pe->cpsz = pe->cpsz ? pe->cpsz * 2 : 64;
+        pe->cps = realloc(pe->cps, pe->cpsz * sizeof(cp));
+      }
+      pe->cps[pe->ncps++] = cp;
+    }
+    if (rv < 0)
+    {
+      fprintf(stderr, "bad extension record: %s\n", line);
+      return 1;
     }
-    DMSG("wrote rec\n");
   }
+  if (parse_result > 0)
+    /* comment line */
+    return 0;
+
+  /* take action on the line */
+  if ((extract = files_list_match(files_list, entry.filename,
+      state->match.glob_flags, state->match.exact_match)) < 0)
+    return 1;
+  
+  if (state->match.exclude_mode)
+    extract = !extract;
+  
+  /* this entry's offset is where the pending one's data ends */
+  if (state->pending.valid)
+  {
+    off64_t zlen = entry.offset - state->pending.offset;
+    int rv = extract_pending(state, zlen > 0 ? zlen : 0);
+    if (rv != 0)
+      return rv;
+  }
+  
+  if (!extract)
+    return 0;
   
+  DMSG("extracting %s\n", entry.filename);
+  state->pending.valid = 1;
+  state->pending.offset = entry.offset;
+  state->pending.blocknum = entry.blocknum;
+  state->pending.blocklength = entry.blocklength;
+  state->pending.sparse_valid = 0;
+  state->pending.st_size = -1;
+  state->pending.ncps = 0;
   return 0;
 }
 
 int extract_files(const char *indexfile, const char *tarfile,
-  const char *outfile, int use_mt, int zlib_level, int debug_messages,
-  int glob_flags, int exclude_mode, int exact_match,
+  const char *outfile, const struct extract_options *opts,
   const struct files_list_state *files_list)
 {
-  int index, tar, outfd;
+  int zlib_level = opts->zlib_level;
+  int index, tar, outfd, rv;
   struct extract_files_state state;
+  struct gz_index gzi;
   
   memset(&state, 0, sizeof(state));
+  sparse_init(&state.pending.sparse);
   
   /* the basic idea:
    * read the index an entry at a time
@@ -196,7 +460,8 @@ int extract_files(const char *indexfile, const char *tarfile,
     /* stdin */
     tar = 0;
   } else {
-    if ((tar = open(tarfile, O_RDONLY|P_O_LARGEFILE)) < 0) {
+    if ((tar = p_open(tarfile, O_RDONLY|P_O_LARGEFILE, 0,
+        opts->use_direct)) < 0) {
       perror("open tarfile");
       return 1;
     }
@@ -204,29 +469,65 @@ int extract_files(const char *indexfile, const char *tarfile,
   if (outfile == NULL) {
     /* stdout */
     outfd = 1;
+    if (opts->use_direct)
+      p_want_direct(outfd, "stdout");
   } else {
-    if ((outfd = open(outfile, O_CREAT|O_TRUNC|O_WRONLY, 0666)) < 0) {
+    if ((outfd = p_open(outfile, O_CREAT|O_TRUNC|O_WRONLY, 0666,
+        opts->use_direct)) < 0) {
       perror("open outfile");
       return 1;
     }
   }
   
-  /* tstream handles base offset */
-  state.tsp = init_trs(NULL, tar, use_mt, TARBLKSZ, zlib_level);
+  if (opts->gzip_input) {
+    /* an ordinary gzip file: seek with the access points, index offsets
+     * are uncompressed ones */
+    char *sidecar = gzi_sidecar_name(indexfile);
+    if (gzi_read(&gzi, sidecar) != 0) {
+      perror(sidecar);
+      return 1;
+    }
+    free(sidecar);
+    zlib_level = 0;
+    state.tsp = init_gzrs(NULL, tar, opts->bufsz, &gzi);
+  } else {
+    /* tstream handles base offset */
+    state.tsp = init_trs(NULL, tar, opts->use_mt, TARBLKSZ, opts->bufsz,
+      zlib_level);
+  }
   if (state.tsp->zlib_err != Z_OK) {
     fprintf(stderr, "zlib init error: %d\n", state.tsp->zlib_err);
     return 1;
   }
+  state.outs = init_tws(NULL, outfd, 0, TARBLKSZ, opts->bufsz, 0);
+  if (state.outs->zlib_err != Z_OK) {
+    fprintf(stderr, "output init error: %d\n", state.outs->zlib_err);
+    return 1;
+  }
   
-  state.debug_messages = debug_messages;
+  state.debug_messages = opts->debug_messages;
   state.zlib_level = zlib_level;
-  state.glob_flags = glob_flags;
-  state.exclude_mode = exclude_mode;
-  state.exact_match = exact_match;
+  state.match = opts->match;
   state.files_list = files_list;
-  state.outfd = outfd;
+  state.cat_mode = opts->cat_mode;
+  state.range_off = opts->range_off;
+  state.range_len = opts->range_len;
   
-  lineloop(index, extract_files_lineloop_processor, (void*)&state);
+  /* a member that couldn't be read fails the whole run */
+  if ((rv = lineloop(index, extract_files_lineloop_processor,
+      (void*)&state)) == 0)
+    rv = extract_pending(&state, 0);
+  free(state.segbuf);
+  sparse_free(&state.pending.sparse);
+  free(state.pending.cps);
   
-  return 0;
+  ts_close(state.tsp, 1);
+  if (opts->gzip_input)
+    gzi_free(&gzi);
+  if (ts_close(state.outs, 1) != 0) {
+    perror("close outfile");
+    return 2;
+  }
+  
+  return rv;
 }
@@ -17,10 +17,12 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 
 #include "config.h"
 
@@ -171,3 +173,37 @@ int append_listfile_to_files_list(struct files_list_state *files_list,
   
   return 0;
 }
+
+int files_list_match(const struct files_list_state *files_list,
+                     const char *name, int glob_flags, int exact_match)
+{
+  size_t i;
+  
+  for (i = 0; i < files_list->argc; ++i)
+  {
+    if (glob_flags)
+    {
+      /* use fnmatch to test, instead of a simple compare */
+      int mr = fnmatch(files_list->argv[i], name, glob_flags);
+      if (mr == 0)
+        return 1;
+      if (mr != FNM_NOMATCH)
+      {
+        /* error in fnmatch */
+        perror("glob match error");
+        return -1;
+      }
+    }
+    /* does the item match an arg? */
+    else if (exact_match)
+    {
+      if (strcmp(files_list->argv[i], name) == 0)
+        return 1;
+    }
+    /* does the start of the item match an arg? */
+    else if (strncmp(files_list->argv[i], name, files_list->arglens[i]) == 0)
+      return 1;
+  }
+  
+  return 0;
+}
@@ -34,4 +34,12 @@ int append_args_to_files_list(struct files_list_state *files_list,
 int append_listfile_to_files_list(struct files_list_state *files_list,
                                   char sep, char *buf, size_t buflen);
 
+/* Check name against the files list: as globs with fnmatch if glob_flags
+ * is set, otherwise as whole names if exact_match is set, or else as the
+ * start of names.  Returns 1 if any matches, 0 if none does, and -1 on
+ * glob errors.
+ */
+int files_list_match(const struct files_list_state *files_list,
+                     const char *name, int glob_flags, int exact_match);
+
 #endif /* __FILES_LIST_H__ */
@@ -34,6 +34,15 @@ struct index_node {
   struct index_node *next;
   // first child node (NULL if none)
   struct index_node *child;
+  // sparse map from the index, NULL if not a sparse file
+  struct sparse_map *sparse;
+  // compressed size of the entry (up to the next one), 0 if not known
+  off64_t zlen;
+  // checkpoints inside the data, from #:cp records
+  struct index_cp *cps;
+  int ncps;
+  // metadata from the #:st record, NULL if the index has none
+  struct index_st *st;
 };
 
 struct tarixfs_t {
@@ -42,6 +51,9 @@ struct tarixfs_t {
   char *tarfilename;
   char *indexfilename;
   int use_zlib;
+  /* ordinary gzip file, and its access points */
+  int use_gzip;
+  struct gz_index gzi;
   /* tar(.gz) stream */
   t_streamp tsp;
   /* hash of all filenames to corresponding index_nodes */
@@ -57,7 +69,9 @@ struct cmissing_state {
 
 
 static struct index_node *find_node(const char *path) {
+  uint64_t start = stats_now();
   struct index_node *node = g_hash_table_lookup(tarixfs.fnhash, path);
+  stats_record(STATS_PH_LOOKUP, start, node == NULL);
 //  if (node == NULL && path[0] == '/'l)
 //    /* try to remove a leading slash */
 //    node = find_node(path + 1);
@@ -84,87 +98,109 @@ static int is_node_children_filled(struct index_node *node) {
   return 1;
 }
 
+/* fill the stat from the index's #:st record, without touching the archive */
+static int fill_node_stat_index(struct index_node *node) {
+  memset(&node->stbuf, 0, sizeof(node->stbuf));
+  node->stbuf.st_ino = node->entry.num + 1;
+  switch (node->entry.recordtype) {
+    case LNKTYPE:
+    case GNUTYPE_VOLHDR:
+      /* hidden, same as when reading the header */
+      node->stbuf.st_mode = 0;
+      break;
+    default:
+      node->stbuf.st_mode = index_type_mode(node->entry.recordtype);
+      if (node->stbuf.st_mode == 0) {
+        fprintf(stderr, "Unknown tar block type '%c' for '%s'\n",
+          node->entry.recordtype, node->entry.filename);
+        return -EIO;
+      }
+      node->stbuf.st_mode |= node->st->mode & 07777;
+  }
+  node->stbuf.st_nlink = 1;
+  node->stbuf.st_uid = node->st->uid;
+  node->stbuf.st_gid = node->st->gid;
+  /* the record has the real size of sparse files already */
+  node->stbuf.st_size = node->st->size;
+  if (node->sparse != NULL)
+    node->stbuf.st_blocks = (sparse_stored_size(node->sparse) + 511) / 512;
+  node->stbuf.st_mtime = node->stbuf.st_atime = node->stbuf.st_ctime
+    = node->st->mtime;
+  return 0;
+}
+
+/* advance the stream by count bytes, caller must hold the stream lock */
+static int stream_skip(off64_t count) {
+  char skipbuf[TARBLKSZ];
+  while (count > 0) {
+    int readcount = TARBLKSZ < count ? TARBLKSZ : count;
+    if (stream_read(tarixfs.tsp, skipbuf, readcount) != readcount)
+      return -1;
+    count -= readcount;
+  }
+  return 0;
+}
+
+static int stream_read_member(void *data, void *buf, size_t len) {
+  return stream_read(tarixfs.tsp, buf, len) == (int)len ? 0 : -1;
+}
+
+/* read the headers at the start of a record into mh (free it with
+ * member_header_free), caller must hold the stream lock */
+static int read_member_header(struct member_header *mh) {
+  return member_read_header(mh, stream_read_member, NULL) == 0 ? 0 : -EIO;
+}
+
+/* caller must hold the stream lock */
 static int fill_node_stat(struct index_node *node) {
   int res;
-  union tar_block tarhdr;
+  struct member_header mh;
+  char typeflag;
+  STATS_ADD(tstats.stat_misses, 1);
+  if (node->st != NULL)
+    return fill_node_stat_index(node);
   /* seek to header */
-  res = ts_seek(tarixfs.tsp, tarixfs.use_zlib
+  res = stream_seek(tarixfs.tsp, tarixfs.use_zlib
     ? node->entry.offset : (off64_t)node->entry.blocknum * TARBLKSZ);
   if (res != 0)
     /*TODO: log underlying error */
     return -EIO;
-  /* read header */
-  res = ts_read(tarixfs.tsp, &tarhdr, TARBLKSZ);
-  if (res < TARBLKSZ)
-    return -EIO;
-  /* handle (skip) long name and link records */
-  while (tarhdr.header.typeflag == GNUTYPE_LONGNAME
-      || tarhdr.header.typeflag == GNUTYPE_LONGLINK) {
-    /* skip the name */
-    res = ts_read(tarixfs.tsp, &tarhdr, TARBLKSZ);
-    if (res < TARBLKSZ)
-      return -EIO;
-    /* read the real file header */
-    res = ts_read(tarixfs.tsp, &tarhdr, TARBLKSZ);
-    if (res < TARBLKSZ)
-      return -EIO;
+  /* read header, past long name and link records and extended headers */
+  res = read_member_header(&mh);
+  if (res != 0) {
+    member_header_free(&mh);
+    return res;
   }
   /* process header */
-  memset(&node->stbuf, 0, sizeof(node->stbuf));
+  typeflag = mh.hdr.header.typeflag;
+  member_stat(&mh, -1, node->sparse, &node->stbuf);
+  member_header_free(&mh);
   node->stbuf.st_ino = node->entry.num + 1;
-  /* tar doesn't fill in higher bits */
-  node->stbuf.st_mode = strtol(tarhdr.header.mode, NULL, 8) & 07777;
-  if (node->entry.recordtype != tarhdr.header.typeflag) {
+  if (node->entry.recordtype != typeflag) {
     if (node->entry.recordtype == 0)
-      node->entry.recordtype = tarhdr.header.typeflag;
+      node->entry.recordtype = typeflag;
     else
       fprintf(stderr, "WARN: entry typeflag changed? index says '%c' tar says '%c'\n",
-        node->entry.recordtype, tarhdr.header.typeflag);
+        node->entry.recordtype, typeflag);
   }
-  switch (tarhdr.header.typeflag) {
-    case REGTYPE:
-    case AREGTYPE:
-      node->stbuf.st_mode |= S_IFREG;
-      break;
-    case SYMTYPE:
-      node->stbuf.st_mode |= S_IFLNK;
-      break;
+  switch (typeflag) {
     case LNKTYPE:
       //TODO: support hardlinks
       // for now, hide hardlinks
-      node->stbuf.st_mode = 0;
-      break;
-    case CHRTYPE:
-      node->stbuf.st_mode |= S_IFCHR;
-      break;
-    case BLKTYPE:
-      node->stbuf.st_mode |= S_IFBLK;
-      break;
-    case GNUTYPE_DUMPDIR:
-    case DIRTYPE:
-      node->stbuf.st_mode |= S_IFDIR;
-      break;
-    case FIFOTYPE:
-      node->stbuf.st_mode |= S_IFIFO;
-      break;
     case GNUTYPE_VOLHDR:
       //TODO: expose volume header as a symlink or something
       // for now, hide the volume header
       node->stbuf.st_mode = 0;
       break;
     default:
-      fprintf(stderr, "Unknown tar block type '%c' for '%s'\n",
-        tarhdr.header.typeflag, node->entry.filename);
-      return -EIO;
+      if ((node->stbuf.st_mode & S_IFMT) == 0) {
+        fprintf(stderr, "Unknown tar block type '%c' for '%s'\n",
+          typeflag, node->entry.filename);
+        return -EIO;
+      }
   }
   /* dirs will get further analysis later on */
-  node->stbuf.st_nlink = 1;
   /*TODO: user/group handling */
-  node->stbuf.st_uid = strtoul(tarhdr.header.uid, NULL, 8);
-  node->stbuf.st_gid = strtoul(tarhdr.header.gid, NULL, 8);
-  node->stbuf.st_size = strtoul(tarhdr.header.size, NULL, 8);
-  node->stbuf.st_mtime = node->stbuf.st_atime = node->stbuf.st_ctime
-    = strtoul(tarhdr.header.mtime, NULL, 8);
   
   return 0;
 }
@@ -214,9 +250,9 @@ fprintf(stderr, "INFO: creating implicit directory '%s'\n", dpath);
   node->entry.version = -1;
   node->entry.num = ++cmstate->ipstate->last_num;
   /* put bogus offset values in */
-  node->entry.blocknum = ~0UL;
+  node->entry.blocknum = ~(blknum_t)0;
   node->entry.offset = ~0ULL;
-  node->entry.blocklength = ~0UL;
+  node->entry.blocklength = ~(blknum_t)0;
   node->entry.filename = dpath;
   node->entry.filename_allocated = 1;
   
@@ -308,12 +344,12 @@ static int fill_link_nodes(struct index_parser_state *ipstate) {
 static off64_t get_node_effective_offset(struct index_node *node) {
   switch (node->entry.version) {
     case 0:
-      return node->entry.blocknum * TARBLKSZ;
+      return (off64_t)node->entry.blocknum * TARBLKSZ;
     case 1:
       if (tarixfs.use_zlib)
         return node->entry.offset;
       else
-        return node->entry.blocknum * TARBLKSZ;
+        return (off64_t)node->entry.blocknum * TARBLKSZ;
     case 2:
       return node->entry.offset;
     default:
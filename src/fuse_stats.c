@@ -0,0 +1,318 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#include "portability.h"
+
+/* operation statistics for the fuse mount, and the instrumented (and
+ * serialized) access to the single tar stream that goes with them.
+ * Everything here is exposed as JSON through the virtual file
+ * TARIX_STATS_PATH.
+ */
+
+#define TARIX_CTL_DIR "/.tarix"
+#define TARIX_STATS_PATH TARIX_CTL_DIR "/stats"
+
+/* latency histogram buckets: bucket 0 is < 1us, bucket n is
+ * [2^(n-1), 2^n) us, the last bucket catches everything slower */
+#define STATS_NBUCKETS 32
+
+enum stats_op {
+  STATS_OP_GETATTR,
+  STATS_OP_READDIR,
+  STATS_OP_OPEN,
+  STATS_OP_READ,
+  STATS_OP_READLINK,
+  /* phases inside the operations above */
+  STATS_PH_LOOKUP,
+  STATS_PH_STREAM_WAIT,
+  STATS_PH_SEEK,
+  STATS_PH_STREAM_READ,
+  STATS_NOPS
+};
+
+static const char *stats_op_names[STATS_NOPS] = {
+  "getattr",
+  "readdir",
+  "open",
+  "read",
+  "readlink",
+  "lookup",
+  "stream_wait",
+  "seek",
+  "stream_read",
+};
+
+struct stats_hist {
+  uint64_t count;
+  uint64_t errors;
+  uint64_t total_ns;
+  uint64_t buckets[STATS_NBUCKETS];
+};
+
+struct tarix_stats {
+  struct stats_hist ops[STATS_NOPS];
+  /* bytes handed back to read(2) callers */
+  uint64_t bytes_served;
+  /* uncompressed bytes pulled through the tar stream (headers, skipped
+   * data and served data) */
+  uint64_t stream_bytes;
+  /* bytes produced by inflate, including read-ahead left in the buffers */
+  uint64_t bytes_inflated;
+  /* compressed bytes consumed by inflate */
+  uint64_t bytes_compressed;
+  uint64_t seeks;
+  /* node stat cache */
+  uint64_t stat_hits;
+  uint64_t stat_misses;
+};
+
+static struct tarix_stats tstats;
+static time_t stats_start;
+
+/* there is only one tar stream, every user of it must hold this */
+static pthread_mutex_t stream_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define STATS_ADD(field, n) __atomic_fetch_add(&(field), (n), __ATOMIC_RELAXED)
+#define STATS_GET(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+static uint64_t stats_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void stats_record(int op, uint64_t start, int failed) {
+  struct stats_hist *h = &tstats.ops[op];
+  uint64_t ns = stats_now() - start;
+  uint64_t us = ns / 1000;
+  int bucket = 0;
+  while (us > 0 && bucket < STATS_NBUCKETS - 1) {
+    us >>= 1;
+    ++bucket;
+  }
+  STATS_ADD(h->count, 1);
+  if (failed)
+    STATS_ADD(h->errors, 1);
+  STATS_ADD(h->total_ns, ns);
+  STATS_ADD(h->buckets[bucket], 1);
+}
+
+static void stream_lock(void) {
+  uint64_t start = stats_now();
+  pthread_mutex_lock(&stream_mutex);
+  stats_record(STATS_PH_STREAM_WAIT, start, 0);
+}
+
+static void stream_unlock(void) {
+  pthread_mutex_unlock(&stream_mutex);
+}
+
+/* ts_seek with accounting, caller must hold the stream lock */
+static int stream_seek(t_streamp tsp, off64_t offset) {
+  uint64_t start = stats_now();
+  int res = ts_seek(tsp, offset);
+  STATS_ADD(tstats.seeks, 1);
+  stats_record(STATS_PH_SEEK, start, res != 0);
+  return res;
+}
+
+/* ts_read with accounting, caller must hold the stream lock */
+static int stream_read(t_streamp tsp, void *buf, int len) {
+  uint64_t start = stats_now();
+  off64_t raw_before = tsp->raw_bytes;
+  off64_t zlib_before = tsp->zlib_bytes;
+  int res = ts_read(tsp, buf, len);
+  if (res > 0)
+    STATS_ADD(tstats.stream_bytes, res);
+  if (tsp->codec != NULL) {
+    STATS_ADD(tstats.bytes_inflated, tsp->raw_bytes - raw_before);
+    STATS_ADD(tstats.bytes_compressed, tsp->zlib_bytes - zlib_before);
+  } else if (res > 0) {
+    /* straight reads: what we read is what we "inflated" */
+    STATS_ADD(tstats.bytes_inflated, res);
+    STATS_ADD(tstats.bytes_compressed, res);
+  }
+  stats_record(STATS_PH_STREAM_READ, start, res < 0);
+  return res;
+}
+
+/* ts_read_segment with accounting (a seek and a read), caller must hold
+ * the stream lock */
+static int stream_read_segment(t_streamp tsp, off64_t offset, off64_t zlen,
+    void *buf, int len) {
+  uint64_t start = stats_now();
+  off64_t zlib_before = tsp->zlib_bytes;
+  off64_t raw_before = tsp->raw_bytes;
+  int res = ts_read_segment(tsp, offset, zlen, buf, len);
+  STATS_ADD(tstats.seeks, 1);
+  if (res > 0)
+    STATS_ADD(tstats.stream_bytes, res);
+  STATS_ADD(tstats.bytes_inflated, tsp->raw_bytes - raw_before);
+  STATS_ADD(tstats.bytes_compressed, tsp->zlib_bytes - zlib_before);
+  stats_record(STATS_PH_STREAM_READ, start, res < 0);
+  return res;
+}
+
+static int is_ctl_path(const char *path) {
+  return strcmp(path, TARIX_CTL_DIR) == 0
+    || strcmp(path, TARIX_STATS_PATH) == 0;
+}
+
+static void stats_append(char **buf, size_t *len, size_t *sz,
+    const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+
+static void stats_append(char **buf, size_t *len, size_t *sz,
+    const char *fmt, ...) {
+  va_list ap;
+  int n;
+  while (1) {
+    va_start(ap, fmt);
+    n = vsnprintf(*buf + *len, *sz - *len, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+      return;
+    if (*len + n < *sz)
+      break;
+    *sz = (*sz + n) * 2;
+    *buf = realloc(*buf, *sz);
+  }
+  *len += n;
+}
+
+/* render a snapshot of the stats as JSON, returns a malloc'd string */
+static char *stats_json(size_t *lenp) {
+  size_t len = 0, sz = 4096;
+  char *buf = malloc(sz);
+  int op, b;
+  uint64_t served = STATS_GET(tstats.bytes_served);
+  uint64_t inflated = STATS_GET(tstats.bytes_inflated);
+  uint64_t hits = STATS_GET(tstats.stat_hits);
+  uint64_t misses = STATS_GET(tstats.stat_misses);
+
+  stats_append(&buf, &len, &sz, "{\n  \"uptime_s\": %lld,\n",
+    (long long)(time(NULL) - stats_start));
+  stats_append(&buf, &len, &sz, "  \"latency_buckets\": \"log2_us\",\n");
+  stats_append(&buf, &len, &sz, "  \"ops\": {\n");
+  for (op = 0; op < STATS_NOPS; ++op) {
+    struct stats_hist *h = &tstats.ops[op];
+    int last = 0;
+    for (b = 0; b < STATS_NBUCKETS; ++b)
+      if (STATS_GET(h->buckets[b]) != 0)
+        last = b;
+    stats_append(&buf, &len, &sz,
+      "    \"%s\": { \"count\": %llu, \"errors\": %llu, \"total_us\": %llu,"
+      " \"latency\": [", stats_op_names[op],
+      (unsigned long long)STATS_GET(h->count),
+      (unsigned long long)STATS_GET(h->errors),
+      (unsigned long long)STATS_GET(h->total_ns) / 1000);
+    /* trailing empty buckets are left off */
+    for (b = 0; b <= last; ++b)
+      stats_append(&buf, &len, &sz, "%s%llu", b ? ", " : "",
+        (unsigned long long)STATS_GET(h->buckets[b]));
+    stats_append(&buf, &len, &sz, "] }%s\n", op < STATS_NOPS - 1 ? "," : "");
+  }
+  stats_append(&buf, &len, &sz, "  },\n");
+  stats_append(&buf, &len, &sz, "  \"bytes_served\": %llu,\n",
+    (unsigned long long)served);
+  stats_append(&buf, &len, &sz, "  \"stream_bytes\": %llu,\n",
+    (unsigned long long)STATS_GET(tstats.stream_bytes));
+  stats_append(&buf, &len, &sz, "  \"bytes_inflated\": %llu,\n",
+    (unsigned long long)inflated);
+  stats_append(&buf, &len, &sz, "  \"bytes_compressed\": %llu,\n",
+    (unsigned long long)STATS_GET(tstats.bytes_compressed));
+  stats_append(&buf, &len, &sz, "  \"amplification\": %.3f,\n",
+    served ? (double)inflated / served : 0.0);
+  stats_append(&buf, &len, &sz, "  \"seeks\": %llu,\n",
+    (unsigned long long)STATS_GET(tstats.seeks));
+  stats_append(&buf, &len, &sz,
+    "  \"stat_cache\": { \"hits\": %llu, \"misses\": %llu,"
+    " \"hit_rate\": %.3f }\n",
+    (unsigned long long)hits, (unsigned long long)misses,
+    hits + misses ? (double)hits / (hits + misses) : 0.0);
+  stats_append(&buf, &len, &sz, "}\n");
+
+  *lenp = len;
+  return buf;
+}
+
+/* snapshot attached to an open handle of the stats file */
+struct stats_snapshot {
+  size_t len;
+  char data[];
+};
+
+static int ctl_getattr(const char *path, struct stat *stbuf) {
+  stbuf->st_uid = getuid();
+  stbuf->st_gid = getgid();
+  stbuf->st_mtime = stbuf->st_atime = stbuf->st_ctime = time(NULL);
+  if (strcmp(path, TARIX_CTL_DIR) == 0) {
+    stbuf->st_mode = S_IFDIR | 0555;
+    stbuf->st_nlink = 2;
+  } else {
+    /* contents are generated at open, size is not known beforehand */
+    stbuf->st_mode = S_IFREG | 0444;
+    stbuf->st_nlink = 1;
+  }
+  return 0;
+}
+
+static int ctl_readdir(const char *path, void *buf, fuse_fill_dir_t filler) {
+  if (strcmp(path, TARIX_CTL_DIR) != 0)
+    return -ENOTDIR;
+  filler(buf, ".", NULL, 0);
+  filler(buf, "..", NULL, 0);
+  filler(buf, strrchr(TARIX_STATS_PATH, '/') + 1, NULL, 0);
+  return 0;
+}
+
+static int ctl_open(const char *path, struct fuse_file_info *fi) {
+  if (strcmp(path, TARIX_STATS_PATH) != 0)
+    return -EISDIR;
+  if ((fi->flags & 3) != O_RDONLY)
+    return -EACCES;
+  size_t len;
+  char *json = stats_json(&len);
+  struct stats_snapshot *snap = malloc(sizeof(*snap) + len);
+  snap->len = len;
+  memcpy(snap->data, json, len);
+  free(json);
+  fi->fh = (uintptr_t)snap;
+  /* size is reported as 0, so bypass the page cache */
+  fi->direct_io = 1;
+  return 0;
+}
+
+static int ctl_read(char *buf, size_t size, off_t offset,
+    struct fuse_file_info *fi) {
+  struct stats_snapshot *snap = (struct stats_snapshot*)(uintptr_t)fi->fh;
+  if (snap == NULL)
+    return -EIO;
+  if (offset >= snap->len)
+    return 0;
+  if (size > snap->len - offset)
+    size = snap->len - offset;
+  memcpy(buf, snap->data + offset, size);
+  return size;
+}
@@ -34,25 +34,31 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "gzindex.h"
 #include "index_parser.h"
 #include "lineloop.h"
+#include "member.h"
 #include "portability.h"
+#include "sparse.h"
 #include "tar.h"
 #include "tstream.h"
 
+// operation statistics and locked access to the tar stream
+#include "fuse_stats.c"
 // helper code related to in memory tar index is in a secondary file
 #include "fuse_index.c"
 
-static int tarix_getattr(const char *path, struct stat *stbuf)
+static int do_getattr(const char *path, struct stat *stbuf)
 {
-  memset(stbuf, 0, sizeof(struct stat));
   struct index_node *node = find_node(path);
   if (node == NULL)
     return -ENOENT;
   int res;
-  if (!is_node_stat_filled(node))
+  if (!is_node_stat_filled(node)) {
     if ((res = fill_node_stat(node)) != 0)
       return res;
+  } else
+    STATS_ADD(tstats.stat_hits, 1);
   // some nodes are invisible
   if (node->stbuf.st_mode == 0)
     return -ENOENT;
@@ -60,16 +66,33 @@ static int tarix_getattr(const char *path, struct stat *stbuf)
   return 0;
 }
 
-static int tarix_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
-    off_t offset, struct fuse_file_info *fi) {
+static int tarix_getattr(const char *path, struct stat *stbuf)
+{
+  uint64_t start = stats_now();
+  int res;
+  memset(stbuf, 0, sizeof(struct stat));
+  if (is_ctl_path(path)) {
+    res = ctl_getattr(path, stbuf);
+  } else {
+    stream_lock();
+    res = do_getattr(path, stbuf);
+    stream_unlock();
+  }
+  stats_record(STATS_OP_GETATTR, start, res != 0);
+  return res;
+}
+
+static int do_readdir(const char *path, void *buf, fuse_fill_dir_t filler) {
   struct index_node *node = find_node(path);
   if (node == NULL)
     return -ENOENT;
   
   int res;
-  if (!is_node_stat_filled(node))
+  if (!is_node_stat_filled(node)) {
     if ((res = fill_node_stat(node)) != 0)
       return res;
+  } else
+    STATS_ADD(tstats.stat_hits, 1);
   
   if (!(node->stbuf.st_mode & S_IFDIR))
     return -ENOTDIR;
@@ -92,18 +115,189 @@ static int tarix_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
   return 0;
 }
 
+static int tarix_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+    off_t offset, struct fuse_file_info *fi) {
+  uint64_t start = stats_now();
+  int res;
+  if (is_ctl_path(path)) {
+    res = ctl_readdir(path, buf, filler);
+  } else {
+    stream_lock();
+    res = do_readdir(path, buf, filler);
+    stream_unlock();
+  }
+  stats_record(STATS_OP_READDIR, start, res != 0);
+  return res;
+}
+
 static int tarix_open(const char *path, struct fuse_file_info *fi) {
-  struct index_node *node = find_node(path);
-  if (node == NULL)
-    return -ENOENT;
-  if ((fi->flags & 3) != O_RDONLY)
-    return -EACCES;
+  uint64_t start = stats_now();
+  int res = 0;
+  fi->fh = 0;
+  if (is_ctl_path(path)) {
+    res = ctl_open(path, fi);
+  } else {
+    struct index_node *node = find_node(path);
+    if (node == NULL)
+      res = -ENOENT;
+    else if ((fi->flags & 3) != O_RDONLY)
+      res = -EACCES;
+  }
+  stats_record(STATS_OP_OPEN, start, res != 0);
+  return res;
+}
+
+static int tarix_release(const char *path, struct fuse_file_info *fi) {
+  /* only the control files attach anything to the handle */
+  if (fi->fh != 0)
+    free((void*)(uintptr_t)fi->fh);
+  fi->fh = 0;
   return 0;
 }
 
-static int tarix_read(const char *path, char *buf, size_t size, off_t offset,
-    struct fuse_file_info *fi) {
-  union tar_block theader;
+/* where the node's stored data is, for member_seek_point */
+static int node_member_data(struct index_node *node, blknum_t datablock,
+    struct member_data *md) {
+  if ((md->offset = get_node_effective_offset(node)) < 0)
+    return -1;
+  md->compressed = tarixfs.use_zlib;
+  md->datablock = datablock;
+  md->cps = node->cps;
+  md->ncps = node->ncps;
+  return 0;
+}
+
+/* get the stream from *cur to pos of the node's stored data */
+static int node_seek(struct index_node *node, const struct member_data *md,
+    off64_t pos, off64_t *cur) {
+  off64_t offset;
+  if (member_seek_point(md, pos, cur, &offset)
+      && stream_seek(tarixfs.tsp, offset) != 0) {
+fprintf(stderr, "seek error for data in record '%s'\n", node->entry.filename);
+    return -EIO;
+  }
+  if (stream_skip(pos - *cur) != 0) {
+fprintf(stderr, "pseudo-seek read error in record '%s'\n", node->entry.filename);
+    return -EIO;
+  }
+  *cur = pos;
+  return 0;
+}
+
+/* read from a sparse file: holes are filled in without touching the
+ * archive, only the stored extents that overlap the request are read */
+static int do_sparse_read(struct index_node *node, char *buf, size_t size,
+    off_t offset) {
+  struct sparse_map *map = node->sparse;
+  struct member_sparse_walk walk;
+  struct member_data md;
+  /* how far into the stored data the stream is */
+  off64_t cur = MEMBER_POS_NONE;
+  off64_t zeros, pos, len;
+  char *out = buf;
+  int res;
+  
+  if (offset >= map->realsize)
+    return 0;
+  if (size > map->realsize - offset)
+    size = map->realsize - offset;
+  memset(buf, 0, size);
+  if (node_member_data(node, map->datablock, &md) != 0)
+    return -EIO;
+  
+  member_sparse_start(&walk, map, offset, offset + size);
+  while (member_sparse_next(&walk, &zeros, &pos, &len)) {
+    out += zeros;
+    if ((res = node_seek(node, &md, pos, &cur)) != 0)
+      return res;
+    if (stream_read(tarixfs.tsp, out, len) != len) {
+fprintf(stderr, "read error for sparse data in record '%s'\n", node->entry.filename);
+      return -EIO;
+    }
+    out += len;
+    cur += len;
+  }
+  
+  return size;
+}
+
+/* small regular files are decoded whole, in one go, and kept for the reads
+ * that follow (the kernel asks for big files a piece at a time) */
+#define FUSE_SEGMENT_MAX (1 << 20)
+
+static struct {
+  struct index_node *node;
+  char *buf;
+  size_t bufsz;
+  /* where the file data starts in buf, and where the entry ends */
+  size_t data;
+  size_t len;
+} seg_cache;
+
+/* member_read_t over the cached segment */
+static int segment_read_member(void *data, void *buf, size_t len) {
+  size_t *pos = (size_t*)data;
+  if (len > seg_cache.len - *pos)
+    return -1;
+  memcpy(buf, seg_cache.buf + *pos, len);
+  *pos += len;
+  return 0;
+}
+
+static int segment_read(struct index_node *node, char *buf, size_t size,
+    off_t offset) {
+  if (seg_cache.node != node) {
+    size_t len = (size_t)node->entry.blocklength * TARBLKSZ;
+    off64_t nodeoffset = get_node_effective_offset(node);
+    struct member_header mh;
+    size_t pos = 0;
+    int res;
+    
+    if (nodeoffset < 0)
+      return -EIO;
+    seg_cache.node = NULL;
+    if (len > seg_cache.bufsz) {
+      free(seg_cache.buf);
+      if ((seg_cache.buf = malloc(len)) == NULL) {
+        seg_cache.bufsz = 0;
+        return -ENOMEM;
+      }
+      seg_cache.bufsz = len;
+    }
+    if (stream_read_segment(tarixfs.tsp, nodeoffset, node->zlen,
+        seg_cache.buf, len) != len) {
+fprintf(stderr, "read error for record '%s'\n", node->entry.filename);
+      return -EIO;
+    }
+    
+    // skip any prefix records (long names, symlinks, extended headers),
+    // as do_read does
+    seg_cache.len = len;
+    res = member_read_header(&mh, segment_read_member, &pos);
+    if (res == 0 && mh.hdr.header.typeflag != REGTYPE
+        && mh.hdr.header.typeflag != AREGTYPE)
+      res = -EIO;
+    member_header_free(&mh);
+    if (res != 0)
+      return -EIO;
+    seg_cache.data = pos;
+    seg_cache.node = node;
+  }
+  
+  if (offset >= seg_cache.len - seg_cache.data)
+    return 0;
+  if (size > seg_cache.len - seg_cache.data - offset)
+    size = seg_cache.len - seg_cache.data - offset;
+  memcpy(buf, seg_cache.buf + seg_cache.data + offset, size);
+  return size;
+}
+
+static int do_read(const char *path, char *buf, size_t size, off_t offset) {
+  struct member_header mh;
+  struct member_data md;
+  blknum_t datablock;
+  off64_t cur = 0;
+  char typeflag;
   int res;
   
   //TODO: cache state in the tar fd so we don't keep re-reading the beginning
@@ -113,62 +307,71 @@ static int tarix_read(const char *path, char *buf, size_t size, off_t offset,
   if (node == NULL)
     return -ENOENT;
   
+  if (node->sparse != NULL)
+    return do_sparse_read(node, buf, size, offset);
+  if (node->zlen > 0
+      && node->entry.blocklength * TARBLKSZ <= FUSE_SEGMENT_MAX)
+    return segment_read(node, buf, size, offset);
+  
   off64_t nodeoffset = get_node_effective_offset(node);
   if (nodeoffset < 0)
     return -EIO;
   
-  if (ts_seek(tarixfs.tsp, nodeoffset) != 0) {
+  if (stream_seek(tarixfs.tsp, nodeoffset) != 0) {
 fprintf(stderr, "seek error for initial tar header in record '%s'\n", node->entry.filename);
     return -EIO;
   }
   
-  if ((res = ts_read(tarixfs.tsp, &theader, TARBLKSZ)) != TARBLKSZ) {
-fprintf(stderr, "read error for initial tar header in record '%s'\n", node->entry.filename);
-    return -EIO;
+  // read past any prefix records (long names, symlinks, extended headers)
+  res = read_member_header(&mh);
+  typeflag = mh.hdr.header.typeflag;
+  datablock = member_data_block(&mh, NULL);
+  member_header_free(&mh);
+  if (res != 0) {
+fprintf(stderr, "read error for tar header in record '%s'\n", node->entry.filename);
+    return res;
   }
   
-  // skip any prefix records (long names, symlinks)
-  
-  while (theader.header.typeflag == GNUTYPE_LONGNAME
-      || theader.header.typeflag == GNUTYPE_LONGLINK) {
-    // skip the long link/name
-    if ((res = ts_read(tarixfs.tsp, &theader, TARBLKSZ)) != TARBLKSZ) {
-fprintf(stderr, "read error skipping long link/name in record '%s'\n", node->entry.filename);
-      return -EIO;
-    }
-    // read the next header (maybe the real one)
-    if ((res = ts_read(tarixfs.tsp, &theader, TARBLKSZ)) != TARBLKSZ) {
-fprintf(stderr, "read error skipping long link/name (#2) in record '%s'\n", node->entry.filename);
-      return -EIO;
-    }
+  if (typeflag == GNUTYPE_SPARSE) {
+fprintf(stderr, "no sparse map for record '%s', index needs to be recreated\n", node->entry.filename);
+    return -EIO;
   }
-  
-  if (theader.header.typeflag != REGTYPE && theader.header.typeflag != AREGTYPE) {
+  if (typeflag != REGTYPE && typeflag != AREGTYPE) {
     // can only read from regular files
     return -EIO;
   }
   
-  // use the buffer in the tar header to skip data
-  //TODO: direct seek on normal files
-  
-  // skip to the desired data
-  while (offset > 0) {
-    int readcount = TARBLKSZ < offset ? TARBLKSZ : offset;
-    res = ts_read(tarixfs.tsp, theader.buffer, readcount);
-    if (res != readcount) {
-fprintf(stderr, "pseudo-seek read error in record '%s'\n", node->entry.filename);
-      return -EIO;
-    }
-    offset -= res;
-  }
+  // a checkpoint inside the data saves decompressing up to it, and
+  // uncompressed archives seek right there
+  if (node_member_data(node, datablock, &md) != 0)
+    return -EIO;
+  if ((res = node_seek(node, &md, offset, &cur)) != 0)
+    return res;
   
   // read the desired data
-  res = ts_read(tarixfs.tsp, buf, size);
+  res = stream_read(tarixfs.tsp, buf, size);
   return res;
 }
 
-static int tarix_readlink(const char *path, char *buf, size_t len) {
-  union tar_block theader;
+static int tarix_read(const char *path, char *buf, size_t size, off_t offset,
+    struct fuse_file_info *fi) {
+  uint64_t start = stats_now();
+  int res;
+  if (fi->fh != 0) {
+    res = ctl_read(buf, size, offset, fi);
+  } else {
+    stream_lock();
+    res = do_read(path, buf, size, offset);
+    stream_unlock();
+    if (res > 0)
+      STATS_ADD(tstats.bytes_served, res);
+  }
+  stats_record(STATS_OP_READ, start, res < 0);
+  return res;
+}
+
+static int do_readlink(const char *path, char *buf, size_t len) {
+  struct member_header mh;
   int res;
   
   struct index_node *node = find_node(path);
@@ -179,48 +382,32 @@ static int tarix_readlink(const char *path, char *buf, size_t len) {
   if (nodeoffset < 0)
     return -EIO;
   
-  if (ts_seek(tarixfs.tsp, nodeoffset) != 0) {
+  if (stream_seek(tarixfs.tsp, nodeoffset) != 0) {
 fprintf(stderr, "seek error for initial tar header in record '%s'\n", node->entry.filename);
     return -EIO;
   }
   
-  if ((res = ts_read(tarixfs.tsp, &theader, TARBLKSZ)) != TARBLKSZ) {
-fprintf(stderr, "read error for initial tar header in record '%s'\n", node->entry.filename);
-    return -EIO;
-  }
-
-  // skip any longname prefix record
-  if (theader.header.typeflag == GNUTYPE_LONGNAME) {
-    // skip the text
-    if ((res = ts_read(tarixfs.tsp, &theader, TARBLKSZ)) != TARBLKSZ) {
-fprintf(stderr, "read error skipping long link/name in record '%s'\n", node->entry.filename);
-      return -EIO;
-    }
-    // read the next (maybe real)
-    if ((res = ts_read(tarixfs.tsp, &theader, TARBLKSZ)) != TARBLKSZ) {
-fprintf(stderr, "read error skipping long link/name (#2) in record '%s'\n", node->entry.filename);
-      return -EIO;
-    }
+  // read past any long name and extended headers, keeping the link name
+  if ((res = read_member_header(&mh)) != 0) {
+    member_header_free(&mh);
+fprintf(stderr, "read error for tar header in record '%s'\n", node->entry.filename);
+    return res;
   }
   
   int cpylen;
   char *cpysrc;
-  // if we hit a longlink record, use that
-  if (theader.header.typeflag == GNUTYPE_LONGLINK) {
-    // read the long link name
-    if ((res = ts_read(tarixfs.tsp, &theader, TARBLKSZ)) != TARBLKSZ) {
-fprintf(stderr, "read error reading long link/name in record '%s'\n", node->entry.filename);
-      return -EIO;
-    }
+  // if we hit a longlink record or an extended header, use that
+  if (mh.hdr.header.typeflag == SYMTYPE && mh.po.linkpath != NULL) {
     // use the smaller of the two lengths
-    cpylen = TARBLKSZ < len ? TARBLKSZ : len;
-    cpysrc = theader.buffer;
-  } else if (theader.header.typeflag == SYMTYPE) {
+    cpylen = strlen(mh.po.linkpath) + 1 < len ? strlen(mh.po.linkpath) + 1 : len;
+    cpysrc = mh.po.linkpath;
+  } else if (mh.hdr.header.typeflag == SYMTYPE) {
     // linkname is 100 bytes
-    cpylen = sizeof(theader.header.linkname) < len ? sizeof(theader.header.linkname) : len;
-    cpysrc = theader.header.linkname;
+    cpylen = sizeof(mh.hdr.header.linkname) < len ? sizeof(mh.hdr.header.linkname) : len;
+    cpysrc = mh.hdr.header.linkname;
   } else {
     // not a symlink
+    member_header_free(&mh);
     return -EINVAL;
   }
   
@@ -229,9 +416,20 @@ fprintf(stderr, "read error reading long link/name in record '%s'\n", node->entr
   // make sure it's null terminated
   buf[cpylen - 1] = 0;
   
+  member_header_free(&mh);
   return 0;
 }
 
+static int tarix_readlink(const char *path, char *buf, size_t len) {
+  uint64_t start = stats_now();
+  int res;
+  stream_lock();
+  res = do_readlink(path, buf, len);
+  stream_unlock();
+  stats_record(STATS_OP_READLINK, start, res != 0);
+  return res;
+}
+
 #include "fuse_rofs.c"
 
 static struct fuse_operations tarix_oper = {
@@ -240,13 +438,13 @@ static struct fuse_operations tarix_oper = {
   .open = tarix_open,
   .read = tarix_read,
   .readlink = tarix_readlink,
+  .release = tarix_release,
   
   //TODO
   //.statfs = tarix_statfs,
   
   // we would have nothing to do for these
   //.flush = tarix_flush,
-  //.release = tarix_release,
   //.fsync = tarix_fsync,
   //.opendir = tarix_opendir, // always succeed
   //.releasedir = tarix_releasedir,
@@ -287,6 +485,7 @@ static struct fuse_operations null_oper = { };
 enum tarix_opt_keys {
   TARIX_KEY_ZLIB = 1,
   TARIX_KEY_HELP = 2,
+  TARIX_KEY_GZIP = 3,
 };
 
 #define TARIX_OPT(t, p, v) { t, offsetof(struct tarixfs_t, p), v }
@@ -294,6 +493,7 @@ static struct fuse_opt tarix_opts[] = {
   TARIX_OPT("tar=%s", tarfilename, 0),
   TARIX_OPT("tarix=%s", indexfilename, 0),
   FUSE_OPT_KEY("zlib", TARIX_KEY_ZLIB),
+  FUSE_OPT_KEY("gzip", TARIX_KEY_GZIP),
   FUSE_OPT_KEY("--help", TARIX_KEY_HELP),
   FUSE_OPT_KEY("-h", TARIX_KEY_HELP),
   FUSE_OPT_END
@@ -314,6 +514,10 @@ int tarix_opt_proc(void *data, const char *arg, int key, struct fuse_args *outar
       tarixfs.use_zlib = 1;
       return 0;
       break;
+    case TARIX_KEY_GZIP:
+      tarixfs.use_gzip = 1;
+      return 0;
+      break;
     case TARIX_KEY_HELP:
       tarixfs.flags_norun |= TARIX_KEY_HELP;
       fuse_opt_add_arg(outargs, "-ho");
@@ -326,6 +530,8 @@ int tarix_opt_proc(void *data, const char *arg, int key, struct fuse_args *outar
 
 int index_lineloop(char *line, void *data) {
   struct index_parser_state *ipstate = (struct index_parser_state*)data;
+  /* extension records attach to the entry before them */
+  static struct index_node *last_node = NULL;
   
   if (ipstate->version < 0) {
     if (init_index_parser(ipstate, line) != 0)
@@ -338,9 +544,49 @@ int index_lineloop(char *line, void *data) {
     if (parse_result < 0)
       /* error */
       return 1;
-    if (parse_result > 0)
-      /* comment line */
+    if (parse_result == 2 && last_node != NULL) {
+      struct sparse_map map;
+      sparse_init(&map);
+      int spr = sparse_parse_ext(node->entry.filename, &map);
+      struct index_cp cp;
+      struct index_st st;
+      if (spr < 0) {
+        fprintf(stderr, "ERROR: bad sparse map for '%s'\n", last_node->entry.filename);
+        return 1;
+      } else if (spr == 0) {
+        last_node->sparse = malloc(sizeof(map));
+        *last_node->sparse = map;
+      } else if ((spr = parse_index_cp(node->entry.filename, &cp)) < 0) {
+        fprintf(stderr, "ERROR: bad checkpoint for '%s'\n", last_node->entry.filename);
+        return 1;
+      } else if (spr == 0) {
+        // they come in order, grow the array by doubling
+        if ((last_node->ncps & (last_node->ncps - 1)) == 0)
+          last_node->cps = realloc(last_node->cps,
+            (last_node->ncps ? 2 * last_node->ncps : 1) * sizeof(cp));
+        last_node->cps[last_node->ncps++] = cp;
+      } else if ((spr = parse_index_st(node->entry.filename, &st)) < 0) {
+        fprintf(stderr, "ERROR: bad metadata for '%s'\n", last_node->entry.filename);
+        return 1;
+      } else if (spr == 0) {
+        if (last_node->st == NULL)
+          last_node->st = malloc(sizeof(st));
+        *last_node->st = st;
+      }
+      /* unknown extensions are ignored */
+    }
+    if (parse_result > 0) {
+      /* comment line or extension record */
+      free(node->entry.filename);
+      free(node);
       return 0;
+    }
+    /* the previous entry's compressed data ends where this one starts */
+    if (last_node != NULL && tarixfs.use_zlib && !tarixfs.use_gzip
+        && node->entry.version >= 1
+        && node->entry.offset > last_node->entry.offset)
+      last_node->zlen = node->entry.offset - last_node->entry.offset;
+    last_node = node;
 
     /* ensure directory entries are correct: not /-terminated */
     int namelen = strlen(node->entry.filename);
@@ -384,6 +630,7 @@ int index_lineloop(char *line, void *data) {
         // fall-through
       case AREGTYPE:
       case REGTYPE:
+      case GNUTYPE_SPARSE:
       case LNKTYPE:
       case SYMTYPE:
       case CHRTYPE:
@@ -412,6 +659,11 @@ static void usage() {
     "    tar=tarfile            tar file to use\n"
     "    tarix=indexfile        tarix index to use\n"
     "    zlib                   enable zlib reading\n"
+    "    gzip                   tar file is an ordinary gzip file, indexed\n"
+    "                           with tarix -i -Z\n"
+    "\n"
+    "Operation statistics are available as JSON in " TARIX_STATS_PATH "\n"
+    "under the mount point.\n"
     );
 }
 
@@ -455,13 +707,28 @@ int main(int argc, char *argv[])
     return 1;
   }
   
-  /* tstream handles base offset */
-  tarixfs.tsp = init_trs(NULL, tarfd, 0, TARBLKSZ, tarixfs.use_zlib);
+  if (tarixfs.use_gzip) {
+    /* offsets in the index are uncompressed ones, the stream gets to them
+     * through the access points */
+    char *sidecar = gzi_sidecar_name(tarixfs.indexfilename);
+    if (gzi_read(&tarixfs.gzi, sidecar) != 0) {
+      perror(sidecar);
+      return 1;
+    }
+    free(sidecar);
+    tarixfs.use_zlib = 0;
+    tarixfs.tsp = init_gzrs(NULL, tarfd, 0, &tarixfs.gzi);
+  } else {
+    /* tstream handles base offset */
+    tarixfs.tsp = init_trs(NULL, tarfd, 0, TARBLKSZ, 0, tarixfs.use_zlib);
+  }
   if (tarixfs.tsp->zlib_err != Z_OK) {
     fprintf(stderr, "zlib init error: %d\n", tarixfs.tsp->zlib_err);
     return 1;
   }
   
+  stats_start = time(NULL);
+  
   /* init the hash table */
   tarixfs.fnhash = g_hash_table_new(g_str_hash, g_str_equal);
   
@@ -0,0 +1,217 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "gzindex.h"
+
+#define GZ_SIDECAR_MAGIC "TARIX GZIP ACCESS POINTS v1\n"
+
+void gzi_init(struct gz_index *gzi, off64_t spacing, int building) {
+  memset(gzi, 0, sizeof(*gzi));
+  gzi->spacing = spacing > 0 ? spacing : GZ_SPACING;
+  gzi->building = building;
+}
+
+void gzi_free(struct gz_index *gzi) {
+  size_t i;
+  for (i = 0; i < gzi->npoints; ++i)
+    free(gzi->points[i].window);
+  free(gzi->points);
+  memset(gzi, 0, sizeof(*gzi));
+}
+
+/* room for one more point */
+static struct gz_point *gzi_new_point(struct gz_index *gzi) {
+  struct gz_point *pt;
+  if (gzi->npoints == gzi->size) {
+    size_t size = gzi->size ? gzi->size * 2 : 64;
+    struct gz_point *points = realloc(gzi->points, size * sizeof(*points));
+    if (points == NULL)
+      return NULL;
+    gzi->points = points;
+    gzi->size = size;
+  }
+  pt = &gzi->points[gzi->npoints];
+  memset(pt, 0, sizeof(*pt));
+  return pt;
+}
+
+int gzi_add(struct gz_index *gzi, off64_t out, off64_t in, int bits,
+    int member, const unsigned char *window, uInt dictlen) {
+  struct gz_point *pt = gzi_new_point(gzi);
+  if (pt == NULL)
+    return -1;
+  pt->out = out;
+  pt->in = in;
+  pt->bits = bits;
+  pt->member = member;
+  if (window != NULL && dictlen > 0) {
+    /* windows are mostly text or tar headers, and squash well */
+    uLongf wlen = compressBound(dictlen);
+    if ((pt->window = malloc(wlen)) == NULL)
+      return -1;
+    if (compress2(pt->window, &wlen, window, dictlen, 6) != Z_OK) {
+      free(pt->window);
+      return -1;
+    }
+    pt->wlen = wlen;
+  }
+  ++gzi->npoints;
+  return 0;
+}
+
+int gzi_due(const struct gz_index *gzi, off64_t out) {
+  if (!gzi->building)
+    return 0;
+  return gzi->npoints == 0
+    || out - gzi->points[gzi->npoints - 1].out >= gzi->spacing;
+}
+
+const struct gz_point *gzi_find(const struct gz_index *gzi, off64_t out) {
+  size_t lo = 0, hi = gzi->npoints;
+  /* first point past out, the one before is it */
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (gzi->points[mid].out <= out)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo > 0 ? &gzi->points[lo - 1] : NULL;
+}
+
+int gzi_window(const struct gz_point *pt, unsigned char *buf) {
+  uLongf len = GZ_WINSIZE;
+  if (pt->wlen == 0)
+    return 0;
+  if (uncompress(buf, &len, pt->window, pt->wlen) != Z_OK)
+    return -1;
+  return len;
+}
+
+static void put_le(unsigned char *buf, unsigned long long val, int len) {
+  int i;
+  for (i = 0; i < len; ++i)
+    buf[i] = (val >> (8 * i)) & 0xff;
+}
+
+static unsigned long long get_le(const unsigned char *buf, int len) {
+  unsigned long long val = 0;
+  int i;
+  for (i = len - 1; i >= 0; --i)
+    val = (val << 8) | buf[i];
+  return val;
+}
+
+/* fixed part of a point record: out, in, bits, flags, window length */
+#define GZ_RECLEN (8 + 8 + 1 + 1 + 4)
+
+int gzi_write(const struct gz_index *gzi, const char *path) {
+  FILE *f;
+  size_t i;
+  
+  if ((f = fopen(path, "w")) == NULL)
+    return -1;
+  if (fputs(GZ_SIDECAR_MAGIC, f) == EOF)
+    goto fail;
+  for (i = 0; i < gzi->npoints; ++i) {
+    const struct gz_point *pt = &gzi->points[i];
+    unsigned char rec[GZ_RECLEN];
+    put_le(rec, pt->out, 8);
+    put_le(rec + 8, pt->in, 8);
+    rec[16] = pt->bits;
+    rec[17] = pt->member ? 1 : 0;
+    put_le(rec + 18, pt->wlen, 4);
+    if (fwrite(rec, GZ_RECLEN, 1, f) != 1)
+      goto fail;
+    if (pt->wlen > 0 && fwrite(pt->window, pt->wlen, 1, f) != 1)
+      goto fail;
+  }
+  return fclose(f) == 0 ? 0 : -1;
+fail:
+  fclose(f);
+  return -1;
+}
+
+int gzi_read(struct gz_index *gzi, const char *path) {
+  char magic[sizeof(GZ_SIDECAR_MAGIC)];
+  unsigned char rec[GZ_RECLEN];
+  FILE *f;
+  size_t n;
+  
+  gzi_init(gzi, 0, 0);
+  if ((f = fopen(path, "r")) == NULL)
+    return -1;
+  if (fread(magic, 1, strlen(GZ_SIDECAR_MAGIC), f)
+      != strlen(GZ_SIDECAR_MAGIC)
+      || memcmp(magic, GZ_SIDECAR_MAGIC, strlen(GZ_SIDECAR_MAGIC)) != 0)
+    goto bad;
+  while ((n = fread(rec, 1, GZ_RECLEN, f)) == GZ_RECLEN) {
+    struct gz_point *pt = gzi_new_point(gzi);
+    if (pt == NULL)
+      goto fail;
+    pt->out = get_le(rec, 8);
+    pt->in = get_le(rec + 8, 8);
+    pt->bits = rec[16];
+    pt->member = rec[17] & 1;
+    pt->wlen = get_le(rec + 18, 4);
+    if (pt->bits > 7 || pt->wlen > compressBound(GZ_WINSIZE)
+        || (gzi->npoints > 0 && pt->out < gzi->points[gzi->npoints - 1].out))
+      goto bad;
+    if (pt->wlen > 0) {
+      if ((pt->window = malloc(pt->wlen)) == NULL)
+        goto fail;
+      /* count it now so gzi_free gets the window */
+      ++gzi->npoints;
+      if (fread(pt->window, pt->wlen, 1, f) != 1)
+        goto bad;
+    } else {
+      ++gzi->npoints;
+    }
+  }
+  if (n != 0 || ferror(f) || gzi->npoints == 0)
+    goto bad;
+  fclose(f);
+  return 0;
+bad:
+  fclose(f);
+  gzi_free(gzi);
+  errno = EINVAL;
+  return -1;
+fail:
+  n = errno;
+  fclose(f);
+  gzi_free(gzi);
+  errno = n;
+  return -1;
+}
+
+char *gzi_sidecar_name(const char *indexfile) {
+  char *name = malloc(strlen(indexfile) + strlen(GZ_SIDECAR_SUFFIX) + 1);
+  if (name != NULL)
+    strcat(strcpy(name, indexfile), GZ_SIDECAR_SUFFIX);
+  return name;
+}
@@ -0,0 +1,94 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __GZINDEX_H__
+#define __GZINDEX_H__
+
+/* access points into ordinary gzip files (not written by tarix), where
+ * inflate can be restarted without decompressing everything before them.
+ * They are collected in one pass over the file and saved in a sidecar
+ * next to the tarix index, see FORMAT. */
+
+#include <stddef.h>
+#include <zlib.h>
+
+#include "portability.h"
+
+/* how much history deflate can refer back to */
+#define GZ_WINSIZE 32768
+/* default distance between access points, in uncompressed bytes */
+#define GZ_SPACING (1 << 20)
+/* sidecar file name is the index file name plus this */
+#define GZ_SIDECAR_SUFFIX ".gzap"
+
+struct gz_point {
+  /* uncompressed offset */
+  off64_t out;
+  /* offset in the gzip file of the first byte with data for out; if bits
+   * is set, the low bits bits of the byte before belong to it as well */
+  off64_t in;
+  int bits;
+  /* start of a gzip member: in points at its header, there's no window */
+  int member;
+  /* the GZ_WINSIZE bytes of output before out, zlib compressed */
+  unsigned char *window;
+  uLong wlen;
+};
+
+struct gz_index {
+  struct gz_point *points;
+  size_t npoints;
+  size_t size;
+  /* minimum distance between points when building */
+  off64_t spacing;
+  /* set while collecting points */
+  int building;
+};
+
+/* Set up an empty index.  spacing 0 means GZ_SPACING. */
+void gzi_init(struct gz_index *gzi, off64_t spacing, int building);
+
+void gzi_free(struct gz_index *gzi);
+
+/* Add a point after the last one.  window is the dictionary inflate has at
+ * that point (dictlen bytes, up to GZ_WINSIZE), NULL for member starts.
+ * Returns 0, or -1 if memory ran out. */
+int gzi_add(struct gz_index *gzi, off64_t out, off64_t in, int bits,
+  int member, const unsigned char *window, uInt dictlen);
+
+/* Does the index want a point at uncompressed offset out? */
+int gzi_due(const struct gz_index *gzi, off64_t out);
+
+/* The last point at or before uncompressed offset out, or NULL. */
+const struct gz_point *gzi_find(const struct gz_index *gzi, off64_t out);
+
+/* Expand a point's window into buf (GZ_WINSIZE bytes).  Returns its
+ * length, or -1 if it is corrupt. */
+int gzi_window(const struct gz_point *pt, unsigned char *buf);
+
+/* Save / load the sidecar.  Return 0, or -1 (errno set, or EINVAL for a
+ * bad file). */
+int gzi_write(const struct gz_index *gzi, const char *path);
+int gzi_read(struct gz_index *gzi, const char *path);
+
+/* malloc'd sidecar file name for an index file */
+char *gzi_sidecar_name(const char *indexfile);
+
+#endif /* __GZINDEX_H__ */
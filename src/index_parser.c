@@ -20,11 +20,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 
 #include "config.h"
 
 #include "tarix.h"
 #include "index_parser.h"
+#include "tar.h"
 
 int init_index_parser(struct index_parser_state *state, char *header) {
   if (sscanf(header, "TARIX INDEX v%d GENERATED BY ", &state->version) != 1) {
@@ -40,7 +42,6 @@ int init_index_parser(struct index_parser_state *state, char *header) {
 }
 
 int parse_index_line(struct index_parser_state *state, char *line, struct index_entry *entry) {
-  /* games with longlong to avoid warnings on 64bit */
   long long lltmp;
   int fnpos, ssret, sscount;
   
@@ -58,35 +59,47 @@ int parse_index_line(struct index_parser_state *state, char *line, struct index_
     entry->blocknum = -1;
     entry->blocklength = -1;
     entry->offset = -1;
-    return 1;
+    if (strncmp(line, INDEX_EXT_PREFIX, strlen(INDEX_EXT_PREFIX)) != 0)
+      return 1;
+    entry->recordtype = ':';
+    if (state->allocate_filename)
+    {
+      entry->filename = strdup(line + strlen(INDEX_EXT_PREFIX));
+      entry->filename_allocated = 1;
+    }
+    else
+      entry->filename = line + strlen(INDEX_EXT_PREFIX);
+    return 2;
   }
   
   switch (state->version) {
     case 0:
       sscount = 2;
-      ssret = sscanf(line, "%ld %ld %n", &entry->blocknum, &entry->blocklength, &fnpos);
+      ssret = sscanf(line, "%" SCNu64 " %" SCNu64 " %n", &entry->blocknum,
+        &entry->blocklength, &fnpos);
       break;
     case 1:
       sscount = 3;
-      ssret = sscanf(line, "%ld %lld %ld %n", &entry->blocknum, &lltmp,
-        &entry->blocklength, &fnpos);
+      ssret = sscanf(line, "%" SCNu64 " %lld %" SCNu64 " %n",
+        &entry->blocknum, &lltmp, &entry->blocklength, &fnpos);
       entry->offset = lltmp;
       break;
     case 2:
       sscount = 4;
-      ssret = sscanf(line, "%c %ld %lld %ld %n", &entry->recordtype, &entry->blocknum,
-        &lltmp, &entry->blocklength, &fnpos);
+      ssret = sscanf(line, "%c %" SCNu64 " %lld %" SCNu64 " %n",
+        &entry->recordtype, &entry->blocknum, &lltmp, &entry->blocklength,
+        &fnpos);
       entry->offset = lltmp;
       break;
     default:
       fprintf(stderr, "Index version %d not supported\n", state->version);
-      return 1;
+      return -1;
   }
   
   if (ssret != sscount) {
     fprintf(stderr, "index format error: v%d expects %d, got %d\n",
       state->version, sscount, ssret);
-    return 1;
+    return -1;
   }
   
   if (state->allocate_filename)
@@ -102,3 +115,76 @@ int parse_index_line(struct index_parser_state *state, char *line, struct index_
   
   return 0;
 }
+
+int parse_index_cp(const char *text, struct index_cp *cp) {
+  const char *pos;
+  char *numend;
+  
+  if (strncmp(text, INDEX_EXT_CP " ", strlen(INDEX_EXT_CP) + 1))
+    return 1;
+  pos = text + strlen(INDEX_EXT_CP) + 1;
+  
+  cp->block = strtoull(pos, &numend, 10);
+  if (numend == pos)
+    return -1;
+  cp->offset = strtoll(pos = numend, &numend, 10);
+  if (numend == pos || cp->offset < 0)
+    return -1;
+  return 0;
+}
+
+const struct index_cp *find_index_cp(const struct index_cp *cps, int ncps,
+    blknum_t datablock, off64_t pos) {
+  int lo = 0, hi = ncps;
+  
+  /* binary search for the first one past pos */
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (cps[mid].block < datablock
+        || (off64_t)(cps[mid].block - datablock) * 512 <= pos)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  /* only points in the data count */
+  if (lo == 0 || cps[lo - 1].block <= datablock)
+    return NULL;
+  return &cps[lo - 1];
+}
+
+int parse_index_st(const char *text, struct index_st *st) {
+  long long size;
+  int end = 0;
+  
+  if (strncmp(text, INDEX_EXT_ST " ", strlen(INDEX_EXT_ST) + 1))
+    return 1;
+  if (sscanf(text + strlen(INDEX_EXT_ST) + 1, "%o %lu %lu %lld %lld%n",
+      &st->mode, &st->uid, &st->gid, &size, &st->mtime, &end) != 5
+      || text[strlen(INDEX_EXT_ST) + 1 + end] != 0 || size < 0)
+    return -1;
+  st->size = size;
+  return 0;
+}
+
+mode_t index_type_mode(char typeflag) {
+  switch (typeflag) {
+    case REGTYPE:
+    case AREGTYPE:
+    case CONTTYPE:
+    case GNUTYPE_SPARSE:
+      return S_IFREG;
+    case SYMTYPE:
+      return S_IFLNK;
+    case CHRTYPE:
+      return S_IFCHR;
+    case BLKTYPE:
+      return S_IFBLK;
+    case GNUTYPE_DUMPDIR:
+    case DIRTYPE:
+      return S_IFDIR;
+    case FIFOTYPE:
+      return S_IFIFO;
+    default:
+      return 0;
+  }
+}
@@ -20,10 +20,26 @@
 #ifndef __INDEX_PARSER_H__
 #define __INDEX_PARSER_H__
 
+#include <inttypes.h>
 #include <sys/types.h>
 
 #include "portability.h"
 
+/* block numbers and counts of 512 byte blocks in an archive: with 32 bits,
+ * they would stop at 2T */
+typedef uint64_t blknum_t;
+
+/* Lines starting with this are extension records that attach extra data to
+ * the preceding index entry.  Readers that don't know about them see a
+ * comment. */
+#define INDEX_EXT_PREFIX "#:"
+
+/* extension record for a checkpoint in the middle of an entry's data */
+#define INDEX_EXT_CP "cp"
+
+/* extension record with what the tar header of an entry says about it */
+#define INDEX_EXT_ST "st"
+
 struct index_parser_state {
   int version;
   int allocate_filename;
@@ -34,16 +50,60 @@ struct index_entry {
   int version;
   /* 0-based index of entry in the index */
   int num;
+  /* the tar record type, '#' for comments, ':' for extension records */
   char recordtype;
-  unsigned long blocknum;
+  blknum_t blocknum;
   off64_t offset;
-  unsigned long blocklength;
+  blknum_t blocklength;
+  /* for extension records, the text after INDEX_EXT_PREFIX */
   char *filename;
   int filename_allocated;
 };
 
 int init_index_parser(struct index_parser_state *state, char *header);
 
+/* Parse an index line into entry.  Returns 0 for a normal entry, 1 for a
+ * comment, 2 for an extension record, and -1 on errors.
+ */
 int parse_index_line(struct index_parser_state *state, char *line, struct index_entry *entry);
 
+/* a point inside an entry's data where decompression can start: block is
+ * counted in 512 blocks from the first block of the entry, offset is the
+ * actual offset as in index lines */
+struct index_cp {
+  blknum_t block;
+  off64_t offset;
+};
+
+/* Parse the text of an extension record (after INDEX_EXT_PREFIX) into cp.
+ * Returns 0 on success, 1 if it is not a checkpoint record, -1 on errors.
+ */
+int parse_index_cp(const char *text, struct index_cp *cp);
+
+/* The last of the ncps checkpoints (in order) at or before byte pos of an
+ * entry's data, which starts datablock blocks into the entry, or NULL if
+ * there is none.
+ */
+const struct index_cp *find_index_cp(const struct index_cp *cps, int ncps,
+  blknum_t datablock, off64_t pos);
+
+/* metadata of an entry: permissions (without the file type bits), owner,
+ * size (the expanded size for sparse files) and mtime */
+struct index_st {
+  unsigned int mode;
+  unsigned long uid;
+  unsigned long gid;
+  off64_t size;
+  long long mtime;
+};
+
+/* Parse the text of an extension record (after INDEX_EXT_PREFIX) into st.
+ * Returns 0 on success, 1 if it is not a metadata record, -1 on errors.
+ */
+int parse_index_st(const char *text, struct index_st *st);
+
+/* The S_IF* file type bits for a tar typeflag, 0 for the types (like hard
+ * links) that are not files of their own */
+mode_t index_type_mode(char typeflag);
+
 #endif
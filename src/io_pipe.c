@@ -0,0 +1,355 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "io_pipe.h"
+
+struct iop_buf {
+  char *data;
+  /* bytes in the buffer, and how far the reading side has got */
+  size_t len;
+  size_t pos;
+};
+
+struct io_pipe {
+  pthread_mutex_t lock;
+  /* the thread waits for work, the caller for it to be done */
+  pthread_cond_t work;
+  pthread_cond_t done;
+  pthread_t thread;
+  int fd;
+  int writer;
+  int seekable;
+  /* next offset the thread reads from */
+  off64_t pos;
+  size_t bufsz;
+  int nbufs;
+  struct iop_buf *bufs;
+  /* buffers filled so far (by the thread for readers, the caller for
+   * writers), and emptied by the other side; fill - take are in flight */
+  unsigned long fill;
+  unsigned long take;
+  int eof;
+  /* errno of a failed read or write, 0 if none */
+  int err;
+  int shutdown;
+};
+
+#define IOP_BUF(iop, n) (&(iop)->bufs[(n) % (iop)->nbufs])
+
+static void *iop_read_worker(void *arg) {
+  struct io_pipe *iop = arg;
+  
+  /* only a read that may block forever is a place to stop */
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+  pthread_mutex_lock(&iop->lock);
+  while (!iop->shutdown) {
+    struct iop_buf *b;
+    size_t got = 0;
+    int err = 0;
+    
+    if (iop->fill - iop->take == iop->nbufs) {
+      pthread_cond_wait(&iop->work, &iop->lock);
+      continue;
+    }
+    b = IOP_BUF(iop, iop->fill);
+    pthread_mutex_unlock(&iop->lock);
+    
+    /* whole buffers: short reads only happen at the end */
+    while (got < iop->bufsz) {
+      ssize_t n;
+      pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+      if (iop->seekable)
+        n = p_pread64(iop->fd, b->data + got, iop->bufsz - got,
+          iop->pos + got);
+      else
+        n = read(iop->fd, b->data + got, iop->bufsz - got);
+      pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        err = errno;
+      if (n <= 0)
+        break;
+      got += n;
+    }
+    iop->pos += got;
+    b->len = got;
+    b->pos = 0;
+    
+    pthread_mutex_lock(&iop->lock);
+    if (got > 0)
+      ++iop->fill;
+    if (got < iop->bufsz) {
+      iop->err = err;
+      iop->eof = err == 0;
+    }
+    pthread_cond_broadcast(&iop->done);
+    if (got < iop->bufsz)
+      break;
+  }
+  pthread_mutex_unlock(&iop->lock);
+  return NULL;
+}
+
+static void *iop_write_worker(void *arg) {
+  struct io_pipe *iop = arg;
+  
+  pthread_mutex_lock(&iop->lock);
+  while (1) {
+    struct iop_buf *b;
+    int err;
+    
+    if (iop->take == iop->fill) {
+      if (iop->shutdown)
+        break;
+      pthread_cond_wait(&iop->work, &iop->lock);
+      continue;
+    }
+    b = IOP_BUF(iop, iop->take);
+    /* after a failure the rest is dropped, the caller hears of it */
+    err = iop->err;
+    pthread_mutex_unlock(&iop->lock);
+    
+    while (b->pos < b->len && err == 0) {
+      ssize_t n = write(iop->fd, b->data + b->pos, b->len - b->pos);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0) {
+        err = n < 0 ? errno : EIO;
+        break;
+      }
+      b->pos += n;
+    }
+    
+    pthread_mutex_lock(&iop->lock);
+    if (err != 0)
+      iop->err = err;
+    b->len = b->pos = 0;
+    ++iop->take;
+    pthread_cond_broadcast(&iop->done);
+  }
+  pthread_mutex_unlock(&iop->lock);
+  return NULL;
+}
+
+static struct io_pipe *iop_start(int fd, int writer, size_t bufsz,
+    int nbufs, size_t align) {
+  struct io_pipe *iop = calloc(1, sizeof(*iop));
+  int i, err = ENOMEM;
+  
+  if (iop == NULL)
+    return NULL;
+  iop->fd = fd;
+  iop->writer = writer;
+  iop->bufsz = bufsz;
+  iop->nbufs = nbufs > 1 ? nbufs : 2;
+  if ((iop->bufs = calloc(iop->nbufs, sizeof(*iop->bufs))) == NULL)
+    goto fail;
+  for (i = 0; i < iop->nbufs; ++i) {
+    void *buf;
+    if (posix_memalign(&buf, align, bufsz) != 0)
+      goto fail;
+    iop->bufs[i].data = buf;
+  }
+  pthread_mutex_init(&iop->lock, NULL);
+  pthread_cond_init(&iop->work, NULL);
+  pthread_cond_init(&iop->done, NULL);
+  return iop;
+  
+fail:
+  if (iop->bufs != NULL)
+    for (i = 0; i < iop->nbufs; ++i)
+      free(iop->bufs[i].data);
+  free(iop->bufs);
+  free(iop);
+  errno = err;
+  return NULL;
+}
+
+static void iop_free(struct io_pipe *iop) {
+  int i;
+  
+  for (i = 0; i < iop->nbufs; ++i)
+    free(iop->bufs[i].data);
+  free(iop->bufs);
+  pthread_mutex_destroy(&iop->lock);
+  pthread_cond_destroy(&iop->work);
+  pthread_cond_destroy(&iop->done);
+  free(iop);
+}
+
+struct io_pipe *iop_start_reader(int fd, int seekable, off64_t pos,
+    size_t bufsz, int nbufs, size_t align) {
+  struct io_pipe *iop = iop_start(fd, 0, bufsz, nbufs, align);
+  int err;
+  
+  if (iop == NULL)
+    return NULL;
+  iop->seekable = seekable;
+  iop->pos = pos;
+  if ((err = pthread_create(&iop->thread, NULL, iop_read_worker, iop))
+      != 0) {
+    iop_free(iop);
+    errno = err;
+    return NULL;
+  }
+  return iop;
+}
+
+struct io_pipe *iop_start_writer(int fd, size_t bufsz, int nbufs,
+    size_t align) {
+  struct io_pipe *iop = iop_start(fd, 1, bufsz, nbufs, align);
+  int err;
+  
+  if (iop == NULL)
+    return NULL;
+  if ((err = pthread_create(&iop->thread, NULL, iop_write_worker, iop))
+      != 0) {
+    iop_free(iop);
+    errno = err;
+    return NULL;
+  }
+  return iop;
+}
+
+ssize_t iop_read(struct io_pipe *iop, void *buf, size_t len) {
+  char *out = buf;
+  size_t done = 0;
+  ssize_t rv;
+  
+  pthread_mutex_lock(&iop->lock);
+  while (done < len) {
+    struct iop_buf *b;
+    size_t n;
+    
+    if (iop->take == iop->fill) {
+      if (iop->eof || iop->err != 0)
+        break;
+      pthread_cond_wait(&iop->done, &iop->lock);
+      continue;
+    }
+    /* the thread leaves filled buffers alone until they are taken */
+    b = IOP_BUF(iop, iop->take);
+    n = b->len - b->pos < len - done ? b->len - b->pos : len - done;
+    pthread_mutex_unlock(&iop->lock);
+    memcpy(out + done, b->data + b->pos, n);
+    pthread_mutex_lock(&iop->lock);
+    b->pos += n;
+    done += n;
+    if (b->pos == b->len) {
+      ++iop->take;
+      pthread_cond_signal(&iop->work);
+    }
+  }
+  /* the data from before a failure comes first */
+  if (done == 0 && iop->err != 0) {
+    errno = iop->err;
+    rv = -1;
+  } else {
+    rv = done;
+  }
+  pthread_mutex_unlock(&iop->lock);
+  return rv;
+}
+
+ssize_t iop_write(struct io_pipe *iop, const void *buf, size_t len) {
+  const char *in = buf;
+  size_t done = 0;
+  
+  pthread_mutex_lock(&iop->lock);
+  while (done < len && iop->err == 0) {
+    struct iop_buf *b;
+    size_t n;
+    
+    /* the buffer after the last one handed over is the caller's, once
+     * the thread is done with it */
+    if (iop->fill - iop->take == iop->nbufs) {
+      pthread_cond_wait(&iop->done, &iop->lock);
+      continue;
+    }
+    b = IOP_BUF(iop, iop->fill);
+    n = iop->bufsz - b->len < len - done ? iop->bufsz - b->len : len - done;
+    pthread_mutex_unlock(&iop->lock);
+    memcpy(b->data + b->len, in + done, n);
+    pthread_mutex_lock(&iop->lock);
+    b->len += n;
+    done += n;
+    if (b->len == iop->bufsz) {
+      ++iop->fill;
+      pthread_cond_signal(&iop->work);
+    }
+  }
+  if (iop->err != 0) {
+    errno = iop->err;
+    pthread_mutex_unlock(&iop->lock);
+    return -1;
+  }
+  pthread_mutex_unlock(&iop->lock);
+  return len;
+}
+
+int iop_drain(struct io_pipe *iop) {
+  int rv = 0;
+  
+  pthread_mutex_lock(&iop->lock);
+  /* hand over the partial buffer too */
+  if (IOP_BUF(iop, iop->fill)->len > 0
+      && iop->fill - iop->take < iop->nbufs) {
+    ++iop->fill;
+    pthread_cond_signal(&iop->work);
+  }
+  while (iop->take != iop->fill)
+    pthread_cond_wait(&iop->done, &iop->lock);
+  if (iop->err != 0) {
+    errno = iop->err;
+    rv = -1;
+  }
+  pthread_mutex_unlock(&iop->lock);
+  return rv;
+}
+
+int iop_end(struct io_pipe *iop) {
+  int rv = 0, err = 0;
+  
+  if (iop == NULL)
+    return 0;
+  if (iop->writer && (rv = iop_drain(iop)) != 0)
+    err = errno;
+  pthread_mutex_lock(&iop->lock);
+  iop->shutdown = 1;
+  pthread_cond_broadcast(&iop->work);
+  pthread_mutex_unlock(&iop->lock);
+  /* a reader may be stuck reading from a pipe nobody writes to */
+  if (!iop->writer)
+    pthread_cancel(iop->thread);
+  pthread_join(iop->thread, NULL);
+  iop_free(iop);
+  if (rv != 0)
+    errno = err;
+  return rv;
+}
@@ -0,0 +1,70 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __IO_PIPE_H__
+#define __IO_PIPE_H__
+
+/* A thread on the other side of a file descriptor, so that its i/o
+ * overlaps with the caller's work: a reader reads ahead into a ring of
+ * buffers that iop_read copies out of, a writer copies what iop_write is
+ * given into the ring and writes it out behind the caller's back.  The
+ * copies cost far less than the i/o or compression they run alongside.
+ */
+
+#include <stddef.h>
+
+#include "portability.h"
+
+/* ring buffers, enough to keep the fd busy while the caller catches up */
+#define IOP_NBUFS 4
+
+struct io_pipe;
+
+/* Start reading fd ahead, in bufsz pieces into buffers aligned to align
+ * (so bufsz and pos must be multiples of it for direct i/o).  Seekable
+ * fds are read with pread from pos on, others with read.  Returns NULL
+ * (with errno set) if the thread or memory couldn't be had. */
+struct io_pipe *iop_start_reader(int fd, int seekable, off64_t pos,
+  size_t bufsz, int nbufs, size_t align);
+
+/* Start writing to fd behind the caller, in pieces of up to bufsz from
+ * buffers aligned to align.  Returns NULL as iop_start_reader. */
+struct io_pipe *iop_start_writer(int fd, size_t bufsz, int nbufs,
+  size_t align);
+
+/* Copy len bytes of input into buf, waiting for them if need be.  Returns
+ * len, less only at the end of the input, or -1 (with errno set) if a read
+ * failed before anything could be copied. */
+ssize_t iop_read(struct io_pipe *iop, void *buf, size_t len);
+
+/* Queue len bytes from buf to be written, waiting only for a free buffer.
+ * Returns len, or -1 (with errno set) if an earlier write failed, as the
+ * write itself would have. */
+ssize_t iop_write(struct io_pipe *iop, const void *buf, size_t len);
+
+/* Wait until everything queued on a writer has been written.  Returns 0,
+ * or -1 (with errno set) if a write failed. */
+int iop_drain(struct io_pipe *iop);
+
+/* Stop the thread and free the pipe; a writer is drained first.  Returns
+ * as iop_drain (always 0 for readers). */
+int iop_end(struct io_pipe *iop);
+
+#endif /* __IO_PIPE_H__ */
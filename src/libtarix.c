@@ -0,0 +1,710 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+
+#include "gzindex.h"
+#include "index_parser.h"
+#include "libtarix.h"
+#include "lineloop.h"
+#include "member.h"
+#include "portability.h"
+#include "sparse.h"
+#include "tar.h"
+#include "tstream.h"
+
+/* buffer for reading past data up to where a read starts */
+#define SKIPBUFSZ (64 << 10)
+/* biggest single ts_read */
+#define READ_MAX (1 << 30)
+
+/* what the tar header of a member says */
+struct member_info {
+  char typeflag;
+  /* blocks up to the end of the header (LONG* records included), and up
+   * to the stored data */
+  blknum_t hdrblocks;
+  blknum_t datablock;
+  struct stat st;
+};
+
+struct tarix_member {
+  char *name;
+  /* 0-based position in the index */
+  int num;
+  blknum_t blocknum;
+  off64_t offset;
+  blknum_t blocklength;
+  /* from the extension records after its entry */
+  struct sparse_map sparse;
+  int sparse_valid;
+  /* size from its metadata record, -1 if there is none */
+  off64_t st_size;
+  struct index_cp *cps;
+  int ncps, cpsz;
+  /* read the first time it's needed, under the archive lock */
+  int info_valid;
+  struct member_info info;
+};
+
+/* a read stream on the archive, used by one thread at a time */
+struct tarix_reader {
+  int fd;
+  t_streamp tsp;
+  /* the member the stream is in, and the position in its stored data
+   * (negative in the headers before it), member is NULL if not known */
+  const struct tarix_member *member;
+  off64_t cur;
+  char *skipbuf;
+  struct tarix_reader *next;
+};
+
+struct tarix_archive {
+  char *tarfile;
+  /* index offsets are compressed ones */
+  int compressed;
+  int gzip;
+  struct gz_index gzi;
+  struct tarix_member *members;
+  int nmembers, msize;
+  /* all the members, sorted by name */
+  struct tarix_member **byname;
+  /* for reading the index */
+  struct index_parser_state ipstate;
+  int gotheader;
+  /* extension records belong to the last member, if it was the last
+   * entry */
+  int last_is_member;
+  /* guards the idle readers and the info of the members */
+  pthread_mutex_t lock;
+  struct tarix_reader *idle;
+};
+
+static int load_lineloop_processor(char *line, void *data) {
+  struct tarix_archive *archive = (struct tarix_archive*)data;
+  struct tarix_member *member;
+  struct index_entry entry;
+  int rv;
+  
+  if (!archive->gotheader) {
+    if (init_index_parser(&archive->ipstate, line) != 0)
+      return 1;
+    archive->ipstate.allocate_filename = 0;
+    archive->gotheader = 1;
+    return 0;
+  }
+  
+  memset(&entry, 0, sizeof(entry));
+  if ((rv = parse_index_line(&archive->ipstate, line, &entry)) < 0)
+    return 1;
+  if (rv == 2 && archive->last_is_member) {
+    struct index_cp cp;
+    struct index_st st;
+    member = &archive->members[archive->nmembers - 1];
+    if ((rv = sparse_parse_ext(entry.filename, &member->sparse)) == 0)
+      member->sparse_valid = 1;
+    else if (rv > 0 && (rv = parse_index_st(entry.filename, &st)) == 0)
+      member->st_size = st.size;
+    else if (rv > 0 && (rv = parse_index_cp(entry.filename, &cp)) == 0) {
+      if (member->ncps == member->cpsz) {
+        struct index_cp *cps;
+        int cpsz = member->cpsz ? member->cpsz * 2 : 64;
+        if ((cps = realloc(member->cps, cpsz * sizeof(cp))) == NULL) {
+          perror("allocate checkpoints");
+          return 1;
+        }
+        member->cps = cps;
+        member->cpsz = cpsz;
+      }
+      member->cps[member->ncps++] = cp;
+    }
+    if (rv < 0) {
+      fprintf(stderr, "bad extension record: %s\n", line);
+      return 1;
+    }
+    return 0;
+  }
+  if (rv > 0)
+    /* comment line */
+    return 0;
+  
+  /* extended headers are read as part of the member after them; indexes
+   * from older versions list them on their own */
+  if (entry.recordtype == XHDTYPE || entry.recordtype == XGLTYPE) {
+    archive->last_is_member = 0;
+    return 0;
+  }
+  
+  if (archive->nmembers == archive->msize) {
+    int msize = archive->msize ? archive->msize * 2 : 256;
+    member = realloc(archive->members, msize * sizeof(*member));
+    if (member == NULL) {
+      perror("allocate members");
+      return 1;
+    }
+    archive->members = member;
+    archive->msize = msize;
+  }
+  member = &archive->members[archive->nmembers];
+  memset(member, 0, sizeof(*member));
+  sparse_init(&member->sparse);
+  if ((member->name = strdup(entry.filename)) == NULL) {
+    perror("allocate member name");
+    return 1;
+  }
+  member->num = archive->nmembers++;
+  member->blocknum = entry.blocknum;
+  member->offset = entry.offset;
+  member->blocklength = entry.blocklength;
+  member->st_size = -1;
+  archive->last_is_member = 1;
+  return 0;
+}
+
+/* by name, and then in archive order */
+static int member_cmp(const void *va, const void *vb) {
+  const struct tarix_member *a = *(const struct tarix_member**)va;
+  const struct tarix_member *b = *(const struct tarix_member**)vb;
+  int rv = strcmp(a->name, b->name);
+  return rv != 0 ? rv : a->num - b->num;
+}
+
+/* the first member (by name) whose name is after path, or whose first len
+ * bytes are not before path if exact is not set */
+static int find_bound(const struct tarix_archive *archive, const char *path,
+    size_t len, int exact) {
+  int lo = 0, hi = archive->nmembers;
+  
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    const char *name = archive->byname[mid]->name;
+    if (exact ? strcmp(name, path) <= 0 : strncmp(name, path, len) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static struct tarix_reader *new_reader(struct tarix_archive *archive) {
+  struct tarix_reader *reader;
+  int err;
+  
+  if ((reader = calloc(1, sizeof(*reader))) == NULL)
+    return NULL;
+  reader->fd = -1;
+  if ((reader->skipbuf = malloc(SKIPBUFSZ)) == NULL)
+    goto fail;
+  if ((reader->fd = p_open(archive->tarfile, O_RDONLY|P_O_LARGEFILE, 0, 0))
+      < 0) {
+    perror(archive->tarfile);
+    goto fail;
+  }
+  if (archive->gzip)
+    reader->tsp = init_gzrs(NULL, reader->fd, 0, &archive->gzi);
+  else
+    reader->tsp = init_trs(NULL, reader->fd, 0, TARBLKSZ, 0,
+      archive->compressed);
+  if (reader->tsp == NULL) {
+    errno = ENOMEM;
+    goto fail;
+  }
+  if (reader->tsp->zlib_err != Z_OK) {
+    fprintf(stderr, "zlib init error: %d\n", reader->tsp->zlib_err);
+    errno = EIO;
+    goto fail;
+  }
+  return reader;
+  
+fail:
+  err = errno;
+  if (reader->tsp != NULL)
+    ts_close(reader->tsp, 1);
+  if (reader->fd >= 0)
+    close(reader->fd);
+  free(reader->skipbuf);
+  free(reader);
+  errno = err;
+  return NULL;
+}
+
+static void free_reader(struct tarix_reader *reader) {
+  ts_close(reader->tsp, 1);
+  close(reader->fd);
+  free(reader->skipbuf);
+  free(reader);
+}
+
+/* Take a reader for reading member from pos of its stored data, preferring
+ * one that was left in it before there.  A new one is opened if they are
+ * all in use.
+ */
+static struct tarix_reader *get_reader(struct tarix_archive *archive,
+    const struct tarix_member *member, off64_t pos) {
+  struct tarix_reader **rp, *reader;
+  
+  pthread_mutex_lock(&archive->lock);
+  for (rp = &archive->idle; *rp != NULL; rp = &(*rp)->next)
+    if ((*rp)->member == member && (*rp)->cur <= pos)
+      break;
+  if (*rp == NULL)
+    rp = &archive->idle;
+  if ((reader = *rp) != NULL)
+    *rp = reader->next;
+  pthread_mutex_unlock(&archive->lock);
+  
+  if (reader == NULL)
+    reader = new_reader(archive);
+  return reader;
+}
+
+static void put_reader(struct tarix_archive *archive,
+    struct tarix_reader *reader) {
+  pthread_mutex_lock(&archive->lock);
+  reader->next = archive->idle;
+  archive->idle = reader;
+  pthread_mutex_unlock(&archive->lock);
+}
+
+/* after an error, where the stream is isn't known */
+static int read_error(struct tarix_reader *reader, int n) {
+  if (n >= 0)
+    fprintf(stderr, "unexpected end of tarfile\n");
+  else
+    ptserror("read tarfile", n, reader->tsp);
+  reader->member = NULL;
+  errno = EIO;
+  return -1;
+}
+
+static int reader_read(struct tarix_reader *reader, char *buf, off64_t len) {
+  int n;
+  
+  while (len > 0) {
+    int want = len < READ_MAX ? len : READ_MAX;
+    if ((n = ts_read(reader->tsp, buf, want)) < want)
+      return read_error(reader, n);
+    reader->cur += n;
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+static int reader_skip(struct tarix_reader *reader, off64_t len) {
+  while (len > 0) {
+    int n = len < SKIPBUFSZ ? len : SKIPBUFSZ;
+    if (reader_read(reader, reader->skipbuf, n) != 0)
+      return -1;
+    len -= n;
+  }
+  return 0;
+}
+
+static int reader_seek_to(struct tarix_reader *reader,
+    const struct tarix_member *member, off64_t offset, off64_t pos) {
+  int rv;
+  
+  if ((rv = ts_seek(reader->tsp, offset)) != 0) {
+    ptserror("seek tarfile", rv, reader->tsp);
+    reader->member = NULL;
+    errno = EIO;
+    return -1;
+  }
+  reader->member = member;
+  reader->cur = pos;
+  return 0;
+}
+
+/* Get the reader to pos of the stored data of member.  A reader a little
+ * before pos just reads on, otherwise it goes where member_seek_point
+ * says.
+ */
+static int reader_seek(struct tarix_archive *archive,
+    struct tarix_reader *reader, const struct tarix_member *member,
+    const struct member_info *info, off64_t pos) {
+  off64_t cur = reader->member == member ? reader->cur : MEMBER_POS_NONE;
+  struct member_data md;
+  off64_t offset;
+  
+  if (cur != MEMBER_POS_NONE && cur <= pos && pos - cur <= SKIPBUFSZ)
+    return reader_skip(reader, pos - cur);
+  md.compressed = archive->compressed;
+  md.offset = archive->compressed ? member->offset
+    : (off64_t)member->blocknum * TARBLKSZ;
+  md.datablock = info->datablock;
+  md.cps = member->cps;
+  md.ncps = member->ncps;
+  if (member_seek_point(&md, pos, &cur, &offset)
+      && reader_seek_to(reader, member, offset, cur) != 0)
+    return -1;
+  return reader_skip(reader, pos - reader->cur);
+}
+
+static int reader_read_member(void *data, void *buf, size_t len) {
+  return reader_read((struct tarix_reader*)data, buf, len);
+}
+
+/* read the tar header of member into info */
+static int read_info(struct tarix_archive *archive,
+    const struct tarix_member *member, struct member_info *info) {
+  const struct sparse_map *sparse = member->sparse_valid ? &member->sparse
+    : NULL;
+  struct tarix_reader *reader;
+  struct member_header mh;
+  int rv;
+  
+  memset(&mh, 0, sizeof(mh));
+  if ((reader = get_reader(archive, NULL, 0)) == NULL)
+    return -1;
+  if (reader_seek_to(reader, NULL, archive->compressed ? member->offset
+      : (off64_t)member->blocknum * TARBLKSZ, 0) != 0)
+    goto fail;
+  if ((rv = member_read_header(&mh, reader_read_member, reader)) != 0) {
+    if (rv == MEMBER_ERR_CORRUPT) {
+      fprintf(stderr, "damaged header for %s\n", member->name);
+      errno = EIO;
+    }
+    reader->member = NULL;
+    goto fail;
+  }
+  
+  info->typeflag = mh.hdr.header.typeflag;
+  info->hdrblocks = mh.hdrblocks;
+  info->datablock = member_data_block(&mh, sparse);
+  member_stat(&mh, member->st_size, sparse, &info->st);
+  info->st.st_ino = member->num + 1;
+  member_header_free(&mh);
+  
+  /* a read of the member can go on from here */
+  reader->member = member;
+  reader->cur = -(off64_t)(info->datablock - info->hdrblocks) * TARBLKSZ;
+  put_reader(archive, reader);
+  return 0;
+  
+fail:
+  member_header_free(&mh);
+  put_reader(archive, reader);
+  return -1;
+}
+
+static int get_info(struct tarix_archive *archive,
+    const struct tarix_member *member, struct member_info *info) {
+  /* only the info of the member gets changed */
+  struct tarix_member *m = (struct tarix_member*)member;
+  int valid;
+  
+  pthread_mutex_lock(&archive->lock);
+  if ((valid = m->info_valid))
+    *info = m->info;
+  pthread_mutex_unlock(&archive->lock);
+  if (valid)
+    return 0;
+  
+  /* two threads might both read it, which does no harm */
+  if (read_info(archive, member, info) != 0)
+    return -1;
+  pthread_mutex_lock(&archive->lock);
+  m->info = *info;
+  m->info_valid = 1;
+  pthread_mutex_unlock(&archive->lock);
+  return 0;
+}
+
+struct tarix_archive *tarix_open(const char *tarfile, const char *indexfile,
+    int flags) {
+  struct tarix_archive *archive;
+  struct tarix_reader *reader;
+  int index, rv, err;
+  
+  if ((flags & TARIX_OPEN_COMPRESSED) && (flags & TARIX_OPEN_GZIP)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if ((archive = calloc(1, sizeof(*archive))) == NULL)
+    return NULL;
+  pthread_mutex_init(&archive->lock, NULL);
+  archive->compressed = (flags & TARIX_OPEN_COMPRESSED) != 0;
+  if ((archive->tarfile = strdup(tarfile)) == NULL)
+    goto fail;
+  
+  if (flags & TARIX_OPEN_GZIP) {
+    /* offsets are uncompressed ones, found with the access points */
+    char *sidecar = gzi_sidecar_name(indexfile);
+    rv = gzi_read(&archive->gzi, sidecar);
+    if (rv != 0)
+      perror(sidecar);
+    free(sidecar);
+    if (rv != 0)
+      goto fail;
+    archive->gzip = 1;
+  }
+  
+  if ((index = open(indexfile, O_RDONLY)) < 0) {
+    perror(indexfile);
+    goto fail;
+  }
+  rv = lineloop(index, load_lineloop_processor, (void*)archive);
+  close(index);
+  if (rv != 0 || !archive->gotheader) {
+    if (rv == 0)
+      fprintf(stderr, "%s: empty index\n", indexfile);
+    errno = EINVAL;
+    goto fail;
+  }
+  
+  if ((archive->byname = malloc((archive->nmembers + 1)
+      * sizeof(*archive->byname))) == NULL)
+    goto fail;
+  for (int i = 0; i < archive->nmembers; ++i)
+    archive->byname[i] = &archive->members[i];
+  qsort(archive->byname, archive->nmembers, sizeof(*archive->byname),
+    member_cmp);
+  
+  /* make sure the archive can be read, the reader is kept for later */
+  if ((reader = new_reader(archive)) == NULL)
+    goto fail;
+  put_reader(archive, reader);
+  return archive;
+  
+fail:
+  err = errno;
+  tarix_close(archive);
+  errno = err;
+  return NULL;
+}
+
+void tarix_close(struct tarix_archive *archive) {
+  struct tarix_reader *reader;
+  int i;
+  
+  if (archive == NULL)
+    return;
+  while ((reader = archive->idle) != NULL) {
+    archive->idle = reader->next;
+    free_reader(reader);
+  }
+  for (i = 0; i < archive->nmembers; ++i) {
+    free(archive->members[i].name);
+    sparse_free(&archive->members[i].sparse);
+    free(archive->members[i].cps);
+  }
+  free(archive->members);
+  free(archive->byname);
+  if (archive->gzip)
+    gzi_free(&archive->gzi);
+  free(archive->tarfile);
+  pthread_mutex_destroy(&archive->lock);
+  free(archive);
+}
+
+const struct tarix_member *tarix_lookup(struct tarix_archive *archive,
+    const char *path) {
+  size_t len = strlen(path);
+  char *dirpath;
+  int i;
+  
+  i = find_bound(archive, path, len, 1);
+  if (i > 0 && strcmp(archive->byname[i - 1]->name, path) == 0)
+    return archive->byname[i - 1];
+  if (len == 0 || path[len - 1] == '/')
+    return NULL;
+  
+  /* directories are in the index with a / */
+  if ((dirpath = malloc(len + 2)) == NULL)
+    return NULL;
+  memcpy(dirpath, path, len);
+  strcpy(dirpath + len, "/");
+  i = find_bound(archive, dirpath, len + 1, 1);
+  if (i > 0 && strcmp(archive->byname[i - 1]->name, dirpath) != 0)
+    i = 0;
+  free(dirpath);
+  return i > 0 ? archive->byname[i - 1] : NULL;
+}
+
+int tarix_foreach(struct tarix_archive *archive, const char *prefix,
+    tarix_member_cb cb, void *data) {
+  size_t len;
+  int i, rv;
+  
+  if (prefix == NULL)
+    prefix = "";
+  len = strlen(prefix);
+  for (i = find_bound(archive, prefix, len, 0); i < archive->nmembers
+      && strncmp(archive->byname[i]->name, prefix, len) == 0; ++i) {
+    /* of several by the same name, the last one is the one that counts */
+    if (i + 1 < archive->nmembers && strcmp(archive->byname[i]->name,
+        archive->byname[i + 1]->name) == 0)
+      continue;
+    if ((rv = cb(archive->byname[i], data)) != 0)
+      return rv;
+  }
+  return 0;
+}
+
+int tarix_count(const struct tarix_archive *archive) {
+  return archive->nmembers;
+}
+
+const char *tarix_member_name(const struct tarix_member *member) {
+  return member->name;
+}
+
+int tarix_stat(struct tarix_archive *archive,
+    const struct tarix_member *member, struct stat *st) {
+  struct member_info info;
+  
+  if (get_info(archive, member, &info) != 0)
+    return -1;
+  *st = info.st;
+  return 0;
+}
+
+/* where a read of len bytes from off of something size bytes long ends */
+static off64_t read_end(off64_t size, size_t len, off64_t off) {
+  return (unsigned long long)(size - off) <= len ? size : off + (off64_t)len;
+}
+
+ssize_t tarix_member_pread(struct tarix_archive *archive,
+    const struct tarix_member *member, void *buf, size_t len, long long off) {
+  struct tarix_reader *reader = NULL;
+  struct member_info info;
+  off64_t size, end;
+  int rv = 0;
+  
+  if (off < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (get_info(archive, member, &info) != 0)
+    return -1;
+  switch (info.typeflag) {
+    case REGTYPE:
+    case AREGTYPE:
+    case CONTTYPE:
+      break;
+    case GNUTYPE_SPARSE:
+      if (member->sparse_valid)
+        break;
+      fprintf(stderr, "no sparse map for %s, the index needs to be"
+        " recreated\n", member->name);
+      errno = EIO;
+      return -1;
+    case GNUTYPE_DUMPDIR:
+    case DIRTYPE:
+      errno = EISDIR;
+      return -1;
+    default:
+      /* only files have contents */
+      errno = EINVAL;
+      return -1;
+  }
+  
+  size = info.st.st_size;
+  if (off >= size || len == 0)
+    return 0;
+  end = read_end(size, len, off);
+  
+  if (!member->sparse_valid) {
+    if ((reader = get_reader(archive, member, off)) == NULL)
+      return -1;
+    rv = reader_seek(archive, reader, member, &info, off)
+      || reader_read(reader, buf, end - off);
+  } else {
+    struct member_sparse_walk walk;
+    off64_t zeros, pos, n;
+    char *out = buf;
+    member_sparse_start(&walk, &member->sparse, off, end);
+    while (member_sparse_next(&walk, &zeros, &pos, &n)) {
+      memset(out, 0, zeros);
+      out += zeros;
+      if (reader == NULL
+          && (reader = get_reader(archive, member, pos)) == NULL)
+        return -1;
+      if ((rv = reader_seek(archive, reader, member, &info, pos)
+          || reader_read(reader, out, n)) != 0)
+        break;
+      out += n;
+    }
+    if (rv == 0)
+      memset(out, 0, zeros);
+  }
+  
+  if (reader != NULL)
+    put_reader(archive, reader);
+  return rv != 0 ? -1 : end - off;
+}
+
+long long tarix_record_size(const struct tarix_member *member) {
+  return (long long)member->blocklength * TARBLKSZ;
+}
+
+ssize_t tarix_record_pread(struct tarix_archive *archive,
+    const struct tarix_member *member, void *buf, size_t len, long long off) {
+  struct tarix_reader *reader;
+  struct member_info info;
+  off64_t size = tarix_record_size(member), end, pos;
+  int rv;
+  
+  if (off < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (off >= size || len == 0)
+    return 0;
+  end = read_end(size, len, off);
+  /* readers count from the start of the data */
+  if (get_info(archive, member, &info) != 0)
+    return -1;
+  pos = off - (off64_t)info.datablock * TARBLKSZ;
+  
+  if ((reader = get_reader(archive, member, pos)) == NULL)
+    return -1;
+  rv = reader_seek(archive, reader, member, &info, pos)
+    || reader_read(reader, buf, end - off);
+  put_reader(archive, reader);
+  return rv != 0 ? -1 : end - off;
+}
+
+int tarix_member_offsets(struct tarix_archive *archive,
+    const struct tarix_member *member, long long *record, long long *data) {
+  struct member_info info;
+  
+  if (archive->compressed || archive->gzip) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (get_info(archive, member, &info) != 0)
+    return -1;
+  *record = (off64_t)member->blocknum * TARBLKSZ;
+  *data = member->sparse_valid || info.typeflag == GNUTYPE_SPARSE ? -1
+    : *record + (off64_t)info.hdrblocks * TARBLKSZ;
+  return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __LIBTARIX_H__
+#define __LIBTARIX_H__
+
+/* libtarix: random access to the files in an indexed tar archive, for
+ * programs that want more than tarix -x.  An archive is opened with its
+ * index, which is read into memory; lookups and iteration only use that,
+ * and tarix_stat and tarix_member_pread read the archive.  All of them can
+ * be called from any number of threads at once on the same archive.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/* flags for tarix_open */
+/* the archive was compressed by tarix (-z or -C) */
+#define TARIX_OPEN_COMPRESSED 1
+/* the archive is an ordinary gzip file indexed with -Z, its inflate
+ * access points are in the sidecar next to the index */
+#define TARIX_OPEN_GZIP 2
+
+struct tarix_archive;
+struct tarix_member;
+
+/* callback for tarix_foreach, a non-zero return stops the iteration and
+ * is passed back to the caller */
+typedef int (*tarix_member_cb)(const struct tarix_member *member,
+  void *data);
+
+/* Open the archive tarfile, reading its index from indexfile.  Returns
+ * NULL on errors, with errno set if it was a system error.
+ */
+struct tarix_archive *tarix_open(const char *tarfile, const char *indexfile,
+  int flags);
+
+/* Close an archive, freeing its members.  Nothing may be using it. */
+void tarix_close(struct tarix_archive *archive);
+
+/* Find a member by its name in the archive (a directory with or without
+ * the trailing /).  If the archive has more than one member by that name,
+ * the last one is returned, as tar would extract it.  Returns NULL if
+ * there is none.
+ */
+const struct tarix_member *tarix_lookup(struct tarix_archive *archive,
+  const char *path);
+
+/* Call cb for each member whose name starts with prefix (all of them if it
+ * is NULL or empty), in order of name.  Returns 0, or what cb returned if
+ * it stopped early.
+ */
+int tarix_foreach(struct tarix_archive *archive, const char *prefix,
+  tarix_member_cb cb, void *data);
+
+/* Number of members in the archive */
+int tarix_count(const struct tarix_archive *archive);
+
+/* The name of a member, as it is in the index */
+const char *tarix_member_name(const struct tarix_member *member);
+
+/* Fill st from the tar header of member (read the first time it is
+ * needed).  Sparse files have their expanded size.  Returns 0, or -1 with
+ * errno set.
+ */
+int tarix_stat(struct tarix_archive *archive,
+  const struct tarix_member *member, struct stat *st);
+
+/* Read up to len bytes of the contents of member from off, like pread(2).
+ * Holes in sparse files read as zeros.  Returns the number of bytes read,
+ * which is less than len only at the end of the file, or -1 with errno
+ * set: EISDIR for a directory, EINVAL for other members without contents,
+ * and EIO if the archive can't be read.
+ */
+ssize_t tarix_member_pread(struct tarix_archive *archive,
+  const struct tarix_member *member, void *buf, size_t len, long long off);
+
+/* Size of the tar record of member, the headers before it and its data,
+ * as tarix -x passes it through */
+long long tarix_record_size(const struct tarix_member *member);
+
+/* Read up to len bytes of the tar record of member from off, as
+ * tarix_member_pread reads its contents.
+ */
+ssize_t tarix_record_pread(struct tarix_archive *archive,
+  const struct tarix_member *member, void *buf, size_t len, long long off);
+
+/* Where the tar record of member starts in the archive file (*record),
+ * and where its contents do (*data, -1 if they are not stored in one
+ * piece, as for sparse files), for copying them straight from the archive
+ * file.  Returns 0, or -1 with errno set (EINVAL if the archive is
+ * compressed).
+ */
+int tarix_member_offsets(struct tarix_archive *archive,
+  const struct tarix_member *member, long long *record, long long *data);
+
+#endif /* __LIBTARIX_H__ */
@@ -42,7 +42,8 @@ int lineloop(int fd, lineprocessor_t lineprocessor, void *data) {
   char *nlpos;
   
   /* linebufavail - 1: make sure there's room to drop a '\0' in */
-  while ((nread = read(fd, linebuf + rdoff, linebufavail - 1)) > 0) {
+  while (lpret == 0
+      && (nread = read(fd, linebuf + rdoff, linebufavail - 1)) > 0) {
     rdoff += nread;
     linebufavail -= nread;
     linebuf[rdoff] = 0; /* null terminate the input buffer */
@@ -0,0 +1,199 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "member.h"
+#include "tarnum.h"
+
+void member_header_free(struct member_header *mh) {
+  pax_override_free(&mh->po);
+}
+
+int member_read_header(struct member_header *mh, member_read_t readfn,
+    void *data) {
+  union tar_block skip;
+  char *payload, **str;
+  long long size;
+  off64_t padded;
+  int rv;
+  
+  memset(mh, 0, sizeof(*mh));
+  while (1) {
+    if (readfn(data, &mh->hdr, TARBLKSZ) != 0)
+      return MEMBER_ERR_READ;
+    ++mh->hdrblocks;
+    if (mh->hdr.header.typeflag != GNUTYPE_LONGNAME
+        && mh->hdr.header.typeflag != GNUTYPE_LONGLINK
+        && mh->hdr.header.typeflag != XHDTYPE
+        && mh->hdr.header.typeflag != XGLTYPE)
+      break;
+    if (TAR_SIZE(mh->hdr.header.size, &size) != 0
+        || size > MEMBER_PREFIX_MAX)
+      return MEMBER_ERR_CORRUPT;
+    padded = (size + TARBLKSZ - 1) / TARBLKSZ * TARBLKSZ;
+    mh->hdrblocks += padded / TARBLKSZ;
+    /* global values are not used */
+    if (mh->hdr.header.typeflag == XGLTYPE) {
+      for (; padded > 0; padded -= TARBLKSZ)
+        if (readfn(data, &skip, TARBLKSZ) != 0)
+          return MEMBER_ERR_READ;
+      continue;
+    }
+    if ((payload = malloc(padded + 1)) == NULL) {
+      errno = ENOMEM;
+      return MEMBER_ERR_READ;
+    }
+    if (readfn(data, payload, padded) != 0) {
+      free(payload);
+      return MEMBER_ERR_READ;
+    }
+    payload[size] = 0;
+    if (mh->hdr.header.typeflag == XHDTYPE) {
+      rv = pax_parse(payload, size, pax_override_record, &mh->po);
+      free(payload);
+      if (rv != 0)
+        return MEMBER_ERR_CORRUPT;
+    } else {
+      str = mh->hdr.header.typeflag == GNUTYPE_LONGNAME ? &mh->po.path
+        : &mh->po.linkpath;
+      free(*str);
+      *str = payload;
+    }
+  }
+  
+  /* the header's size field is only used where no extended header
+   * replaces it */
+  if (mh->po.have_size)
+    size = mh->po.size;
+  else if (TAR_SIZE(mh->hdr.header.size, &size) != 0)
+    return MEMBER_ERR_CORRUPT;
+  else if (mh->hdr.header.typeflag == GNUTYPE_SPARSE
+      && TAR_SIZE(mh->hdr.oldgnu_header.realsize, &size) != 0)
+    return MEMBER_ERR_CORRUPT;
+  mh->size = size;
+  return 0;
+}
+
+off64_t member_size(const struct member_header *mh, off64_t index_size,
+    const struct sparse_map *sparse) {
+  if (sparse != NULL)
+    return sparse->realsize;
+  /* the header's size field can't hold it when an extended header has
+   * it, and the index has that too */
+  if (index_size >= 0)
+    return index_size;
+  return mh->size;
+}
+
+blknum_t member_data_block(const struct member_header *mh,
+    const struct sparse_map *sparse) {
+  return sparse != NULL ? sparse->datablock : mh->hdrblocks;
+}
+
+void member_stat(const struct member_header *mh, off64_t index_size,
+    const struct sparse_map *sparse, struct stat *st) {
+  const struct posix_header *hdr = &mh->hdr.header;
+  
+  memset(st, 0, sizeof(*st));
+  /* tar doesn't fill in higher bits */
+  st->st_mode = TAR_FIELD(hdr->mode) & 07777;
+  /* hard links and the like have no file type of their own */
+  st->st_mode |= index_type_mode(hdr->typeflag);
+  st->st_nlink = 1;
+  st->st_uid = TAR_FIELD(hdr->uid);
+  st->st_gid = TAR_FIELD(hdr->gid);
+  st->st_size = member_size(mh, index_size, sparse);
+  st->st_mtime = st->st_atime = st->st_ctime
+    = mh->po.have_mtime ? mh->po.mtime : TAR_FIELD(hdr->mtime);
+  /* only what is stored takes up space */
+  st->st_blocks = ((sparse != NULL ? sparse_stored_size(sparse)
+    : st->st_size) + 511) / 512;
+}
+
+int member_seek_point(const struct member_data *md, off64_t pos,
+    off64_t *cur, off64_t *offset) {
+  int known = *cur != MEMBER_POS_NONE && *cur <= pos;
+  const struct index_cp *cp;
+  off64_t cppos;
+  
+  if (known && *cur == pos)
+    return 0;
+  if (!md->compressed) {
+    *offset = md->offset + (off64_t)md->datablock * TARBLKSZ + pos;
+    *cur = pos;
+    return 1;
+  }
+  
+  if ((cp = find_index_cp(md->cps, md->ncps, md->datablock, pos)) != NULL) {
+    cppos = (off64_t)(cp->block - md->datablock) * TARBLKSZ;
+    if (!known || cppos > *cur) {
+      *offset = cp->offset;
+      *cur = cppos;
+      return 1;
+    }
+  }
+  if (!known) {
+    *offset = md->offset;
+    *cur = -(off64_t)md->datablock * TARBLKSZ;
+    return 1;
+  }
+  return 0;
+}
+
+void member_sparse_start(struct member_sparse_walk *walk,
+    const struct sparse_map *map, off64_t pos, off64_t end) {
+  walk->map = map;
+  walk->next = 0;
+  walk->stored = 0;
+  walk->done = pos;
+  walk->end = end;
+}
+
+int member_sparse_next(struct member_sparse_walk *walk, off64_t *zeros,
+    off64_t *stored, off64_t *len) {
+  const struct sparse_map *map = walk->map;
+  
+  for (; walk->next < map->count && walk->done < walk->end;
+      walk->stored += map->extents[walk->next].numbytes, ++walk->next) {
+    const struct sparse_extent *ext = &map->extents[walk->next];
+    off64_t s, e;
+    if (ext->offset + ext->numbytes <= walk->done)
+      continue;
+    if (ext->offset >= walk->end)
+      break;
+    s = ext->offset > walk->done ? ext->offset : walk->done;
+    e = ext->offset + ext->numbytes < walk->end
+      ? ext->offset + ext->numbytes : walk->end;
+    *zeros = s - walk->done;
+    *stored = walk->stored + (s - ext->offset);
+    *len = e - s;
+    walk->done = e;
+    return 1;
+  }
+  *zeros = walk->end - walk->done;
+  walk->done = walk->end;
+  return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#ifndef __MEMBER_H__
+#define __MEMBER_H__
+
+/* Reading a member back out of an archive with the help of its index
+ * entry: the headers at the start of its record, what they say about it,
+ * and where in the record its contents are.  Extracting, libtarix and
+ * fuse_tarix all go through here, each with its own way to read the
+ * archive. */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "index_parser.h"
+#include "pax.h"
+#include "portability.h"
+#include "sparse.h"
+#include "tar.h"
+
+/* no long name or extended header is bigger than this */
+#define MEMBER_PREFIX_MAX (16 << 20)
+
+/* errors from member_read_header */
+#define MEMBER_ERR_READ -1
+#define MEMBER_ERR_CORRUPT -2
+
+/* read exactly len bytes into buf; returns 0, or non-zero (having said
+ * what went wrong) if that couldn't be done */
+typedef int (*member_read_t)(void *data, void *buf, size_t len);
+
+/* the headers at the start of a record */
+struct member_header {
+  /* the member's own header */
+  union tar_block hdr;
+  /* long name and link name records and extended header values before
+   * it; global extended headers are not used */
+  struct pax_override po;
+  /* blocks from the start of the record to the end of hdr */
+  blknum_t hdrblocks;
+  /* the contents' size by the headers: an extended header's, a GNU sparse
+   * member's expanded size, or hdr's size field */
+  off64_t size;
+};
+
+/* Read the headers at the start of a record, through readfn, up to the
+ * member's own one.  The stream is then at the end of hdrblocks.
+ * Returns 0, MEMBER_ERR_READ if read failed, or MEMBER_ERR_CORRUPT if a
+ * header has a size that can't be decoded or is negative, or a header
+ * before the member's is otherwise damaged.  mh has to be freed with
+ * member_header_free either way.
+ */
+int member_read_header(struct member_header *mh, member_read_t readfn,
+  void *data);
+
+void member_header_free(struct member_header *mh);
+
+/* The size of a member's contents: a sparse file's expanded size from its
+ * map (if not NULL), otherwise what the index's metadata record has
+ * (index_size, if >= 0), an extended header, or the header itself.
+ */
+off64_t member_size(const struct member_header *mh, off64_t index_size,
+  const struct sparse_map *sparse);
+
+/* blocks from the start of the record to the first of the stored data */
+blknum_t member_data_block(const struct member_header *mh,
+  const struct sparse_map *sparse);
+
+/* Fill in st from the headers, as member_size has the size, with the file
+ * type bits from index_type_mode (none for hard links and types that
+ * aren't files).  st_ino is left 0.
+ */
+void member_stat(const struct member_header *mh, off64_t index_size,
+  const struct sparse_map *sparse, struct stat *st);
+
+/* where a member's stored data is in the archive */
+struct member_data {
+  /* archive offset of the start of the record, as in the index */
+  off64_t offset;
+  /* offsets are into a compressed stream, not block positions */
+  int compressed;
+  /* blocks from the start of the record to the data */
+  blknum_t datablock;
+  /* checkpoints inside the data */
+  const struct index_cp *cps;
+  int ncps;
+};
+
+/* position in the data of a stream that is not in the member */
+#define MEMBER_POS_NONE (-((off64_t)1 << 62))
+
+/* How to get to position pos of the stored data, with the stream at
+ * position *cur of it (negative in the headers before it), or anywhere
+ * else if *cur is MEMBER_POS_NONE.  Returns 1 if the stream should seek
+ * to the archive offset in *offset, which is position *cur of the data,
+ * or 0 if reading on from *cur is the best there is.  Uncompressed
+ * archives seek right to pos, compressed ones to the checkpoint before
+ * pos if that is ahead of the stream, or to the start of the record if
+ * the stream is past pos or elsewhere.
+ */
+int member_seek_point(const struct member_data *md, off64_t pos,
+  off64_t *cur, off64_t *offset);
+
+/* Walking the part [pos, end) of a sparse file: the holes are zeros and
+ * the extents are read from the stored data, which is the extents back to
+ * back */
+struct member_sparse_walk {
+  const struct sparse_map *map;
+  int next;
+  /* stored bytes before extent next, and the file position reached */
+  off64_t stored;
+  off64_t done;
+  off64_t end;
+};
+
+void member_sparse_start(struct member_sparse_walk *walk,
+  const struct sparse_map *map, off64_t pos, off64_t end);
+
+/* The next piece: *zeros bytes of hole, then *len bytes from position
+ * *stored of the stored data.  Returns 1, or 0 at the end, where *zeros
+ * is the hole up to end that is left.
+ */
+int member_sparse_next(struct member_sparse_walk *walk, off64_t *zeros,
+  off64_t *stored, off64_t *len);
+
+#endif /* __MEMBER_H__ */
@@ -0,0 +1,116 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "pax.h"
+
+/* each record is "<length> <keyword>=<value>\n", where length is the
+ * decimal length of the whole record including itself and the newline */
+
+int pax_parse(char *buf, size_t len, pax_record_t record, void *data) {
+  char *pos = buf;
+  char *end = buf + len;
+  
+  while (pos < end && *pos != 0) {
+    char *kw, *eq, *reclast;
+    unsigned long reclen;
+    int rv;
+    
+    reclen = strtoul(pos, &kw, 10);
+    if (kw == pos || *kw != ' ' || reclen == 0 || reclen > end - pos)
+      return -1;
+    ++kw;
+    reclast = pos + reclen - 1;
+    if (*reclast != '\n')
+      return -1;
+    eq = memchr(kw, '=', reclast - kw);
+    if (eq == NULL)
+      return -1;
+    *eq = 0;
+    *reclast = 0;
+    
+    rv = record(kw, eq + 1, reclast - eq - 1, data);
+    if (rv != 0)
+      return rv;
+    
+    pos += reclen;
+  }
+  
+  return 0;
+}
+
+int pax_override_record(const char *keyword, const char *value,
+    size_t valuelen, void *data) {
+  struct pax_override *po = (struct pax_override*)data;
+  char *end, **str = NULL;
+  
+  if (strcmp(keyword, "size") == 0) {
+    po->size = strtoll(value, &end, 10);
+    if (end == value || *end != 0 || po->size < 0)
+      return -1;
+    po->have_size = 1;
+  } else if (strcmp(keyword, "mtime") == 0) {
+    /* seconds, with an optional fraction after a '.' */
+    po->mtime = strtoll(value, &end, 10);
+    if (end == value)
+      return -1;
+    if (*end == '.') {
+      const char *frac = ++end;
+      int nonzero = 0;
+      for (; *end >= '0' && *end <= '9'; ++end)
+        nonzero |= *end != '0';
+      if (end == frac)
+        return -1;
+      /* round towards the past, as a stat() would */
+      if (nonzero && *value == '-')
+        --po->mtime;
+    }
+    if (*end != 0)
+      return -1;
+    po->have_mtime = 1;
+  } else if (strcmp(keyword, "path") == 0) {
+    str = &po->path;
+  } else if (strcmp(keyword, "linkpath") == 0) {
+    str = &po->linkpath;
+  }
+  
+  if (str != NULL) {
+    free(*str);
+    /* an empty value cancels the keyword */
+    *str = valuelen > 0 ? strdup(value) : NULL;
+    if (valuelen > 0 && *str == NULL)
+      return -1;
+  }
+  return 0;
+}
+
+void pax_override_free(struct pax_override *po) {
+  free(po->path);
+  free(po->linkpath);
+  memset(po, 0, sizeof(*po));
+}
+
+int pax_override_parse(char *buf, size_t len, struct pax_override *po) {
+  pax_override_free(po);
+  return pax_parse(buf, len, pax_override_record, po);
+}
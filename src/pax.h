@@ -0,0 +1,65 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __PAX_H__
+#define __PAX_H__
+
+#include <sys/types.h>
+
+/* Callback for each "keyword=value" record of a POSIX.1-2001 extended
+ * header.  The value is null terminated (the trailing newline is dropped),
+ * but may contain embedded nulls, so its length is passed as well.
+ * A non-zero return stops the parse and is passed back to the caller.
+ */
+typedef int (*pax_record_t)(const char *keyword, const char *value,
+  size_t valuelen, void *data);
+
+/* Walk the records in the extended header payload buf[0..len-1].
+ * The buffer is modified in place.  Returns 0 on success, -1 if the
+ * payload is malformed, or the first non-zero callback return.
+ */
+int pax_parse(char *buf, size_t len, pax_record_t record, void *data);
+
+/* extended header values that stand in for fields of the next member's
+ * header */
+struct pax_override {
+  /* the size, for members too big for the header field */
+  int have_size;
+  long long size;
+  /* whole seconds, the fraction is dropped */
+  int have_mtime;
+  long long mtime;
+  /* malloced, or NULL if not given */
+  char *path;
+  char *linkpath;
+};
+
+/* pax_record_t collecting the keywords of struct pax_override, others are
+ * ignored */
+int pax_override_record(const char *keyword, const char *value,
+  size_t valuelen, void *data);
+
+/* free the strings and forget all values */
+void pax_override_free(struct pax_override *po);
+
+/* parse a whole payload into po, which is cleared first; returns as
+ * pax_parse does */
+int pax_override_parse(char *buf, size_t len, struct pax_override *po);
+
+#endif /* __PAX_H__ */
@@ -19,12 +19,63 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "portability.h"
+
+int p_open(const char *path, int flags, mode_t mode, int direct)
+{
+  int fd;
+  if (direct && P_O_DIRECT != 0)
+  {
+    fd = open(path, flags | P_O_DIRECT, mode);
+    if (fd >= 0 || errno != EINVAL)
+      return fd;
+    fprintf(stderr, "%s: direct i/o not supported, using buffered i/o\n",
+      path);
+  }
+  return open(path, flags, mode);
+}
+
+int p_set_direct(int fd, int on)
+{
+  int flags;
+  if (P_O_DIRECT == 0)
+  {
+    if (!on)
+      return 0;
+    errno = EINVAL;
+    return -1;
+  }
+  if ((flags = fcntl(fd, F_GETFL)) < 0)
+    return -1;
+  flags = on ? (flags | P_O_DIRECT) : (flags & ~P_O_DIRECT);
+  return fcntl(fd, F_SETFL, flags);
+}
+
+int p_get_direct(int fd)
+{
+  int flags = fcntl(fd, F_GETFL);
+  return P_O_DIRECT != 0 && flags >= 0 && (flags & P_O_DIRECT) != 0;
+}
+
+void p_want_direct(int fd, const char *name)
+{
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !(S_ISREG(st.st_mode) || S_ISBLK(st.st_mode)))
+    return;
+  if (p_set_direct(fd, 1) != 0)
+    fprintf(stderr, "%s: direct i/o not supported, using buffered i/o\n",
+      name);
+}
+
 #ifdef HAVE_MTIO_H
 #include <sys/ioctl.h>
 #include <sys/mtio.h>
 
-#include "portability.h"
-
 /* linux defaults to hardware block addresses, so I guess we'll have
  * freebsd use them, since you have to be explicit with freebsd */
 
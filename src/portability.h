@@ -21,6 +21,7 @@
 #define __PORTABILITY_H__
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <limits.h>
 
@@ -28,27 +29,50 @@
 
 #define P_O_LARGEFILE 0
 #define p_lseek64 lseek
+#define p_pread64 pread
 typedef off_t off64_t;
 
 #elif defined(__CYGWIN__)
 
 #define P_O_LARGEFILE 0
 #define p_lseek64 lseek
+#define p_pread64 pread
 typedef off_t off64_t;
 
 #elif defined(__APPLE__)
 
 #define P_O_LARGEFILE 0
 #define p_lseek64 lseek
+#define p_pread64 pread
 typedef off_t off64_t;
 
 #else
 
 #define P_O_LARGEFILE O_LARGEFILE
 #define p_lseek64 lseek64
+#define p_pread64 pread64
 
 #endif
 
+/* O_DIRECT is a linux (and fbsd) thing, elsewhere we just do buffered i/o */
+#ifdef O_DIRECT
+#define P_O_DIRECT O_DIRECT
+#else
+#define P_O_DIRECT 0
+#endif
+
+/* Like open(2), but if direct is set try O_DIRECT first, falling back to
+ * normal i/o (with a warning) if the file system refuses it. */
+int p_open(const char *path, int flags, mode_t mode, int direct);
+/* Turn O_DIRECT on or off for an open fd, returns 0 or -1 and errno. */
+int p_set_direct(int fd, int on);
+/* Returns 1 if fd is open with O_DIRECT, 0 if not. */
+int p_get_direct(int fd);
+/* Turn on O_DIRECT for an already open fd (such as stdout) if it refers to
+ * a regular file or block device, warning about it (using name) if that
+ * fails.  Pipes and the like are left alone. */
+void p_want_direct(int fd, const char *name);
+
 #if HAVE_MTIO_H
 int p_mt_setblk(int fd, int blksz);
 int p_mt_getpos(int fd, off64_t *offset);
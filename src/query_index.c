@@ -0,0 +1,538 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/* tarix -l: list the index entries that match some conditions, from the
+ * index alone */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+
+#include "debug.h"
+#include "index_parser.h"
+#include "tar.h"
+#include "tarix.h"
+
+/* the index is cut into chunks of about this much text, which threads
+ * work through in parallel */
+#define QUERY_CHUNK (1 << 20)
+
+/* what entries have to be like to be listed */
+struct query {
+  /* type letters (f d l h c b p ?) allowed, all if empty */
+  char types[16];
+  /* bounds, inclusive */
+  long long size_min, size_max;
+  long long mtime_min, mtime_max;
+  /* -1 for any */
+  long long uid, gid;
+  /* set if any condition needs the #:st records */
+  int needs_st;
+};
+
+struct query_chunk {
+  const char *start, *end;
+  /* the output, and the entries that had no metadata to check */
+  char *out;
+  size_t outlen;
+  unsigned long missing_st;
+  int done;
+  int error;
+};
+
+struct query_state {
+  struct query q;
+  int list_level;
+  struct match_options match;
+  const struct files_list_state *files_list;
+  struct index_parser_state ipstate;
+  struct query_chunk *chunks;
+  int nchunks;
+  /* the next chunk to work on, and chunks are marked done, under lock */
+  int next;
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+};
+
+/* an entry whose extension records are still to come */
+struct query_entry {
+  char type;
+  blknum_t blocknum;
+  off64_t offset;
+  char *name;
+  size_t namesz;
+  int st_valid;
+  struct index_st st;
+};
+
+/* the letter for the type of an entry, as in find -type (h for hard
+ * links) */
+static char type_letter(char typeflag) {
+  mode_t mode = index_type_mode(typeflag);
+  
+  if (typeflag == LNKTYPE)
+    return 'h';
+  if (S_ISREG(mode))
+    return 'f';
+  if (S_ISDIR(mode))
+    return 'd';
+  if (S_ISLNK(mode))
+    return 'l';
+  if (S_ISCHR(mode))
+    return 'c';
+  if (S_ISBLK(mode))
+    return 'b';
+  if (S_ISFIFO(mode))
+    return 'p';
+  return '?';
+}
+
+/* a size with an optional k, M, G or T suffix */
+static int parse_query_size(const char *arg, long long *size) {
+  char *end;
+  
+  *size = strtoll(arg, &end, 10);
+  if (end == arg || *size < 0)
+    return -1;
+  switch (*end) {
+    case 'T': case 't':
+      *size <<= 10;
+      /* fall through */
+    case 'G': case 'g':
+      *size <<= 10;
+      /* fall through */
+    case 'M': case 'm':
+      *size <<= 10;
+      /* fall through */
+    case 'K': case 'k':
+      *size <<= 10;
+      ++end;
+  }
+  return *end == 0 ? 0 : -1;
+}
+
+/* a time as @<seconds>, or a local YYYY-MM-DD with an optional HH:MM[:SS]
+ * after a space or T */
+static int parse_query_time(const char *arg, long long *t) {
+  struct tm tm;
+  const char *end;
+  char *numend;
+  
+  if (*arg == '@') {
+    *t = strtoll(arg + 1, &numend, 10);
+    return numend == arg + 1 || *numend != 0 ? -1 : 0;
+  }
+  memset(&tm, 0, sizeof(tm));
+  if ((end = strptime(arg, "%Y-%m-%d", &tm)) == NULL)
+    return -1;
+  if ((*end == ' ' || *end == 'T') && end[1] != 0) {
+    const char *tend = strptime(end + 1, "%H:%M:%S", &tm);
+    if (tend == NULL)
+      tend = strptime(end + 1, "%H:%M", &tm);
+    end = tend;
+  }
+  if (end == NULL || *end != 0)
+    return -1;
+  tm.tm_isdst = -1;
+  *t = mktime(&tm);
+  return 0;
+}
+
+/* apply a comparison (=, <, <=, >, >=) with value to the bounds */
+static void set_bounds(const char *op, long long value, long long *min,
+    long long *max) {
+  if (op[0] == '<')
+    *max = op[1] == '=' ? value : value - 1;
+  else if (op[0] == '>')
+    *min = op[1] == '=' ? value : value + 1;
+  else
+    *min = *max = value;
+}
+
+/* Parse a query: comma separated conditions that must all hold, each a
+ * key, a comparison and a value.  Returns 0, or -1 with a message. */
+static int parse_query(const char *text, struct query *q) {
+  char *copy, *cond, *saveptr = NULL;
+  
+  memset(q, 0, sizeof(*q));
+  q->size_min = q->mtime_min = LLONG_MIN;
+  q->size_max = q->mtime_max = LLONG_MAX;
+  q->uid = q->gid = -1;
+  if (text == NULL)
+    return 0;
+  
+  copy = strdup(text);
+  for (cond = strtok_r(copy, ",", &saveptr); cond != NULL;
+      cond = strtok_r(NULL, ",", &saveptr)) {
+    size_t keylen = strcspn(cond, "=<>");
+    char *op = cond + keylen, *value, *end;
+    long long n;
+    value = op + (op[0] != '=' && op[0] != 0 && op[1] == '=' ? 2 : 1);
+    if (*op == 0) {
+      /* no comparison */
+    } else if (keylen == 4 && strncmp(cond, "type", 4) == 0 && *op == '='
+        && *value != 0 && strlen(value) < sizeof(q->types)
+        && strspn(value, "fdlhcbp?") == strlen(value)) {
+      strcpy(q->types, value);
+      continue;
+    } else if (keylen == 4 && strncmp(cond, "size", 4) == 0
+        && parse_query_size(value, &n) == 0) {
+      set_bounds(op, n, &q->size_min, &q->size_max);
+      q->needs_st = 1;
+      continue;
+    } else if (keylen == 5 && strncmp(cond, "mtime", 5) == 0
+        && parse_query_time(value, &n) == 0) {
+      set_bounds(op, n, &q->mtime_min, &q->mtime_max);
+      q->needs_st = 1;
+      continue;
+    } else if (keylen == 3 && (strncmp(cond, "uid", 3) == 0
+        || strncmp(cond, "gid", 3) == 0) && *op == '=') {
+      n = strtoll(value, &end, 10);
+      if (end != value && *end == 0 && n >= 0) {
+        *(cond[0] == 'u' ? &q->uid : &q->gid) = n;
+        q->needs_st = 1;
+        continue;
+      }
+    }
+    fprintf(stderr, "Invalid query condition '%s'\n", cond);
+    free(copy);
+    return -1;
+  }
+  free(copy);
+  return 0;
+}
+
+/* whether the entry matches the query, -1 if it can't be told without
+ * metadata the index doesn't have */
+static int query_match(const struct query *q, const struct query_entry *e) {
+  if (q->types[0] != 0 && strchr(q->types, type_letter(e->type)) == NULL)
+    return 0;
+  if (!q->needs_st)
+    return 1;
+  if (!e->st_valid)
+    return -1;
+  return e->st.size >= q->size_min && e->st.size <= q->size_max
+    && e->st.mtime >= q->mtime_min && e->st.mtime <= q->mtime_max
+    && (q->uid < 0 || e->st.uid == q->uid)
+    && (q->gid < 0 || e->st.gid == q->gid);
+}
+
+/* like tar -tv, with numeric owners */
+static void print_long(FILE *out, const struct query_entry *e) {
+  static const char rwx[] = "rwxrwxrwx";
+  char mode[11], when[32];
+  char letter = type_letter(e->type);
+  int i;
+  
+  mode[0] = letter == 'f' ? '-' : letter;
+  if (!e->st_valid) {
+    fprintf(out, "%c????????? ?/? %10s %16s %s\n", mode[0], "?", "?",
+      e->name);
+    return;
+  }
+  for (i = 0; i < 9; ++i)
+    mode[i + 1] = e->st.mode & (0400 >> i) ? rwx[i] : '-';
+  if (e->st.mode & 04000)
+    mode[3] = mode[3] == 'x' ? 's' : 'S';
+  if (e->st.mode & 02000)
+    mode[6] = mode[6] == 'x' ? 's' : 'S';
+  if (e->st.mode & 01000)
+    mode[9] = mode[9] == 'x' ? 't' : 'T';
+  mode[10] = 0;
+  {
+    time_t t = e->st.mtime;
+    struct tm tm;
+    if (localtime_r(&t, &tm) == NULL
+        || strftime(when, sizeof(when), "%Y-%m-%d %H:%M", &tm) == 0)
+      snprintf(when, sizeof(when), "@%lld", e->st.mtime);
+  }
+  fprintf(out, "%s %lu/%lu %10lld %16s %s\n", mode, e->st.uid, e->st.gid,
+    (long long)e->st.size, when, e->name);
+}
+
+/* tab separated: type, mode, uid, gid, size, mtime, block, offset, name,
+ * with - for what the index doesn't know */
+static void print_fields(FILE *out, const struct query_entry *e) {
+  if (e->st_valid)
+    fprintf(out, "%c\t%o\t%lu\t%lu\t%lld\t%lld\t", type_letter(e->type),
+      e->st.mode, e->st.uid, e->st.gid, (long long)e->st.size, e->st.mtime);
+  else
+    fprintf(out, "%c\t-\t-\t-\t-\t-\t", type_letter(e->type));
+  fprintf(out, "%" PRIu64 "\t%lld\t%s\n", e->blocknum, (long long)e->offset,
+    e->name);
+}
+
+static int query_entry_done(struct query_state *qs,
+    struct query_chunk *chunk, FILE *out, const struct query_entry *e) {
+  int rv;
+  
+  if ((rv = files_list_match(qs->files_list, e->name, qs->match.glob_flags,
+      qs->match.exact_match)) < 0)
+    return -1;
+  if (qs->files_list->argc > 0 && rv == qs->match.exclude_mode)
+    return 0;
+  if ((rv = query_match(&qs->q, e)) < 0)
+    ++chunk->missing_st;
+  if (rv <= 0)
+    return 0;
+  if (qs->list_level > 1)
+    print_fields(out, e);
+  else
+    print_long(out, e);
+  return 0;
+}
+
+/* list the matching entries of a chunk of the index into its output */
+static int query_chunk(struct query_state *qs, struct query_chunk *chunk) {
+  struct index_parser_state ipstate = qs->ipstate;
+  struct index_entry entry;
+  struct query_entry e;
+  const char *pos, *nl;
+  char *line = NULL;
+  size_t linesz = 0;
+  int have_entry = 0, rv = 0;
+  FILE *out;
+  
+  if ((out = open_memstream(&chunk->out, &chunk->outlen)) == NULL) {
+    perror("open_memstream");
+    return -1;
+  }
+  memset(&entry, 0, sizeof(entry));
+  memset(&e, 0, sizeof(e));
+  for (pos = chunk->start; pos < chunk->end && rv == 0; pos = nl + 1) {
+    size_t len;
+    if ((nl = memchr(pos, '\n', chunk->end - pos)) == NULL)
+      nl = chunk->end;
+    len = nl - pos;
+    if (len + 1 > linesz) {
+      linesz = (len + 1) * 2;
+      line = realloc(line, linesz);
+    }
+    memcpy(line, pos, len);
+    line[len] = 0;
+    
+    switch (parse_index_line(&ipstate, line, &entry)) {
+      case 0:
+        if (have_entry)
+          rv = query_entry_done(qs, chunk, out, &e);
+        /* extended headers are part of the member after them */
+        have_entry = entry.recordtype != XHDTYPE
+          && entry.recordtype != XGLTYPE;
+        if (!have_entry)
+          break;
+        if (strlen(entry.filename) + 1 > e.namesz) {
+          e.namesz = strlen(entry.filename) + 1;
+          e.name = realloc(e.name, e.namesz);
+        }
+        strcpy(e.name, entry.filename);
+        e.type = entry.recordtype;
+        e.blocknum = entry.blocknum;
+        e.offset = entry.offset;
+        e.st_valid = 0;
+        break;
+      case 2:
+        if (have_entry && !e.st_valid) {
+          int strv = parse_index_st(entry.filename, &e.st);
+          if (strv < 0) {
+            fprintf(stderr, "bad extension record: %s\n", line);
+            rv = -1;
+          }
+          e.st_valid = strv == 0;
+        }
+        break;
+      case 1:
+        break;
+      default:
+        rv = -1;
+        break;
+    }
+  }
+  if (have_entry && rv == 0)
+    rv = query_entry_done(qs, chunk, out, &e);
+  
+  free(line);
+  free(e.name);
+  fclose(out);
+  return rv;
+}
+
+static void *query_thread(void *data) {
+  struct query_state *qs = (struct query_state*)data;
+  
+  while (1) {
+    struct query_chunk *chunk;
+    int rv;
+    pthread_mutex_lock(&qs->lock);
+    if (qs->next == qs->nchunks) {
+      pthread_mutex_unlock(&qs->lock);
+      return NULL;
+    }
+    chunk = &qs->chunks[qs->next++];
+    pthread_mutex_unlock(&qs->lock);
+    
+    rv = query_chunk(qs, chunk);
+    
+    pthread_mutex_lock(&qs->lock);
+    chunk->error = rv != 0;
+    chunk->done = 1;
+    pthread_cond_broadcast(&qs->done);
+    pthread_mutex_unlock(&qs->lock);
+  }
+}
+
+/* cut the text from start to end into chunks, each starting at an index
+ * line (not an extension record, which belongs with the line before) */
+static int make_chunks(struct query_state *qs, const char *start,
+    const char *end) {
+  int size = 0;
+  
+  while (start < end) {
+    const char *cut = end - start > QUERY_CHUNK ? start + QUERY_CHUNK : end;
+    while (cut < end) {
+      const char *nl = memchr(cut, '\n', end - cut);
+      cut = nl != NULL ? nl + 1 : end;
+      if ((size_t)(end - cut) < strlen(INDEX_EXT_PREFIX)
+          || strncmp(cut, INDEX_EXT_PREFIX, strlen(INDEX_EXT_PREFIX)) != 0)
+        break;
+    }
+    if (qs->nchunks == size) {
+      size = size ? size * 2 : 64;
+      qs->chunks = realloc(qs->chunks, size * sizeof(*qs->chunks));
+      if (qs->chunks == NULL) {
+        perror("allocate chunks");
+        return -1;
+      }
+    }
+    memset(&qs->chunks[qs->nchunks], 0, sizeof(*qs->chunks));
+    qs->chunks[qs->nchunks].start = start;
+    qs->chunks[qs->nchunks].end = cut;
+    ++qs->nchunks;
+    start = cut;
+  }
+  return 0;
+}
+
+int query_index(const char *indexfile, const struct query_options *opts,
+    const struct files_list_state *files_list) {
+  int debug_messages = opts->debug_messages;
+  int jobs = opts->jobs;
+  struct query_state qs;
+  pthread_t *threads;
+  unsigned long missing_st = 0;
+  const char *text, *nl;
+  char *header;
+  struct stat st;
+  int fd, i, nthreads, rv = 0;
+  
+  memset(&qs, 0, sizeof(qs));
+  if (parse_query(opts->query, &qs.q) != 0)
+    return 1;
+  qs.list_level = opts->list_level;
+  qs.match = opts->match;
+  qs.files_list = files_list;
+  
+  if ((fd = open(indexfile, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+    perror("open indexfile");
+    return 1;
+  }
+  if (st.st_size == 0 || (text = mmap(NULL, st.st_size, PROT_READ,
+      MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+    fprintf(stderr, "Cannot map index file: %s\n", st.st_size == 0
+      ? "empty" : strerror(errno));
+    close(fd);
+    return 1;
+  }
+  close(fd);
+  
+  /* the header line, then the entries */
+  if ((nl = memchr(text, '\n', st.st_size)) == NULL)
+    nl = text + st.st_size;
+  header = strndup(text, nl - text);
+  rv = init_index_parser(&qs.ipstate, header);
+  free(header);
+  qs.ipstate.allocate_filename = 0;
+  if (rv != 0 || make_chunks(&qs, nl + (nl < text + st.st_size),
+      text + st.st_size) != 0) {
+    munmap((void*)text, st.st_size);
+    return 1;
+  }
+  
+  if (jobs <= 0)
+    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  nthreads = jobs < qs.nchunks ? jobs : qs.nchunks;
+  if (nthreads < 1)
+    nthreads = 1;
+  DMSG("querying %d chunks with %d threads\n", qs.nchunks, nthreads);
+  pthread_mutex_init(&qs.lock, NULL);
+  pthread_cond_init(&qs.done, NULL);
+  threads = calloc(nthreads, sizeof(*threads));
+  for (i = 0; i < nthreads; ++i)
+    if (pthread_create(&threads[i], NULL, query_thread, &qs) != 0) {
+      perror("pthread_create");
+      nthreads = i;
+      /* the threads there are will do all the work */
+      break;
+    }
+  if (nthreads == 0)
+    query_thread(&qs);
+  
+  /* output goes out in order, as soon as each chunk is done */
+  for (i = 0; i < qs.nchunks; ++i) {
+    struct query_chunk *chunk = &qs.chunks[i];
+    pthread_mutex_lock(&qs.lock);
+    while (!chunk->done)
+      pthread_cond_wait(&qs.done, &qs.lock);
+    pthread_mutex_unlock(&qs.lock);
+    if (chunk->error)
+      rv = 1;
+    if (rv == 0 && chunk->outlen > 0
+        && fwrite(chunk->out, 1, chunk->outlen, stdout) < chunk->outlen) {
+      perror("write output");
+      rv = 1;
+    }
+    missing_st += chunk->missing_st;
+    free(chunk->out);
+  }
+  for (i = 0; i < nthreads; ++i)
+    pthread_join(threads[i], NULL);
+  free(threads);
+  pthread_cond_destroy(&qs.done);
+  pthread_mutex_destroy(&qs.lock);
+  free(qs.chunks);
+  munmap((void*)text, st.st_size);
+  
+  if (missing_st > 0)
+    fprintf(stderr, "%lu entries have no metadata in the index to check,"
+      " it needs to be recreated\n", missing_st);
+  if (fflush(stdout) != 0)
+    rv = 1;
+  return rv;
+}
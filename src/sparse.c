@@ -0,0 +1,224 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "index_parser.h"
+#include "sparse.h"
+#include "tarnum.h"
+
+void sparse_init(struct sparse_map *map) {
+  memset(map, 0, sizeof(*map));
+}
+
+void sparse_free(struct sparse_map *map) {
+  free(map->extents);
+  sparse_init(map);
+}
+
+int sparse_add(struct sparse_map *map, off64_t offset, off64_t numbytes) {
+  if (offset < 0 || numbytes < 0)
+    return -1;
+  if (map->count > 0) {
+    struct sparse_extent *last = &map->extents[map->count - 1];
+    if (offset < last->offset + last->numbytes)
+      return -1;
+  }
+  if (map->count == map->alloc) {
+    map->alloc = map->alloc ? map->alloc * 2 : 16;
+    map->extents = realloc(map->extents,
+      map->alloc * sizeof(struct sparse_extent));
+  }
+  map->extents[map->count].offset = offset;
+  map->extents[map->count].numbytes = numbytes;
+  ++map->count;
+  return 0;
+}
+
+int sparse_add_gnu(struct sparse_map *map, const struct sparse *sp, int nsp) {
+  long long offset, numbytes;
+  int i;
+  for (i = 0; i < nsp; ++i) {
+    /* an empty slot ends the list */
+    if (sp[i].offset[0] == 0)
+      break;
+    if (TAR_SIZE(sp[i].offset, &offset) != 0
+        || TAR_SIZE(sp[i].numbytes, &numbytes) != 0
+        || sparse_add(map, offset, numbytes) != 0)
+      return -1;
+  }
+  return 0;
+}
+
+/* the 1.0 map is newline terminated decimals: a count, then that many
+ * offset/size pairs, padded with nulls to a block boundary */
+int sparse_parse_map10(struct sparse_map *map, const char *buf, size_t len,
+    size_t *used) {
+  const char *pos = buf;
+  const char *end = buf + len;
+  unsigned long long nums[2];
+  long long count = -1;
+  int nnum = 0;
+  
+  map->count = 0;
+  while (count < 0 || map->count < count) {
+    char *numend;
+    const char *nl = memchr(pos, '\n', end - pos);
+    if (nl == NULL)
+      /* map continues in the next block */
+      return 0;
+    nums[nnum] = strtoull(pos, &numend, 10);
+    if (numend != nl)
+      return -1;
+    pos = nl + 1;
+    if (count < 0) {
+      count = nums[0];
+      continue;
+    }
+    if (++nnum == 2) {
+      if (sparse_add(map, nums[0], nums[1]) != 0)
+        return -1;
+      nnum = 0;
+    }
+  }
+  
+  *used = pos - buf;
+  return 1;
+}
+
+int sparse_pax_record(const char *keyword, const char *value,
+    size_t valuelen, void *data) {
+  struct sparse_pax *sp = (struct sparse_pax*)data;
+  
+  if (strncmp(keyword, "GNU.sparse.", 11) != 0)
+    return 0;
+  keyword += 11;
+  sp->seen = 1;
+  
+  if (strcmp(keyword, "major") == 0) {
+    sp->major = atoi(value);
+  } else if (strcmp(keyword, "minor") == 0) {
+    sp->minor = atoi(value);
+  } else if (strcmp(keyword, "name") == 0) {
+    free(sp->name);
+    sp->name = strdup(value);
+  } else if (strcmp(keyword, "size") == 0
+      || strcmp(keyword, "realsize") == 0) {
+    sp->map.realsize = strtoull(value, NULL, 10);
+  } else if (strcmp(keyword, "offset") == 0) {
+    /* 0.0 format */
+    sp->pending_offset = strtoull(value, NULL, 10);
+    sp->have_offset = 1;
+  } else if (strcmp(keyword, "numbytes") == 0) {
+    if (!sp->have_offset)
+      return -1;
+    if (sparse_add(&sp->map, sp->pending_offset,
+        strtoull(value, NULL, 10)) != 0)
+      return -1;
+    sp->have_offset = 0;
+  } else if (strcmp(keyword, "map") == 0) {
+    /* 0.1 format: offset,size,offset,size,... */
+    const char *pos = value;
+    while (*pos != 0) {
+      char *numend;
+      off64_t offset, numbytes;
+      offset = strtoull(pos, &numend, 10);
+      if (*numend != ',')
+        return -1;
+      pos = numend + 1;
+      numbytes = strtoull(pos, &numend, 10);
+      if (*numend != ',' && *numend != 0)
+        return -1;
+      if (sparse_add(&sp->map, offset, numbytes) != 0)
+        return -1;
+      pos = *numend ? numend + 1 : numend;
+    }
+  }
+  /* numblocks is implied by the map */
+  
+  return 0;
+}
+
+void sparse_pax_free(struct sparse_pax *sp) {
+  free(sp->name);
+  sparse_free(&sp->map);
+  memset(sp, 0, sizeof(*sp));
+}
+
+int sparse_write_ext(FILE *indexf, const struct sparse_map *map) {
+  int i;
+  if (fprintf(indexf, INDEX_EXT_PREFIX SPARSE_EXT_KEYWORD " %lld %" PRIu64
+      " %d", (long long)map->realsize, map->datablock, map->count) < 0)
+    return -1;
+  for (i = 0; i < map->count; ++i)
+    if (fprintf(indexf, " %lld %lld", (long long)map->extents[i].offset,
+        (long long)map->extents[i].numbytes) < 0)
+      return -1;
+  return fputc('\n', indexf) == EOF ? -1 : 0;
+}
+
+int sparse_parse_ext(const char *text, struct sparse_map *map) {
+  const char *pos;
+  char *numend;
+  long long realsize, offset, numbytes;
+  blknum_t datablock;
+  long count, i;
+  
+  if (strncmp(text, SPARSE_EXT_KEYWORD " ", strlen(SPARSE_EXT_KEYWORD) + 1))
+    return 1;
+  pos = text + strlen(SPARSE_EXT_KEYWORD) + 1;
+  
+  realsize = strtoll(pos, &numend, 10);
+  if (numend == pos)
+    return -1;
+  datablock = strtoull(pos = numend, &numend, 10);
+  if (numend == pos)
+    return -1;
+  count = strtol(pos = numend, &numend, 10);
+  if (numend == pos || count < 0)
+    return -1;
+  
+  sparse_free(map);
+  map->realsize = realsize;
+  map->datablock = datablock;
+  for (i = 0; i < count; ++i) {
+    offset = strtoll(pos = numend, &numend, 10);
+    if (numend == pos)
+      return -1;
+    numbytes = strtoll(pos = numend, &numend, 10);
+    if (numend == pos)
+      return -1;
+    if (sparse_add(map, offset, numbytes) != 0)
+      return -1;
+  }
+  
+  return 0;
+}
+
+off64_t sparse_stored_size(const struct sparse_map *map) {
+  off64_t total = 0;
+  int i;
+  for (i = 0; i < map->count; ++i)
+    total += map->extents[i].numbytes;
+  return total;
+}
@@ -0,0 +1,105 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __SPARSE_H__
+#define __SPARSE_H__
+
+/* GNU sparse file maps: parsing them out of archives and carrying them
+ * through the index */
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "index_parser.h"
+#include "portability.h"
+#include "tar.h"
+
+/* keyword for the sparse map extension record in the index */
+#define SPARSE_EXT_KEYWORD "sparse"
+
+struct sparse_extent {
+  /* offset of the data in the expanded file */
+  off64_t offset;
+  /* length of the data, everything between extents is a hole */
+  off64_t numbytes;
+};
+
+struct sparse_map {
+  /* size of the expanded file */
+  off64_t realsize;
+  /* number of 512 blocks from the start of the index record to the first
+   * byte of stored data (skips LONG*, headers and any sparse maps) */
+  blknum_t datablock;
+  int count;
+  int alloc;
+  struct sparse_extent *extents;
+};
+
+/* GNU.sparse.* values collected from PAX extended headers */
+struct sparse_pax {
+  /* non-zero once any GNU.sparse keyword has been seen */
+  int seen;
+  int major;
+  int minor;
+  char *name;
+  /* 0.0 sends offsets and sizes as separate records */
+  off64_t pending_offset;
+  int have_offset;
+  struct sparse_map map;
+};
+
+void sparse_init(struct sparse_map *map);
+void sparse_free(struct sparse_map *map);
+
+/* Append an extent, returns 0 on success, -1 if out of order */
+int sparse_add(struct sparse_map *map, off64_t offset, off64_t numbytes);
+
+/* Append the extents from an old GNU header or extension header.  Stops at
+ * the first unused slot.  Returns 0 on success, -1 on error.
+ */
+int sparse_add_gnu(struct sparse_map *map, const struct sparse *sp, int nsp);
+
+/* Parse the map at the start of the data of a PAX 1.0 sparse member.
+ * Returns 1 when the map is complete, with the number of bytes it
+ * used (not rounded to blocks) in *used, 0 if more data is needed, or -1
+ * on a malformed map.
+ */
+int sparse_parse_map10(struct sparse_map *map, const char *buf, size_t len,
+  size_t *used);
+
+/* pax_record_t callback collecting GNU.sparse.* keywords into a
+ * struct sparse_pax, other keywords are ignored */
+int sparse_pax_record(const char *keyword, const char *value,
+  size_t valuelen, void *data);
+
+void sparse_pax_free(struct sparse_pax *sp);
+
+/* Write the extension record for map to the index */
+int sparse_write_ext(FILE *indexf, const struct sparse_map *map);
+
+/* Parse the text of an extension record (after the "#:" marker).  Returns
+ * 0 on success, 1 if it is not a sparse record, -1 on errors.
+ */
+int sparse_parse_ext(const char *text, struct sparse_map *map);
+
+/* Sum of the stored (non-hole) bytes */
+off64_t sparse_stored_size(const struct sparse_map *map);
+
+#endif /* __SPARSE_H__ */
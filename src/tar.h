@@ -22,6 +22,9 @@
 
 /* This file is mostly copied from the GNU tar source */
 
+#include <stddef.h>
+#include <string.h>
+
 #define TARBLKSZ 512
 
 #define TMAGIC   "ustar"        /* ustar and a null */
@@ -54,6 +57,9 @@
 #define GNUTYPE_VOLHDR 'V'
 /* Solaris extended header */
 #define SOLARIS_XHDTYPE 'X'
+/* POSIX.1-2001 extended headers */
+#define XHDTYPE  'x'            /* Extended header referring to the next file */
+#define XGLTYPE  'g'            /* Global extended header */
 
 
 /* Bits used in the mode field, values in octal.  */
@@ -92,10 +98,54 @@ struct posix_header
                                 /* 500 */
 };
 
+/* old GNU format, used for sparse files */
+struct sparse
+{                               /* byte offset */
+  char offset[12];              /*   0 */
+  char numbytes[12];            /*  12 */
+                                /*  24 */
+};
+
+#define SPARSES_IN_OLDGNU_HEADER 4
+#define SPARSES_IN_SPARSE_HEADER 21
+
+struct oldgnu_header
+{                               /* byte offset */
+  char unused_pad1[345];        /*   0 */
+  char atime[12];               /* 345 Incr. archive: atime of the file */
+  char ctime[12];               /* 357 Incr. archive: ctime of the file */
+  char offset[12];              /* 369 Multivolume archive: the offset of
+                                   the start of this volume */
+  char longnames[4];            /* 381 Not used */
+  char unused_pad2;             /* 385 */
+  struct sparse sp[SPARSES_IN_OLDGNU_HEADER];
+                                /* 386 */
+  char isextended;              /* 482 Sparse file: Extension sparse header
+                                   follows */
+  char realsize[12];            /* 483 Sparse file: Real size*/
+                                /* 495 */
+};
+
+/* sparse extension header, follows an oldgnu_header with isextended set */
+struct sparse_header
+{                               /* byte offset */
+  struct sparse sp[SPARSES_IN_SPARSE_HEADER];
+                                /*   0 */
+  char isextended;              /* 504 */
+                                /* 505 */
+};
+
 union tar_block
 {
   char buffer[TARBLKSZ];
   struct posix_header header;
+  struct oldgnu_header oldgnu_header;
+  struct sparse_header sparse_header;
 };
 
+/* the old GNU magic runs over into the version field, so it has to be
+ * compared against the raw block */
+#define IS_OLDGNU_HEADER(blk) (memcmp((blk)->buffer \
+  + offsetof(struct posix_header, magic), OLDGNU_MAGIC, OLDGNU_MAGLEN) == 0)
+
 #endif /* __TAR_H__ */
@@ -22,12 +22,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <fnmatch.h>
+#include <limits.h>
 
 #include "config.h"
 
 #include "tarix.h"
+#include "tstream.h"
 
-#define OPTSTR_BASE "adeghHinxzf:t:o:T:123456789"
+#define OPTSTR_BASE "aAcdeghHilnORxzZb:f:j:k:q:r:t:o:B:C:D:P:T:123456789"
 #ifdef FNM_LEADING_DIR
 #define OPTSTR_FNM "G"
 #else
@@ -43,31 +45,35 @@
 
 int show_help(int long_help) {
   fprintf(stdout, "%s",
-    "Usage: tarix [-aeghHinxz" OPTSTR_FNM OPTSTR_MT "] [-<n>] [-f index_file] \n"
-    "       [-t tarfile] [-o outfile] [-T list_file] [<filenames>]\n"
-    "  -h   Show short help\n"
-    "  -H   Show long help\n"
+    "Usage: tarix [-aAceghHilnORxzZ" OPTSTR_FNM OPTSTR_MT "] [-<n>] [-f index_file] [-q query]\n"
+    "       [-t tarfile] [-o outfile] [-T list_file] [-b bufsize] [-j jobs]\n"
+    "       [-B member_size] [-C codec] [-D dict_file] [-k interval] [-r off:len]\n"
+    "       [-P interval] [<filenames>]\n"
+    "  -h   Show short help (-H: long help)\n"
     "  -i   Explicitly create index, don't pass tar data to stdout\n"
+    "  -A   Add what was appended to the (uncompressed) tar file to its index\n"
+    "  -R   Resume creating an archive (-o) from the last -P progress point\n"
     "  -z   Enable zlib (de)compression (default off)\n"
     "  -x   Use index to extract tar file\n"
+    "  -l   List index entries (-ll: tab separated), matching -q conditions\n"
     "  -<n> Set zlib compression level (default 3, same meaning as gzip)\n"
     "  -f   Set index file to use (else $TARIX_OUTFILE or out.tarix)\n"
     "  -t   Set tar file to use (otherwise stdin)\n"
-    "  -o   (use with -x) Set tar file to write, otherwise stdout\n"
+    "  -o   Set the archive (or with -x tar file) to write, otherwise stdout\n"
     "  -T   (use with -x) Read the list of files to be extracted from list file\n"
-    "  -a   (use with -x) Filenames to extract must match exactly the files in\n"
-    "       index, not the start\n"
-    "  -n   (use with -T) Filenames from list file are separated by null characters,\n"
-    "       not by newlines\n"
+    "  -a   (use with -x) Filenames must match index names exactly, not the start\n"
+    "  -c   (use with -x) Write just the contents of files, or with -r a range\n"
+    "  -n   (use with -T) Names in list file are separated by nulls, not newlines\n"
 #ifdef HAVE_MTIO_H
     "  -m   Use mt (magnetic tape) IOCTLs for seeking instead of lseek\n"
 #endif
     "  -g   Interpret <filenames> as globs matching exact names\n"
 #ifdef FNM_LEADING_DIR /* FNM_LEADING_DIR is a GNU extension */
-    "  -G   Interpret <filenames> as globs matching exact names,\n"
-    "       or matching a directory name to get it and all its contents\n"
+    "  -G   As -g, but a directory name also gets all its contents\n"
 #endif
     "  -e   Interpret <filenames> as items to exclude, instead of include\n"
+    "  -b   Set the archive i/o buffer size, k and M suffixes allowed (default 10k)\n"
+    "  -O   Use direct i/o (O_DIRECT) for archive files, bypassing the page cache\n"
   );
   if (long_help) fprintf(stdout, "%s",
     "\n"
@@ -79,21 +85,156 @@ int show_help(int long_help) {
     "option.\n"
     "\n"
     "An archive created with zlib must be extracted thus too.\n"
-    "A zlib'd archive will be readable with gunzip, but an archive\n"
-    "compressed with gzip will not be readable by tarix\n"
+    "A zlib'd archive will be readable with gunzip.  An archive compressed\n"
+    "by gzip itself doesn't have the seek points tarix puts in, but -Z\n"
+    "indexes it all the same (see below)\n"
     "\n"
     "If extracting an indexed archive (-x), then a list of file or directory\n"
     "names can be passed as arguments, and will be used to restrict the items\n"
     "extracted, similar to how tar -x processes arguments\n"
+    "\n"
+    "Big buffers (-b 4M) make for fewer, larger reads and writes, which suits\n"
+    "fast disks and network storage.  With -O the archive (and the extract\n"
+    "output) is read and written with O_DIRECT where the file system supports\n"
+    "it, so that streaming a huge archive does not churn the page cache.\n"
+    "\n"
+    "With -Z the tar file is an ordinary gzip file (a .tar.gz from anywhere).\n"
+    "Creating an index decompresses it once, and saves points where inflate\n"
+    "can be restarted in <index_file>.gzap next to the index.  -x -Z uses\n"
+    "those to get to a file with at most about 1M of decompression.\n"
+    "\n"
+    "With -i, -j <n> indexes an existing uncompressed archive file with n\n"
+    "threads, each scanning a part of the archive for headers.  The index is\n"
+    "the same as a single scan writes; this helps on storage that serves\n"
+    "many reads at once, with lots of small members.  With -z, -j <n>\n"
+    "compresses with n threads instead, into the same single gzip stream\n"
+    "(zstd uses the library's own threads); that speeds up big files.\n"
+    "\n"
+    "With -z, -B <size> writes the archive as independent gzip members in\n"
+    "the BGZF layout (as bgzip does) instead of one long member.  A member\n"
+    "ends at the first file boundary after <size> bytes of tar data (at most\n"
+    "about 64k), and index entries there point at a member start, where any\n"
+    "gzip or BGZF reader can begin decompressing.  -B 1 starts a member for\n"
+    "every file.\n"
+#ifdef HAVE_ZSTD
+    "\n"
+    "-C zstd compresses with zstd instead (and implies -z), as a zstd frame\n"
+    "for every file with a seek table at the end, in the zstd seekable\n"
+    "format.  Extracting (-x -z) recognizes zstd archives by themselves.\n"
+#endif
+    "\n"
+    "With -z (or -C), -D <dict_file> uses the file (its last 32k) as a preset\n"
+    "dictionary for every file's compression, which gains back much of what\n"
+    "restarting the compressor at each file costs on many small files.  It is\n"
+    "stored at the start of the archive.  zlib archives with a dictionary are\n"
+    "written as members, as with -B 1, and can only be read by tarix.\n"
+#ifdef HAVE_ZSTD
+    "A dictionary trained with zstd --train --maxdict=32768 on files like\n"
+    "those in the archive works best.\n"
+#endif
+    "\n"
+    "With -z (or -C), -k <size> also checkpoints the compressed stream every\n"
+    "<size> bytes (64k at least) inside big files, and lists the points in\n"
+    "the index after the file's entry.  fuse_tarix starts reads from the\n"
+    "middle of such a file at the point before, instead of decompressing it\n"
+    "from its start.  Each point costs some compression.\n"
+    "\n"
+    "-x -c writes the contents of the (regular) files it finds one after the\n"
+    "other, as tar -x -O would, instead of their tar records.  -r <off>:<len>\n"
+    "limits that to len bytes from offset off of each file, where a negative\n"
+    "off counts from the end, and :<len> can be left out to get the rest.\n"
+    "Both take k and M suffixes.  Only the bytes asked for are read from an\n"
+    "uncompressed archive, and -k checkpoints are used in compressed ones.\n"
+    "\n"
+    "-l lists the entries of the index that match <filenames> (as with -x)\n"
+    "like tar -tv does, but without reading the archive; with -ll as tab\n"
+    "separated type, mode, uid, gid, size, mtime, block, offset and name.\n"
+    "-q <query> only lists the entries that meet all of its comma separated\n"
+    "conditions: type=<letters> (of fdlhcbp, as find -type, h for hard\n"
+    "links), size, mtime and uid or gid compared with =, <, <=, > or >=.\n"
+    "Sizes take k, M, G and T suffixes, times are @<seconds> or local\n"
+    "YYYY-MM-DD[THH:MM[:SS]].  For example -q 'type=f,size>1G,mtime>2024-06-01'\n"
+    "The index is read in chunks by -j <n> threads (all cpus by default).\n"
+    "Indexes from before tarix recorded metadata only answer type queries.\n"
+    "\n"
+    "After tar -r (or cat) added to an uncompressed archive file, -A indexes\n"
+    "just the new part, from where the last entry of the index ends, and adds\n"
+    "it to the index.  The first and last entries are checked against the\n"
+    "archive before.  -j <n> scans the new part with n threads, as with -i.\n"
+    "\n"
+    "When writing the archive to a file (-o), -P <size> syncs the archive and\n"
+    "the index to disk every <size> bytes of tar data (k, M and G suffixes),\n"
+    "and records how far they got in <index_file>.resume.  If tarix dies,\n"
+    "running it again with the same options and -R cuts both back to the\n"
+    "last such point and carries on from there, reading the tar file (-t)\n"
+    "from the matching offset.  Not for zstd, -B or -D archives, nor -O.\n"
   );
   return 0;
 }
 
+/* apply a k, M or G suffix at end to size, returns the end of the suffix,
+ * or NULL if the result doesn't fit */
+static char *size_suffix(long long *size, char *end)
+{
+  long long mult = 1;
+  if (*end == 'k' || *end == 'K')
+    mult = 1LL << 10;
+  else if (*end == 'm' || *end == 'M')
+    mult = 1LL << 20;
+  else if (*end == 'g' || *end == 'G')
+    mult = 1LL << 30;
+  if (mult == 1)
+    return end;
+  if (*size > LLONG_MAX / mult || *size < LLONG_MIN / mult)
+    return NULL;
+  *size *= mult;
+  return end + 1;
+}
+
+/* parse a size with an optional k or M suffix, returns -1 if invalid */
+static long parse_size(const char *arg)
+{
+  char *end;
+  long long size = strtoll(arg, &end, 10);
+  if (end == arg || size <= 0)
+    return -1;
+  end = size_suffix(&size, end);
+  if (end == NULL || *end != 0 || size > TS_MAX_BUFSZ)
+    return -1;
+  return size;
+}
+
+/* parse an extract range, off:len or off, into off and len (-1 for the
+ * rest of the file); returns -1 if invalid */
+static int parse_range(const char *arg, long long *off, long long *len)
+{
+  char *end;
+  *off = strtoll(arg, &end, 10);
+  if (end == arg)
+    return -1;
+  if ((end = size_suffix(off, end)) == NULL)
+    return -1;
+  *len = -1;
+  if (*end == ':' && end[1] != 0)
+  {
+    const char *lenarg = end + 1;
+    *len = strtoll(lenarg, &end, 10);
+    if (end == lenarg || *len < 0
+        || (end = size_suffix(len, end)) == NULL)
+      return -1;
+  }
+  else if (*end == ':')
+    ++end;
+  return *end == 0 ? 0 : -1;
+}
+
 enum tarix_action {
   CREATE_INDEX,
   SHOW_HELP,
   LONG_HELP,
-  EXTRACT_FILES
+  EXTRACT_FILES,
+  LIST_INDEX,
+  APPEND_INDEX
 };
 
 static int envgetopt(char **evarp, char *optstr)
@@ -175,10 +316,28 @@ int main(int argc, char *argv[])
   int use_mt = 0;
   int use_zlib = 0;
   int zlib_level = 3;
+  int bufsz = 0;
+  int use_direct = 0;
+  int jobs = 0;
+  int gzip_input = 0;
+  long member_size = 0;
+  long cp_interval = 0;
+  const struct ts_codec *codec = &ts_codec_zlib;
+  const char *dictfile = NULL;
   int glob_flags = 0;
   int exact_match = 0;
   int exclude_mode = 0;
+  int cat_mode = 0;
+  long long range_off = 0, range_len = -1;
+  int have_range = 0;
+  int list_level = 0;
+  const char *query = NULL;
+  long long progress_interval = 0;
+  int resume = 0;
   int debug_messages = 0;
+  struct create_options copts;
+  struct extract_options eopts;
+  struct query_options qopts;
   char sep = '\n';
   char *tenv = getenv("TARIX");
   struct files_list_state files_list = { 0, 0, NULL, NULL };
@@ -201,6 +360,37 @@ int main(int argc, char *argv[])
       case 'a':
         exact_match = 1;
         break;
+      case 'A':
+        action = APPEND_INDEX;
+        break;
+      case 'b':
+        if ((bufsz = parse_size(optarg)) < 0)
+        {
+          fprintf(stderr, "Invalid buffer size '%s'\n", optarg);
+          return 1;
+        }
+        break;
+      case 'B':
+        if ((member_size = parse_size(optarg)) < 0 || member_size > 65536)
+        {
+          fprintf(stderr, "Invalid member size '%s'\n", optarg);
+          return 1;
+        }
+        break;
+      case 'C':
+        if ((codec = ts_find_codec(optarg)) == NULL)
+        {
+          fprintf(stderr, "Unknown codec '%s'\n", optarg);
+          return 1;
+        }
+        use_zlib = 1;
+        break;
+      case 'D':
+        dictfile = optarg;
+        break;
+      case 'c':
+        cat_mode = 1;
+        break;
       case 'e':
         exclude_mode = 1;
         break;
@@ -210,6 +400,29 @@ int main(int argc, char *argv[])
         indexfile = (char*)malloc(strlen(optarg) + 1);
         strcpy(indexfile, optarg);
         break;
+      case 'r':
+        if (parse_range(optarg, &range_off, &range_len) != 0)
+        {
+          fprintf(stderr, "Invalid range '%s'\n", optarg);
+          return 1;
+        }
+        have_range = 1;
+        break;
+      case 'k':
+        if ((cp_interval = parse_size(optarg)) < 0 || cp_interval < 65536)
+        {
+          fprintf(stderr, "Invalid checkpoint interval '%s'\n", optarg);
+          return 1;
+        }
+        break;
+      case 'j':
+        jobs = atoi(optarg);
+        if (jobs < 1 || jobs > 256)
+        {
+          fprintf(stderr, "Invalid number of jobs '%s'\n", optarg);
+          return 1;
+        }
+        break;
       case 'g':
         glob_flags |= FNM_PATHNAME;
         break;
@@ -228,6 +441,13 @@ int main(int argc, char *argv[])
         action = CREATE_INDEX;
         pass_through = 0;
         break;
+      case 'l':
+        action = LIST_INDEX;
+        ++list_level;
+        break;
+      case 'q':
+        query = optarg;
+        break;
 #ifdef HAVE_MTIO_H
       case 'm':
         use_mt = 1;
@@ -254,12 +474,34 @@ int main(int argc, char *argv[])
       case 'n':
         sep = '\0';
         break;
+      case 'O':
+        use_direct = 1;
+        break;
+      case 'P':
+      {
+        char *end;
+        progress_interval = strtoll(optarg, &end, 10);
+        if (end == optarg || progress_interval <= 0
+            || (end = size_suffix(&progress_interval, end)) == NULL
+            || *end != 0)
+        {
+          fprintf(stderr, "Invalid progress interval '%s'\n", optarg);
+          return 1;
+        }
+        break;
+      }
+      case 'R':
+        resume = 1;
+        break;
       case 'x':
         action = EXTRACT_FILES;
         break;
       case 'z':
         use_zlib = 1;
         break;
+      case 'Z':
+        gzip_input = 1;
+        break;
       case '1': case '2': case '3': case '4': case '5': case '6': case '7':
       case '9':
         zlib_level = opt - '0';
@@ -288,33 +530,124 @@ int main(int argc, char *argv[])
   
   if (!use_zlib)
     zlib_level = 0;
+  if (member_size > 0 && (zlib_level == 0 || codec != &ts_codec_zlib))
+  {
+    fprintf(stderr, "-B only applies to zlib archives (-z)\n");
+    return 1;
+  }
+  if (dictfile != NULL && zlib_level == 0)
+  {
+    fprintf(stderr, "-D only applies to compressed archives (-z or -C)\n");
+    return 1;
+  }
+  if (cat_mode && action != EXTRACT_FILES)
+  {
+    fprintf(stderr, "-c only applies to extracting (-x)\n");
+    return 1;
+  }
+  if (have_range && !cat_mode)
+  {
+    fprintf(stderr, "-r only applies to -c\n");
+    return 1;
+  }
+  if (cp_interval > 0 && zlib_level == 0)
+  {
+    fprintf(stderr, "-k only applies to compressed archives (-z or -C)\n");
+    return 1;
+  }
+  if (action == APPEND_INDEX && (use_zlib || gzip_input))
+  {
+    fprintf(stderr, "-A only applies to uncompressed archives\n");
+    return 1;
+  }
+  if ((progress_interval > 0 || resume) && (action != CREATE_INDEX
+      || !pass_through || gzip_input || member_size > 0 || dictfile != NULL
+      || use_direct || (zlib_level > 0 && codec != &ts_codec_zlib)))
+  {
+    fprintf(stderr, "-P and -R only apply to creating zlib or uncompressed"
+      " archives, without -B, -D, -i, -O or -Z\n");
+    return 1;
+  }
+  if ((progress_interval > 0 || resume) && outfile == NULL)
+  {
+    fprintf(stderr, "-P and -R need the archive written to a file (-o)\n");
+    return 1;
+  }
+  if (resume && tarfile == NULL)
+  {
+    fprintf(stderr, "-R needs the tar file being archived (-t)\n");
+    return 1;
+  }
+  if (query != NULL && action != LIST_INDEX)
+  {
+    fprintf(stderr, "-q only applies to listing (-l)\n");
+    return 1;
+  }
+  
+  if (action == EXTRACT_FILES || action == LIST_INDEX)
+  {
+    if (append_args_to_files_list(&files_list, argc, argv, optind))
+      return 1;
+    
+    if (listfile)
+    {
+      char *buf;
+      size_t buflen;
+      
+      if (read_listfile(listfile, sep, &buf, &buflen))
+        return 1;
+      if (append_listfile_to_files_list(&files_list, sep, buf, buflen))
+        return 1;
+    }
+  }
+  
+  copts.pass_through = pass_through;
+  copts.zlib_level = zlib_level;
+  copts.codec = codec;
+  copts.bufsz = bufsz;
+  copts.use_direct = use_direct;
+  copts.jobs = jobs;
+  copts.gzip_input = gzip_input;
+  copts.member_size = member_size;
+  copts.dictfile = dictfile;
+  copts.cp_interval = cp_interval;
+  copts.progress_interval = progress_interval;
+  copts.resume = resume;
+  copts.debug_messages = debug_messages;
+  
+  eopts.use_mt = use_mt;
+  eopts.zlib_level = zlib_level;
+  eopts.bufsz = bufsz;
+  eopts.use_direct = use_direct;
+  eopts.gzip_input = gzip_input;
+  eopts.cat_mode = cat_mode;
+  eopts.range_off = range_off;
+  eopts.range_len = range_len;
+  eopts.match.glob_flags = glob_flags;
+  eopts.match.exclude_mode = exclude_mode;
+  eopts.match.exact_match = exact_match;
+  eopts.debug_messages = debug_messages;
+  
+  qopts.list_level = list_level;
+  qopts.query = query;
+  qopts.jobs = jobs;
+  qopts.match = eopts.match;
+  qopts.debug_messages = debug_messages;
   
   switch (action)
   {
     case CREATE_INDEX:
-      return create_index(indexfile, tarfile, pass_through, zlib_level,
-        debug_messages);
+      return create_index(indexfile, tarfile, outfile, &copts);
+    case APPEND_INDEX:
+      return append_index(indexfile, tarfile, &copts);
     case SHOW_HELP:
       return show_help(0);
     case LONG_HELP:
       return show_help(1);
     case EXTRACT_FILES:
-      if (append_args_to_files_list(&files_list, argc, argv, optind))
-        return 1;
-
-      if (listfile)
-      {
-        char *buf;
-        size_t buflen;
-
-        if (read_listfile(listfile, sep, &buf, &buflen))
-          return 1;
-        if (append_listfile_to_files_list(&files_list, sep, buf, buflen))
-          return 1;
-      }
-      
-      return extract_files(indexfile, tarfile, outfile, use_mt, zlib_level,
-        debug_messages, glob_flags, exclude_mode, exact_match, &files_list);
+      return extract_files(indexfile, tarfile, outfile, &eopts, &files_list);
+    case LIST_INDEX:
+      return query_index(indexfile, &qopts, &files_list);
     default:
       fprintf(stderr, "EEK! unknown action!\n");
       return 1;
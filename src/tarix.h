@@ -21,6 +21,9 @@
 #define __TARIX_H__
 
 #include "files_list.h"
+#include "portability.h"
+
+struct ts_codec;
 
 #define stringify(x) #x
 
@@ -29,11 +32,63 @@
 #define TARIX_VERSION "1.0.7"
 #define TARIX_DEF_OUTFILE "out.tarix"
 
+/* how to create an index (and the archive), from the command line;
+ * appending to an index only takes bufsz, use_direct, jobs and
+ * debug_messages from it */
+struct create_options {
+  int pass_through;             /* write the archive too, not with -i */
+  int zlib_level;               /* 0 for an uncompressed archive */
+  const struct ts_codec *codec; /* -C, with zlib_level > 0 */
+  int bufsz;                    /* -b, 0 for the default */
+  int use_direct;               /* -O */
+  int jobs;                     /* -j */
+  int gzip_input;               /* -Z */
+  long member_size;             /* -B */
+  const char *dictfile;         /* -D */
+  long cp_interval;             /* -k */
+  long long progress_interval;  /* -P */
+  int resume;                   /* -R */
+  int debug_messages;
+};
+
+/* how the files list picks index entries, for extracting and listing */
+struct match_options {
+  int glob_flags;               /* -g, -G: fnmatch flags, 0 for none */
+  int exclude_mode;             /* -e: the entries that don't match */
+  int exact_match;              /* -a: no prefix matches */
+};
+
+/* how to extract from an archive, from the command line */
+struct extract_options {
+  int use_mt;                   /* -m */
+  int zlib_level;               /* 0 for an uncompressed archive */
+  int bufsz;                    /* -b, 0 for the default */
+  int use_direct;               /* -O */
+  int gzip_input;               /* -Z */
+  int cat_mode;                 /* -c */
+  off64_t range_off;            /* -r, with cat_mode */
+  off64_t range_len;            /* -1 for the rest of the file */
+  struct match_options match;
+  int debug_messages;
+};
+
+/* how to list an index, from the command line */
+struct query_options {
+  int list_level;               /* how many -l */
+  const char *query;            /* -q, NULL for all entries */
+  int jobs;                     /* -j */
+  struct match_options match;
+  int debug_messages;
+};
+
 int create_index(const char *indexfile, const char *tarfile,
-  int pass_through, int zlib_level, int debug_messages);
+  const char *outfile, const struct create_options *opts);
+int append_index(const char *indexfile, const char *tarfile,
+  const struct create_options *opts);
 int extract_files(const char *indexfile, const char *tarfile,
-  const char *outfile, int use_mt, int zlib_level, int debug_messages,
-  int glob_flags, int exclude_mode, int exact_match,
+  const char *outfile, const struct extract_options *opts,
+  const struct files_list_state *files_list);
+int query_index(const char *indexfile, const struct query_options *opts,
   const struct files_list_state *files_list);
 
 #endif /* __TARIX_H__ */
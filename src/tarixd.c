@@ -0,0 +1,448 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/* tarixd: keeps indexed archives open, and serves their files to local
+ * clients over a unix socket, so that every request doesn't pay for
+ * reading the index and setting up decompression again.
+ *
+ * The protocol: a client sends requests, one per line, and gets for each
+ * either "OK <length>\n" followed by that many bytes, or
+ * "ERR <errno> <message>\n".  Requests are a verb, the name of the archive,
+ * and then the path, which is the rest of the line:
+ *
+ *   stat <archive> <path>
+ *     "<type> <mode> <uid> <gid> <size> <mtime>\n", type is one of -dlcbp
+ *     (? for anything else) and mode is octal
+ *   list <archive> <prefix>
+ *     the names under prefix (all of them if it is empty), one per line
+ *   cat <archive> <offset> <length> <path>
+ *     the contents of the file, length bytes (-1 for the rest) from offset
+ *     (from the end if it is negative)
+ *   extract <archive> <path>
+ *     the tar record of the file, as tarix -x writes it
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include "config.h"
+
+#include "libtarix.h"
+#include "portability.h"
+#include "tarix.h"
+
+/* longest request line */
+#define TARIXD_MAXLINE 8192
+/* data that can't be sent straight from the archive goes through a
+ * buffer this big */
+#define TARIXD_BUFSZ (256 << 10)
+
+struct served_archive {
+  char *name;
+  struct tarix_archive *archive;
+  /* the archive file, for sending data straight from it, -1 if it is
+   * compressed */
+  int fd;
+};
+
+static struct served_archive *served;
+static int nserved;
+static volatile sig_atomic_t stopping;
+
+static void usage() {
+  fprintf(stderr,
+    "tarixd -s socket name:tarfile:indexfile[:zlib|:gzip] ...\n"
+    "\n"
+    "Serves files from the archives to local clients on the unix socket.\n"
+    "Each archive is given a name for clients to use, and is compressed\n"
+    "(zlib, for tarix -z or -C) or an ordinary gzip file indexed with\n"
+    "tarix -Z (gzip).  The protocol is described in src/tarixd.c.\n"
+    "tarix " TARIX_VERSION "\n"
+    );
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+static int send_error(int fd, int err) {
+  char msg[256];
+  
+  snprintf(msg, sizeof(msg), "ERR %d %s\n", err, strerror(err));
+  return write_all(fd, msg, strlen(msg));
+}
+
+static int send_ok(int fd, long long len) {
+  char msg[64];
+  
+  snprintf(msg, sizeof(msg), "OK %lld\n", len);
+  return write_all(fd, msg, strlen(msg));
+}
+
+/* send len bytes of the archive file from off */
+static int send_range(int fd, struct served_archive *sa, off64_t off,
+    off64_t len) {
+#ifdef __linux__
+  while (len > 0) {
+    ssize_t n = sendfile(fd, sa->fd, &off, len < (1 << 30) ? len : 1 << 30);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    len -= n;
+  }
+  if (len == 0)
+    return 0;
+#endif
+  /* sendfile isn't there, or can't do it */
+  char *buf = malloc(TARIXD_BUFSZ);
+  if (buf == NULL)
+    return -1;
+  while (len > 0) {
+    ssize_t n = p_pread64(sa->fd, buf, len < TARIXD_BUFSZ ? len
+      : TARIXD_BUFSZ, off);
+    if (n <= 0 || write_all(fd, buf, n) != 0)
+      break;
+    off += n;
+    len -= n;
+  }
+  free(buf);
+  return len == 0 ? 0 : -1;
+}
+
+typedef ssize_t (*member_pread_t)(struct tarix_archive *archive,
+  const struct tarix_member *member, void *buf, size_t len, long long off);
+
+/* send len bytes from off of member through a buffer, read with rd */
+static int send_read(int fd, struct served_archive *sa,
+    const struct tarix_member *member, member_pread_t rd, off64_t off,
+    off64_t len) {
+  char *buf = malloc(TARIXD_BUFSZ);
+  
+  if (buf == NULL)
+    return -1;
+  while (len > 0) {
+    ssize_t n = rd(sa->archive, member, buf, len < TARIXD_BUFSZ ? len
+      : TARIXD_BUFSZ, off);
+    if (n <= 0 || write_all(fd, buf, n) != 0)
+      break;
+    off += n;
+    len -= n;
+  }
+  free(buf);
+  return len == 0 ? 0 : -1;
+}
+
+static char stat_type(mode_t mode) {
+  if (S_ISREG(mode))
+    return '-';
+  if (S_ISDIR(mode))
+    return 'd';
+  if (S_ISLNK(mode))
+    return 'l';
+  if (S_ISCHR(mode))
+    return 'c';
+  if (S_ISBLK(mode))
+    return 'b';
+  if (S_ISFIFO(mode))
+    return 'p';
+  return '?';
+}
+
+static int list_member(const struct tarix_member *member, void *data) {
+  fprintf((FILE*)data, "%s\n", tarix_member_name(member));
+  return 0;
+}
+
+/* the next space separated word of the request */
+static char *next_word(char **pos) {
+  char *word = *pos, *end;
+  
+  if (word == NULL || *word == 0)
+    return NULL;
+  if ((end = strchr(word, ' ')) != NULL) {
+    *end = 0;
+    *pos = end + 1;
+  } else {
+    *pos = word + strlen(word);
+  }
+  return word;
+}
+
+/* Handle a request, returns 0 when the connection can go on, or -1 if
+ * the client isn't there any more, or a response couldn't be finished. */
+static int handle_request(int fd, char *line) {
+  char *pos = line, *verb, *name, *path;
+  const struct tarix_member *member;
+  struct served_archive *sa = NULL;
+  long long off = 0, len = -1;
+  struct stat st;
+  int i;
+  
+  verb = next_word(&pos);
+  name = next_word(&pos);
+  if (verb == NULL || name == NULL)
+    return send_error(fd, EINVAL);
+  for (i = 0; i < nserved; ++i)
+    if (strcmp(served[i].name, name) == 0)
+      sa = &served[i];
+  if (sa == NULL)
+    return send_error(fd, ENOENT);
+  if (strcmp(verb, "cat") == 0) {
+    char *offw = next_word(&pos), *lenw = next_word(&pos), *end;
+    if (offw == NULL || lenw == NULL)
+      return send_error(fd, EINVAL);
+    off = strtoll(offw, &end, 10);
+    if (*end != 0)
+      return send_error(fd, EINVAL);
+    len = strtoll(lenw, &end, 10);
+    if (*end != 0 || len < -1)
+      return send_error(fd, EINVAL);
+  }
+  path = pos;
+  
+  if (strcmp(verb, "list") == 0) {
+    char *buf = NULL;
+    size_t bufsz = 0;
+    FILE *out = open_memstream(&buf, &bufsz);
+    int rv;
+    if (out == NULL)
+      return send_error(fd, errno);
+    tarix_foreach(sa->archive, path, list_member, out);
+    fclose(out);
+    rv = send_ok(fd, bufsz) || write_all(fd, buf, bufsz);
+    free(buf);
+    return rv ? -1 : 0;
+  }
+  
+  if ((member = tarix_lookup(sa->archive, path)) == NULL)
+    return send_error(fd, ENOENT);
+  if (tarix_stat(sa->archive, member, &st) != 0)
+    return send_error(fd, errno);
+  
+  if (strcmp(verb, "stat") == 0) {
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%c %o %lu %lu %lld %ld\n",
+      stat_type(st.st_mode), st.st_mode & 07777, (unsigned long)st.st_uid,
+      (unsigned long)st.st_gid, (long long)st.st_size, (long)st.st_mtime);
+    return send_ok(fd, strlen(msg)) || write_all(fd, msg, strlen(msg))
+      ? -1 : 0;
+  } else if (strcmp(verb, "cat") == 0) {
+    long long record, data;
+    off64_t start, end;
+    if (S_ISDIR(st.st_mode))
+      return send_error(fd, EISDIR);
+    if (!S_ISREG(st.st_mode))
+      return send_error(fd, EINVAL);
+    start = off < 0 ? st.st_size + off : off;
+    if (start < 0)
+      start = 0;
+    if (start > st.st_size)
+      start = st.st_size;
+    end = len < 0 || len > st.st_size - start ? st.st_size : start + len;
+    if (send_ok(fd, end - start) != 0)
+      return -1;
+    if (sa->fd >= 0 && tarix_member_offsets(sa->archive, member, &record,
+        &data) == 0 && data >= 0)
+      return send_range(fd, sa, data + start, end - start);
+    return send_read(fd, sa, member, tarix_member_pread, start,
+      end - start);
+  } else if (strcmp(verb, "extract") == 0) {
+    long long record, data, size = tarix_record_size(member);
+    if (send_ok(fd, size) != 0)
+      return -1;
+    if (sa->fd >= 0 && tarix_member_offsets(sa->archive, member, &record,
+        &data) == 0)
+      return send_range(fd, sa, record, size);
+    return send_read(fd, sa, member, tarix_record_pread, 0, size);
+  }
+  return send_error(fd, EINVAL);
+}
+
+static void *serve_client(void *data) {
+  int fd = (int)(long)data;
+  FILE *in = fdopen(fd, "r");
+  char line[TARIXD_MAXLINE];
+  
+  if (in == NULL) {
+    close(fd);
+    return NULL;
+  }
+  while (fgets(line, sizeof(line), in) != NULL) {
+    char *nl = strchr(line, '\n');
+    if (nl == NULL) {
+      /* too long, or cut off */
+      send_error(fd, ENAMETOOLONG);
+      break;
+    }
+    *nl = 0;
+    if (handle_request(fd, line) != 0)
+      break;
+  }
+  fclose(in);
+  return NULL;
+}
+
+static void stop(int sig) {
+  stopping = 1;
+}
+
+/* name:tarfile:indexfile[:zlib|:gzip] */
+static int open_served(struct served_archive *sa, char *arg) {
+  char *tarfile, *indexfile, *mode;
+  int flags = 0;
+  
+  sa->name = arg;
+  if ((tarfile = strchr(arg, ':')) == NULL
+      || (indexfile = strchr(tarfile + 1, ':')) == NULL) {
+    fprintf(stderr, "archive must be name:tarfile:indexfile: %s\n", arg);
+    return 1;
+  }
+  *tarfile++ = 0;
+  *indexfile++ = 0;
+  if ((mode = strchr(indexfile, ':')) != NULL) {
+    *mode++ = 0;
+    if (strcmp(mode, "zlib") == 0)
+      flags = TARIX_OPEN_COMPRESSED;
+    else if (strcmp(mode, "gzip") == 0)
+      flags = TARIX_OPEN_GZIP;
+    else {
+      fprintf(stderr, "unknown archive type: %s\n", mode);
+      return 1;
+    }
+  }
+  
+  if ((sa->archive = tarix_open(tarfile, indexfile, flags)) == NULL) {
+    fprintf(stderr, "%s: cannot open archive\n", sa->name);
+    return 1;
+  }
+  sa->fd = -1;
+  if (flags == 0 && (sa->fd = p_open(tarfile, O_RDONLY|P_O_LARGEFILE, 0, 0))
+      < 0) {
+    perror(tarfile);
+    return 1;
+  }
+  fprintf(stderr, "%s: %d members\n", sa->name, tarix_count(sa->archive));
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  const char *sockpath = NULL;
+  struct sockaddr_un addr;
+  struct sigaction sa;
+  pthread_attr_t attr;
+  int opt, lfd, i;
+  
+  while ((opt = getopt(argc, argv, "hs:")) != -1) {
+    switch (opt) {
+      case 's':
+        sockpath = optarg;
+        break;
+      case 'h':
+        usage();
+        return 0;
+      default:
+        usage();
+        return 1;
+    }
+  }
+  if (sockpath == NULL || optind == argc) {
+    usage();
+    return 1;
+  }
+  if (strlen(sockpath) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "socket path too long: %s\n", sockpath);
+    return 1;
+  }
+  
+  nserved = argc - optind;
+  if ((served = calloc(nserved, sizeof(*served))) == NULL) {
+    perror("allocate archives");
+    return 1;
+  }
+  for (i = 0; i < nserved; ++i)
+    if (open_served(&served[i], argv[optind + i]) != 0)
+      return 1;
+  
+  if ((lfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+    perror("socket");
+    return 1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, sockpath);
+  unlink(sockpath);
+  if (bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) != 0
+      || listen(lfd, 64) != 0) {
+    perror(sockpath);
+    return 1;
+  }
+  
+  /* clients going away are noticed by the writes failing, and a signal to
+   * stop interrupts accept, so the socket can be cleaned up */
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = SIG_IGN;
+  sigaction(SIGPIPE, &sa, NULL);
+  sa.sa_handler = stop;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  while (!stopping) {
+    pthread_t thread;
+    int fd = accept(lfd, NULL, NULL);
+    if (fd < 0) {
+      if (errno != EINTR && errno != ECONNABORTED)
+        perror("accept");
+      continue;
+    }
+    if (pthread_create(&thread, &attr, serve_client, (void*)(long)fd) != 0)
+    {
+      perror("pthread_create");
+      close(fd);
+    }
+  }
+  
+  unlink(sockpath);
+  return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <limits.h>
+
+#include "config.h"
+
+#include "tarnum.h"
+
+int tar_number(const char *field, size_t len, long long *value) {
+  const unsigned char *p = (const unsigned char*)field;
+  const unsigned char *end = p + len;
+  long long v;
+  
+  *value = 0;
+  if (len == 0)
+    return -1;
+  
+  if (*p & 0x80) {
+    /* base-256, the first byte has 6 bits of the value */
+    v = (*p & 0x3f) - (*p & 0x40 ? 0x40 : 0);
+    while (++p < end) {
+      if (v > (LLONG_MAX - *p) / 256 || v < LLONG_MIN / 256)
+        return -1;
+      v = v * 256 + *p;
+    }
+    *value = v;
+    return 0;
+  }
+  
+  while (p < end && *p == ' ')
+    ++p;
+  for (v = 0; p < end && *p >= '0' && *p <= '7'; ++p) {
+    if (v > LLONG_MAX / 8)
+      return -1;
+    v = v * 8 + (*p - '0');
+  }
+  if (p < end && *p != ' ' && *p != 0)
+    return -1;
+  *value = v;
+  return 0;
+}
+
+long long tar_field(const char *field, size_t len) {
+  long long v;
+  tar_number(field, len, &v);
+  return v;
+}
+
+int tar_size(const char *field, size_t len, long long *value) {
+  if (tar_number(field, len, value) != 0 || *value < 0) {
+    *value = 0;
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __TARNUM_H__
+#define __TARNUM_H__
+
+#include <stddef.h>
+
+/* Decode a numeric tar header field of len bytes.  It is either octal
+ * digits, after any spaces and up to a space, a null or the end of the
+ * field, or for values too big for that (as GNU tar and star write them)
+ * base-256: bit 7 of the first byte set, bit 6 the sign, and the rest of
+ * the field the value in two's complement, big endian.  Returns 0 and the
+ * value in *value, or -1 (and 0 in *value) if the field is neither or the
+ * value doesn't fit.
+ */
+int tar_number(const char *field, size_t len, long long *value);
+
+/* the value of a header field, 0 where it can't be decoded */
+long long tar_field(const char *field, size_t len);
+#define TAR_FIELD(f) tar_field((f), sizeof(f))
+
+/* a size or offset field: as tar_number, but a negative value is an
+ * error as well */
+int tar_size(const char *field, size_t len, long long *value);
+#define TAR_SIZE(f, v) tar_size((f), sizeof(f), (v))
+
+#endif /* __TARNUM_H__ */
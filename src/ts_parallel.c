@@ -0,0 +1,353 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/* parallel deflate for zlib write streams, pigz style: the data is cut in
+ * chunks that worker threads compress at the same time, each with the
+ * last 32K of the chunk before it as its dictionary, and ended with a sync
+ * flush so they can just be put one after the other.  The result is the
+ * same single deflate stream (bar the extra empty stored blocks) that one
+ * thread would write.  A checkpoint ends the current chunk, and the next
+ * one starts without a dictionary, which makes it a full flush point.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "crc32.h"
+#include "tstream.h"
+#include "ts_util.h"
+
+/* chunk states */
+#define PAR_FREE 0
+#define PAR_FILLING 1
+#define PAR_QUEUED 2
+#define PAR_RUNNING 3
+#define PAR_DONE 4
+
+/* data per chunk, and the history each one gets from the one before */
+#define PAR_CHUNK (256 * 1024)
+#define PAR_WINDOW 32768
+#define PAR_MAX_JOBS 256
+
+struct par_chunk {
+  int state;
+  /* sequence number, chunks are written out in this order */
+  unsigned long seq;
+  /* the data, preceded by the dictionary: in[0, dictlen) is the end of
+   * the chunk before, in[dictlen, dictlen + len) the data */
+  Bytef *in;
+  uInt dictlen;
+  uInt len;
+  /* the last chunk of the stream ends with the final block */
+  int last;
+  /* compressed output, and the crc of the data */
+  Bytef *out;
+  uLong outsz;
+  uLong outlen;
+  unsigned long crc;
+  int err;
+};
+
+struct ts_parallel {
+  pthread_mutex_t lock;
+  /* queued chunks for the workers, finished ones for the writer */
+  pthread_cond_t work;
+  pthread_cond_t done;
+  int level;
+  int nthreads;
+  pthread_t *threads;
+  int shutdown;
+  struct par_chunk *chunks;
+  int nchunks;
+  /* next chunk to fill, to compress, to write out */
+  unsigned long fill_seq;
+  unsigned long take_seq;
+  unsigned long write_seq;
+};
+
+#define CHUNK(par, seq) (&(par)->chunks[(seq) % (par)->nchunks])
+
+static void *par_worker(void *arg) {
+  struct ts_parallel *par = arg;
+  z_stream zs;
+  int zerr;
+  
+  memset(&zs, 0, sizeof(zs));
+  zerr = deflateInit2(&zs, par->level, Z_DEFLATED, -MAX_WBITS,
+    MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+  
+  pthread_mutex_lock(&par->lock);
+  while (1) {
+    struct par_chunk *c = CHUNK(par, par->take_seq);
+    int rv;
+    
+    if (c->state != PAR_QUEUED || c->seq != par->take_seq) {
+      if (par->shutdown)
+        break;
+      pthread_cond_wait(&par->work, &par->lock);
+      continue;
+    }
+    c->state = PAR_RUNNING;
+    ++par->take_seq;
+    pthread_mutex_unlock(&par->lock);
+    
+    rv = zerr;
+    if (rv == Z_OK)
+      rv = deflateReset(&zs);
+    if (rv == Z_OK && c->dictlen > 0)
+      rv = deflateSetDictionary(&zs, c->in, c->dictlen);
+    if (rv == Z_OK) {
+      zs.next_in = c->in + c->dictlen;
+      zs.avail_in = c->len;
+      zs.next_out = c->out;
+      zs.avail_out = c->outsz;
+      rv = deflate(&zs, c->last ? Z_FINISH : Z_SYNC_FLUSH);
+      /* outsz is enough for everything in one go */
+      if (rv == (c->last ? Z_STREAM_END : Z_OK) && zs.avail_in == 0
+          && zs.avail_out > 0)
+        rv = Z_OK;
+      else if (rv == Z_OK || rv == Z_STREAM_END)
+        rv = Z_BUF_ERROR;
+      c->outlen = zs.next_out - c->out;
+      c->crc = update_crc(0, c->in + c->dictlen, c->len);
+    }
+    
+    pthread_mutex_lock(&par->lock);
+    c->err = rv;
+    c->state = PAR_DONE;
+    pthread_cond_broadcast(&par->done);
+  }
+  pthread_mutex_unlock(&par->lock);
+  
+  if (zerr == Z_OK)
+    deflateEnd(&zs);
+  return NULL;
+}
+
+/* write out finished chunks, in order: until the one numbered upto if
+ * wait is set, otherwise just those that are done */
+static int par_write(t_streamp tsp, unsigned long upto, int wait) {
+  struct ts_parallel *par = tsp->par;
+  int rv = 0;
+  
+  pthread_mutex_lock(&par->lock);
+  while (par->write_seq < upto) {
+    struct par_chunk *c = CHUNK(par, par->write_seq);
+    if (c->state != PAR_DONE) {
+      if (!wait)
+        break;
+      pthread_cond_wait(&par->done, &par->lock);
+      continue;
+    }
+    pthread_mutex_unlock(&par->lock);
+    
+    if (c->err != Z_OK) {
+      tsp->zlib_err = c->err;
+      rv = TS_ERR_ZLIB;
+    } else if (ts_put_output(tsp, c->out, c->outlen) != 0) {
+      rv = -1;
+    }
+    tsp->crc32 = combine_crc(tsp->crc32, c->crc, c->len);
+    
+    pthread_mutex_lock(&par->lock);
+    if (rv != 0)
+      break;
+    c->state = PAR_FREE;
+    ++par->write_seq;
+  }
+  pthread_mutex_unlock(&par->lock);
+  
+  /* zlib's idea of the output position, for flush_tail */
+  tsp->zsp->next_out = tsp->outbuf + tsp->out_tail;
+  tsp->zsp->avail_out = tsp->bufsz - tsp->out_tail;
+  return rv;
+}
+
+/* get the next chunk ready for filling, once it's free */
+static int par_next_chunk(t_streamp tsp) {
+  struct ts_parallel *par = tsp->par;
+  struct par_chunk *prev = par->fill_seq > 0
+    ? CHUNK(par, par->fill_seq - 1) : NULL;
+  struct par_chunk *c = CHUNK(par, par->fill_seq);
+  int rv;
+  
+  /* the chunk that had the slot before has to be written out */
+  if (par->fill_seq >= par->nchunks
+      && (rv = par_write(tsp, par->fill_seq - par->nchunks + 1, 1)) != 0)
+    return rv;
+  
+  c->len = 0;
+  c->last = 0;
+  c->dictlen = 0;
+  if (prev != NULL) {
+    /* the previous chunk is only read by its worker, copying from it is
+     * fine */
+    c->dictlen = prev->len < PAR_WINDOW ? prev->len : PAR_WINDOW;
+    memcpy(c->in, prev->in + prev->dictlen + prev->len - c->dictlen,
+      c->dictlen);
+  }
+  pthread_mutex_lock(&par->lock);
+  c->seq = par->fill_seq;
+  c->state = PAR_FILLING;
+  pthread_mutex_unlock(&par->lock);
+  return 0;
+}
+
+/* hand the chunk being filled to the workers */
+static int par_submit(t_streamp tsp, int last) {
+  struct ts_parallel *par = tsp->par;
+  struct par_chunk *c = CHUNK(par, par->fill_seq);
+  int rv;
+  
+  pthread_mutex_lock(&par->lock);
+  c->last = last;
+  c->state = PAR_QUEUED;
+  ++par->fill_seq;
+  pthread_cond_broadcast(&par->work);
+  pthread_mutex_unlock(&par->lock);
+  
+  if (last)
+    return 0;
+  /* write out what's done meanwhile, and go on with the next */
+  if ((rv = par_write(tsp, par->fill_seq, 0)) != 0)
+    return rv;
+  return par_next_chunk(tsp);
+}
+
+int par_start(t_streamp tsp, int jobs) {
+  struct ts_parallel *par = calloc(1, sizeof(*par));
+  int i;
+  
+  if (par == NULL)
+    goto nomem;
+  tsp->par = par;
+  if (jobs > PAR_MAX_JOBS)
+    jobs = PAR_MAX_JOBS;
+  pthread_mutex_init(&par->lock, NULL);
+  pthread_cond_init(&par->work, NULL);
+  pthread_cond_init(&par->done, NULL);
+  par->level = tsp->level;
+  /* enough chunks to keep every thread busy while the oldest is written */
+  par->nchunks = 2 * jobs;
+  if ((par->chunks = calloc(par->nchunks, sizeof(*par->chunks))) == NULL)
+    goto nomem;
+  for (i = 0; i < par->nchunks; ++i) {
+    struct par_chunk *c = &par->chunks[i];
+    c->outsz = compressBound(PAR_CHUNK) + 64;
+    if ((c->in = malloc(PAR_WINDOW + PAR_CHUNK)) == NULL
+        || (c->out = malloc(c->outsz)) == NULL)
+      goto nomem;
+  }
+  if ((par->threads = calloc(jobs, sizeof(*par->threads))) == NULL)
+    goto nomem;
+  for (i = 0; i < jobs; ++i) {
+    if (pthread_create(&par->threads[i], NULL, par_worker, par) != 0)
+      break;
+    ++par->nthreads;
+  }
+  if (par->nthreads == 0)
+    goto nomem;
+  
+  /* compressed data goes after the gzip header zlib was going to follow */
+  tsp->out_tail = tsp->zsp->next_out - tsp->outbuf;
+  return par_next_chunk(tsp);
+
+nomem:
+  tsp->zlib_err = Z_MEM_ERROR;
+  return TS_ERR_ZLIB;
+}
+
+int par_compress(t_streamp tsp, Bytef *buf, int len) {
+  struct ts_parallel *par = tsp->par;
+  int left = len;
+  
+  while (left > 0) {
+    struct par_chunk *c = CHUNK(par, par->fill_seq);
+    int piece = PAR_CHUNK - c->len;
+    int rv;
+    if (piece > left)
+      piece = left;
+    memcpy(c->in + c->dictlen + c->len, buf, piece);
+    c->len += piece;
+    tsp->raw_bytes += piece;
+    buf += piece;
+    left -= piece;
+    if (c->len == PAR_CHUNK && (rv = par_submit(tsp, 0)) != 0)
+      return rv;
+  }
+  return len;
+}
+
+off64_t par_checkpoint(t_streamp tsp) {
+  struct ts_parallel *par = tsp->par;
+  int rv;
+  
+  /* right after a checkpoint or a full chunk the next chunk is empty, and
+   * only has to start without the history */
+  if (CHUNK(par, par->fill_seq)->len > 0 && (rv = par_submit(tsp, 0)) != 0)
+    return rv;
+  if ((rv = par_write(tsp, par->fill_seq, 1)) != 0)
+    return rv;
+  CHUNK(par, par->fill_seq)->dictlen = 0;
+  return tsp->zlib_bytes + (tsp->out_tail - tsp->out_head);
+}
+
+int par_finish(t_streamp tsp) {
+  struct ts_parallel *par = tsp->par;
+  int rv;
+  
+  /* the last chunk has the final block, even if it's empty */
+  if ((rv = par_submit(tsp, 1)) != 0
+      || (rv = par_write(tsp, par->fill_seq, 1)) != 0)
+    return rv;
+  tsp->zlib_err = Z_STREAM_END;
+  return 0;
+}
+
+void par_end(t_streamp tsp) {
+  struct ts_parallel *par = tsp->par;
+  int i;
+  
+  if (par == NULL)
+    return;
+  pthread_mutex_lock(&par->lock);
+  par->shutdown = 1;
+  pthread_cond_broadcast(&par->work);
+  pthread_mutex_unlock(&par->lock);
+  for (i = 0; i < par->nthreads; ++i)
+    pthread_join(par->threads[i], NULL);
+  free(par->threads);
+  if (par->chunks != NULL) {
+    for (i = 0; i < par->nchunks; ++i) {
+      free(par->chunks[i].in);
+      free(par->chunks[i].out);
+    }
+    free(par->chunks);
+  }
+  pthread_mutex_destroy(&par->lock);
+  pthread_cond_destroy(&par->work);
+  pthread_cond_destroy(&par->done);
+  free(par);
+  tsp->par = NULL;
+}
@@ -20,12 +20,15 @@
 /* utility funcs for tstream */
 
 #include <zlib.h>
+#include <stdlib.h>
 #include <time.h>
 #include <string.h>
 #include <stdio.h>
 
 #include "config.h"
 
+#include "gzindex.h"
+#include "io_pipe.h"
 #include "tarix.h"
 #include "tstream.h"
 #include "ts_util.h"
@@ -51,7 +54,7 @@ void put_gz_header(t_streamp tsp) {
   obuf[2] = 8;
   /* flags: FCOMMENT */
   /* note: we don't include a filename yet, see TODO above */
-  obuf[3] = (1 << 4);
+  obuf[3] = GZ_FCOMMENT;
   /* mtime, force lsb */
   now = time(NULL);
   lsb_buf(obuf + 4, now);
@@ -68,6 +71,124 @@ void put_gz_header(t_streamp tsp) {
   tsp->zsp->avail_out -= nbytes;
 }
 
+void put_member_header(t_streamp tsp) {
+  Bytef *obuf = tsp->zsp->next_out;
+  
+  /* exactly what bgzip writes: no mtime, unknown OS, and just the BC
+   * extra field, whose BSIZE is filled in by close_member */
+  memset(obuf, 0, BGZF_HEADER_LEN);
+  obuf[0] = 0x1f;
+  obuf[1] = 0x8b;
+  obuf[2] = 8;
+  obuf[3] = GZ_FEXTRA;
+  obuf[9] = 0xff;
+  /* XLEN */
+  obuf[10] = 6;
+  obuf[12] = 'B';
+  obuf[13] = 'C';
+  /* SLEN */
+  obuf[14] = 2;
+  tsp->member_start = obuf - tsp->outbuf;
+  tsp->member_raw = 0;
+  tsp->crc32 = 0;
+  tsp->zsp->next_out += BGZF_HEADER_LEN;
+  tsp->zsp->avail_out -= BGZF_HEADER_LEN;
+}
+
+int close_member(t_streamp tsp) {
+  z_streamp zsp = tsp->zsp;
+  Bytef *start;
+  unsigned long bsize;
+  int len, nwrite;
+  
+  do {
+    process_deflate(tsp, Z_FINISH);
+  } while (tsp->zlib_err == Z_OK);
+  if (tsp->zlib_err != Z_STREAM_END)
+    return TS_ERR_ZLIB;
+  
+  lsb_buf(zsp->next_out, tsp->crc32);
+  lsb_buf(zsp->next_out + 4, tsp->member_raw);
+  zsp->next_out += GZ_FOOTER_LEN;
+  zsp->avail_out -= GZ_FOOTER_LEN;
+  bsize = zsp->next_out - (tsp->outbuf + tsp->member_start) - 1;
+  tsp->outbuf[tsp->member_start + 16] = bsize & 0xff;
+  tsp->outbuf[tsp->member_start + 17] = (bsize >> 8) & 0xff;
+  
+  /* the member is complete, write it out (but for a partial unit with
+   * direct i/o, which moves to the front) */
+  start = tsp->outbuf + tsp->out_head;
+  len = zsp->next_out - start;
+  if (tsp->direct)
+    len -= len % tsp->align;
+  nwrite = len > 0 ? ts_fd_write(tsp, start, len) : 0;
+  if (nwrite != len) {
+    perror(nwrite >= 0 ? "partial block write" : "write block");
+    return -1;
+  }
+  tsp->zlib_bytes += nwrite;
+  len = zsp->next_out - (start + nwrite);
+  memmove(tsp->outbuf, start + nwrite, len);
+  tsp->out_head = 0;
+  zsp->next_out = tsp->outbuf + len;
+  zsp->avail_out = tsp->bufsz - len;
+  
+  tsp->zlib_err = deflateReset(zsp);
+  if (tsp->zlib_err == Z_OK && tsp->dict != NULL)
+    tsp->zlib_err = deflateSetDictionary(zsp, tsp->dict, tsp->dictlen);
+  return tsp->zlib_err == Z_OK ? 0 : TS_ERR_ZLIB;
+}
+
+int put_dict_member(t_streamp tsp) {
+  z_stream dzs;
+  Bytef *obuf = tsp->zsp->next_out;
+  uInt bsize;
+  int rv;
+  
+  /* a BGZF header, with a second extra subfield marking the member as
+   * the dictionary, and giving its size */
+  memset(obuf, 0, GZ_DICT_HEADER_LEN);
+  obuf[0] = 0x1f;
+  obuf[1] = 0x8b;
+  obuf[2] = 8;
+  obuf[3] = GZ_FEXTRA;
+  obuf[9] = 0xff;
+  obuf[10] = 6 + 6;
+  obuf[12] = 'B';
+  obuf[13] = 'C';
+  obuf[14] = 2;
+  obuf[18] = 'T';
+  obuf[19] = 'D';
+  obuf[20] = 2;
+  obuf[22] = tsp->dictlen & 0xff;
+  obuf[23] = tsp->dictlen >> 8;
+  
+  /* the dictionary itself is the data, compressed as well as can be */
+  memset(&dzs, 0, sizeof(dzs));
+  if ((tsp->zlib_err = deflateInit2(&dzs, 9, Z_DEFLATED, -MAX_WBITS, 9,
+      Z_DEFAULT_STRATEGY)) != Z_OK)
+    return TS_ERR_ZLIB;
+  dzs.next_in = tsp->dict;
+  dzs.avail_in = tsp->dictlen;
+  dzs.next_out = obuf + GZ_DICT_HEADER_LEN;
+  dzs.avail_out = tsp->zsp->avail_out - GZ_DICT_HEADER_LEN - GZ_FOOTER_LEN;
+  rv = deflate(&dzs, Z_FINISH);
+  deflateEnd(&dzs);
+  if (rv != Z_STREAM_END) {
+    tsp->zlib_err = rv == Z_OK ? Z_BUF_ERROR : rv;
+    return TS_ERR_ZLIB;
+  }
+  lsb_buf(dzs.next_out, crc(tsp->dict, tsp->dictlen));
+  lsb_buf(dzs.next_out + 4, tsp->dictlen);
+  
+  bsize = dzs.next_out + GZ_FOOTER_LEN - obuf - 1;
+  obuf[16] = bsize & 0xff;
+  obuf[17] = bsize >> 8;
+  tsp->zsp->next_out += bsize + 1;
+  tsp->zsp->avail_out -= bsize + 1;
+  return 0;
+}
+
 int put_gz_footer(t_streamp tsp) {
   Bytef obuf[GZ_FOOTER_LEN];
   int wr;
@@ -75,7 +196,7 @@ int put_gz_footer(t_streamp tsp) {
   lsb_buf(obuf, tsp->crc32);
   lsb_buf(obuf + 4, (unsigned long)(tsp->raw_bytes & 0xffffffff));
   
-  wr = write(tsp->fd, obuf, 8);
+  wr = ts_fd_write(tsp, obuf, 8);
   if (wr > 0)
     tsp->zlib_bytes += wr;
   return wr;
@@ -83,7 +204,7 @@ int put_gz_footer(t_streamp tsp) {
 
 int process_deflate(t_streamp tsp, int flush) {
   z_streamp zsp = tsp->zsp;
-  int inbytes_used, ready2write;
+  int inbytes_used, nwrite;
 
   /* save old pointer for crc calcs */
   Bytef *old_ni = zsp->next_in;
@@ -94,45 +215,131 @@ int process_deflate(t_streamp tsp, int flush) {
   
   if (inbytes_used > 0) {
     /* update crc32 and raw_bytes */
-    tsp->crc32 = update_crc(tsp->crc32, old_ni, inbytes_used);
+    if (tsp->track_crc)
+      tsp->crc32 = update_crc(tsp->crc32, old_ni, inbytes_used);
     tsp->raw_bytes += inbytes_used;
-    /* reconfigure the input buffer */
-    memmove(tsp->inbuf, zsp->next_in, zsp->avail_in);
-    zsp->next_in = tsp->inbuf;
   }
   
-  /* amount ready to write is the buffer size minus the amount unused */
-  ready2write = tsp->bufsz - zsp->avail_out;
+  /* members are written whole, by close_member */
+  if (tsp->member_group > 0)
+    return 0;
+  
+  tsp->out_tail = zsp->next_out - tsp->outbuf;
+  nwrite = ts_write_output(tsp, flush != Z_NO_FLUSH);
+  zsp->next_out = tsp->outbuf + tsp->out_tail;
+  zsp->avail_out = tsp->bufsz - tsp->out_tail;
+  return nwrite;
+}
+
+int ts_fd_write(t_streamp tsp, const void *buf, int len) {
+  if (tsp->pipe != NULL)
+    return iop_write(tsp->pipe, buf, len);
+  return write(tsp->fd, buf, len);
+}
+
+int ts_write_output(t_streamp tsp, int flush) {
+  /* ready to write is everything the codec produced we haven't written */
+  int ready2write = tsp->out_tail - tsp->out_head;
+  int ewrite = ready2write;
+  int nwrite;
   
   if (ready2write == 0)
     return 0;
   
   /* flush buffer if it's near full, or it was requested */
-  if (zsp->avail_out < tsp->blksz || flush != Z_NO_FLUSH) {
-    int ewrite = ready2write;
-    int nwrite;
-    /* if no specific flush requested, make ewrite an even multiple of the
-     * block size */
-    if (flush == Z_NO_FLUSH)
-      ewrite -= ewrite % tsp->blksz;
-    nwrite = write(tsp->fd, tsp->outbuf, ewrite);
-    if (nwrite != ewrite)
-      perror(nwrite >= 0 ? "partial block write" : "write block");
-    if (nwrite > 0) {
-      /* shift out the now flushed part of the buffer.  under some common
-       * circumstances, this will become a no-op, as the amount to move will
-       * be zero.  it's important that the amounts be based on ready2write,
-       * not ewrite, since we need to move all bytes that are used but not
-       * written */
-      memmove(tsp->outbuf, tsp->outbuf + nwrite, ready2write - nwrite);
-      zsp->next_out = tsp->outbuf + ready2write - nwrite;
-      zsp->avail_out += nwrite;
-      tsp->zlib_bytes += nwrite;
-    }
+  if (tsp->bufsz - tsp->out_tail >= tsp->blksz && !flush)
+    return 0;
+  
+  /* if no specific flush requested, make ewrite an even multiple of the
+   * block size */
+  if (!flush)
+    ewrite -= ewrite % tsp->blksz;
+  /* direct i/o only writes whole aligned units, a partial one waits for
+   * more data or for ts_close */
+  if (tsp->direct)
+    ewrite -= ewrite % tsp->align;
+  nwrite = ewrite > 0
+    ? ts_fd_write(tsp, tsp->outbuf + tsp->out_head, ewrite) : 0;
+  if (nwrite != ewrite)
+    perror(nwrite >= 0 ? "partial block write" : "write block");
+  if (nwrite < 0)
     return nwrite;
-  } else {
+  tsp->out_head += nwrite;
+  tsp->zlib_bytes += nwrite;
+  if (tsp->out_tail == tsp->out_head) {
+    /* all written, start over at the front */
+    tsp->out_head = tsp->out_tail = 0;
+  } else if (tsp->bufsz - tsp->out_tail < tsp->blksz) {
+    /* out of room at the end: wrap around, carrying the partial block
+     * that is left over (always less than blksz bytes, unless the write
+     * came up short) */
+    int carry = ready2write - nwrite;
+    memmove(tsp->outbuf, tsp->outbuf + tsp->out_head, carry);
+    tsp->out_head = 0;
+    tsp->out_tail = carry;
+  }
+  return nwrite;
+}
+
+int ts_put_output(t_streamp tsp, const Bytef *buf, size_t len) {
+  while (len > 0) {
+    size_t piece = tsp->bufsz - tsp->out_tail;
+    if (piece > len)
+      piece = len;
+    memcpy(tsp->outbuf + tsp->out_tail, buf, piece);
+    tsp->out_tail += piece;
+    buf += piece;
+    len -= piece;
+    if (ts_write_output(tsp, 0) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+static int gz_getc(t_streamp tsp);
+static int gz_more_input(t_streamp tsp);
+static int gz_next_member(t_streamp tsp);
+
+/* bookkeeping for ordinary gzip files after an inflate call: access points
+ * while building, and moving on to the next member at the end of one */
+static int gz_after_inflate(t_streamp tsp) {
+  struct gz_index *gzi = tsp->gzi;
+  z_streamp zsp = tsp->zsp;
+  int i;
+  
+  /* between deflate blocks (but not after the last one), inflate can be
+   * restarted given the window */
+  if (tsp->zlib_err == Z_OK && (zsp->data_type & 128)
+      && !(zsp->data_type & 64) && gzi_due(gzi, tsp->raw_bytes)) {
+    Bytef window[GZ_WINSIZE];
+    uInt len = GZ_WINSIZE;
+    if (inflateGetDictionary(zsp, window, &len) != Z_OK
+        || gzi_add(gzi, tsp->raw_bytes, tsp->zlib_bytes, zsp->data_type & 7,
+          0, window, len) != 0)
+      tsp->zlib_err = Z_MEM_ERROR;
+    return 0;
+  }
+  
+  if (tsp->zlib_err != Z_STREAM_END)
     return 0;
+  /* in raw mode the member trailer is still there */
+  if (tsp->gz_raw) {
+    for (i = 0; i < GZ_FOOTER_LEN; ++i)
+      if (gz_getc(tsp) < 0)
+        return 0;
   }
+  /* another member follows, unless this is the end of the file; like
+   * gzip, ignore trailing garbage (usually zero padding) */
+  if (gz_more_input(tsp) < 0)
+    return -1;
+  if (zsp->avail_in == 0 || *zsp->next_in != 0x1f)
+    return 0;
+  tsp->gz_raw = 0;
+  tsp->zlib_err = inflateReset2(zsp, MAX_WBITS + 16);
+  if (tsp->zlib_err == Z_OK && gzi_due(gzi, tsp->raw_bytes)
+      && gzi_add(gzi, tsp->raw_bytes, tsp->zlib_bytes, 0, 1, NULL, 0) != 0)
+    tsp->zlib_err = Z_MEM_ERROR;
+  return 0;
 }
 
 int process_inflate(t_streamp tsp, int flush) {
@@ -140,19 +347,20 @@ int process_inflate(t_streamp tsp, int flush) {
   int nread = 0, inbytes_used, obytes_gend;
   Bytef *old_ni, *old_no;
   
-  /* fill input buffer if it's empty */
+  /* stop at every deflate block boundary when collecting access points */
+  if (tsp->gzi != NULL && tsp->gzi->building)
+    flush = Z_BLOCK;
+  
+  /* refill input buffer once zlib has used it all up (input read ahead by
+   * ts_read_segment goes first) */
   if (zsp->avail_in == 0) {
-    /* how many bytes can we read? */
-    int eread = tsp->bufsz - zsp->avail_in;
-    /* make it a multiple of the block size */
-    eread -= eread % tsp->blksz;
-    nread = read(tsp->fd, zsp->next_in + zsp->avail_in, eread);
-    if (nread < 0) {
-      perror("read block");
+    nread = tsp->in_head < tsp->in_tail ? tsp->in_tail - tsp->in_head
+      : ts_fill_input(tsp);
+    if (nread < 0)
       return nread;
-    } else {
-      zsp->avail_in += nread;
-    }
+    zsp->next_in = tsp->inbuf + tsp->in_head;
+    zsp->avail_in = nread;
+    tsp->in_head = tsp->in_tail;
   }
 
   /* save old pointer for crc calcs */
@@ -164,57 +372,263 @@ int process_inflate(t_streamp tsp, int flush) {
   inbytes_used = zsp->next_in - old_ni;
   obytes_gend = zsp->next_out - old_no;
   /* update crc32 and byte counters */
-  tsp->crc32 = update_crc(tsp->crc32, old_no, obytes_gend);
+  if (tsp->track_crc)
+    tsp->crc32 = update_crc(tsp->crc32, old_no, obytes_gend);
   tsp->zlib_bytes += inbytes_used;
   tsp->raw_bytes += obytes_gend;
   
-  /* reconfigure the input buffer */
-  if (inbytes_used > 0) {
-    memmove(tsp->inbuf, zsp->next_in, zsp->avail_in);
-    zsp->next_in = tsp->inbuf;
+  if (tsp->gzi != NULL) {
+    if (gz_after_inflate(tsp) < 0)
+      return -1;
+  } else if (tsp->zlib_err == Z_STREAM_END) {
+    if (gz_next_member(tsp) < 0)
+      return -1;
   }
   
   return nread;
 }
 
-int read_gz_header(t_streamp tsp) {
+int ts_fill_input(t_streamp tsp) {
+  /* bufsz is a multiple of the block size, and for direct i/o of the
+   * alignment too */
+  do {
+    int nread = read(tsp->fd, tsp->inbuf, tsp->bufsz);
+    if (nread < 0) {
+      perror("read block");
+      return nread;
+    }
+    tsp->in_head = 0;
+    tsp->in_tail = nread;
+    if (tsp->in_skip > 0) {
+      uLong skip = tsp->in_skip < nread ? tsp->in_skip : nread;
+      tsp->in_head = skip;
+      tsp->in_skip -= skip;
+    }
+    if (nread == 0)
+      break;
+  } while (tsp->in_head == tsp->in_tail);
+  return tsp->in_tail - tsp->in_head;
+}
+
+/* make sure zlib has input, if there is any left.  returns the number of
+ * bytes available, 0 at eof, -1 on read errors */
+static int gz_more_input(t_streamp tsp) {
+  z_streamp zsp = tsp->zsp;
+  if (zsp->avail_in == 0) {
+    int nread = tsp->in_head < tsp->in_tail ? tsp->in_tail - tsp->in_head
+      : ts_fill_input(tsp);
+    if (nread <= 0)
+      return nread;
+    zsp->next_in = tsp->inbuf + tsp->in_head;
+    zsp->avail_in = nread;
+    tsp->in_head = tsp->in_tail;
+  }
+  return zsp->avail_in;
+}
+
+/* next byte of the compressed stream, or -1 at eof / on errors */
+static int gz_getc(t_streamp tsp) {
+  z_streamp zsp = tsp->zsp;
+  if (gz_more_input(tsp) <= 0)
+    return -1;
+  --zsp->avail_in;
+  ++tsp->zlib_bytes;
+  return *zsp->next_in++;
+}
+
+/* parse a gzip member header at the current input position, noting
+ * whether it is one of ours (the tarix comment) or a BGZF block.  returns
+ * 0, -1 on i/o errors / eof, 1 if it is not a gzip header */
+static int skip_gz_header(t_streamp tsp, int *tarix, int *bgzf,
+    uInt *dictlen) {
   const char *signature_start = "TARIX COMPRESSED v";
-  int p = 0;
-  char c;
+  int p, c, flags;
   Bytef buf[10];
-
-  int nread = read(tsp->fd, buf, 10);
-  if (nread < 0)
-    return nread;
-  if (nread != 10)
-    return 1;
   
-  /* check gzip magic */
-  if (buf[0] != 0x1f || buf[1] != 0x8b)
+  *tarix = *bgzf = 0;
+  *dictlen = 0;
+  for (p = 0; p < 10; ++p) {
+    if ((c = gz_getc(tsp)) < 0)
+      return -1;
+    buf[p] = c;
+  }
+  
+  /* check gzip magic and deflate */
+  if (buf[0] != 0x1f || buf[1] != 0x8b || buf[2] != 8)
     return 1;
-  /* check gzip settings: deflate, FCOMMENT */
-  if (buf[2] != 8 || buf[3] != (1 << 4))
+  flags = buf[3];
+  /* reserved flags */
+  if (flags & 0xe0)
     return 1;
   
-  // check comment magic: start sequence
-  while (p < strlen(signature_start)) {
-    if (read(tsp->fd, &c, 1) != 1)
+  if (flags & GZ_FEXTRA) {
+    /* subfields: two id bytes, a length, the data */
+    int xlen, lo, hi;
+    if ((lo = gz_getc(tsp)) < 0 || (hi = gz_getc(tsp)) < 0)
       return -1;
-    if (c != signature_start[p])
-      return 1;
-    ++p;
+    xlen = lo | (hi << 8);
+    while (xlen >= 4) {
+      int si1, si2, slen;
+      if ((si1 = gz_getc(tsp)) < 0 || (si2 = gz_getc(tsp)) < 0
+          || (lo = gz_getc(tsp)) < 0 || (hi = gz_getc(tsp)) < 0)
+        return -1;
+      slen = lo | (hi << 8);
+      xlen -= 4;
+      if (si1 == 'B' && si2 == 'C' && slen == 2)
+        *bgzf = 1;
+      if (si1 == 'T' && si2 == 'D' && slen == 2 && xlen >= 2) {
+        /* the member holds the preset dictionary, of this size */
+        if ((lo = gz_getc(tsp)) < 0 || (hi = gz_getc(tsp)) < 0)
+          return -1;
+        *dictlen = lo | (hi << 8);
+        slen = 0;
+        xlen -= 2;
+      }
+      for (; slen > 0 && xlen > 0; --slen, --xlen)
+        if (gz_getc(tsp) < 0)
+          return -1;
+    }
+    for (; xlen > 0; --xlen)
+      if (gz_getc(tsp) < 0)
+        return -1;
+  }
+  if (flags & GZ_FNAME) {
+    do {
+      if ((c = gz_getc(tsp)) < 0)
+        return -1;
+    } while (c != 0);
+  }
+  if (flags & GZ_FCOMMENT) {
+    /* comment magic: start sequence, one version character (zlib
+     * archives can have v1 through vCURRENT inclusive), null */
+    int match = 1;
+    for (p = 0; ; ++p) {
+      if ((c = gz_getc(tsp)) < 0)
+        return -1;
+      if (c == 0)
+        break;
+      if (p < strlen(signature_start))
+        match = match && c == signature_start[p];
+      else if (p == strlen(signature_start))
+        match = match && c - '0' >= 1 && c - '0' <= TARIX_FORMAT_VERSION;
+      else
+        match = 0;
+    }
+    *tarix = match && p == strlen(signature_start) + 1;
   }
-  // comment magic: version character (just one for now)
-  if (read(tsp->fd, &c, 1) != 1)
+  if (flags & GZ_FHCRC) {
+    if (gz_getc(tsp) < 0 || gz_getc(tsp) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+static int gz_next_member(t_streamp tsp);
+
+/* inflate the dictionary member, whose header has just been read, into
+ * tsp->dict; and move on to the member after it */
+static int gz_read_dict(t_streamp tsp, uInt len) {
+  z_streamp zsp = tsp->zsp;
+  int rv;
+  
+  if (len == 0 || len > TS_DICT_MAX || (tsp->dict = malloc(len)) == NULL)
     return -1;
-  // zlib archives can have v1 through vCURRENT inclusive
-  if (c - '0' < 1 || c - '0' > TARIX_FORMAT_VERSION)
+  tsp->dictlen = len;
+  zsp->next_out = tsp->dict;
+  zsp->avail_out = len;
+  do {
+    uInt avail;
+    if (gz_more_input(tsp) <= 0)
+      return -1;
+    avail = zsp->avail_in;
+    rv = inflate(zsp, Z_NO_FLUSH);
+    tsp->zlib_bytes += avail - zsp->avail_in;
+  } while (rv == Z_OK);
+  if (rv != Z_STREAM_END || zsp->avail_out != 0)
     return 1;
-  // comment magic: null terminator
-  if (read(tsp->fd, &c, 1) != 1)
-    return -1;
-  if (c != 0)
+  if (gz_next_member(tsp) != 0 || tsp->zlib_err != Z_OK)
     return 1;
-  
   return 0;
 }
+
+int read_gz_header(t_streamp tsp) {
+  int tarix, bgzf;
+  uInt dictlen;
+  int rv = skip_gz_header(tsp, &tarix, &bgzf, &dictlen);
+  if (rv != 0)
+    return rv;
+  if (dictlen > 0)
+    return gz_read_dict(tsp, dictlen);
+  /* BGZF blocks don't have room for our comment */
+  return tarix || bgzf ? 0 : 1;
+}
+
+int gz_member_start(t_streamp tsp) {
+  int tarix, bgzf, nread;
+  uInt dictlen;
+  if ((nread = gz_more_input(tsp)) < 0)
+    return -1;
+  /* 0x1f can't start a deflate block (it would be of the reserved type),
+   * so this is a member header, not a flush point */
+  if (nread == 0 || *tsp->zsp->next_in != 0x1f)
+    return 0;
+  return skip_gz_header(tsp, &tarix, &bgzf, &dictlen);
+}
+
+/* after the end of a member of a tarix stream: skip its trailer, and
+ * carry on with the next member if there is one */
+static int gz_next_member(t_streamp tsp) {
+  int i, rv;
+  for (i = 0; i < GZ_FOOTER_LEN; ++i)
+    if (gz_getc(tsp) < 0)
+      return 0;
+  if ((rv = gz_more_input(tsp)) <= 0)
+    /* really the end (the header may end with the input buffer, so this
+     * can't be told after it) */
+    return rv;
+  if ((rv = gz_member_start(tsp)) < 0)
+    return -1;
+  if (rv > 0) {
+    tsp->zlib_err = Z_DATA_ERROR;
+    return 0;
+  }
+  tsp->zlib_err = inflateReset(tsp->zsp);
+  if (tsp->zlib_err == Z_OK && tsp->dict != NULL)
+    tsp->zlib_err = inflateSetDictionary(tsp->zsp, tsp->dict, tsp->dictlen);
+  return 0;
+}
+
+int gz_resume(t_streamp tsp, const struct gz_point *pt) {
+  z_streamp zsp = tsp->zsp;
+  Bytef window[GZ_WINSIZE];
+  int len;
+  
+  if (pt->member) {
+    /* a fresh member, with a header */
+    tsp->gz_raw = 0;
+    tsp->zlib_err = inflateReset2(zsp, MAX_WBITS + 16);
+    return tsp->zlib_err == Z_OK ? 0 : TS_ERR_ZLIB;
+  }
+  
+  tsp->gz_raw = 1;
+  tsp->zlib_err = inflateReset2(zsp, -MAX_WBITS);
+  if (tsp->zlib_err != Z_OK)
+    return TS_ERR_ZLIB;
+  if (pt->bits) {
+    int c = gz_getc(tsp);
+    if (c < 0) {
+      tsp->zlib_err = Z_BUF_ERROR;
+      return TS_ERR_ZLIB;
+    }
+    tsp->zlib_err = inflatePrime(zsp, pt->bits, c >> (8 - pt->bits));
+    if (tsp->zlib_err != Z_OK)
+      return TS_ERR_ZLIB;
+  }
+  if ((len = gzi_window(pt, window)) < 0) {
+    tsp->zlib_err = Z_DATA_ERROR;
+    return TS_ERR_ZLIB;
+  }
+  if (len > 0)
+    tsp->zlib_err = inflateSetDictionary(zsp, window, len);
+  return tsp->zlib_err == Z_OK ? 0 : TS_ERR_ZLIB;
+}
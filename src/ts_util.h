@@ -28,11 +28,85 @@ void put_gz_header(t_streamp tsp);
 /* Write the gzip footer direct to the output fd */
 int put_gz_footer(t_streamp tsp);
 
-/* Read the gzip header, check for magic.  Returns 0 on sucess, -1 on i/o
- * error, 1 on magic problems */
+/* Read the gzip header, check for magic (our comment, or the BGZF extra
+ * field).  If the first member is a dictionary (put_dict_member), load it
+ * and go on to the next.  Returns 0 on sucess, -1 on i/o error, 1 on magic
+ * problems */
 int read_gz_header(t_streamp tsp);
 
+/* Internal function for seeks: if the input at the current position is a
+ * gzip member header, skip it.  Returns 0 (also if there is no header),
+ * -1 on i/o errors, 1 on a bad header. */
+int gz_member_start(t_streamp tsp);
+
 #define GZ_FOOTER_LEN 8
+#define BGZF_HEADER_LEN 18
+#define GZ_DICT_HEADER_LEN (BGZF_HEADER_LEN + 6)
+
+/* gzip header flags */
+#define GZ_FHCRC (1 << 1)
+#define GZ_FEXTRA (1 << 2)
+#define GZ_FNAME (1 << 3)
+#define GZ_FCOMMENT (1 << 4)
+
+/* Start a BGZF member in the output buffer (ts_set_members) */
+void put_member_header(t_streamp tsp);
+
+/* Put the member holding the preset dictionary (ts_set_dictionary) in the
+ * output buffer: a BGZF member whose data is the dictionary, with an extra
+ * 'TD' subfield giving its size.  Returns 0 or TS_ERR_ZLIB */
+int put_dict_member(t_streamp tsp);
+
+/* Finish the current member: trailer, BSIZE, and write it out.  The next
+ * one has to be started with put_member_header.  Returns 0, -1 on write
+ * errors, or TS_ERR_ZLIB. */
+int close_member(t_streamp tsp);
+
+#ifdef HAVE_ZSTD
+/* the zstd codec, from ts_zstd.c */
+extern const struct ts_codec ts_codec_zstd;
+#endif
+
+/* parallel deflate of zlib write streams, from ts_parallel.c: par_start
+ * takes over a stream after its gzip header, with jobs threads; the
+ * others stand in for the zlib codec functions of the same name once it
+ * has, and par_end frees it all (also after errors) */
+int par_start(t_streamp tsp, int jobs);
+int par_compress(t_streamp tsp, Bytef *buf, int len);
+off64_t par_checkpoint(t_streamp tsp);
+int par_finish(t_streamp tsp);
+void par_end(t_streamp tsp);
+
+struct gz_point;
+
+/* Internal function to restart inflate at an access point of an ordinary
+ * gzip file, the fd must be positioned at the point's byte (or the byte
+ * before, for a point in the middle of one).  Returns 0, or TS_ERR_ZLIB.
+ */
+int gz_resume(t_streamp tsp, const struct gz_point *pt);
+
+/* Internal function to refill the input buffer of a read stream from the
+ * file descriptor, honoring in_skip.  Sets in_head and in_tail and returns
+ * the number of bytes available, 0 at eof, or -1 on read errors.
+ */
+int ts_fill_input(t_streamp tsp);
+
+/* Internal function for every write to the fd of a write stream: straight
+ * to the fd, or queued on its pipe (ts_set_async).  Returns as write(2).
+ */
+int ts_fd_write(t_streamp tsp, const void *buf, int len);
+
+/* Internal function to write out the data a codec left in
+ * outbuf[out_head, out_tail): whole blocks once outbuf is close to full,
+ * everything (but for a partial unit with direct i/o) if flush is set.
+ * Returns the number of bytes written, or -1 on write errors.
+ */
+int ts_write_output(t_streamp tsp, int flush);
+
+/* Internal function to append len bytes of codec output to outbuf, writing
+ * it out as it fills.  Returns 0, or -1 on write errors.
+ */
+int ts_put_output(t_streamp tsp, const Bytef *buf, size_t len);
 
 /* Internal function to handle an iteration of calling deflate on the zlib
  * stream.  Will write the output buffer to the file descriptor and reset it
@@ -0,0 +1,429 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/* the zstd codec for tstream: one zstd frame per checkpoint, and a seek
+ * table at the end in the zstd seekable format, so other tools can seek
+ * in tarix's archives too */
+
+#include "config.h"
+
+#ifdef HAVE_ZSTD
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zstd.h>
+#include <zstd_errors.h>
+
+#include "tstream.h"
+#include "ts_util.h"
+
+/* frames can't be bigger than the seek table can describe, beyond that
+ * they are cut short (inside a file, so the index doesn't point there) */
+#define ZSTD_FRAME_MAX (1 << 30)
+
+/* skippable frame holding the seek table, and the magic that ends it */
+#define SEEKABLE_SKIPPABLE_MAGIC 0x184d2a5e
+#define SEEKABLE_MAGIC 0x8f92eab1
+#define SEEKABLE_FOOTER_LEN 9
+
+/* skippable frame holding the preset dictionary, at the very start */
+#define DICT_SKIPPABLE_MAGIC 0x184d2a5d
+#define DICT_TAG "TXDC"
+#define DICT_HEADER_LEN 12
+
+struct zstd_state {
+  ZSTD_CCtx *cctx;
+  ZSTD_DCtx *dctx;
+  /* error code of the last zstd call that failed */
+  size_t err;
+  /* write streams: the frame being written started at this output offset,
+   * and has frame_raw bytes of input so far */
+  off64_t frame_start;
+  uLong frame_raw;
+  /* the seek table: compressed and uncompressed size of each frame */
+  uint32_t *table;
+  size_t nframes;
+  size_t tablesz;
+  /* read streams: the decoder is in the middle of a frame */
+  int in_frame;
+};
+
+#define ZSTATE(tsp) ((struct zstd_state*)(tsp)->cstate)
+
+/* record a zstd error, returns TS_ERR_ZLIB */
+static int zstd_fail(t_streamp tsp, size_t code) {
+  ZSTATE(tsp)->err = code;
+  tsp->zlib_err = ZSTD_getErrorCode(code) == ZSTD_error_memory_allocation
+    ? Z_MEM_ERROR : Z_DATA_ERROR;
+  return TS_ERR_ZLIB;
+}
+
+/* compressed bytes produced so far, written or not */
+static off64_t zstd_out_pos(t_streamp tsp) {
+  return tsp->zlib_bytes + (tsp->out_tail - tsp->out_head);
+}
+
+static int zstd_init_write(t_streamp tsp, int level) {
+  struct zstd_state *zs = calloc(1, sizeof(*zs));
+  size_t rv;
+  
+  tsp->cstate = zs;
+  if (zs == NULL || (zs->cctx = ZSTD_createCCtx()) == NULL) {
+    tsp->zlib_err = Z_MEM_ERROR;
+    return TS_ERR_ZLIB;
+  }
+  if (ZSTD_isError(rv = ZSTD_CCtx_setParameter(zs->cctx,
+        ZSTD_c_compressionLevel, level))
+      || ZSTD_isError(rv = ZSTD_CCtx_setParameter(zs->cctx,
+        ZSTD_c_checksumFlag, 1)))
+    return zstd_fail(tsp, rv);
+  return 0;
+}
+
+/* run the compressor on in, writing out full buffers as they come */
+static int zstd_run(t_streamp tsp, ZSTD_inBuffer *in, ZSTD_EndDirective mode) {
+  struct zstd_state *zs = ZSTATE(tsp);
+  size_t left;
+  
+  do {
+    ZSTD_outBuffer out = { tsp->outbuf, tsp->bufsz, tsp->out_tail };
+    left = ZSTD_compressStream2(zs->cctx, &out, in, mode);
+    tsp->out_tail = out.pos;
+    if (ZSTD_isError(left))
+      return zstd_fail(tsp, left);
+    if (ts_write_output(tsp, 0) < 0)
+      return -1;
+  } while (mode == ZSTD_e_continue ? in->pos < in->size : left != 0);
+  return 0;
+}
+
+/* add the frame that ends here to the seek table */
+static int zstd_add_frame(t_streamp tsp) {
+  struct zstd_state *zs = ZSTATE(tsp);
+  off64_t end;
+  
+  if (zs->nframes == zs->tablesz) {
+    size_t newsz = zs->tablesz ? zs->tablesz * 2 : 256;
+    uint32_t *table = realloc(zs->table, 2 * newsz * sizeof(*table));
+    if (table == NULL) {
+      tsp->zlib_err = Z_MEM_ERROR;
+      return TS_ERR_ZLIB;
+    }
+    zs->table = table;
+    zs->tablesz = newsz;
+  }
+  end = zstd_out_pos(tsp);
+  zs->table[2 * zs->nframes] = end - zs->frame_start;
+  zs->table[2 * zs->nframes + 1] = zs->frame_raw;
+  ++zs->nframes;
+  zs->frame_start = end;
+  zs->frame_raw = 0;
+  return 0;
+}
+
+/* end the current frame, if it has anything in it */
+static int zstd_end_frame(t_streamp tsp) {
+  struct zstd_state *zs = ZSTATE(tsp);
+  ZSTD_inBuffer in = { NULL, 0, 0 };
+  int rv;
+  
+  if (zs->frame_raw == 0)
+    return 0;
+  if ((rv = zstd_run(tsp, &in, ZSTD_e_end)) != 0)
+    return rv;
+  return zstd_add_frame(tsp);
+}
+
+static int zstd_compress(t_streamp tsp, Bytef *buf, int len) {
+  struct zstd_state *zs = ZSTATE(tsp);
+  int left = len;
+  
+  while (left > 0) {
+    uLong room = ZSTD_FRAME_MAX - zs->frame_raw;
+    int piece = left < room ? left : room;
+    ZSTD_inBuffer in = { buf, piece, 0 };
+    int rv;
+    
+    if ((rv = zstd_run(tsp, &in, ZSTD_e_continue)) != 0)
+      return rv;
+    tsp->raw_bytes += piece;
+    zs->frame_raw += piece;
+    buf += piece;
+    left -= piece;
+    if (piece == room && (rv = zstd_end_frame(tsp)) != 0)
+      return rv;
+  }
+  return len;
+}
+
+static off64_t zstd_checkpoint(t_streamp tsp) {
+  int rv = zstd_end_frame(tsp);
+  if (rv != 0)
+    return rv;
+  /* the next frame starts here */
+  return zstd_out_pos(tsp);
+}
+
+static void put_le32(Bytef *buf, uint32_t v);
+
+/* the dictionary goes in a skippable frame of its own (compressed, as a
+ * zstd frame), which the seek table lists as a frame with no content */
+static int zstd_set_dict(t_streamp tsp) {
+  struct zstd_state *zs = ZSTATE(tsp);
+  size_t bound = ZSTD_compressBound(tsp->dictlen);
+  Bytef *frame = malloc(DICT_HEADER_LEN + bound);
+  size_t rv;
+  
+  if (frame == NULL) {
+    tsp->zlib_err = Z_MEM_ERROR;
+    return TS_ERR_ZLIB;
+  }
+  rv = ZSTD_compress(frame + DICT_HEADER_LEN, bound, tsp->dict,
+    tsp->dictlen, ZSTD_maxCLevel());
+  if (ZSTD_isError(rv)) {
+    free(frame);
+    return zstd_fail(tsp, rv);
+  }
+  put_le32(frame, DICT_SKIPPABLE_MAGIC);
+  put_le32(frame + 4, 4 + rv);
+  memcpy(frame + 8, DICT_TAG, 4);
+  rv = ts_put_output(tsp, frame, DICT_HEADER_LEN + rv);
+  free(frame);
+  if (rv != 0)
+    return -1;
+  if ((rv = zstd_add_frame(tsp)) != 0)
+    return rv;
+  
+  if (ZSTD_isError(rv = ZSTD_CCtx_loadDictionary(zs->cctx, tsp->dict,
+        tsp->dictlen)))
+    return zstd_fail(tsp, rv);
+  return 0;
+}
+
+/* the library's own worker threads, a library built without them just
+ * compresses the same as before */
+static int zstd_set_jobs(t_streamp tsp, int jobs) {
+  struct zstd_state *zs = ZSTATE(tsp);
+  ZSTD_CCtx_setParameter(zs->cctx, ZSTD_c_nbWorkers, jobs);
+  return 0;
+}
+
+static int zstd_finish(t_streamp tsp) {
+  return zstd_end_frame(tsp);
+}
+
+static void put_le32(Bytef *buf, uint32_t v) {
+  buf[0] = v & 0xff;
+  buf[1] = (v >> 8) & 0xff;
+  buf[2] = (v >> 16) & 0xff;
+  buf[3] = (v >> 24) & 0xff;
+}
+
+/* the seek table, as a skippable frame: entries of compressed and
+ * decompressed size (no checksums, the frames have their own), then the
+ * frame count, descriptor and magic */
+static int zstd_trailer(t_streamp tsp) {
+  struct zstd_state *zs = ZSTATE(tsp);
+  size_t body = 8 * zs->nframes + SEEKABLE_FOOTER_LEN;
+  size_t len = 8 + body, i;
+  Bytef *buf = malloc(len);
+  ssize_t nwrite;
+  
+  if (buf == NULL) {
+    perror("seek table");
+    return -1;
+  }
+  put_le32(buf, SEEKABLE_SKIPPABLE_MAGIC);
+  put_le32(buf + 4, body);
+  for (i = 0; i < 2 * zs->nframes; ++i)
+    put_le32(buf + 8 + 4 * i, zs->table[i]);
+  put_le32(buf + len - 9, zs->nframes);
+  buf[len - 5] = 0;
+  put_le32(buf + len - 4, SEEKABLE_MAGIC);
+  
+  nwrite = ts_fd_write(tsp, buf, len);
+  free(buf);
+  if (nwrite != len) {
+    perror(nwrite >= 0 ? "partial seek table write" : "write seek table");
+    return -1;
+  }
+  tsp->zlib_bytes += nwrite;
+  return 0;
+}
+
+static uint32_t get_le32(const Bytef *buf) {
+  return buf[0] | buf[1] << 8 | buf[2] << 16 | (uint32_t)buf[3] << 24;
+}
+
+/* take exactly len bytes from the input */
+static int zstd_take(t_streamp tsp, Bytef *buf, size_t len) {
+  while (len > 0) {
+    size_t piece = tsp->in_tail - tsp->in_head;
+    if (piece == 0) {
+      int nread = ts_fill_input(tsp);
+      if (nread <= 0)
+        return -1;
+      continue;
+    }
+    if (piece > len)
+      piece = len;
+    memcpy(buf, tsp->inbuf + tsp->in_head, piece);
+    tsp->in_head += piece;
+    tsp->zlib_bytes += piece;
+    buf += piece;
+    len -= piece;
+  }
+  return 0;
+}
+
+/* pick up the preset dictionary, if the archive starts with one */
+static int zstd_read_dict(t_streamp tsp) {
+  struct zstd_state *zs = ZSTATE(tsp);
+  Bytef header[DICT_HEADER_LEN];
+  Bytef *frame;
+  uint32_t flen;
+  unsigned long long len;
+  size_t rv;
+  
+  /* detect_codec has just filled the input buffer */
+  if (tsp->in_tail - tsp->in_head < 4
+      || get_le32(tsp->inbuf + tsp->in_head) != DICT_SKIPPABLE_MAGIC)
+    return 0;
+  if (zstd_take(tsp, header, DICT_HEADER_LEN) != 0
+      || memcmp(header + 8, DICT_TAG, 4) != 0
+      || (flen = get_le32(header + 4) - 4) == 0
+      || flen > ZSTD_compressBound(TS_DICT_MAX)) {
+    tsp->zlib_err = Z_DATA_ERROR;
+    return TS_ERR_ZLIB;
+  }
+  if ((frame = malloc(flen)) == NULL) {
+    tsp->zlib_err = Z_MEM_ERROR;
+    return TS_ERR_ZLIB;
+  }
+  if (zstd_take(tsp, frame, flen) != 0
+      || (len = ZSTD_getFrameContentSize(frame, flen)) == 0
+      || len > TS_DICT_MAX
+      || (tsp->dict = malloc(len)) == NULL) {
+    free(frame);
+    tsp->zlib_err = Z_DATA_ERROR;
+    return TS_ERR_ZLIB;
+  }
+  tsp->dictlen = len;
+  rv = ZSTD_decompress(tsp->dict, len, frame, flen);
+  free(frame);
+  if (ZSTD_isError(rv))
+    return zstd_fail(tsp, rv);
+  
+  /* a session reset (zstd_reset) leaves this in place */
+  if (ZSTD_isError(rv = ZSTD_DCtx_loadDictionary(zs->dctx, tsp->dict, len)))
+    return zstd_fail(tsp, rv);
+  return 0;
+}
+
+static int zstd_init_read(t_streamp tsp) {
+  struct zstd_state *zs = calloc(1, sizeof(*zs));
+  
+  tsp->cstate = zs;
+  if (zs == NULL || (zs->dctx = ZSTD_createDCtx()) == NULL) {
+    tsp->zlib_err = Z_MEM_ERROR;
+    return TS_ERR_ZLIB;
+  }
+  return zstd_read_dict(tsp);
+}
+
+static int zstd_decompress(t_streamp tsp, Bytef *buf, int len) {
+  struct zstd_state *zs = ZSTATE(tsp);
+  ZSTD_inBuffer in;
+  ZSTD_outBuffer out = { buf, len, 0 };
+  size_t rv;
+  
+  if (tsp->in_head == tsp->in_tail) {
+    int nread = ts_fill_input(tsp);
+    if (nread < 0)
+      return nread;
+    if (nread == 0) {
+      /* the end, which had better not be in the middle of a frame */
+      tsp->zlib_err = zs->in_frame ? Z_DATA_ERROR : Z_STREAM_END;
+      return 0;
+    }
+  }
+  
+  in.src = tsp->inbuf;
+  in.size = tsp->in_tail;
+  in.pos = tsp->in_head;
+  rv = ZSTD_decompressStream(zs->dctx, &out, &in);
+  tsp->zlib_bytes += in.pos - tsp->in_head;
+  tsp->in_head = in.pos;
+  tsp->raw_bytes += out.pos;
+  if (ZSTD_isError(rv))
+    return zstd_fail(tsp, rv);
+  /* frames (and the seek table) follow each other until eof */
+  zs->in_frame = rv != 0;
+  return out.pos;
+}
+
+static int zstd_reset(t_streamp tsp) {
+  struct zstd_state *zs = ZSTATE(tsp);
+  size_t rv = ZSTD_DCtx_reset(zs->dctx, ZSTD_reset_session_only);
+  if (ZSTD_isError(rv))
+    return zstd_fail(tsp, rv);
+  zs->in_frame = 0;
+  tsp->zlib_err = Z_OK;
+  return 0;
+}
+
+static void zstd_end(t_streamp tsp) {
+  struct zstd_state *zs = ZSTATE(tsp);
+  if (zs == NULL)
+    return;
+  ZSTD_freeCCtx(zs->cctx);
+  ZSTD_freeDCtx(zs->dctx);
+  free(zs->table);
+  free(zs);
+  tsp->cstate = NULL;
+}
+
+static const char *zstd_errmsg(t_streamp tsp) {
+  struct zstd_state *zs = ZSTATE(tsp);
+  if (zs == NULL || zs->err == 0)
+    return zError(tsp->zlib_err);
+  return ZSTD_getErrorName(zs->err);
+}
+
+const struct ts_codec ts_codec_zstd = {
+  .name = "zstd",
+  .init_write = zstd_init_write,
+  .header = NULL,
+  .compress = zstd_compress,
+  .checkpoint = zstd_checkpoint,
+  .set_dict = zstd_set_dict,
+  .set_jobs = zstd_set_jobs,
+  .finish = zstd_finish,
+  .trailer = zstd_trailer,
+  .init_read = zstd_init_read,
+  .decompress = zstd_decompress,
+  .reset = zstd_reset,
+  .end = zstd_end,
+  .errmsg = zstd_errmsg,
+};
+
+#endif /* HAVE_ZSTD */
@@ -24,6 +24,8 @@
 
 #include "config.h"
 
+#include "gzindex.h"
+#include "io_pipe.h"
 #include "portability.h"
 #include "tstream.h"
 #include "ts_util.h"
@@ -31,19 +33,50 @@
 
 /* TODO: pass filename for inclusion in gzip header */
 
-/* common tsp init */
-static void init_ts_buffers(t_streamp tsp) {
-  if (tsp->bufsz <= 0)
-    tsp->bufsz = TS_BUFSZ;
-  if (tsp->inbuf == NULL)
-    tsp->inbuf = (Bytef*)malloc(tsp->bufsz);
-  if (tsp->outbuf == NULL)
-    tsp->outbuf = (Bytef*)malloc(tsp->bufsz);
+static Bytef *alloc_ts_buffer(t_streamp tsp) {
+  void *buf;
+  if (posix_memalign(&buf, tsp->align, tsp->bufsz) != 0)
+    return NULL;
+  return (Bytef*)buf;
+}
+
+/* (re)set the buffers, allocating them the first time.  returns 0, or -1
+ * if allocation failed */
+static int init_ts_buffers(t_streamp tsp) {
+  /* compressed reads need input, direct reads need aligned input */
+  if (tsp->inbuf == NULL && tsp->mode == TS_READ
+      && (tsp->codec != NULL || tsp->direct)) {
+    if ((tsp->inbuf = alloc_ts_buffer(tsp)) == NULL)
+      return -1;
+    tsp->insz = tsp->bufsz;
+  }
+  /* write streams deflate directly from the caller's buffer, but need
+   * somewhere for the output; uncompressed writes get collected here */
+  if (tsp->outbuf == NULL
+      && (tsp->codec != NULL || tsp->mode == TS_WRITE)) {
+    if ((tsp->outbuf = alloc_ts_buffer(tsp)) == NULL)
+      return -1;
+  }
+  tsp->in_head = tsp->in_tail = tsp->in_skip = 0;
+  tsp->out_head = tsp->out_tail = 0;
+  if (tsp->zsp != NULL) {
     /* put our buffer info into it */
     tsp->zsp->next_in = tsp->inbuf;
     tsp->zsp->avail_in = 0;
     tsp->zsp->next_out = tsp->outbuf;
     tsp->zsp->avail_out = tsp->bufsz;
+  }
+  return 0;
+}
+
+static void free_ts_buffers(t_streamp tsp) {
+  free(tsp->inbuf);
+  free(tsp->outbuf);
+  free(tsp->zsp);
+  free(tsp->dict);
+  tsp->inbuf = tsp->outbuf = NULL;
+  tsp->zsp = NULL;
+  tsp->dict = NULL;
 }
 
 static int do_seek(t_streamp tsp, off64_t offset) {
@@ -92,18 +125,29 @@ static off64_t do_tell(t_streamp tsp) {
 
 /* common tsp init */
 static t_streamp init_ts(t_streamp tsp, int fd, int usemt, int blksz,
-    int zlib_level) {
+    int bufsz, const struct ts_codec *codec) {
   /* allocate the stream data */
   if (tsp == NULL)
     tsp = calloc(1, sizeof(t_stream));
 
   /* initialize fields */
   tsp->fd = fd;
+  tsp->codec = codec;
   tsp->zlib_err = Z_OK;
+  tsp->resumed_at = 0;
 #ifdef HAVE_MTIO_H
   tsp->usemt = usemt;
 #endif
   tsp->blksz = blksz <= 0 ? TARBLKSZ : blksz;
+  tsp->align = sysconf(_SC_PAGESIZE);
+  tsp->direct = p_get_direct(fd);
+  /* buffers hold whole blocks, and whole aligned units for direct i/o */
+  tsp->bufsz = bufsz <= 0 ? TS_BUFSZ : bufsz;
+  if (tsp->bufsz > TS_MAX_BUFSZ)
+    tsp->bufsz = TS_MAX_BUFSZ;
+  tsp->bufsz += (tsp->blksz - tsp->bufsz % tsp->blksz) % tsp->blksz;
+  if (tsp->direct)
+    tsp->bufsz += (tsp->align - tsp->bufsz % tsp->align) % tsp->align;
   
 #ifdef HAVE_MTIO_H
   if (tsp->usemt) {
@@ -130,67 +174,312 @@ static t_streamp init_ts(t_streamp tsp, int fd, int usemt, int blksz,
     return tsp;
   }
   
-  if (zlib_level > 0) {
-    /* create the zlib stream */
-    tsp->zsp = calloc(1, sizeof(z_stream));
-    
-    init_ts_buffers(tsp);
-  }
-  
   return tsp;
 }
 
-t_streamp init_tws(t_streamp tsp, int fd, int usemt, int blksz,
+/* create the zlib stream of the zlib codec, on the buffers (and any input
+ * that is already there) */
+static int zlib_alloc(t_streamp tsp) {
+  z_streamp zsp = calloc(1, sizeof(z_stream));
+  if (zsp == NULL)
+    return -1;
+  zsp->next_in = tsp->inbuf + tsp->in_head;
+  zsp->avail_in = tsp->in_tail - tsp->in_head;
+  tsp->in_head = tsp->in_tail;
+  zsp->next_out = tsp->outbuf;
+  zsp->avail_out = tsp->bufsz;
+  tsp->zsp = zsp;
+  return 0;
+}
+
+t_streamp init_tws(t_streamp tsp, int fd, int usemt, int blksz, int bufsz,
     int zlib_level) {
-  /* common init, includes part of zlib */
-  tsp = init_ts(tsp, fd, usemt, blksz, zlib_level);
+  return init_tws_codec(tsp, fd, usemt, blksz, bufsz, zlib_level,
+    zlib_level > 0 ? &ts_codec_zlib : NULL);
+}
+
+t_streamp init_tws_codec(t_streamp tsp, int fd, int usemt, int blksz,
+    int bufsz, int level, const struct ts_codec *codec) {
+  /* common init */
+  tsp = init_ts(tsp, fd, usemt, blksz, bufsz, codec);
   tsp->mode = TS_WRITE;
+  tsp->track_crc = 1;
+  if (tsp->zlib_err != Z_OK)
+    return tsp;
+  if (init_ts_buffers(tsp) != 0) {
+    tsp->zlib_err = Z_MEM_ERROR;
+    return tsp;
+  }
 
-  /* if zlib asked for, set it up */
-  if (zlib_level > 0) {
-  
-    /* negative window bits suppress zlib wrapper */
-    tsp->zlib_err = deflateInit2(tsp->zsp, zlib_level, Z_DEFLATED, -MAX_WBITS,
-      MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
-    if (tsp->zlib_err != Z_OK)
+  /* if compression asked for, set it up */
+  tsp->level = level;
+  if (codec != NULL) {
+    if (codec->init_write(tsp, level) != 0)
       return tsp;
-    
-    /* add the gzip header to the stream */
-    put_gz_header(tsp);
+    if (codec->header != NULL)
+      codec->header(tsp);
   }
   
   return tsp;
 }
 
-t_streamp init_trs(t_streamp tsp, int fd, int usemt, int blksz,
-    int zlib_level) {
-  /* common init, includes part of zlib */
-  tsp = init_ts(tsp, fd, usemt, blksz, zlib_level);
-  tsp->mode = TS_READ;
+int ts_set_members(t_streamp tsp, uLong group) {
+  if (tsp == NULL || tsp->mode != TS_WRITE || tsp->codec != &ts_codec_zlib
+      || tsp->zlib_bytes != 0 || tsp->raw_bytes != 0 || tsp->par != NULL)
+    return TS_ERR_BADMODE;
+  
+  /* a whole member has to fit in outbuf */
+  if (tsp->bufsz < TS_MEMBER_BUFSZ) {
+    free(tsp->outbuf);
+    tsp->bufsz = TS_MEMBER_BUFSZ;
+    if ((tsp->outbuf = alloc_ts_buffer(tsp)) == NULL) {
+      tsp->zlib_err = Z_MEM_ERROR;
+      return TS_ERR_ZLIB;
+    }
+  }
+  
+  /* drop the tarix header, the members have their own */
+  tsp->out_head = tsp->out_tail = 0;
+  tsp->zsp->next_out = tsp->outbuf;
+  tsp->zsp->avail_out = tsp->bufsz;
+  tsp->member_group = group < 1 ? 1
+    : group > TS_MEMBER_MAX ? TS_MEMBER_MAX : group;
+  tsp->member_flushes = 0;
+  put_member_header(tsp);
+  
+  return 0;
+}
 
-  /* if zlib asked for, set it up */
-  if (zlib_level > 0) {
-     int gzhrv;
+int ts_set_dictionary(t_streamp tsp, const Bytef *dict, uInt len) {
+  if (tsp == NULL || tsp->mode != TS_WRITE || tsp->codec == NULL
+      || tsp->zlib_bytes != 0 || tsp->raw_bytes != 0 || len == 0)
+    return TS_ERR_BADMODE;
   
-    /* negative window bits suppress zlib wrapper */
-    tsp->zlib_err = inflateInit2(tsp->zsp, -MAX_WBITS);
-    if (tsp->zlib_err != Z_OK)
-      return tsp;
+  if (len > TS_DICT_MAX) {
+    dict += len - TS_DICT_MAX;
+    len = TS_DICT_MAX;
+  }
+  if ((tsp->dict = malloc(len)) == NULL) {
+    tsp->zlib_err = Z_MEM_ERROR;
+    return TS_ERR_ZLIB;
+  }
+  memcpy(tsp->dict, dict, len);
+  tsp->dictlen = len;
+  return tsp->codec->set_dict(tsp);
+}
+
+int ts_set_jobs(t_streamp tsp, int jobs) {
+  if (tsp == NULL || tsp->mode != TS_WRITE || tsp->codec == NULL
+      || tsp->raw_bytes != 0)
+    return TS_ERR_BADMODE;
+  if (jobs <= 1)
+    return 0;
+  return tsp->codec->set_jobs(tsp, jobs);
+}
+
+int ts_set_async(t_streamp tsp, int nbufs) {
+  if (tsp == NULL || tsp->mode != TS_WRITE || tsp->pipe != NULL)
+    return TS_ERR_BADMODE;
+#ifdef HAVE_MTIO_H
+  if (tsp->usemt)
+    return 0;
+#endif
+  if (nbufs <= 1)
+    return 0;
+  tsp->pipe = iop_start_writer(tsp->fd, tsp->bufsz, nbufs, tsp->align);
+  return tsp->pipe != NULL ? 0 : -1;
+}
+
+/* end the current member and start the next */
+static int next_member(t_streamp tsp) {
+  int rv = close_member(tsp);
+  if (rv != 0)
+    return rv;
+  tsp->member_flushes = 0;
+  put_member_header(tsp);
+  return 0;
+}
+
+/* ts_write for ts_set_members streams: members are cut when they are
+ * full, however the data is split up */
+static int member_write(t_streamp tsp, Bytef *buf, int len) {
+  z_streamp zsp = tsp->zsp;
+  int left = len;
+  
+  while (left > 0) {
+    uLong room = TS_MEMBER_MAX - tsp->member_raw
+      - tsp->member_flushes * TS_MEMBER_FLUSH;
+    int piece = left < room ? left : room;
+    
+    zsp->next_in = buf;
+    zsp->avail_in = piece;
+    while (zsp->avail_in > 0) {
+      process_deflate(tsp, Z_NO_FLUSH);
+      if (tsp->zlib_err != Z_OK)
+        return TS_ERR_ZLIB;
+    }
+    tsp->member_raw += piece;
+    buf += piece;
+    left -= piece;
     
-    /* read the gzip header from the stream */
-    gzhrv = read_gz_header(tsp);
-    if (gzhrv != 0)
-      tsp->zlib_err = Z_VERSION_ERROR;
+    if (piece == room) {
+      int rv = next_member(tsp);
+      if (rv != 0)
+        return rv;
+    }
+  }
+  
+  return len;
+}
+
+/* which codec wrote the archive: zstd frames (or the skippable frame of
+ * a dictionary) start with their magic, anything else had better be gzip */
+static const struct ts_codec *detect_codec(t_streamp tsp) {
+#ifdef HAVE_ZSTD
+  static const Bytef zstd_magic[4] = { 0x28, 0xb5, 0x2f, 0xfd };
+  Bytef *p;
+  if (ts_fill_input(tsp) >= 4
+      && (memcmp(p = tsp->inbuf + tsp->in_head, zstd_magic, 4) == 0
+        || ((p[0] & 0xf0) == 0x50 && p[1] == 0x2a && p[2] == 0x4d
+          && p[3] == 0x18)))
+    return &ts_codec_zstd;
+#endif
+  return &ts_codec_zlib;
+}
+
+t_streamp init_trs(t_streamp tsp, int fd, int usemt, int blksz, int bufsz,
+    int zlib_level) {
+  /* common init; the input buffer is needed to find out the codec */
+  tsp = init_ts(tsp, fd, usemt, blksz, bufsz,
+    zlib_level > 0 ? &ts_codec_zlib : NULL);
+  tsp->mode = TS_READ;
+  tsp->track_crc = 0;
+  if (tsp->zlib_err != Z_OK)
+    return tsp;
+  if (init_ts_buffers(tsp) != 0) {
+    tsp->zlib_err = Z_MEM_ERROR;
+    return tsp;
+  }
+  
+  if (tsp->codec != NULL) {
+    tsp->codec = detect_codec(tsp);
+    tsp->codec->init_read(tsp);
   }
   
   return tsp;
 }
 
-int ts_write(t_streamp tsp, void *buf, int len) {
-  int left; /* how many bytes in buf left to process? */
-  Bytef *cur; /* pointer to next byte to process in buf */
-  z_streamp zsp;
+t_streamp init_gzrs(t_streamp tsp, int fd, int bufsz, struct gz_index *gzi) {
+  tsp = init_ts(tsp, fd, 0, 0, bufsz, &ts_codec_zlib);
+  tsp->mode = TS_READ;
+  tsp->track_crc = 0;
+  tsp->gzi = gzi;
+  if (tsp->zlib_err != Z_OK)
+    return tsp;
+  if (init_ts_buffers(tsp) != 0 || zlib_alloc(tsp) != 0) {
+    tsp->zlib_err = Z_MEM_ERROR;
+    return tsp;
+  }
+  
+  /* zlib takes care of the gzip headers and trailers (and checks the
+   * crc) when reading from the start of a member */
+  tsp->zlib_err = inflateInit2(tsp->zsp, MAX_WBITS + 16);
+  if (tsp->zlib_err == Z_OK && gzi->building
+      && gzi_add(gzi, 0, 0, 0, 1, NULL, 0) != 0)
+    tsp->zlib_err = Z_MEM_ERROR;
+  
+  return tsp;
+}
+
+/* collect uncompressed data, writing whole buffers */
+static int buffered_write(t_streamp tsp, const Bytef *buf, int len) {
+  int left = len;
+  while (left > 0) {
+    int toadd = tsp->bufsz - tsp->out_tail;
+    if (toadd > left)
+      toadd = left;
+    memcpy(tsp->outbuf + tsp->out_tail, buf, toadd);
+    tsp->out_tail += toadd;
+    tsp->raw_bytes += toadd;
+    buf += toadd;
+    left -= toadd;
+    if (tsp->out_tail == tsp->bufsz) {
+      int nwrite = ts_fd_write(tsp, tsp->outbuf, tsp->bufsz);
+      if (nwrite != tsp->bufsz) {
+        perror(nwrite >= 0 ? "partial block write" : "write block");
+        return -1;
+      }
+      tsp->out_tail = 0;
+    }
+  }
+  return len;
+}
+
+/* hand out uncompressed data read with direct i/o */
+static int buffered_read(t_streamp tsp, Bytef *buf, int len) {
+  int left = len;
+  while (left > 0) {
+    int toadd;
+    if (tsp->in_head == tsp->in_tail) {
+      int nread = ts_fill_input(tsp);
+      if (nread < 0)
+        return nread;
+      if (nread == 0)
+        break;
+    }
+    toadd = tsp->in_tail - tsp->in_head;
+    if (toadd > left)
+      toadd = left;
+    memcpy(buf, tsp->inbuf + tsp->in_head, toadd);
+    tsp->in_head += toadd;
+    tsp->raw_bytes += toadd;
+    buf += toadd;
+    left -= toadd;
+  }
+  return len - left;
+}
+
+/* write out whatever is left in the output buffer at close.  for direct
+ * i/o, the last partial unit can't be written with O_DIRECT, so switch the
+ * fd back to normal i/o for it */
+static int flush_tail(t_streamp tsp) {
+  Bytef *start = tsp->outbuf + tsp->out_head;
+  int len, nwrite;
   
+  if (tsp->zsp != NULL)
+    len = tsp->zsp->next_out - start;
+  else
+    len = tsp->out_tail - tsp->out_head;
+  /* a trailer may follow, even with nothing left here */
+  if (tsp->direct) {
+    /* what is queued was meant for O_DIRECT */
+    if (tsp->pipe != NULL && iop_drain(tsp->pipe) != 0) {
+      perror("write block");
+      return -1;
+    }
+    if (p_set_direct(tsp->fd, 0) != 0) {
+      perror("clear O_DIRECT");
+      return -1;
+    }
+    tsp->direct = 0;
+  }
+  if (len == 0)
+    return 0;
+  nwrite = ts_fd_write(tsp, start, len);
+  if (nwrite != len) {
+    perror(nwrite >= 0 ? "partial block write" : "write block");
+    return -1;
+  }
+  if (tsp->zsp != NULL) {
+    tsp->zlib_bytes += nwrite;
+    tsp->zsp->next_out = tsp->outbuf;
+    tsp->zsp->avail_out = tsp->bufsz;
+  }
+  tsp->out_head = tsp->out_tail = 0;
+  return 0;
+}
+
+int ts_write(t_streamp tsp, void *buf, int len) {
   /* sanity check */
   if (tsp == NULL || tsp->mode != TS_WRITE)
     return TS_ERR_BADMODE;
@@ -199,112 +488,158 @@ int ts_write(t_streamp tsp, void *buf, int len) {
   if (len == 0)
     return 0;
   
-  if (tsp->zsp == NULL) {
-    /* non-zlib is just a simple write through */
-    return write(tsp->fd, buf, len);
+  if (tsp->codec == NULL) {
+    /* uncompressed is a write through, in buffer sized pieces */
+    return buffered_write(tsp, buf, len);
   }
   
-  /* dump into zlib buffers */
+  return tsp->codec->compress(tsp, buf, len);
+}
+
+static int zlib_compress(t_streamp tsp, Bytef *buf, int len) {
+  z_streamp zsp = tsp->zsp;
   
-  /* start write processing at the beginning of the buffer */
-  left = len;
-  cur = buf;
-  zsp = tsp->zsp;
+  if (tsp->member_group > 0)
+    return member_write(tsp, buf, len);
+  if (tsp->par != NULL)
+    return par_compress(tsp, buf, len);
   
-  while (left > 0) {
-    int nwrite;
-    
-    /* if there is room in the input buffer, put some data in */
-    if (zsp->avail_in < tsp->bufsz) {
-      /* how many bytes to stick in the input buffer */
-      int toadd = tsp->bufsz - zsp->avail_in;
-      if (toadd > left)
-        toadd = left;
-      
-      /* copy our bytes to the end of the input buffer */
-      memcpy(zsp->next_in + zsp->avail_in, cur, toadd);
-      zsp->avail_in += toadd;
-      cur += toadd;
-      left -= toadd;
-    }
-    
+  /* let zlib consume straight from the caller's buffer.  deflate only
+   * stops short of taking all the input when its output buffer is full,
+   * and process_deflate drains that, so this loop always finishes with
+   * nothing left pointing into buf */
+  zsp->next_in = buf;
+  zsp->avail_in = len;
+  
+  while (zsp->avail_in > 0) {
     /* run a deflate cycle */
-    nwrite = process_deflate(tsp, Z_NO_FLUSH);
+    int nwrite = process_deflate(tsp, Z_NO_FLUSH);
     if (nwrite < 0)
       return nwrite;
     if (tsp->zlib_err != Z_OK)
       return TS_ERR_ZLIB;
-  } /* while left < len */
+  }
   
   return len;
 }
 
 int ts_read(t_streamp tsp, void *buf, int len) {
-  z_streamp zsp;
   int left;
-  void *cur;
+  Bytef *cur;
   
   if (tsp == NULL || tsp->mode != TS_READ)
     return TS_ERR_BADMODE;
   
-  zsp = tsp->zsp;
-  
-  /* non-zlib: straight read */
-  if (zsp == NULL)
-    return read(tsp->fd, buf, len);
+  /* uncompressed: straight read */
+  if (tsp->codec == NULL) {
+    int nread;
+    if (tsp->direct)
+      return buffered_read(tsp, buf, len);
+    nread = read(tsp->fd, buf, len);
+    if (nread > 0)
+      tsp->raw_bytes += nread;
+    return nread;
+  }
   
-  /* zlib read */
+  /* compressed read */
   left = len;
   cur = buf;
   
   while (left > 0) {
-    /* run an inflate cycle, flush as much to output buffer as possible */
-    int nread = process_inflate(tsp, Z_SYNC_FLUSH);
-    if (nread < 0)
-      return nread;
-    if (tsp->zlib_err != Z_OK && tsp->zlib_err != Z_STREAM_END)
-      return TS_ERR_ZLIB;
+    Bytef *start;
+    int direct, nout;
     
-    /* if there is anything available in the zlib output buffer */
-    if (zsp->avail_out < tsp->bufsz) {
-      /* the available data is the buffer size minus the unused part */
-      int bytesavail = tsp->bufsz - zsp->avail_out;
-      int toadd = bytesavail;
+    /* hand out anything left over from a previous round */
+    if (tsp->out_head < tsp->out_tail) {
+      int toadd = tsp->out_tail - tsp->out_head;
       if (toadd > left)
         toadd = left;
-      
-      /* copy data to the requested buffer */
-      memcpy(cur, tsp->outbuf, toadd);
-      /* shift out the part we've used up */
-      memmove(tsp->outbuf, tsp->outbuf + toadd, bytesavail - toadd);
-      zsp->avail_out += toadd;
-      zsp->next_out = tsp->outbuf + (tsp->bufsz - zsp->avail_out);
-      /* mark what we've used up */
+      memcpy(cur, tsp->outbuf + tsp->out_head, toadd);
+      tsp->out_head += toadd;
+      if (tsp->out_head == tsp->out_tail)
+        tsp->out_head = tsp->out_tail = 0;
       left -= toadd;
       cur += toadd;
+      continue;
     }
     
     if (tsp->zlib_err == Z_STREAM_END) {
       /* if we're at the end of the stream, bail */
       break;
     }
-  } /* while tread < len */
+    
+    /* decompress straight into the caller's buffer if it wants at least a
+     * buffer full, small reads go through outbuf so the codec still gets
+     * to work in big chunks */
+    direct = left >= tsp->bufsz;
+    start = direct ? cur : tsp->outbuf;
+    
+    /* run a decompression cycle, as much output as there is room for */
+    nout = tsp->codec->decompress(tsp, start, direct ? left : tsp->bufsz);
+    if (nout < 0)
+      return nout;
+    if (tsp->zlib_err != Z_OK && tsp->zlib_err != Z_STREAM_END)
+      return TS_ERR_ZLIB;
+    
+    if (direct) {
+      left -= nout;
+      cur += nout;
+    } else {
+      tsp->out_tail = nout;
+    }
+  } /* while left > 0 */
   
   return len - left;
 }
 
-off64_t ts_checkpoint(t_streamp tsp) {
-  z_streamp zsp;
+static int zlib_decompress(t_streamp tsp, Bytef *buf, int len) {
+  z_streamp zsp = tsp->zsp;
+  int nread;
   
+  zsp->next_out = buf;
+  zsp->avail_out = len;
+  /* flush as much to the output buffer as possible */
+  nread = process_inflate(tsp, Z_SYNC_FLUSH);
+  len = zsp->next_out - buf;
+  /* don't leave zlib pointing into the caller's memory */
+  zsp->next_out = tsp->outbuf;
+  zsp->avail_out = 0;
+  
+  return nread < 0 ? nread : len;
+}
+
+off64_t ts_checkpoint(t_streamp tsp) {
   if (tsp == NULL || tsp->mode != TS_WRITE)
     return TS_ERR_BADMODE;
   
-  zsp = tsp->zsp;
-  
-  /* non-zlib: return basic offset */
-  if (zsp == NULL)
+  /* uncompressed: return basic offset */
+  if (tsp->codec == NULL)
     return tsp->raw_bytes;
   
+  return tsp->codec->checkpoint(tsp);
+}
+
+static off64_t zlib_checkpoint(t_streamp tsp) {
+  z_streamp zsp = tsp->zsp;
+  
+  if (tsp->member_group > 0) {
+    /* a full enough member ends here, an empty one starts here */
+    if (tsp->member_raw >= tsp->member_group) {
+      int rv = next_member(tsp);
+      if (rv != 0)
+        return rv;
+    }
+    if (tsp->member_raw == 0)
+      return tsp->zlib_bytes + tsp->member_start - tsp->out_head;
+    ++tsp->member_flushes;
+  }
+  /* the stream that was resumed from flushed here already, another flush
+   * would only add an empty block */
+  if (tsp->resumed_at > 0 && tsp->raw_bytes == tsp->resumed_at)
+    return tsp->zlib_bytes;
+  if (tsp->par != NULL)
+    return par_checkpoint(tsp);
+  
   /* do a zlib checkpoint */
   while (1) {
     int pdr = process_deflate(tsp, Z_FULL_FLUSH);
@@ -319,15 +654,197 @@ off64_t ts_checkpoint(t_streamp tsp) {
     }
   }
   
-  return tsp->zlib_bytes;
+  /* with direct i/o, a partial unit may still be waiting in the buffer */
+  return tsp->zlib_bytes + (zsp->next_out - (tsp->outbuf + tsp->out_head));
+}
+
+/* streams whose whole state at a checkpoint is the counters and the crc */
+static int ts_resumable(t_streamp tsp) {
+  return tsp != NULL && tsp->mode == TS_WRITE && !tsp->direct
+    && (tsp->codec == NULL
+      || (tsp->codec == &ts_codec_zlib && tsp->member_group == 0));
+}
+
+int ts_sync(t_streamp tsp) {
+  if (!ts_resumable(tsp))
+    return TS_ERR_BADMODE;
+  if (flush_tail(tsp) != 0)
+    return -1;
+  if (tsp->pipe != NULL && iop_drain(tsp->pipe) != 0) {
+    perror("write block");
+    return -1;
+  }
+  if (fsync(tsp->fd) != 0) {
+    perror("fsync archive");
+    return -1;
+  }
+  return 0;
+}
+
+int ts_resume(t_streamp tsp, off64_t raw_bytes, off64_t zlib_bytes,
+    unsigned long crc32) {
+  if (!ts_resumable(tsp) || tsp->raw_bytes != 0 || tsp->zlib_bytes != 0)
+    return TS_ERR_BADMODE;
+  /* drop the header, the archive has one */
+  tsp->out_head = tsp->out_tail = 0;
+  if (tsp->zsp != NULL) {
+    tsp->zsp->next_out = tsp->outbuf;
+    tsp->zsp->avail_out = tsp->bufsz;
+  }
+  tsp->raw_bytes = tsp->resumed_at = raw_bytes;
+  tsp->zlib_bytes = tsp->codec != NULL ? zlib_bytes : 0;
+  tsp->crc32 = crc32;
+  return 0;
+}
+
+/* ts_seek for init_gzrs streams: restart inflate at the access point
+ * before offset, and inflate up to it */
+static int gz_seek(t_streamp tsp, off64_t offset) {
+  z_streamp zsp = tsp->zsp;
+  const struct gz_point *pt = gzi_find(tsp->gzi, offset);
+  off64_t pos;
+  
+  if (pt == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  init_ts_buffers(tsp);
+  /* a point in the middle of a byte needs that byte too */
+  pos = pt->in - (pt->bits ? 1 : 0);
+  tsp->zlib_bytes = pos;
+  tsp->raw_bytes = pt->out;
+  if (tsp->direct) {
+    tsp->in_skip = pos % tsp->align;
+    pos -= tsp->in_skip;
+  }
+  if (do_seek(tsp, pos) != 0)
+    return -1;
+  if (gz_resume(tsp, pt) != 0)
+    return TS_ERR_ZLIB;
+  
+  /* this is the bounded part: at most the spacing of the points */
+  while (tsp->raw_bytes < offset) {
+    off64_t left = offset - tsp->raw_bytes;
+    zsp->next_out = tsp->outbuf;
+    zsp->avail_out = left < tsp->bufsz ? left : tsp->bufsz;
+    if (process_inflate(tsp, Z_SYNC_FLUSH) < 0)
+      return -1;
+    if (tsp->zlib_err == Z_STREAM_END)
+      /* past the end, reads will come up empty */
+      break;
+    if (tsp->zlib_err != Z_OK)
+      return TS_ERR_ZLIB;
+  }
+  zsp->next_out = tsp->outbuf;
+  zsp->avail_out = 0;
+  return 0;
 }
 
 int ts_seek(t_streamp tsp, off64_t offset) {
-  z_streamp zsp;
+  if (tsp == NULL || tsp->mode != TS_READ)
+    return TS_ERR_BADMODE;
+  
+  if (tsp->gzi != NULL)
+    return gz_seek(tsp, offset);
+  
+  /* reset buffers */
+  init_ts_buffers(tsp);
+  
+  /* direct i/o has to start at an aligned offset, the difference is
+   * dropped from the first read */
+  if (tsp->direct) {
+    tsp->in_skip = offset % tsp->align;
+    offset -= tsp->in_skip;
+  }
+  
+  /* actual stream seek, both compressed and uncompressed */
+  if (do_seek(tsp, offset) != 0)
+    return -1;
+  
+  /* next read will refill buffers */
+  if (tsp->codec != NULL)
+    return tsp->codec->reset(tsp);
+  
+  return 0;
+}
+
+/* read exactly len bytes of input (less only at eof) with one read(2) if
+ * possible, into inbuf grown to fit */
+static int read_ahead(t_streamp tsp, uLong len) {
+  if (len > tsp->insz) {
+    void *buf;
+    if (posix_memalign(&buf, tsp->align, len) != 0)
+      return -1;
+    free(tsp->inbuf);
+    tsp->inbuf = buf;
+    tsp->insz = len;
+    if (tsp->zsp != NULL)
+      tsp->zsp->next_in = tsp->inbuf;
+  }
+  tsp->in_head = tsp->in_tail = 0;
+  while (tsp->in_tail < len) {
+    int nread = read(tsp->fd, tsp->inbuf + tsp->in_tail, len - tsp->in_tail);
+    if (nread < 0) {
+      perror("read segment");
+      return nread;
+    }
+    if (nread == 0)
+      break;
+    tsp->in_tail += nread;
+  }
+  return 0;
+}
+
+int ts_read_segment(t_streamp tsp, off64_t offset, off64_t zlen, void *buf,
+    int len) {
+  Bytef *cur = buf;
+  int left = len, rv;
   
   if (tsp == NULL || tsp->mode != TS_READ)
     return TS_ERR_BADMODE;
   
+  /* only whole compressed segments in plain files are worth the trouble,
+   * direct i/o already reads in big aligned pieces */
+  if (tsp->codec == NULL || tsp->gzi != NULL || tsp->direct
+      || zlen <= 0 || zlen > TS_SEGMENT_MAX) {
+    if ((rv = ts_seek(tsp, offset)) != 0)
+      return rv;
+    while (left > 0) {
+      int nread = ts_read(tsp, cur, left);
+      if (nread < 0)
+        return nread;
+      if (nread == 0)
+        break;
+      left -= nread;
+      cur += nread;
+    }
+    return len - left;
+  }
+  
+  /* seek, with all the input ready for the codec, which takes it from
+   * inbuf first (including a member header for zlib's reset) */
+  init_ts_buffers(tsp);
+  if (do_seek(tsp, offset) != 0 || read_ahead(tsp, zlen) != 0)
+    return -1;
+  if ((rv = tsp->codec->reset(tsp)) != 0)
+    return rv;
+  
+  /* and decompress it straight into the caller's buffer */
+  while (left > 0 && tsp->zlib_err != Z_STREAM_END) {
+    int nout = tsp->codec->decompress(tsp, cur, left);
+    if (nout < 0)
+      return nout;
+    if (tsp->zlib_err != Z_OK && tsp->zlib_err != Z_STREAM_END)
+      return TS_ERR_ZLIB;
+    left -= nout;
+    cur += nout;
+  }
+  return len - left;
+}
+
+static int zlib_reset(t_streamp tsp) {
+  int rv;
+  
   /* we could use inflateSync to ensure a proper stream state, but
    * inspection of the zlib code for that shows that it just searches for a
    * sync point and then resets the stream.  Since we know where the sync
@@ -336,20 +853,25 @@ int ts_seek(t_streamp tsp, off64_t offset) {
   
   /* TODO: check for the sync point magic right before the offset? */
   
-  zsp = tsp->zsp;
-  if (zsp != NULL) {
-    /* reset buffers */
-    init_ts_buffers(tsp);
-    /* reset zlib */
-    tsp->zlib_err = inflateReset(zsp);
-  }
+  tsp->zlib_err = inflateReset(tsp->zsp);
+  if (tsp->zlib_err != Z_OK)
+    return TS_ERR_ZLIB;
   
-  /* actual stream seek, both for zlib and non-zlib */
-  if (do_seek(tsp, offset) != 0)
-    return -1;
-  
-  /* next read will refill buffers */
+  /* the offset may be the start of a member rather than a flush point,
+   * then its header has to go first */
+  if ((rv = gz_member_start(tsp)) != 0) {
+    if (rv > 0)
+      tsp->zlib_err = Z_DATA_ERROR;
+    return rv < 0 ? -1 : TS_ERR_ZLIB;
+  }
   
+  /* a flush point inside a member doesn't refer back to the dictionary,
+   * but doesn't mind it either */
+  if (tsp->dict != NULL) {
+    tsp->zlib_err = inflateSetDictionary(tsp->zsp, tsp->dict, tsp->dictlen);
+    if (tsp->zlib_err != Z_OK)
+      return TS_ERR_ZLIB;
+  }
   return 0;
 }
 
@@ -360,11 +882,11 @@ int ts_close(t_streamp tsp, int dofree) {
     return 0;
   
   if (tsp->mode == TS_READ) {
-    if (tsp->zsp != NULL) {
-      tsp->zlib_err = inflateEnd(tsp->zsp);
-    }
+    if (tsp->codec != NULL)
+      tsp->codec->end(tsp);
     
     tsp->mode = TS_CLOSED;
+    free_ts_buffers(tsp);
     
     if (dofree)
       free(tsp);
@@ -372,32 +894,28 @@ int ts_close(t_streamp tsp, int dofree) {
     return 0;
   } else if (tsp->mode == TS_WRITE) {
     int ret = 0;
-    int ngf;
     
-    if (tsp->zsp != NULL) {
-      /* flush zlib */
-      while (1) {
-        int nwrite = process_deflate(tsp, Z_FINISH);
-        if (nwrite < 0) {
-          ret = -1;
-          break;
-        }
-        if (tsp->zlib_err == Z_STREAM_END) {
-          /* all done flushing zlib */
-          break;
-        }
-        /* otherwise loop again and flush some more */
-      } /* while not flushed */
-      
-      tsp->zlib_err = deflateEnd(tsp->zsp);
-      
-      ngf = put_gz_footer(tsp);
-      if (ngf != GZ_FOOTER_LEN)
-        return -1;
-      
-    } /* if zsp != NULL */
+    if (tsp->codec != NULL && tsp->codec->finish(tsp) != 0)
+      ret = -1;
+    
+    if (flush_tail(tsp) != 0)
+      ret = -1;
+    
+    if (tsp->codec != NULL) {
+      if (tsp->codec->trailer != NULL && tsp->codec->trailer(tsp) != 0)
+        ret = -1;
+      tsp->codec->end(tsp);
+    }
+    
+    /* everything written has to be out before the caller closes the fd */
+    if (tsp->pipe != NULL && iop_end(tsp->pipe) != 0) {
+      perror("write block");
+      ret = -1;
+    }
+    tsp->pipe = NULL;
     
     tsp->mode = TS_CLOSED;
+    free_ts_buffers(tsp);
     
     if (dofree)
       free(tsp);
@@ -408,10 +926,17 @@ int ts_close(t_streamp tsp, int dofree) {
   }
 }
 
+const char *ts_strerror(t_streamp tsp) {
+  if (tsp->codec == NULL)
+    return "no codec";
+  return tsp->codec->errmsg(tsp);
+}
+
 void ptserror(const char *msg, off64_t rv, t_streamp tsp) {
   if (rv == TS_ERR_ZLIB) {
-    fprintf(stderr, "%s: zlib error: %d: %s\n", msg, tsp->zlib_err,
-      tsp->zsp->msg);
+    fprintf(stderr, "%s: %s error: %d: %s\n", msg,
+      tsp->codec != NULL ? tsp->codec->name : "zlib", tsp->zlib_err,
+      ts_strerror(tsp));
   } else if (rv == TS_ERR_BADMODE) {
     fprintf(stderr, "%s: invalid tstream mode\n", msg);
   } else if (rv == -1) {
@@ -420,3 +945,140 @@ void ptserror(const char *msg, off64_t rv, t_streamp tsp) {
     fprintf(stderr, "unknown error: %lld\n", (long long)rv);
   }
 }
+
+/* the zlib codec: a gzip stream (or BGZF members) with full flushes at
+ * the checkpoints */
+
+static int zlib_init_write(t_streamp tsp, int level) {
+  if (zlib_alloc(tsp) != 0) {
+    tsp->zlib_err = Z_MEM_ERROR;
+    return TS_ERR_ZLIB;
+  }
+  /* negative window bits suppress zlib wrapper */
+  tsp->zlib_err = deflateInit2(tsp->zsp, level, Z_DEFLATED, -MAX_WBITS,
+    MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+  return tsp->zlib_err == Z_OK ? 0 : TS_ERR_ZLIB;
+}
+
+static int zlib_set_dict(t_streamp tsp) {
+  int rv;
+  
+  /* only member starts are reset points for a sequential reader too */
+  if (tsp->member_group == 0 && (rv = ts_set_members(tsp, 1)) != 0)
+    return rv;
+  
+  /* the dictionary goes in a member of its own, in front of the first */
+  tsp->zsp->next_out = tsp->outbuf;
+  tsp->zsp->avail_out = tsp->bufsz;
+  if ((rv = put_dict_member(tsp)) != 0)
+    return rv;
+  put_member_header(tsp);
+  tsp->zlib_err = deflateSetDictionary(tsp->zsp, tsp->dict, tsp->dictlen);
+  return tsp->zlib_err == Z_OK ? 0 : TS_ERR_ZLIB;
+}
+
+static int zlib_set_jobs(t_streamp tsp, int jobs) {
+  /* members are small enough as it is */
+  if (tsp->member_group > 0)
+    return TS_ERR_BADMODE;
+  return par_start(tsp, jobs);
+}
+
+static int zlib_finish(t_streamp tsp) {
+  if (tsp->member_group > 0) {
+    /* finish the last member, then the empty EOF member */
+    if (tsp->member_raw > 0 && next_member(tsp) != 0)
+      return -1;
+    return close_member(tsp);
+  }
+  if (tsp->par != NULL)
+    return par_finish(tsp);
+  
+  /* flush zlib */
+  while (1) {
+    int nwrite = process_deflate(tsp, Z_FINISH);
+    if (nwrite < 0)
+      return -1;
+    if (tsp->zlib_err == Z_STREAM_END) {
+      /* all done flushing zlib */
+      break;
+    }
+    if (tsp->zlib_err != Z_OK && tsp->zlib_err != Z_BUF_ERROR)
+      return TS_ERR_ZLIB;
+    /* otherwise loop again and flush some more */
+  } /* while not flushed */
+  return 0;
+}
+
+static int zlib_trailer(t_streamp tsp) {
+  /* members have their own */
+  if (tsp->member_group > 0)
+    return 0;
+  return put_gz_footer(tsp) == GZ_FOOTER_LEN ? 0 : -1;
+}
+
+static int zlib_init_read(t_streamp tsp) {
+  if (zlib_alloc(tsp) != 0) {
+    tsp->zlib_err = Z_MEM_ERROR;
+    return TS_ERR_ZLIB;
+  }
+  /* negative window bits suppress zlib wrapper */
+  tsp->zlib_err = inflateInit2(tsp->zsp, -MAX_WBITS);
+  if (tsp->zlib_err != Z_OK)
+    return TS_ERR_ZLIB;
+  
+  /* read the gzip header from the stream */
+  if (read_gz_header(tsp) != 0) {
+    tsp->zlib_err = Z_VERSION_ERROR;
+    return TS_ERR_ZLIB;
+  }
+  return 0;
+}
+
+static void zlib_end(t_streamp tsp) {
+  par_end(tsp);
+  if (tsp->zsp == NULL)
+    return;
+  if (tsp->mode == TS_READ)
+    tsp->zlib_err = inflateEnd(tsp->zsp);
+  else
+    tsp->zlib_err = deflateEnd(tsp->zsp);
+}
+
+static const char *zlib_errmsg(t_streamp tsp) {
+  if (tsp->zsp != NULL && tsp->zsp->msg != NULL)
+    return tsp->zsp->msg;
+  return zError(tsp->zlib_err);
+}
+
+const struct ts_codec ts_codec_zlib = {
+  .name = "zlib",
+  .init_write = zlib_init_write,
+  .header = put_gz_header,
+  .compress = zlib_compress,
+  .checkpoint = zlib_checkpoint,
+  .set_dict = zlib_set_dict,
+  .set_jobs = zlib_set_jobs,
+  .finish = zlib_finish,
+  .trailer = zlib_trailer,
+  .init_read = zlib_init_read,
+  .decompress = zlib_decompress,
+  .reset = zlib_reset,
+  .end = zlib_end,
+  .errmsg = zlib_errmsg,
+};
+
+const struct ts_codec *ts_find_codec(const char *name) {
+  static const struct ts_codec *codecs[] = {
+    &ts_codec_zlib,
+#ifdef HAVE_ZSTD
+    &ts_codec_zstd,
+#endif
+    NULL
+  };
+  int i;
+  for (i = 0; codecs[i] != NULL; ++i)
+    if (strcmp(codecs[i]->name, name) == 0)
+      return codecs[i];
+  return NULL;
+}
@@ -26,25 +26,58 @@
 
 #include "portability.h"
 
+struct gz_index;
+struct io_pipe;
+struct ts_codec;
+struct ts_parallel;
+
 typedef struct _t_stream {
   /* real file descriptor to read/write from */
   int fd;
-  /* buffers for zlib work */
+  /* buffers for zlib (and direct i/o) work, page aligned.  inbuf holds
+   * compressed input for read streams and is not used by write streams,
+   * which deflate straight from the caller's memory.  outbuf collects the
+   * output of write streams, and inflated data for read streams */
   uLong bufsz;
   Bytef *inbuf;
+  /* allocated size of inbuf: bufsz, or more after ts_read_segment */
+  uLong insz;
   Bytef *outbuf;
-  /* zlib stream */
+  /* unconsumed input from the last read is inbuf[in_head, in_tail) */
+  uLong in_head;
+  uLong in_tail;
+  /* bytes to drop from the next read, after an aligned-down seek */
+  uLong in_skip;
+  /* outbuf is used as a ring without wrapping: out_head is the first byte
+   * not yet handed on (written to fd or copied to the reader), out_tail
+   * the end of valid data (for zlib write streams the end is zsp->next_out,
+   * and out_tail only follows it around writes).  Both go back to the start
+   * once the consumer catches up, so data is never shifted down */
+  uLong out_head;
+  uLong out_tail;
+  /* compression backend, NULL for uncompressed streams, and its state */
+  const struct ts_codec *codec;
+  void *cstate;
+  /* zlib stream, for the zlib codec */
   z_streamp zsp;
   /* stream mode, one of TS_READ or TS_WRITE */
   int mode;
-  /* return code from the last zlib call */
+  /* return code from the last zlib call; other codecs map their errors to
+   * the nearest zlib code (Z_DATA_ERROR, Z_MEM_ERROR, ...) */
   int zlib_err;
-  /* crc32 of input data processed so far */
+  /* crc32 of input data processed so far, only maintained if track_crc */
   unsigned long crc32;
+  /* write streams need the crc for the gzip footer and always track it,
+   * read streams never verify it, so it is off unless the caller sets this
+   * after init_trs */
+  int track_crc;
   /* number of raw data bytes processed so far */
   off64_t raw_bytes;
-  /* number of zlib stream bytes processed so far (includes headers) */
+  /* number of compressed bytes processed so far (includes headers) */
   off64_t zlib_bytes;
+  /* raw_bytes ts_resume carried on from, 0 if it didn't; the output
+   * ends at a checkpoint there already */
+  off64_t resumed_at;
 #if HAVE_MTIO_H
   /* boolean for using magnetic tape interface or not */
   int usemt;
@@ -53,6 +86,36 @@ typedef struct _t_stream {
   int blksz;
   /* base offset of archive start */
   off64_t baseoffset;
+  /* set if fd was opened with O_DIRECT: all i/o on it is then done from
+   * the aligned buffers, in multiples of align bytes, except for the tail
+   * of a write stream, for which ts_close turns O_DIRECT back off */
+  int direct;
+  uLong align;
+  /* write streams from ts_set_members: 0 if the stream is one gzip
+   * member, otherwise a checkpoint ends the member once it holds this
+   * many uncompressed bytes */
+  uLong member_group;
+  /* where the current member's header is in outbuf, and the uncompressed
+   * bytes in the member so far */
+  uLong member_start;
+  uLong member_raw;
+  /* full flushes in the current member, each costs some output space */
+  uLong member_flushes;
+  /* preset dictionary, in place of the history at every member or frame
+   * start (see ts_set_dictionary) */
+  Bytef *dict;
+  uInt dictlen;
+  /* compression level of write streams */
+  int level;
+  /* worker threads of a zlib write stream, see ts_set_jobs */
+  struct ts_parallel *par;
+  /* thread writing the output behind the stream, see ts_set_async */
+  struct io_pipe *pipe;
+  /* access points of an ordinary gzip file, for streams from init_gzrs */
+  struct gz_index *gzi;
+  /* inflating bare deflate data after a seek into the middle of a gzip
+   * member, the member trailer is up to us */
+  int gz_raw;
 } t_stream;
 
 typedef struct _t_stream *t_streamp;
@@ -66,6 +129,69 @@ typedef struct _t_stream *t_streamp;
  * 10240 corresponds to a tar blocking factor of 20
  */
 #define TS_BUFSZ 10240
+/* upper limit for user supplied buffer sizes, lengths are ints */
+#define TS_MAX_BUFSZ (1 << 30)
+
+/* members are BGZF blocks: at most this much data, so that they always
+ * compress to less than 64K, and outbuf has to hold one whole */
+#define TS_MEMBER_MAX 0xff00
+/* room set aside per full flush inside a member: the empty stored block
+ * plus the end of the block it cuts short */
+#define TS_MEMBER_FLUSH 16
+#define TS_MEMBER_BUFSZ (1 << 17)
+
+/* preset dictionaries are at most the deflate window */
+#define TS_DICT_MAX 32768
+
+/* ts_read_segment reads compressed segments up to this size in one go */
+#define TS_SEGMENT_MAX (1 << 20)
+
+/* A compression backend.  The zlib one writes a gzip stream with full
+ * flushes at checkpoints; ts_find_codec knows what else there is.  The
+ * stream functions below do the buffering and the sanity checks, and call
+ * these for the rest.  Functions that can fail return 0 (or a count), -1
+ * on i/o errors, or TS_ERR_ZLIB with tsp->zlib_err set.
+ */
+struct ts_codec {
+  /* name for the command line and messages */
+  const char *name;
+  /* set up a write stream, outbuf is allocated */
+  int (*init_write)(t_streamp tsp, int level);
+  /* put the stream header into outbuf, may be NULL */
+  void (*header)(t_streamp tsp);
+  /* compress len bytes from the caller's buf, as ts_write */
+  int (*compress)(t_streamp tsp, Bytef *buf, int len);
+  /* make a point decompression can start at, as ts_checkpoint */
+  off64_t (*checkpoint)(t_streamp tsp);
+  /* store tsp->dict at the start of the stream and use it from then on */
+  int (*set_dict)(t_streamp tsp);
+  /* compress with jobs threads from now on, as ts_set_jobs */
+  int (*set_jobs)(t_streamp tsp, int jobs);
+  /* end the compressed data at ts_close, before the tail of outbuf is
+   * written */
+  int (*finish)(t_streamp tsp);
+  /* write the stream trailer straight to the fd, after that; may be NULL */
+  int (*trailer)(t_streamp tsp);
+  /* set up a read stream at the start of the archive, the input buffer
+   * may already hold the first bytes; sets zlib_err to Z_VERSION_ERROR if
+   * the magic is wrong */
+  int (*init_read)(t_streamp tsp);
+  /* one round of decompression into buf, returns the number of bytes
+   * produced (possibly 0), sets zlib_err to Z_STREAM_END at the end */
+  int (*decompress)(t_streamp tsp, Bytef *buf, int len);
+  /* start over at a checkpoint, the fd has been positioned at it */
+  int (*reset)(t_streamp tsp);
+  /* release the codec state, for both kinds of stream */
+  void (*end)(t_streamp tsp);
+  /* description of the last error */
+  const char *(*errmsg)(t_streamp tsp);
+};
+
+extern const struct ts_codec ts_codec_zlib;
+
+/* Look up a codec by name ("zlib", "zstd" if built with it), NULL if
+ * there is no such codec */
+const struct ts_codec *ts_find_codec(const char *name);
 
 /* error constants */
 #define TS_ERR_ZLIB -2
@@ -75,27 +201,89 @@ typedef struct _t_stream *t_streamp;
  * If in is not null, it will be used, otherwise a new item will be allocated.
  * If zlib_level > 0, zlib will be initialized, otherwise it will be
  * a straight write through.
- * The fd argument is the file descriptor to do the real writes to.
+ * The fd argument is the file descriptor to do the real writes to.  If it
+ * has O_DIRECT set, writes are collected into aligned buffers.
+ * bufsz is the size of the i/o buffers (0 for TS_BUFSZ), it is rounded
+ * up to a multiple of blksz (and of the page size for direct i/o).
  * The initialized t_streamp will be returned.
  * If zlib is requested, the caller should check tsp->zlib_error.
  * If zlib initialization failed, the caller must call ts_close on the stream
  * and then discard it.
  */
-t_streamp init_tws(t_streamp tsp, int fd, int usemt, int blksz,
+t_streamp init_tws(t_streamp tsp, int fd, int usemt, int blksz, int bufsz,
   int zlib_level);
 
+/* As init_tws, compressing with the given codec (at level) instead of
+ * zlib.  A NULL codec makes an uncompressed stream.
+ */
+t_streamp init_tws_codec(t_streamp tsp, int fd, int usemt, int blksz,
+  int bufsz, int level, const struct ts_codec *codec);
+
 /* Create/init a tar read stream.
  * If in is not null, it will be used, otherwise a new item will be allocated.
- * If zlib_level > 0, zlib will be initialized, otherwise it will be
- * a straight read through.
- * The fd argument is the file descriptor to do the real reads from.
+ * If zlib_level > 0, the stream is compressed, otherwise it will be
+ * a straight read through.  The codec is recognized by the magic at the
+ * start of the archive.
+ * The fd argument is the file descriptor to do the real reads from, it
+ * may have O_DIRECT set.  bufsz is as for init_tws.
  * The initialized t_streamp will be returned.
  * If the magic is wrong, zlib_err will be set to Z_VERSION_ERROR.
  */
-t_streamp init_trs(t_streamp tsp, int fd, int usemt, int blksz,
+t_streamp init_trs(t_streamp tsp, int fd, int usemt, int blksz, int bufsz,
   int zlib_level);
 
-/* Write bytes to the stream.  If zlib is enabled, data may be buffered.
+/* Switch a new zlib write stream (before anything is written) to
+ * independent gzip members in the BGZF layout: each member carries its
+ * compressed size in a "BC" extra field, holds at most TS_MEMBER_MAX bytes
+ * of data, and a checkpoint ends the member once it holds at least group
+ * bytes (1 for a member per checkpoint).  Checkpoints inside a member are
+ * full flushes as usual.  The stream ends with the BGZF EOF member.
+ * Returns 0, or TS_ERR_BADMODE / TS_ERR_ZLIB (zlib_err Z_MEM_ERROR).
+ */
+int ts_set_members(t_streamp tsp, uLong group);
+
+/* Give a new write stream (before anything is written) a preset
+ * dictionary: the last TS_DICT_MAX bytes of dict.  It is stored at the
+ * start of the archive, where read streams pick it up, and used at every
+ * point decompression can start at.  For zlib that has to be the start of
+ * a member, so this calls ts_set_members(tsp, 1) if that hasn't been
+ * done; and the archive is then only readable with tarix.  Returns 0, or
+ * TS_ERR_BADMODE / TS_ERR_ZLIB / -1 on write errors.
+ */
+int ts_set_dictionary(t_streamp tsp, const Bytef *dict, uInt len);
+
+/* Compress a new write stream (before anything is written) with jobs
+ * threads.  zlib cuts the data in chunks that are deflated at the same
+ * time, each with the end of the one before as history, and joins them up
+ * into the same single gzip stream; checkpoints wait for the chunks in
+ * flight, so this pays off for big files.  It can't be combined with
+ * members (ts_set_members, ts_set_dictionary).  zstd uses its own worker
+ * threads, if the library has them.  jobs <= 1 changes nothing.  Returns
+ * 0, or TS_ERR_BADMODE / TS_ERR_ZLIB.
+ */
+int ts_set_jobs(t_streamp tsp, int jobs);
+
+/* Write the output of a write stream from a thread, through nbufs buffers
+ * of bufsz, so that compressing the next data overlaps with writing out
+ * what came before.  Write errors then come back from a later ts_write,
+ * ts_checkpoint, ts_sync or ts_close.  Tapes, whose records would
+ * change size, are left as they are, and so is nbufs <= 1.  Returns 0,
+ * TS_ERR_BADMODE, or -1 (with errno set) if the thread couldn't be
+ * started.
+ */
+int ts_set_async(t_streamp tsp, int nbufs);
+
+/* Create/init a read stream on an ordinary gzip file (any gzip, possibly
+ * of several members, not just tarix output).  gzi must stay around as
+ * long as the stream.  If gzi->building is set, access points are added to
+ * it while reading through the file from the start; otherwise ts_seek uses
+ * its points to get to an uncompressed offset.  The caller should check
+ * tsp->zlib_err as for init_trs.
+ */
+t_streamp init_gzrs(t_streamp tsp, int fd, int bufsz, struct gz_index *gzi);
+
+/* Write bytes to the stream.  Data is buffered, and written out in
+ * buffer sized pieces (or as zlib produces it) and at ts_close.
  * Returns the number of bytes processed, which is not necessarily the
  * number of bytes written to the fd in the case of zlib.
  * If the stream is not a write stream, TS_ERR_BADMODE will be returned.
@@ -116,25 +304,63 @@ int ts_write(t_streamp tsp, void *buf, int len);
  */
 int ts_read(t_streamp tsp, void *buf, int len);
 
-/* Checkpoint a write stream.  Only meaningful for zlib streams, but calling
- * it on a non-zlib stream is harmless (equivalent to a no-op).
+/* Checkpoint a write stream.  Only meaningful for compressed streams, but
+ * calling it on an uncompressed stream is harmless (equivalent to a no-op).
  * For a zlib stream, this will flush the zlib stream to make a seekable
- * point in the compressed stream.
+ * point in the compressed stream, or start a new gzip member (see
+ * ts_set_members), in which case the position is that of its header.
+ * For zstd it ends the current frame, the position is that of the next.
  * Return value will be the real byte position in the output of the sync
  * point, -1 on write errors, TS_ERR_ZLIB on zlib errors, and TS_ERR_BADMODE
  * if a read stream is passed in.
  */
 off64_t ts_checkpoint(t_streamp tsp);
 
+/* Make everything written to a write stream so far durable: write out
+ * what is buffered and fsync the fd.  Meant for right after ts_checkpoint,
+ * so that a later ts_resume can carry on from there.  Only uncompressed
+ * streams and single zlib streams (no members, no O_DIRECT) can do this.
+ * Returns 0, -1 on i/o errors, or TS_ERR_BADMODE.
+ */
+int ts_sync(t_streamp tsp);
+
+/* Carry on with a new write stream (before anything is written, but after
+ * ts_set_jobs) where another stream was synced with ts_sync: raw_bytes,
+ * zlib_bytes and crc32 are the other stream's at that point, and the fd
+ * must be positioned at zlib_bytes (raw_bytes for uncompressed streams).
+ * The stream header isn't written again, and the trailer at ts_close
+ * covers all the data.  A ts_checkpoint before any more data is written
+ * adds nothing to the output, so offsets come out as if the stream had
+ * never stopped.  Only for the streams ts_sync works on.  Returns 0 or
+ * TS_ERR_BADMODE.
+ */
+int ts_resume(t_streamp tsp, off64_t raw_bytes, off64_t zlib_bytes,
+  unsigned long crc32);
+
 /* Seek in an input stream, similar to lseek(2).  Always acts in the whence
- * = SEEK_SET mode.  Note that for zlib streams, the offset MUST be the
- * actual offset in the zlib stream, not the logical offset in the
- * uncompressed stream.  Returns 0 on success, -1 on i/o error,
+ * = SEEK_SET mode.  Note that for compressed streams, the offset MUST be
+ * the actual offset in the compressed stream, not the logical offset in the
+ * uncompressed stream.  Streams from init_gzrs are the exception: they
+ * take any uncompressed offset, and inflate forward from the access point
+ * before it.  Returns 0 on success, -1 on i/o error,
  * TS_ERR_BADMODE if the stream is not a read stream, and TS_ERR_ZLIB if
  * there is a zlib error.
  */
 int ts_seek(t_streamp tsp, off64_t offset);
 
+/* Seek to offset and read len bytes, like ts_seek followed by ts_read,
+ * where zlen is the compressed size of what is to be read (the distance to
+ * the next index entry), or 0 if that isn't known.  A compressed segment
+ * of up to TS_SEGMENT_MAX bytes is read with one read(2) and decompressed
+ * straight into buf in one go, instead of a buffer at a time.  zlen only
+ * has to be right for that to be efficient: any more input needed is read
+ * as usual, and the stream can be read on from where this stops.  Returns
+ * the number of bytes read into buf, which is less than len only at the
+ * end of the stream, or an error as ts_seek and ts_read do.
+ */
+int ts_read_segment(t_streamp tsp, off64_t offset, off64_t zlen, void *buf,
+  int len);
+
 /* Close and free a stream (read or write).  Returns 0 on success, -1 on i/o
  * errors, TS_ERR_ZLIB on zlib errors, or TS_ERR_BADMODE if the stream
  * is in an invalid state.
@@ -146,6 +372,9 @@ int ts_seek(t_streamp tsp, off64_t offset);
  */
 int ts_close(t_streamp tsp, int dofree);
 
+/* Description of the last codec error of a stream */
+const char *ts_strerror(t_streamp tsp);
+
 /* Util function like perror, but handles multistate errors from tstream
  * functions
  */
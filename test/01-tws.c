@@ -41,7 +41,7 @@ int main (int argc, char **argv) {
     return 1;
   }
   
-  tsp = init_tws(NULL, fd, 0, 0, 3);
+  tsp = init_tws(NULL, fd, 0, 0, 0, 3);
   if (tsp->zlib_err != Z_OK) {
     printf("zlib init error: %d\n", tsp->zlib_err);
     return 1;
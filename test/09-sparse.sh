@@ -0,0 +1,37 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# only GNU tar writes the GNU sparse formats
+if ! tar --version | grep GNU.tar ; then
+  exit 0
+fi
+
+rm -rf bin/test/sparse.d bin/test/sparse.x.d
+mkdir -p bin/test/sparse.d bin/test/sparse.x.d
+
+# 10 data extents scattered through a 40MB file, enough to need old GNU
+# extension headers
+truncate -s 40M bin/test/sparse.d/holes
+for i in 1 2 3 4 5 6 7 8 9 10 ; do
+  printf "extent $i" | dd of=bin/test/sparse.d/holes bs=1 seek=$((i * 3000000)) \
+    conv=notrunc 2>/dev/null
+done
+cp bin/test/data bin/test/sparse.d/plain
+
+for fmt in "gnu" "posix --sparse-version=0.0" "posix --sparse-version=0.1" \
+    "posix --sparse-version=1.0" ; do
+  tar -c -f - --sparse --format=$fmt -C bin/test sparse.d \
+    | bin/tarix -zf bin/test/sparse.tarix >bin/test/sparse.tgz
+  cat bin/test/sparse.tarix
+  # the sparse member is indexed under its real name, with its map
+  grep -A1 ' sparse.d/holes$' bin/test/sparse.tarix | grep '^#:sparse 41943040 '
+  extents=`grep '^#:sparse' bin/test/sparse.tarix | awk '{ print $4 }'`
+  [ $extents -ge 10 ]
+  
+  # extraction still passes the whole record through
+  bin/tarix -zxf bin/test/sparse.tarix -t bin/test/sparse.tgz sparse.d \
+    | tar -x -f - -C bin/test/sparse.x.d
+  cmp bin/test/sparse.d/holes bin/test/sparse.x.d/sparse.d/holes
+  rm -rf bin/test/sparse.x.d/sparse.d
+done
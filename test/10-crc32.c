@@ -0,0 +1,83 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/* test case for the crc32 implementations, checked against zlib */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <zlib.h>
+
+#include "crc32.h"
+
+#define BUFSZ 70000
+
+int main (int argc, char **argv) {
+  unsigned char *buf = malloc(BUFSZ);
+  int i, off, len, split, errors = 0;
+
+  printf("crc32 implementation: %s\n", crc_impl());
+
+  srandom(1);
+  for (i = 0; i < BUFSZ; ++i)
+    buf[i] = random();
+
+  /* every alignment, short lengths and lengths around the block sizes */
+  for (off = 0; off < 16; ++off) {
+    for (len = 0; len < 300 && off + len <= BUFSZ; ++len) {
+      unsigned long want = crc32(0L, buf + off, len);
+      unsigned long got = update_crc(0L, buf + off, len);
+      if (want != got) {
+        printf("off %d len %d: want %08lx got %08lx\n", off, len, want, got);
+        ++errors;
+      }
+    }
+  }
+
+  /* big buffers, in pieces */
+  for (i = 0; i < 50; ++i) {
+    unsigned long want, got;
+    off = random() % 64;
+    len = random() % (BUFSZ - off);
+    split = len ? random() % len : 0;
+    want = crc32(0L, buf + off, len);
+    got = update_crc(0L, buf + off, split);
+    got = update_crc(got, buf + off + split, len - split);
+    if (want != got) {
+      printf("off %d len %d split %d: want %08lx got %08lx\n", off, len,
+        split, want, got);
+      ++errors;
+    }
+    /* and stitched back together without the data */
+    got = combine_crc(crc(buf + off, split), crc(buf + off + split,
+      len - split), len - split);
+    if (want != got) {
+      printf("combine off %d len %d split %d: want %08lx got %08lx\n", off,
+        len, split, want, got);
+      ++errors;
+    }
+  }
+
+  free(buf);
+  if (errors) {
+    printf("%d mismatches\n", errors);
+    return 1;
+  }
+  return 0;
+}
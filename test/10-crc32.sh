@@ -0,0 +1,7 @@
+#!/usr/bin/env bash
+
+# test script for 10-crc32.c
+
+set -xe
+
+bin/test/10-crc32
@@ -0,0 +1,150 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/* test case for tar streams with mixed size reads and writes: small ones
+ * go through the stream's buffers, big ones go straight between zlib and
+ * the caller's memory.  Optional arguments: buffer size, and "direct" to
+ * open the files with O_DIRECT */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#include "portability.h"
+#include "tstream.h"
+
+#define OFILE "bin/test/tsrw.gz"
+#define DATASZ (1 << 20)
+#define NCP 16
+
+/* chunk sizes to cycle through, around and well above TS_BUFSZ */
+static const int sizes[] = { 1, 512, 7, TS_BUFSZ, 3000, TS_BUFSZ + 1,
+  100000, 512, 65536, 13 };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+int main (int argc, char **argv) {
+  unsigned char *data = malloc(DATASZ), *back = malloc(DATASZ);
+  off64_t cp_raw[NCP], cp_off[NCP];
+  int fd, rv, i, pos, n, ncp = 0;
+  int bufsz = argc > 1 ? atoi(argv[1]) : 0;
+  int direct = argc > 2 && strcmp(argv[2], "direct") == 0;
+  t_streamp tsp;
+
+  /* compressible, but not trivially */
+  srandom(2);
+  for (i = 0; i < DATASZ; ++i)
+    data[i] = (random() % 16) + 'a';
+
+  if ((fd = p_open(OFILE, O_WRONLY | O_CREAT | O_TRUNC, 0666, direct)) < 0) {
+    perror("open output");
+    return 1;
+  }
+  tsp = init_tws(NULL, fd, 0, 0, bufsz, 6);
+  printf("bufsz %lu, direct %d\n", tsp->bufsz, tsp->direct);
+  if (tsp->zlib_err != Z_OK) {
+    printf("zlib init error: %d\n", tsp->zlib_err);
+    return 1;
+  }
+  for (pos = 0, i = 0; pos < DATASZ; pos += n, ++i) {
+    n = sizes[i % NSIZES];
+    if (n > DATASZ - pos)
+      n = DATASZ - pos;
+    if (i % 3 == 0 && ncp < NCP) {
+      cp_raw[ncp] = pos;
+      cp_off[ncp] = ts_checkpoint(tsp);
+      if (cp_off[ncp] < 0) {
+        ptserror("ts_checkpoint", cp_off[ncp], tsp);
+        return 1;
+      }
+      ++ncp;
+    }
+    rv = ts_write(tsp, data + pos, n);
+    if (rv != n) {
+      ptserror("ts_write", rv, tsp);
+      return 1;
+    }
+  }
+  rv = ts_close(tsp, 1);
+  if (rv != 0) {
+    printf("ts_close: %d\n", rv);
+    return 1;
+  }
+  close(fd);
+
+  /* read it all back, cycling through the sizes at a different phase */
+  if ((fd = p_open(OFILE, O_RDONLY, 0, direct)) < 0) {
+    perror("open input");
+    return 1;
+  }
+  tsp = init_trs(NULL, fd, 0, 0, bufsz, 6);
+  if (tsp->zlib_err != Z_OK) {
+    printf("zlib init error: %d\n", tsp->zlib_err);
+    return 1;
+  }
+  for (pos = 0, i = 3; pos < DATASZ; pos += rv, ++i) {
+    n = sizes[i % NSIZES];
+    if (n > DATASZ - pos)
+      n = DATASZ - pos;
+    rv = ts_read(tsp, back + pos, n);
+    if (rv <= 0) {
+      ptserror("ts_read", rv, tsp);
+      return 1;
+    }
+  }
+  if (memcmp(data, back, DATASZ) != 0) {
+    printf("sequential read mismatch\n");
+    return 1;
+  }
+
+  /* and from each checkpoint, in reverse */
+  for (i = ncp - 1; i >= 0; --i) {
+    n = sizes[i % NSIZES];
+    if (n > DATASZ - cp_raw[i])
+      n = DATASZ - cp_raw[i];
+    rv = ts_seek(tsp, cp_off[i]);
+    if (rv != 0) {
+      ptserror("ts_seek", rv, tsp);
+      return 1;
+    }
+    rv = ts_read(tsp, back, n);
+    if (rv != n || memcmp(data + cp_raw[i], back, n) != 0) {
+      printf("checkpoint %d at %lld: read %d of %d, mismatch\n", i,
+        (long long)cp_off[i], rv, n);
+      return 1;
+    }
+  }
+  ts_close(tsp, 1);
+  close(fd);
+
+  /* leave the plain data for the script to compare with zcat */
+  if ((fd = open(OFILE ".orig", O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0
+      || write(fd, data, DATASZ) != DATASZ) {
+    perror("write original");
+    return 1;
+  }
+  close(fd);
+
+  printf("OK\n");
+  return 0;
+}
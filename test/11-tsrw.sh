@@ -0,0 +1,13 @@
+#!/usr/bin/env bash
+
+# test script for 11-tsrw.c
+
+set -xe
+
+for args in "" "65536" "1048576 direct" "20000 direct" ; do
+  rm -f bin/test/tsrw.gz bin/test/tsrw.gz.orig
+  bin/test/11-tsrw $args
+  # gzip checks the crc and length in the footer
+  gzip -t bin/test/tsrw.gz
+  zcat bin/test/tsrw.gz | cmp - bin/test/tsrw.gz.orig
+done
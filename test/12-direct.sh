@@ -0,0 +1,48 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# big buffers and direct i/o must give the same archives and extracts as
+# the defaults
+
+rm -rf bin/test/direct.*
+mkdir -p bin/test/direct.d
+for i in 1 2 3 4 5 ; do
+  head -c $((i * 70000 + 123)) /dev/urandom >bin/test/direct.d/rand$i
+  seq 1 $((i * 20000)) >bin/test/direct.d/seq$i
+done
+tar -c -f bin/test/direct.tar -C bin/test direct.d
+
+for z in "" "-z" ; do
+  for opts in "-b 1M" "-O" "-O -b 200k" ; do
+    bin/tarix $z $opts -f bin/test/direct.tarix -t bin/test/direct.tar \
+      >bin/test/direct.out
+    bin/tarix $z -f bin/test/direct.ref.tarix -t bin/test/direct.tar \
+      >bin/test/direct.ref
+    if [ -z "$z" ]; then
+      cmp bin/test/direct.out bin/test/direct.tar
+    else
+      zcat bin/test/direct.out | cmp - bin/test/direct.tar
+    fi
+    # gzip header has a timestamp, but the offsets must agree
+    diff <(tail -n +2 bin/test/direct.tarix) \
+      <(tail -n +2 bin/test/direct.ref.tarix)
+
+    # extract to a file and to stdout
+    bin/tarix $z $opts -x -f bin/test/direct.tarix -t bin/test/direct.out \
+      -o bin/test/direct.x.tar direct.d/rand3 direct.d/seq5
+    bin/tarix $z $opts -x -f bin/test/direct.tarix -t bin/test/direct.out \
+      direct.d/rand3 direct.d/seq5 >bin/test/direct.x2.tar
+    cmp bin/test/direct.x.tar bin/test/direct.x2.tar
+    rm -rf bin/test/direct.x
+    mkdir bin/test/direct.x
+    tar -x -f bin/test/direct.x.tar -C bin/test/direct.x
+    cmp bin/test/direct.x/direct.d/rand3 bin/test/direct.d/rand3
+    cmp bin/test/direct.x/direct.d/seq5 bin/test/direct.d/seq5
+    [ `tar -t -f bin/test/direct.x.tar | wc -l` -eq 2 ]
+  done
+done
+
+# bad sizes are refused
+! bin/tarix -b 0 -i -f bin/test/direct.tarix -t bin/test/direct.tar
+! bin/tarix -b 12q -i -f bin/test/direct.tarix -t bin/test/direct.tar
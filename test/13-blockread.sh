@@ -0,0 +1,35 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# the block reader must see the same blocks whether the tar comes from a
+# mapped file, a pipe delivering odd sized pieces, or direct reads
+
+[ -f bin/test/direct.tar ]
+
+rm -f bin/test/blockread.*
+
+bin/tarix -f bin/test/blockread.ref.tarix -t bin/test/direct.tar \
+  >bin/test/blockread.out
+cmp bin/test/blockread.out bin/test/direct.tar
+
+# pipe, in pieces that never line up with the blocks
+dd if=bin/test/direct.tar bs=777 2>/dev/null \
+  | bin/tarix -b 4k -f bin/test/blockread.pipe.tarix >bin/test/blockread.out
+cmp bin/test/blockread.out bin/test/direct.tar
+cmp bin/test/blockread.pipe.tarix bin/test/blockread.ref.tarix
+
+# stdin redirected from a file gets mapped too
+bin/tarix -i -f bin/test/blockread.stdin.tarix <bin/test/direct.tar
+cmp bin/test/blockread.stdin.tarix bin/test/blockread.ref.tarix
+
+bin/tarix -O -b 64k -f bin/test/blockread.direct.tarix \
+  -t bin/test/direct.tar >bin/test/blockread.out
+cmp bin/test/blockread.out bin/test/direct.tar
+cmp bin/test/blockread.direct.tarix bin/test/blockread.ref.tarix
+
+# a truncated archive is an error
+head -c $(( $(stat -c %s bin/test/direct.tar) - 100 )) bin/test/direct.tar \
+  >bin/test/blockread.trunc.tar
+! bin/tarix -i -f bin/test/blockread.trunc.tarix \
+  -t bin/test/blockread.trunc.tar
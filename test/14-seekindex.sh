@@ -0,0 +1,46 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# index-only mode seeks over member data on files and block devices, the
+# index must come out the same as when reading everything
+
+rm -rf bin/test/seekidx.*
+d=bin/test/seekidx.d
+long=$d/`printf 'long%.0s' {1..40}`
+mkdir -p $long
+for i in 1 2 3 ; do
+  head -c $((i * 100000 + 7)) /dev/urandom >$long/file$i
+  echo $i >$d/small$i
+done
+ln -s $long/file1 $d/longlink
+truncate -s 5M $d/holes
+echo data | dd of=$d/holes bs=1 seek=3000000 conv=notrunc 2>/dev/null
+
+if tar --version | grep GNU.tar ; then
+  formats="gnu posix"
+  sparse=--sparse
+else
+  formats="ustar"
+  sparse=
+fi
+
+for fmt in $formats ; do
+  tar -c -f bin/test/seekidx.tar --format=$fmt $sparse -C bin/test seekidx.d
+  # reference: pass-through reads every block
+  bin/tarix -f bin/test/seekidx.ref.tarix -t bin/test/seekidx.tar >/dev/null
+  for opts in "" "-O" "-O -b 4k" "-b 4k" ; do
+    bin/tarix -i $opts -f bin/test/seekidx.tarix -t bin/test/seekidx.tar
+    cmp bin/test/seekidx.tarix bin/test/seekidx.ref.tarix
+  done
+  bin/tarix -i -f bin/test/seekidx.tarix <bin/test/seekidx.tar
+  cmp bin/test/seekidx.tarix bin/test/seekidx.ref.tarix
+  # not seekable
+  cat bin/test/seekidx.tar | bin/tarix -i -f bin/test/seekidx.tarix
+  cmp bin/test/seekidx.tarix bin/test/seekidx.ref.tarix
+done
+
+# truncated in the middle of a member's data must still be noticed
+head -c 150000 bin/test/seekidx.tar >bin/test/seekidx.trunc.tar
+! bin/tarix -i -f bin/test/seekidx.tarix -t bin/test/seekidx.trunc.tar
+! bin/tarix -i -O -f bin/test/seekidx.tarix -t bin/test/seekidx.trunc.tar
@@ -0,0 +1,61 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# a parallel index scan (-j) must write the same index as a serial one,
+# even when chunks start inside member data that looks like tar headers
+
+rm -rf bin/test/parscan.*
+d=bin/test/parscan.d
+long=$d/`printf 'long%.0s' {1..40}`
+mkdir -p $long $d/small $d/inner
+for i in `seq 1 1500` ; do
+  echo $i >$d/small/f$i
+done
+# a tar file stored in the archive, full of real looking headers
+for i in `seq 1 2000` ; do
+  echo $i >$d/inner/g$i
+done
+tar -c -f $d/inner.tar -C $d inner
+rm -rf $d/inner
+# a header for a huge member in the middle of random data: a guess made
+# from that never lines up again
+truncate -s 1G bin/test/parscan.huge
+(tar -c --format=ustar -f - bin/test/parscan.huge 2>/dev/null || true) \
+  | head -c 512 >bin/test/parscan.hdr
+rm -f bin/test/parscan.huge
+head -c $((3900 * 512)) /dev/urandom >$d/fake.bin
+cat bin/test/parscan.hdr >>$d/fake.bin
+head -c 100000 /dev/urandom >>$d/fake.bin
+for i in 1 2 3 ; do
+  head -c $((i * 1000000 + 7)) /dev/urandom >$long/file$i
+done
+truncate -s 5M $d/holes
+echo data | dd of=$d/holes bs=1 seek=3000000 conv=notrunc 2>/dev/null
+
+if tar --version | grep GNU.tar ; then
+  formats="gnu posix"
+  sparse=--sparse
+else
+  formats="ustar"
+  sparse=
+fi
+
+for fmt in $formats ; do
+  tar -c -f bin/test/parscan.tar --format=$fmt $sparse -C bin/test parscan.d
+  bin/tarix -i -f bin/test/parscan.ref.tarix -t bin/test/parscan.tar
+  for j in 2 3 4 7 16 ; do
+    for opts in "" "-O" "-b 4k" ; do
+      bin/tarix -i -j $j $opts -f bin/test/parscan.tarix -t bin/test/parscan.tar
+      cmp bin/test/parscan.tarix bin/test/parscan.ref.tarix
+    done
+  done
+  bin/tarix -i -j 4 -f bin/test/parscan.tarix <bin/test/parscan.tar
+  cmp bin/test/parscan.tarix bin/test/parscan.ref.tarix
+done
+
+# the chunk scans must notice truncation the same way
+head -c 9000000 bin/test/parscan.tar >bin/test/parscan.trunc.tar
+! bin/tarix -i -j 4 -f bin/test/parscan.tarix -t bin/test/parscan.trunc.tar
+
+! bin/tarix -i -j 0 -f bin/test/parscan.tarix -t bin/test/parscan.tar
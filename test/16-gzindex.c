@@ -0,0 +1,120 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/* test case for random access to ordinary gzip files through the access
+ * points: seek to random offsets and compare what comes back with the
+ * uncompressed file.  Arguments: gzip file, access point sidecar, the
+ * uncompressed file, and optionally a buffer size and "direct" */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#include "gzindex.h"
+#include "portability.h"
+#include "tstream.h"
+
+#define NSEEKS 300
+#define MAXREAD 100000
+
+int main (int argc, char **argv) {
+  struct gz_index gzi;
+  struct stat st;
+  unsigned char *plain, *back;
+  int fd, pfd, i, n;
+  int bufsz = argc > 4 ? atoi(argv[4]) : 0;
+  int direct = argc > 5 && strcmp(argv[5], "direct") == 0;
+  t_streamp tsp;
+
+  if (argc < 4) {
+    fprintf(stderr, "usage: %s gzfile sidecar plainfile [bufsz [direct]]\n",
+      argv[0]);
+    return 1;
+  }
+  if (gzi_read(&gzi, argv[2]) != 0) {
+    perror(argv[2]);
+    return 1;
+  }
+  printf("%lu access points\n", (unsigned long)gzi.npoints);
+  
+  if ((pfd = open(argv[3], O_RDONLY)) < 0 || fstat(pfd, &st) != 0) {
+    perror(argv[3]);
+    return 1;
+  }
+  plain = malloc(st.st_size + 1);
+  back = malloc(st.st_size + 1);
+  if (read(pfd, plain, st.st_size) != st.st_size) {
+    perror("read plain file");
+    return 1;
+  }
+  
+  if ((fd = p_open(argv[1], O_RDONLY, 0, direct)) < 0) {
+    perror(argv[1]);
+    return 1;
+  }
+  tsp = init_gzrs(NULL, fd, bufsz, &gzi);
+  if (tsp->zlib_err != Z_OK) {
+    printf("zlib init error: %d\n", tsp->zlib_err);
+    return 1;
+  }
+  
+  /* all of it, from the start */
+  n = ts_read(tsp, back, st.st_size + 1);
+  if (n != st.st_size || memcmp(back, plain, n) != 0) {
+    printf("full read: got %d of %lld bytes\n", n, (long long)st.st_size);
+    return 1;
+  }
+  
+  srandom(16);
+  for (i = 0; i < NSEEKS; ++i) {
+    off64_t off = random() % st.st_size;
+    int len = random() % MAXREAD + 1;
+    int rv;
+    /* some right on the access points, where there is nothing to skip */
+    if (i % 10 == 0)
+      off = gzi.points[random() % gzi.npoints].out;
+    if (len > st.st_size - off)
+      len = st.st_size - off;
+    if ((rv = ts_seek(tsp, off)) != 0) {
+      ptserror("ts_seek", rv, tsp);
+      return 1;
+    }
+    n = ts_read(tsp, back, len);
+    if (n != len) {
+      ptserror("ts_read", n, tsp);
+      printf("seek to %lld: got %d of %d bytes\n", (long long)off, n, len);
+      return 1;
+    }
+    if (memcmp(back, plain + off, len) != 0) {
+      printf("seek to %lld: data mismatch\n", (long long)off);
+      return 1;
+    }
+  }
+  
+  ts_close(tsp, 1);
+  gzi_free(&gzi);
+  close(fd);
+  printf("ok\n");
+  return 0;
+}
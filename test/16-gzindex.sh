@@ -0,0 +1,60 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# indexing ordinary gzip files (-Z): the index must match the one for the
+# uncompressed tar, and extracting / seeking must work from the access
+# points, for single and multi member files
+
+rm -rf bin/test/gzidx.*
+d=bin/test/gzidx.d
+mkdir -p $d/small
+for i in `seq 1 400` ; do
+  seq $i $((i * 7)) >$d/small/f$i
+done
+# text compresses to real deflate blocks, which end mid byte
+for i in 1 2 3 ; do
+  cat src/*.c >$d/text$i
+  seq 1 $((i * 50000)) >>$d/text$i
+done
+head -c 1500000 /dev/urandom >$d/rand
+
+tar -c -f bin/test/gzidx.tar -C bin/test gzidx.d
+bin/tarix -i -f bin/test/gzidx.ref.tarix -t bin/test/gzidx.tar
+bin/tarix -x -f bin/test/gzidx.ref.tarix -t bin/test/gzidx.tar \
+  gzidx.d/small/f20 gzidx.d/text2 gzidx.d/rand >bin/test/gzidx.ref.x.tar
+
+# one member at different levels, several members, and zero padding
+gzip -1 -c bin/test/gzidx.tar >bin/test/gzidx.1.tar.gz
+gzip -9 -c bin/test/gzidx.tar >bin/test/gzidx.9.tar.gz
+split -b 3000000 bin/test/gzidx.tar bin/test/gzidx.part.
+for p in bin/test/gzidx.part.* ; do
+  gzip -c $p >>bin/test/gzidx.multi.tar.gz
+done
+cp bin/test/gzidx.9.tar.gz bin/test/gzidx.pad.tar.gz
+head -c 10000 /dev/zero >>bin/test/gzidx.pad.tar.gz
+
+for gz in 1 9 multi pad ; do
+  f=bin/test/gzidx.$gz.tar.gz
+  bin/tarix -i -Z -f bin/test/gzidx.tarix -t $f
+  cmp bin/test/gzidx.tarix bin/test/gzidx.ref.tarix
+  test -s bin/test/gzidx.tarix.gzap
+  bin/tarix -x -Z -f bin/test/gzidx.tarix -t $f \
+    gzidx.d/small/f20 gzidx.d/text2 gzidx.d/rand >bin/test/gzidx.x.tar
+  cmp bin/test/gzidx.x.tar bin/test/gzidx.ref.x.tar
+  for args in "" "4096" "65536 direct" ; do
+    bin/test/16-gzindex $f bin/test/gzidx.tarix.gzap bin/test/gzidx.tar $args
+  done
+done
+
+# reading from stdin works too
+bin/tarix -i -Z -f bin/test/gzidx.tarix <bin/test/gzidx.9.tar.gz
+cmp bin/test/gzidx.tarix bin/test/gzidx.ref.tarix
+
+# truncated and corrupt input
+head -c 2000000 bin/test/gzidx.9.tar.gz >bin/test/gzidx.trunc.tar.gz
+! bin/tarix -i -Z -f bin/test/gzidx.tarix -t bin/test/gzidx.trunc.tar.gz
+! bin/tarix -i -Z -f bin/test/gzidx.tarix -t bin/test/gzidx.tar
+# no access points, no extract
+rm bin/test/gzidx.tarix.gzap
+! bin/tarix -x -Z -f bin/test/gzidx.tarix -t bin/test/gzidx.9.tar.gz
@@ -0,0 +1,105 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+/* test case for the layout of BGZF member archives (-B): walk the members
+ * by their BSIZE fields, which must add up to the file exactly, and end
+ * with the EOF member.  Offsets read from stdin (one per line) must all be
+ * member starts.  Prints the number of members. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BGZF_MAX 65536
+
+static const unsigned char bgzf_eof[28] = {
+  0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0,
+  0x1b, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+int main (int argc, char **argv) {
+  FILE *f;
+  unsigned char *buf;
+  long *starts = NULL;
+  long nstarts = 0, size = 0, pos = 0;
+  long offset;
+  size_t len;
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s gzfile <offsets\n", argv[0]);
+    return 1;
+  }
+  if ((f = fopen(argv[1], "rb")) == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+  buf = malloc(BGZF_MAX);
+  while ((len = fread(buf, 1, 18, f)) > 0) {
+    unsigned long bsize, isize;
+    if (len != 18 || memcmp(buf, bgzf_eof, 16) != 0) {
+      fprintf(stderr, "bad member header at %ld\n", pos);
+      return 1;
+    }
+    bsize = (buf[16] | (buf[17] << 8)) + 1;
+    if (bsize < 26 || fread(buf + 18, 1, bsize - 18, f) != bsize - 18) {
+      fprintf(stderr, "bad member size %lu at %ld\n", bsize, pos);
+      return 1;
+    }
+    isize = buf[bsize - 4] | (buf[bsize - 3] << 8)
+      | ((unsigned long)buf[bsize - 2] << 16)
+      | ((unsigned long)buf[bsize - 1] << 24);
+    if (isize > 0xff00) {
+      fprintf(stderr, "member at %ld holds %lu bytes\n", pos, isize);
+      return 1;
+    }
+    if (nstarts == size) {
+      size = size ? size * 2 : 1024;
+      starts = realloc(starts, size * sizeof(*starts));
+    }
+    starts[nstarts++] = pos;
+    pos += bsize;
+  }
+  if (nstarts < 2 || memcmp(buf, bgzf_eof, sizeof(bgzf_eof)) != 0) {
+    fprintf(stderr, "no EOF member\n");
+    return 1;
+  }
+  fclose(f);
+
+  while (scanf("%ld", &offset) == 1) {
+    long lo = 0, hi = nstarts;
+    while (hi - lo > 1) {
+      long mid = (lo + hi) / 2;
+      if (starts[mid] <= offset)
+        lo = mid;
+      else
+        hi = mid;
+    }
+    if (starts[lo] != offset) {
+      fprintf(stderr, "offset %ld is not a member start\n", offset);
+      return 1;
+    }
+  }
+
+  printf("%ld members\n", nstarts);
+  free(starts);
+  free(buf);
+  return 0;
+}
@@ -0,0 +1,51 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# independent gzip members (-z -B): the archive must be valid gzip and
+# BGZF, with the index entries at member starts for -B 1, and extracting
+# must work whether the entries are member starts or flush points
+
+rm -rf bin/test/members.*
+d=bin/test/members.d
+mkdir -p $d
+for i in `seq 1 40` ; do
+  seq $i $((i * 300)) >$d/seq$i
+  head -c $((i * 2000 + 7)) /dev/urandom >$d/rand$i
+done
+# bigger than a member, both ways
+head -c 300000 /dev/urandom >$d/bigrand
+seq 1 100000 >$d/bigseq
+tar -c -f bin/test/members.tar -C bin/test members.d
+
+bin/tarix -z -f bin/test/members.ref.tarix -t bin/test/members.tar \
+  >bin/test/members.ref.gz
+bin/tarix -x -z -f bin/test/members.ref.tarix -t bin/test/members.ref.gz \
+  members.d/seq7 members.d/rand3 members.d/bigseq >bin/test/members.ref.x.tar
+
+for opts in "-B 1" "-B 20k" "-B 64k" "-B 1 -b 1M" "-B 8k -O" ; do
+  bin/tarix -z $opts -f bin/test/members.tarix -t bin/test/members.tar \
+    >bin/test/members.gz
+  gzip -t bin/test/members.gz
+  zcat bin/test/members.gz | cmp - bin/test/members.tar
+  # same entries as one long member, bar the offsets
+  diff <(tail -n +2 bin/test/members.tarix | cut -d ' ' -f 1,2,4-) \
+    <(tail -n +2 bin/test/members.ref.tarix | cut -d ' ' -f 1,2,4-)
+  if [ "$opts" = "-B 1" ]; then
+    tail -n +2 bin/test/members.tarix | cut -d ' ' -f 3 \
+      | bin/test/17-members bin/test/members.gz
+  else
+    bin/test/17-members bin/test/members.gz </dev/null
+  fi
+  bin/tarix -x -z -f bin/test/members.tarix -t bin/test/members.gz \
+    members.d/seq7 members.d/rand3 members.d/bigseq >bin/test/members.x.tar
+  cmp bin/test/members.x.tar bin/test/members.ref.x.tar
+done
+
+# members need zlib
+! bin/tarix -B 1 -f bin/test/members.tarix -t bin/test/members.tar \
+  >/dev/null
+! bin/tarix -z -B 65537 -f bin/test/members.tarix -t bin/test/members.tar \
+  >/dev/null
+
+rm -rf bin/test/members.*
@@ -0,0 +1,148 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+/* test case for zstd archives (-C zstd): the seek table at the end must
+ * describe the frames exactly, every frame must decompress by itself to
+ * its part of the uncompressed tar, and the offsets read from stdin (one
+ * per line) must all be frame starts.  Arguments: the archive and the
+ * uncompressed tar.  Prints the number of frames. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "config.h"
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+
+static unsigned char *slurp(const char *name, long *len) {
+  struct stat st;
+  unsigned char *buf;
+  FILE *f = fopen(name, "rb");
+  if (f == NULL || fstat(fileno(f), &st) != 0) {
+    perror(name);
+    exit(1);
+  }
+  buf = malloc(st.st_size + 1);
+  if (fread(buf, 1, st.st_size, f) != st.st_size) {
+    perror(name);
+    exit(1);
+  }
+  fclose(f);
+  *len = st.st_size;
+  return buf;
+}
+
+static unsigned long le32(const unsigned char *p) {
+  return p[0] | (p[1] << 8) | ((unsigned long)p[2] << 16)
+    | ((unsigned long)p[3] << 24);
+}
+
+int main (int argc, char **argv) {
+  unsigned char *zbuf, *plain, *out;
+  long zlen, plen, n, nframes, tablelen;
+  long cpos = 0, dpos = 0;
+  long *starts;
+  long offset;
+
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s archive plain <offsets\n", argv[0]);
+    return 1;
+  }
+  zbuf = slurp(argv[1], &zlen);
+  plain = slurp(argv[2], &plen);
+
+  if (zlen < 17 || le32(zbuf + zlen - 4) != 0x8f92eab1) {
+    fprintf(stderr, "no seekable footer\n");
+    return 1;
+  }
+  nframes = le32(zbuf + zlen - 9);
+  if (zbuf[zlen - 5] != 0) {
+    fprintf(stderr, "unexpected descriptor %d\n", zbuf[zlen - 5]);
+    return 1;
+  }
+  tablelen = 8 + 8 * nframes + 9;
+  if (tablelen > zlen || le32(zbuf + zlen - tablelen) != 0x184d2a5e
+      || le32(zbuf + zlen - tablelen + 4) != tablelen - 8) {
+    fprintf(stderr, "bad seek table frame\n");
+    return 1;
+  }
+
+  starts = malloc((nframes + 1) * sizeof(*starts));
+  out = malloc(1 << 30 > plen ? plen + 1 : 1 << 30);
+  for (n = 0; n < nframes; ++n) {
+    const unsigned char *e = zbuf + zlen - tablelen + 8 + 8 * n;
+    unsigned long csize = le32(e), dsize = le32(e + 4);
+    size_t rv;
+    starts[n] = cpos;
+    if (cpos + csize > zlen - tablelen || dpos + dsize > plen) {
+      fprintf(stderr, "frame %ld out of bounds\n", n);
+      return 1;
+    }
+    rv = ZSTD_decompress(out, dsize + 1, zbuf + cpos, csize);
+    if (ZSTD_isError(rv) || rv != dsize) {
+      fprintf(stderr, "frame %ld: %s\n", n,
+        ZSTD_isError(rv) ? ZSTD_getErrorName(rv) : "wrong size");
+      return 1;
+    }
+    if (memcmp(out, plain + dpos, dsize) != 0) {
+      fprintf(stderr, "frame %ld: wrong data\n", n);
+      return 1;
+    }
+    cpos += csize;
+    dpos += dsize;
+  }
+  if (cpos != zlen - tablelen || dpos != plen) {
+    fprintf(stderr, "frames cover %ld/%ld of %ld/%ld bytes\n", cpos, dpos,
+      zlen - tablelen, plen);
+    return 1;
+  }
+  starts[nframes] = cpos;
+
+  while (scanf("%ld", &offset) == 1) {
+    long lo = 0, hi = nframes + 1;
+    while (hi - lo > 1) {
+      long mid = (lo + hi) / 2;
+      if (starts[mid] <= offset)
+        lo = mid;
+      else
+        hi = mid;
+    }
+    if (starts[lo] != offset) {
+      fprintf(stderr, "offset %ld is not a frame start\n", offset);
+      return 1;
+    }
+  }
+
+  printf("%ld frames\n", nframes);
+  return 0;
+}
+
+#else
+
+int main (int argc, char **argv) {
+  printf("built without zstd\n");
+  return 0;
+}
+
+#endif /* HAVE_ZSTD */
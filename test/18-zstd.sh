@@ -0,0 +1,61 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# zstd archives (-C zstd): valid seekable zstd with a frame per file, the
+# same index entries as zlib bar the offsets, and extracts that match
+
+if ! bin/tarix -C zstd -h >/dev/null ; then
+  echo "tarix built without zstd, skipping"
+  exit 0
+fi
+
+rm -rf bin/test/zstd.*
+d=bin/test/zstd.d
+mkdir -p $d
+for i in `seq 1 40` ; do
+  seq $i $((i * 300)) >$d/seq$i
+  head -c $((i * 2000 + 7)) /dev/urandom >$d/rand$i
+done
+head -c 300000 /dev/urandom >$d/bigrand
+seq 1 300000 >$d/bigseq
+tar -c -f bin/test/zstd.tar -C bin/test zstd.d
+
+bin/tarix -z -f bin/test/zstd.ref.tarix -t bin/test/zstd.tar \
+  >bin/test/zstd.ref.gz
+bin/tarix -x -z -f bin/test/zstd.ref.tarix -t bin/test/zstd.ref.gz \
+  zstd.d/seq7 zstd.d/rand3 zstd.d/bigseq >bin/test/zstd.ref.x.tar
+
+for opts in "" "-1" "-9" "-b 1M" "-O" "-O -b 200k" ; do
+  bin/tarix -C zstd $opts -f bin/test/zstd.tarix -t bin/test/zstd.tar \
+    >bin/test/zstd.out
+  diff <(tail -n +2 bin/test/zstd.tarix | cut -d ' ' -f 1,2,4-) \
+    <(tail -n +2 bin/test/zstd.ref.tarix | cut -d ' ' -f 1,2,4-)
+  tail -n +2 bin/test/zstd.tarix | cut -d ' ' -f 3 \
+    | bin/test/18-zstd bin/test/zstd.out bin/test/zstd.tar
+  for xopts in "" "-O" ; do
+    bin/tarix -x -z $xopts -f bin/test/zstd.tarix -t bin/test/zstd.out \
+      zstd.d/seq7 zstd.d/rand3 zstd.d/bigseq >bin/test/zstd.x.tar
+    cmp bin/test/zstd.x.tar bin/test/zstd.ref.x.tar
+  done
+done
+
+# from stdin, as a compress program for tar
+bin/tarix -C zstd -f bin/test/zstd.tarix <bin/test/zstd.tar \
+  >bin/test/zstd.out
+bin/test/18-zstd bin/test/zstd.out bin/test/zstd.tar </dev/null
+bin/tarix -x -z -f bin/test/zstd.tarix -t bin/test/zstd.out \
+  zstd.d/seq7 zstd.d/rand3 zstd.d/bigseq >bin/test/zstd.x.tar
+cmp bin/test/zstd.x.tar bin/test/zstd.ref.x.tar
+
+# an archive cut off inside a frame is an error, not a short extract
+off=`grep ' zstd.d/bigseq$' bin/test/zstd.tarix | cut -d ' ' -f 3`
+head -c $((off + 1000)) bin/test/zstd.out >bin/test/zstd.trunc
+! bin/tarix -x -z -f bin/test/zstd.tarix -t bin/test/zstd.trunc \
+  zstd.d/bigseq >/dev/null
+# members are a zlib thing
+! bin/tarix -C zstd -B 1 -f bin/test/zstd.tarix -t bin/test/zstd.tar \
+  >/dev/null
+! bin/tarix -C lzma -f bin/test/zstd.tarix -t bin/test/zstd.tar >/dev/null
+
+rm -rf bin/test/zstd.*
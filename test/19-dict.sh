@@ -0,0 +1,70 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# preset dictionaries (-D): lots of small, similar files must come out
+# smaller than without, and extract the same, seeking or from the start
+
+rm -rf bin/test/dict.*
+d=bin/test/dict.d
+mkdir -p $d
+for i in `seq 1 1000` ; do
+  for j in `seq 1 5` ; do
+    echo "{ \"record\": $i, \"entry\": $j, \"status\": \"ok\"," \
+      "\"description\": \"an entry in a small file of the tarix tests\" }"
+  done >$d/rec$i.json
+done
+seq 1 20000 >$d/bigseq
+tar -c -f bin/test/dict.tar -C bin/test dict.d
+# the dictionary: more of the same, and over 32k so only its end is used
+for i in `seq 1 1000` ; do
+  echo "{ \"record\": $i, \"entry\": 1, \"status\": \"ok\"," \
+    "\"description\": \"an entry in a small file of the tarix tests\" }"
+done >bin/test/dict.dict
+
+codecs="-z"
+if bin/tarix -C zstd -h >/dev/null 2>&1 ; then
+  codecs="$codecs -Czstd"
+fi
+
+for c in $codecs ; do
+  bin/tarix $c -f bin/test/dict.ref.tarix -t bin/test/dict.tar \
+    >bin/test/dict.ref.out
+  for opts in "" "-B 32k" "-O" ; do
+    if [ "$c" != "-z" -a "$opts" = "-B 32k" ]; then
+      continue
+    fi
+    bin/tarix $c $opts -D bin/test/dict.dict -f bin/test/dict.tarix \
+      -t bin/test/dict.tar >bin/test/dict.out
+    # (bigger members have less to gain)
+    if [ "$opts" != "-B 32k" ]; then
+      test `stat -c %s bin/test/dict.out` -lt \
+        $((`stat -c %s bin/test/dict.ref.out` * 9 / 10))
+    fi
+    diff <(tail -n +2 bin/test/dict.tarix | cut -d ' ' -f 1,2,4-) \
+      <(tail -n +2 bin/test/dict.ref.tarix | cut -d ' ' -f 1,2,4-)
+    # seeking, and reading it all from the start
+    bin/tarix -x -z -f bin/test/dict.tarix -t bin/test/dict.out \
+      dict.d/rec7.json dict.d/rec750.json dict.d/bigseq >bin/test/dict.x.tar
+    bin/tarix -x -z -f bin/test/dict.ref.tarix -t bin/test/dict.ref.out \
+      dict.d/rec7.json dict.d/rec750.json dict.d/bigseq \
+      >bin/test/dict.ref.x.tar
+    cmp bin/test/dict.x.tar bin/test/dict.ref.x.tar
+    bin/tarix -x -z -f bin/test/dict.tarix dict.d <bin/test/dict.out \
+      >bin/test/dict.x.tar
+    bin/tarix -x -z -f bin/test/dict.ref.tarix -t bin/test/dict.ref.out \
+      dict.d >bin/test/dict.ref.x.tar
+    cmp bin/test/dict.x.tar bin/test/dict.ref.x.tar
+  done
+done
+
+# dictionaries need compression, and something in them
+! bin/tarix -D bin/test/dict.dict -f bin/test/dict.tarix \
+  -t bin/test/dict.tar >/dev/null
+: >bin/test/dict.empty
+! bin/tarix -z -D bin/test/dict.empty -f bin/test/dict.tarix \
+  -t bin/test/dict.tar >/dev/null
+! bin/tarix -z -D bin/test/dict.missing -f bin/test/dict.tarix \
+  -t bin/test/dict.tar >/dev/null
+
+rm -rf bin/test/dict.*
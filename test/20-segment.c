@@ -0,0 +1,150 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/* test case for ts_read_segment: records written with checkpoints, read
+ * back in a scrambled order with right, short, long and unknown
+ * compressed lengths, and read on from there */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#include "tstream.h"
+
+#define OFILE "bin/test/segment.z"
+#define NRECS 60
+
+static off64_t offsets[NRECS + 1];
+static int lens[NRECS];
+
+static int rec_len(int i) {
+  /* mostly small, now and then bigger than a member */
+  return i % 10 == 9 ? 100000 : (i * 7919) % 20000 + 1;
+}
+
+static void rec_fill(int i, Bytef *buf, int len) {
+  int j;
+  for (j = 0; j < len; ++j)
+    buf[j] = "tarix segments "[(i + j / 5 + (j % 3) * (j % 3) % 3) % 15];
+}
+
+static int check(int i, const Bytef *buf, int len) {
+  static Bytef want[100000];
+  rec_fill(i, want, lens[i]);
+  if (len != lens[i] || memcmp(buf, want, len) != 0) {
+    fprintf(stderr, "record %d mismatch, %d bytes\n", i, len);
+    return 1;
+  }
+  return 0;
+}
+
+int main (int argc, char **argv) {
+  static Bytef buf[100000];
+  const struct ts_codec *codec;
+  t_streamp tsp;
+  int fd, i, rv;
+  
+  if (argc < 2 || (codec = ts_find_codec(argv[1])) == NULL) {
+    fprintf(stderr, "usage: %s codec [member_size]\n", argv[0]);
+    return 1;
+  }
+  
+  if ((fd = open(OFILE, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+    perror("open output");
+    return 1;
+  }
+  tsp = init_tws_codec(NULL, fd, 0, 0, 0, 3, codec);
+  if (tsp->zlib_err != Z_OK) {
+    printf("init error: %d\n", tsp->zlib_err);
+    return 1;
+  }
+  if (argc > 2 && ts_set_members(tsp, atoi(argv[2])) != 0) {
+    printf("member setup error: %d\n", tsp->zlib_err);
+    return 1;
+  }
+  for (i = 0; i < NRECS; ++i) {
+    if ((offsets[i] = ts_checkpoint(tsp)) < 0) {
+      ptserror("ts_checkpoint", offsets[i], tsp);
+      return 1;
+    }
+    lens[i] = rec_len(i);
+    rec_fill(i, buf, lens[i]);
+    if ((rv = ts_write(tsp, buf, lens[i])) != lens[i]) {
+      ptserror("ts_write", rv, tsp);
+      return 1;
+    }
+  }
+  if ((offsets[NRECS] = ts_checkpoint(tsp)) < 0
+      || (rv = ts_close(tsp, 1)) != 0) {
+    fprintf(stderr, "closing the write stream failed\n");
+    return 1;
+  }
+  
+  if ((fd = open(OFILE, O_RDONLY)) < 0) {
+    perror("open input");
+    return 1;
+  }
+  tsp = init_trs(NULL, fd, 0, 0, 0, 3);
+  if (tsp->zlib_err != Z_OK) {
+    printf("init error: %d\n", tsp->zlib_err);
+    return 1;
+  }
+  for (i = 0; i < NRECS; ++i) {
+    /* every record once, out of order */
+    int r = (i * 37) % NRECS;
+    off64_t zlen = offsets[r + 1] - offsets[r];
+    switch (i % 4) {
+      case 1: zlen /= 2; break;
+      case 2: zlen *= 2; break;
+      case 3: zlen = 0; break;
+    }
+    rv = ts_read_segment(tsp, offsets[r], zlen, buf, lens[r]);
+    if (rv < 0) {
+      ptserror("ts_read_segment", rv, tsp);
+      return 1;
+    }
+    if (check(r, buf, rv) != 0)
+      return 1;
+    /* the stream goes on from there */
+    if (r + 1 < NRECS) {
+      rv = ts_read(tsp, buf, lens[r + 1]);
+      if (rv < 0) {
+        ptserror("ts_read", rv, tsp);
+        return 1;
+      }
+      if (check(r + 1, buf, rv) != 0)
+        return 1;
+    }
+  }
+  
+  rv = ts_close(tsp, 1);
+  if (rv == 0)
+    printf("OK\n");
+  else {
+    ptserror("ts_close", rv, tsp);
+    return 1;
+  }
+  
+  return 0;
+}
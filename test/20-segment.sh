@@ -0,0 +1,41 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# whole segment reads: the tstream level with right and wrong lengths, and
+# extracting small files scattered over an archive
+
+bin/test/20-segment zlib
+bin/test/20-segment zlib 1
+bin/test/20-segment zlib 30000
+if bin/tarix -C zstd -h >/dev/null 2>&1 ; then
+  bin/test/20-segment zstd
+fi
+rm -f bin/test/segment.z
+
+rm -rf bin/test/segment.*
+d=bin/test/segment.d
+mkdir -p $d
+for i in `seq 1 300` ; do
+  seq $i $((i * 7)) >$d/small$i
+done
+seq 1 200000 >$d/big
+tar -c -f bin/test/segment.tar -C bin/test segment.d
+
+for opts in "-z" "-z -B 20k" "-z -b 1M" ; do
+  bin/tarix $opts -f bin/test/segment.tarix -t bin/test/segment.tar \
+    >bin/test/segment.gz
+  # every 7th file, then the last entry (whose length isn't known)
+  names=`grep -v '^#' bin/test/segment.tarix | tail -n +2 | cut -d ' ' -f 5- \
+    | awk 'NR % 7 == 0'`
+  last=`grep -v '^#' bin/test/segment.tarix | tail -n 1 | cut -d ' ' -f 5-`
+  rm -rf bin/test/segment.x
+  mkdir bin/test/segment.x
+  bin/tarix -x -z -a -f bin/test/segment.tarix -t bin/test/segment.gz \
+    $names "$last" | tar -x -f - -C bin/test/segment.x
+  for n in $names "$last" ; do
+    cmp bin/test/$n bin/test/segment.x/$n
+  done
+done
+
+rm -rf bin/test/segment.*
@@ -0,0 +1,50 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# compressing with threads (-z -j): the same tar and index as one thread
+# writes, still a single gzip stream, and files extract from the middle
+
+rm -rf bin/test/par.*
+d=bin/test/par.d
+mkdir -p $d
+seq 1 400000 >$d/big1
+for i in `seq 1 20` ; do
+  seq $i $((i * 11)) >$d/small$i
+done
+# incompressible chunks must fit too
+head -c 1500000 /dev/urandom >$d/random
+seq 5 700000 >$d/big2
+echo last >$d/zlast
+tar -c -f bin/test/par.tar -C bin/test par.d
+
+codecs="-z"
+if bin/tarix -C zstd -h >/dev/null 2>&1 ; then
+  codecs="$codecs -Czstd"
+fi
+
+for c in $codecs ; do
+  bin/tarix $c -f bin/test/par.ref.tarix -t bin/test/par.tar \
+    >bin/test/par.ref.out
+  for opts in "-j 4" "-j 2 -1" "-j 3 -O" "-j 4 -B 30k" ; do
+    if [ "$c" != "-z" -a "$opts" = "-j 4 -B 30k" ]; then
+      continue
+    fi
+    bin/tarix $c $opts -f bin/test/par.tarix -t bin/test/par.tar \
+      >bin/test/par.out
+    if [ "$c" = "-z" ]; then
+      gzip -t bin/test/par.out
+      gzip -dc bin/test/par.out | cmp - bin/test/par.tar
+    fi
+    # the same entries, only the compressed offsets differ
+    diff <(cut -d ' ' -f 1,2,4- bin/test/par.ref.tarix) \
+      <(cut -d ' ' -f 1,2,4- bin/test/par.tarix)
+    for n in big2 small7 zlast ; do
+      bin/tarix -x $c -f bin/test/par.tarix -t bin/test/par.out \
+        par.d/$n | tar -x -O -f - >bin/test/par.x
+      cmp $d/$n bin/test/par.x
+    done
+  done
+done
+
+rm -rf bin/test/par.*
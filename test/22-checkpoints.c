@@ -0,0 +1,172 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+/* test case for checkpoints in member data (tarix -k): every #:cp record
+ * of the index must be a point decompression can start at, right at the
+ * tar block it names, and find_index_cp must pick the one before a given
+ * data offset */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "index_parser.h"
+#include "portability.h"
+#include "tar.h"
+#include "tstream.h"
+
+#define MAXCPS 10000
+
+static int tar, arch;
+static struct index_entry entry;
+static struct index_cp cps[MAXCPS];
+static int ncps, ncps_total;
+
+/* the cps of the entry are all there, check find_index_cp on them */
+static int check_find(void) {
+  union tar_block hdr;
+  unsigned long datablock = 1;
+  int i;
+  
+  if (ncps == 0)
+    return 0;
+  if (pread(tar, &hdr, TARBLKSZ, (off_t)entry.blocknum * TARBLKSZ)
+      != TARBLKSZ) {
+    perror("read tar header");
+    return 1;
+  }
+  if (hdr.header.typeflag == GNUTYPE_LONGNAME)
+    datablock = 3;
+  
+  if (find_index_cp(cps, ncps, datablock,
+      (off64_t)(cps[0].block - datablock) * TARBLKSZ - 1) != NULL) {
+    fprintf(stderr, "%s: checkpoint before the first\n", entry.filename);
+    return 1;
+  }
+  for (i = 0; i < ncps; ++i) {
+    off64_t pos = (off64_t)(cps[i].block - datablock) * TARBLKSZ;
+    if (find_index_cp(cps, ncps, datablock, pos) != &cps[i]
+        || find_index_cp(cps, ncps, datablock, pos + 700) != &cps[i]) {
+      fprintf(stderr, "%s: wrong checkpoint for cp %d\n", entry.filename, i);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* decompression from the point gives the block it is for */
+static int check_cp(t_streamp tsp, const struct index_cp *cp) {
+  char want[TARBLKSZ], got[TARBLKSZ];
+  off_t pos = (off_t)(entry.blocknum + cp->block) * TARBLKSZ;
+  int rv;
+  
+  if (pread(tar, want, TARBLKSZ, pos) != TARBLKSZ) {
+    perror("read tar");
+    return 1;
+  }
+  if ((rv = ts_seek(tsp, cp->offset)) != 0) {
+    ptserror("seek", rv, tsp);
+    return 1;
+  }
+  if ((rv = ts_read(tsp, got, TARBLKSZ)) != TARBLKSZ) {
+    ptserror("read", rv, tsp);
+    return 1;
+  }
+  if (memcmp(want, got, TARBLKSZ) != 0) {
+    fprintf(stderr, "%s: checkpoint at block %lu is off\n", entry.filename,
+      cp->block);
+    return 1;
+  }
+  return 0;
+}
+
+int main (int argc, char **argv) {
+  struct index_parser_state ips;
+  char line[4096];
+  FILE *index;
+  t_streamp tsp;
+  
+  if (argc < 4) {
+    fprintf(stderr, "usage: %s tarfile archive index\n", argv[0]);
+    return 1;
+  }
+  if ((tar = open(argv[1], O_RDONLY)) < 0
+      || (arch = open(argv[2], O_RDONLY)) < 0
+      || (index = fopen(argv[3], "r")) == NULL) {
+    perror("open");
+    return 1;
+  }
+  tsp = init_trs(NULL, arch, 0, 0, 0, 1);
+  if (tsp->zlib_err != Z_OK) {
+    ptserror("init", TS_ERR_ZLIB, tsp);
+    return 1;
+  }
+  
+  memset(&ips, 0, sizeof(ips));
+  ips.version = -1;
+  memset(&entry, 0, sizeof(entry));
+  while (fgets(line, sizeof(line), index) != NULL) {
+    struct index_entry e;
+    struct index_cp cp;
+    int rv;
+    
+    line[strcspn(line, "\n")] = 0;
+    if (ips.version < 0) {
+      if (init_index_parser(&ips, line) != 0)
+        return 1;
+      continue;
+    }
+    memset(&e, 0, sizeof(e));
+    if ((rv = parse_index_line(&ips, line, &e)) < 0)
+      return 1;
+    if (rv == 0) {
+      /* on to the next entry */
+      if (check_find() != 0)
+        return 1;
+      entry = e;
+      entry.filename = strdup(e.filename);
+      ncps = 0;
+    } else if (rv == 2 && (rv = parse_index_cp(e.filename, &cp)) == 0) {
+      if (ncps > 0 && cp.block <= cps[ncps - 1].block) {
+        fprintf(stderr, "%s: checkpoints out of order\n", entry.filename);
+        return 1;
+      }
+      if (ncps == MAXCPS || check_cp(tsp, &cp) != 0)
+        return 1;
+      cps[ncps++] = cp;
+      ++ncps_total;
+    } else if (rv < 0) {
+      fprintf(stderr, "bad checkpoint record: %s\n", line);
+      return 1;
+    }
+  }
+  if (check_find() != 0)
+    return 1;
+  
+  printf("%d checkpoints ok\n", ncps_total);
+  ts_close(tsp, 1);
+  return 0;
+}
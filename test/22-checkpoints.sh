@@ -0,0 +1,56 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# checkpoints inside big files (-k): listed after the file's entry, each
+# one where it says, and the archive the same as without
+
+rm -rf bin/test/kcp.*
+d=bin/test/kcp.d
+mkdir -p $d
+seq 1 500000 >$d/big
+head -c 700000 /dev/urandom >$d/random
+for i in `seq 1 10` ; do
+  seq $i $((i * 13)) >$d/small$i
+done
+long=$d/a-directory-with-a-long-name-for-a-gnu-longname-record/and-then-a-file-with-a-long-name-too
+mkdir -p `dirname $long`
+seq 7 300000 >$long
+tar -c -f bin/test/kcp.tar -C bin/test kcp.d
+
+codecs="-z"
+if bin/tarix -C zstd -h >/dev/null 2>&1 ; then
+  codecs="$codecs -Czstd"
+fi
+
+for c in $codecs ; do
+  for opts in "-k 64k" "-k 100k -B 30k" "-k 256k -j 3" "-k 64k -D $d/big" ; do
+    if [ "$c" != "-z" -a "$opts" = "-k 100k -B 30k" ]; then
+      continue
+    fi
+    bin/tarix $c $opts -f bin/test/kcp.tarix -t bin/test/kcp.tar \
+      >bin/test/kcp.out
+    test `grep -c '^#:cp ' bin/test/kcp.tarix` -gt 10
+    bin/test/22-checkpoints bin/test/kcp.tar bin/test/kcp.out \
+      bin/test/kcp.tarix
+    if [ "$c" = "-z" -a "$opts" != "-k 64k -D $d/big" ]; then
+      gzip -dc bin/test/kcp.out | cmp - bin/test/kcp.tar
+    fi
+    bin/tarix -x $c -f bin/test/kcp.tarix -t bin/test/kcp.out kcp.d/big \
+      | tar -x -O -f - >bin/test/kcp.x
+    cmp $d/big bin/test/kcp.x
+  done
+done
+
+# a point every 64k of the 3.4M file, and none in small ones
+bin/tarix -z -k 64k -f bin/test/kcp.tarix -t bin/test/kcp.tar \
+  >bin/test/kcp.out
+n=`grep -v '^#:st ' bin/test/kcp.tarix | grep -A 200 ' kcp.d/big$' \
+  | tail -n +2 | grep -m 1 -v '^#:cp ' -B 1000 | grep -c '^#:cp '`
+test $n = $(( (`stat -c %s $d/big` - 1) / 65536 ))
+
+# only for compressed archives, and not too close together
+! bin/tarix -k 64k -f bin/test/kcp.tarix -t bin/test/kcp.tar >/dev/null
+! bin/tarix -z -k 4k -f bin/test/kcp.tarix -t bin/test/kcp.tar >/dev/null
+
+rm -rf bin/test/kcp.*
@@ -0,0 +1,106 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# cat mode (-x -c): just the contents of files, or a range (-r) of each,
+# from uncompressed, compressed and ordinary gzip archives
+
+rm -rf bin/test/cat.*
+d=bin/test/cat.d
+mkdir -p $d/sub
+seq 1 300000 >$d/big
+for i in `seq 1 5` ; do
+  seq $i $((i * 17)) >$d/sub/small$i
+done
+long=$d/sub/a-file-with-a-name-long-enough-for-a-gnu-longname-record-in-the-archive-itself
+seq 3 40000 >$long
+ln -s big $d/link
+: >$d/empty
+sparse=
+if tar --version | grep GNU.tar ; then
+  truncate -s 3M $d/holes
+  for i in 1 2 3 ; do
+    printf "extent $i" | dd of=$d/holes bs=1 seek=$((i * 700000)) \
+      conv=notrunc 2>/dev/null
+  done
+  sparse=--sparse
+fi
+
+# range off:len of file, as bytes
+range() {
+  tail -c +$(($2 + 1)) $1 | head -c $3
+}
+
+for fmt in gnu "posix --sparse-version=1.0" ; do
+  if [ -z "$sparse" -a "$fmt" != gnu ]; then
+    continue
+  fi
+  tar -c -f bin/test/cat.tar $sparse --format=$fmt -C bin/test cat.d
+  gzip -c bin/test/cat.tar >bin/test/cat.tar.gz
+  modes="plain -z -zk64k -Z"
+  if bin/tarix -C zstd -h >/dev/null 2>&1 ; then
+    modes="$modes -Czstd"
+  fi
+  for m in $modes ; do
+    x=
+    case $m in
+      plain)
+        bin/tarix -i -f bin/test/cat.tarix -t bin/test/cat.tar
+        cp bin/test/cat.tar bin/test/cat.out ;;
+      -Z)
+        bin/tarix -i -Z -f bin/test/cat.tarix -t bin/test/cat.tar.gz
+        cp bin/test/cat.tar.gz bin/test/cat.out
+        x=-Z ;;
+      -zk64k)
+        bin/tarix -z -k 64k -f bin/test/cat.tarix -t bin/test/cat.tar \
+          >bin/test/cat.out
+        x=-z ;;
+      *)
+        bin/tarix $m -f bin/test/cat.tarix -t bin/test/cat.tar \
+          >bin/test/cat.out
+        x=-z ;;
+    esac
+    cx="bin/tarix -x -c $x -f bin/test/cat.tarix -t bin/test/cat.out"
+    
+    # whole files, and a directory's worth as tar -x -O has it
+    $cx -a cat.d/big | cmp - $d/big
+    $cx -a ${long#bin/test/} | cmp - $long
+    $cx -a cat.d/empty | cmp - $d/empty
+    $cx cat.d | cmp - <(tar -x -O -f bin/test/cat.tar cat.d)
+    # links have no contents
+    test `$cx -a cat.d/link | wc -c` = 0
+    
+    # ranges
+    $cx -a -r 1000:5000 cat.d/big | cmp - <(range $d/big 1000 5000)
+    $cx -a -r 1500k:100 cat.d/big | cmp - <(range $d/big 1536000 100)
+    $cx -a -r 2000000 cat.d/big | cmp - <(range $d/big 2000000 9999999)
+    $cx -a -r -3000 cat.d/big | cmp - <(tail -c 3000 $d/big)
+    $cx -a -r -1k: cat.d/big | cmp - <(tail -c 1024 $d/big)
+    $cx -a -r 100: cat.d/sub/small3 | cmp - <(range $d/sub/small3 100 999)
+    test `$cx -a -r 0:0 cat.d/big | wc -c` = 0
+    test `$cx -a -r 10M:10 cat.d/big | wc -c` = 0
+    # each file gets its range
+    $cx -r 2:3 cat.d/sub/small | cmp - <(for n in `grep -o \
+      ' cat.d/sub/small.*' bin/test/cat.tarix` ; do
+      range bin/test/$n 2 3 ; done)
+    if [ -n "$sparse" ]; then
+      $cx -a cat.d/holes | cmp - $d/holes
+      $cx -a -r 699990:30 cat.d/holes | cmp - <(range $d/holes 699990 30)
+      $cx -a -r 1400005:700000 cat.d/holes \
+        | cmp - <(range $d/holes 1400005 700000)
+    fi
+  done
+done
+
+# -c and -r go with extracting
+! bin/tarix -c -f bin/test/cat.tarix -t bin/test/cat.tar
+! bin/tarix -x -r 1:2 -f bin/test/cat.tarix -t bin/test/cat.tar cat.d
+! bin/tarix -x -c -r 1:x -f bin/test/cat.tarix -t bin/test/cat.tar cat.d
+# sizes too big once the suffix is applied
+for r in 9000000000000G -9000000000000G 1:9000000000000G ; do
+  ! bin/tarix -x -c -r $r -f bin/test/cat.tarix -t bin/test/cat.tar cat.d
+done
+! bin/tarix -x -b 9000000000000G -f bin/test/cat.tarix -t bin/test/cat.tar \
+  cat.d
+
+rm -rf bin/test/cat.*
@@ -0,0 +1,202 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+
+/* test case for libtarix: every member of the archive is found by name
+ * and reads back the same as the file it came from, and so do random
+ * ranges read by several threads at once */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "libtarix.h"
+
+#define MAXFILES 1000
+#define NTHREADS 4
+#define NREADS 300
+
+static struct tarix_archive *archive;
+static const char *dir;
+static const struct tarix_member *files[MAXFILES];
+static off_t sizes[MAXFILES];
+static int nfiles, nmembers;
+
+/* read len bytes at off of member and the file it came from, and compare
+ * them */
+static int check_range(const struct tarix_member *member, off_t size,
+    off_t off, size_t len) {
+  char path[4096], *got, *want;
+  ssize_t n, wantn;
+  int fd, rv = 0;
+  
+  snprintf(path, sizeof(path), "%s/%s", dir, tarix_member_name(member));
+  got = malloc(len + 1);
+  want = malloc(len + 1);
+  if ((fd = open(path, O_RDONLY)) < 0) {
+    perror(path);
+    return 1;
+  }
+  wantn = pread(fd, want, len, off);
+  close(fd);
+  n = tarix_member_pread(archive, member, got, len, off);
+  if (n != wantn || (wantn >= 0 && memcmp(got, want, wantn) != 0)) {
+    fprintf(stderr, "%s: %zu at %lld read %zd, wanted %zd (size %lld)\n",
+      path, len, (long long)off, n, wantn, (long long)size);
+    rv = 1;
+  }
+  free(got);
+  free(want);
+  return rv;
+}
+
+static int check_member(const struct tarix_member *member, void *data) {
+  const char *prefix = (const char*)data;
+  char path[4096];
+  struct stat st, dst;
+  
+  ++nmembers;
+  if (strncmp(tarix_member_name(member), prefix, strlen(prefix)) != 0) {
+    fprintf(stderr, "%s is not under %s\n", tarix_member_name(member),
+      prefix);
+    return 1;
+  }
+  if (tarix_lookup(archive, tarix_member_name(member)) != member) {
+    fprintf(stderr, "%s not found\n", tarix_member_name(member));
+    return 1;
+  }
+  if (tarix_stat(archive, member, &st) != 0) {
+    perror(tarix_member_name(member));
+    return 1;
+  }
+  snprintf(path, sizeof(path), "%s/%s", dir, tarix_member_name(member));
+  if (lstat(path, &dst) != 0) {
+    perror(path);
+    return 1;
+  }
+  if ((st.st_mode & S_IFMT) != (dst.st_mode & S_IFMT)
+      || (st.st_mode & 07777) != (dst.st_mode & 07777)) {
+    fprintf(stderr, "%s: mode %o, wanted %o\n", path, st.st_mode,
+      dst.st_mode);
+    return 1;
+  }
+  if (S_ISDIR(st.st_mode)) {
+    char buf[16];
+    if (tarix_member_pread(archive, member, buf, sizeof(buf), 0) != -1
+        || errno != EISDIR) {
+      fprintf(stderr, "%s: read a directory\n", path);
+      return 1;
+    }
+    return 0;
+  }
+  if (!S_ISREG(st.st_mode))
+    return 0;
+  if (st.st_size != dst.st_size) {
+    fprintf(stderr, "%s: size %lld, wanted %lld\n", path,
+      (long long)st.st_size, (long long)dst.st_size);
+    return 1;
+  }
+  if (*prefix == 0 && nfiles < MAXFILES) {
+    sizes[nfiles] = st.st_size;
+    files[nfiles++] = member;
+  }
+  /* all of it, and past the end */
+  return check_range(member, st.st_size, 0, st.st_size + 100)
+    || check_range(member, st.st_size, st.st_size, 10);
+}
+
+static void *reader_thread(void *data) {
+  unsigned int seed = (unsigned long)data;
+  int i;
+  
+  for (i = 0; i < NREADS; ++i) {
+    int f = rand_r(&seed) % nfiles;
+    off_t off = sizes[f] ? rand_r(&seed) % sizes[f] : 0;
+    size_t len = rand_r(&seed) % (i % 10 == 0 ? 300000 : 5000);
+    if (check_range(files[f], sizes[f], off, len) != 0)
+      return (void*)1;
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  pthread_t threads[NTHREADS];
+  int flags = 0, all, i, rv = 0;
+  
+  if (argc != 6) {
+    fprintf(stderr, "usage: %s plain|z|gzip tarfile indexfile dir prefix\n",
+      argv[0]);
+    return 2;
+  }
+  if (strcmp(argv[1], "z") == 0)
+    flags = TARIX_OPEN_COMPRESSED;
+  else if (strcmp(argv[1], "gzip") == 0)
+    flags = TARIX_OPEN_GZIP;
+  dir = argv[4];
+  if ((archive = tarix_open(argv[2], argv[3], flags)) == NULL) {
+    perror("tarix_open");
+    return 1;
+  }
+  
+  if (tarix_foreach(archive, NULL, check_member, "") != 0)
+    return 1;
+  all = nmembers;
+  if (all == 0 || nfiles == 0) {
+    fprintf(stderr, "no files found\n");
+    return 1;
+  }
+  /* a prefix only gets what is under it */
+  nmembers = 0;
+  if (tarix_foreach(archive, argv[5], check_member, argv[5]) != 0)
+    return 1;
+  if (nmembers == 0 || nmembers >= all) {
+    fprintf(stderr, "%d of %d members under %s\n", nmembers, all, argv[5]);
+    return 1;
+  }
+  /* directories are found without their / as well */
+  if (tarix_lookup(archive, "tlib.d") == NULL
+      || tarix_lookup(archive, "tlib.d/nonexistent") != NULL) {
+    fprintf(stderr, "lookup failed\n");
+    return 1;
+  }
+  
+  for (i = 0; i < NTHREADS; ++i)
+    if (pthread_create(&threads[i], NULL, reader_thread,
+        (void*)(unsigned long)(i + 1)) != 0) {
+      perror("pthread_create");
+      return 1;
+    }
+  for (i = 0; i < NTHREADS; ++i) {
+    void *trv;
+    pthread_join(threads[i], &trv);
+    if (trv != NULL)
+      rv = 1;
+  }
+  
+  tarix_close(archive);
+  return rv;
+}
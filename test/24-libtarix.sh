@@ -0,0 +1,55 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# libtarix: lookups, stat and reads from several threads at once, on every
+# kind of archive tarix can read
+
+rm -rf bin/test/tlib.*
+d=bin/test/tlib.d
+mkdir -p $d/sub/deeper $d/empty
+seq 1 500000 >$d/big
+head -c 700000 /dev/urandom >$d/random
+for i in `seq 1 20` ; do
+  seq $i $((i * 13)) >$d/sub/small$i
+done
+: >$d/sub/deeper/zero
+ln -s big $d/link
+long=$d/a-directory-with-a-long-name-for-a-gnu-longname-record/and-then-a-file-with-a-long-name-too
+mkdir -p `dirname $long`
+seq 7 300000 >$long
+# a hole at the start, data in the middle, and a hole at the end
+truncate -s 3M $d/sparse
+seq 1 100000 | dd of=$d/sparse bs=1k seek=1000 conv=notrunc 2>/dev/null
+truncate -s 6M $d/sparse
+
+for fmt in gnu posix ; do
+  tar -c -S --format=$fmt -f bin/test/tlib.tar -C bin/test tlib.d
+  
+  bin/tarix -f bin/test/tlib.tarix -t bin/test/tlib.tar >/dev/null
+  bin/test/24-libtarix plain bin/test/tlib.tar bin/test/tlib.tarix \
+    bin/test tlib.d/sub/
+  
+  bin/tarix -z -k 64k -f bin/test/tlib.tarix -t bin/test/tlib.tar \
+    >bin/test/tlib.out
+  bin/test/24-libtarix z bin/test/tlib.out bin/test/tlib.tarix \
+    bin/test tlib.d/sub/
+  
+  gzip -c bin/test/tlib.tar >bin/test/tlib.tar.gz
+  bin/tarix -Z -f bin/test/tlib.tarix -t bin/test/tlib.tar.gz
+  bin/test/24-libtarix gzip bin/test/tlib.tar.gz bin/test/tlib.tarix \
+    bin/test tlib.d/sub/
+  
+  if bin/tarix -C zstd -h >/dev/null 2>&1 ; then
+    bin/tarix -C zstd -f bin/test/tlib.tarix -t bin/test/tlib.tar \
+      >bin/test/tlib.out
+    bin/test/24-libtarix z bin/test/tlib.out bin/test/tlib.tarix \
+      bin/test tlib.d/sub/
+  fi
+done
+
+# the library is there to link against
+test -s bin/libtarix.a
+test -s bin/libtarix.so
+
+rm -rf bin/test/tlib.*
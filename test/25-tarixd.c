@@ -0,0 +1,99 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+
+/* a client for tarixd: sends each argument as a request on one connection,
+ * and writes the data of the responses to stdout, stopping with an error
+ * at the first one that isn't OK */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int read_all(int fd, char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = read(fd, buf, len);
+    if (n <= 0)
+      return -1;
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  struct sockaddr_un addr;
+  char buf[65536];
+  int fd, i;
+  
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s socket request...\n", argv[0]);
+    return 2;
+  }
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+    perror("socket");
+    return 1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, argv[1], sizeof(addr.sun_path) - 1);
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    perror(argv[1]);
+    return 1;
+  }
+  
+  for (i = 2; i < argc; ++i) {
+    long long len;
+    size_t pos = 0;
+    if (write(fd, argv[i], strlen(argv[i])) != strlen(argv[i])
+        || write(fd, "\n", 1) != 1) {
+      perror("write request");
+      return 1;
+    }
+    /* the status line */
+    do {
+      if (pos == sizeof(buf) - 1 || read(fd, buf + pos, 1) != 1) {
+        fprintf(stderr, "no response to %s\n", argv[i]);
+        return 1;
+      }
+    } while (buf[pos++] != '\n');
+    buf[pos] = 0;
+    if (sscanf(buf, "OK %lld\n", &len) != 1) {
+      fprintf(stderr, "%s: %s", argv[i], buf);
+      return 1;
+    }
+    while (len > 0) {
+      size_t n = len < sizeof(buf) ? len : sizeof(buf);
+      if (read_all(fd, buf, n) != 0) {
+        fprintf(stderr, "short response to %s\n", argv[i]);
+        return 1;
+      }
+      fwrite(buf, 1, n, stdout);
+      len -= n;
+    }
+  }
+  close(fd);
+  return 0;
+}
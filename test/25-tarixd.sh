@@ -0,0 +1,74 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# tarixd: the same archive uncompressed, compressed and gzip'd, served
+# from one daemon
+
+rm -rf bin/test/td.*
+d=bin/test/td.d
+mkdir -p $d/sub
+seq 1 500000 >$d/big
+head -c 700000 /dev/urandom >$d/random
+for i in `seq 1 20` ; do
+  seq $i $((i * 13)) >$d/sub/small$i
+done
+truncate -s 3M $d/sparse
+seq 1 100000 | dd of=$d/sparse bs=1k seek=1000 conv=notrunc 2>/dev/null
+tar -c -S -f bin/test/td.tar -C bin/test td.d
+
+bin/tarix -f bin/test/td.tarix -t bin/test/td.tar >/dev/null
+bin/tarix -z -k 64k -f bin/test/td.z.tarix -t bin/test/td.tar \
+  >bin/test/td.tar.z
+gzip -c bin/test/td.tar >bin/test/td.tar.gz
+bin/tarix -Z -f bin/test/td.gz.tarix -t bin/test/td.tar.gz
+
+s=bin/test/td.sock
+bin/tarixd -s $s p:bin/test/td.tar:bin/test/td.tarix \
+  z:bin/test/td.tar.z:bin/test/td.z.tarix:zlib \
+  g:bin/test/td.tar.gz:bin/test/td.gz.tarix:gzip &
+pid=$!
+trap "kill $pid 2>/dev/null || true" EXIT
+c="bin/test/25-tarixd $s"
+for i in `seq 1 100` ; do
+  $c "list p td.d/sub/" >/dev/null 2>&1 && break
+  sleep 0.1
+done
+
+for a in p z g ; do
+  for f in big random sparse sub/small7 ; do
+    $c "cat $a 0 -1 td.d/$f" | cmp - $d/$f
+    $c "cat $a 100000 5000 td.d/$f" | cmp - <(tail -c +100001 $d/$f | head -c 5000)
+    $c "cat $a -3000 -1 td.d/$f" | cmp - <(tail -c 3000 $d/$f)
+    $c "extract $a td.d/$f" | tar -x -O -f - | cmp - $d/$f
+    test "`$c "stat $a td.d/$f" | cut -d ' ' -f 1,5`" = "- `stat -c %s $d/$f`"
+  done
+  # several requests on one connection
+  $c "cat $a 0 -1 td.d/sub/small1" "stat $a td.d/sub" "cat $a 0 -1 td.d/big" \
+    | cmp - <(cat $d/sub/small1; $c "stat $a td.d/sub"; cat $d/big)
+  $c "stat $a td.d/sub" | grep '^d 755 '
+  test `$c "list $a td.d/sub/" | wc -l` = 21
+  test "`$c "list $a td.d/sub/small2" | sort`" = "`printf 'td.d/sub/small2\ntd.d/sub/small20'`"
+  ! $c "cat $a 0 -1 td.d/nonexistent"
+  ! $c "cat $a 0 -1 td.d/sub"
+done
+! $c "cat nonexistent 0 -1 td.d/big"
+! $c "bogus p td.d/big"
+
+# clients at the same time
+pids=
+for i in `seq 1 4` ; do
+  $c "cat z 0 -1 td.d/big" "cat g 0 -1 td.d/big" >bin/test/td.out$i &
+  pids="$pids $!"
+done
+wait $pids
+for i in `seq 1 4` ; do
+  cat $d/big $d/big | cmp - bin/test/td.out$i
+done
+
+# the socket goes away with the daemon
+kill $pid
+wait $pid || true
+! test -e $s
+
+rm -rf bin/test/td.*
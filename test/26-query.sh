@@ -0,0 +1,81 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# listing and querying the index (-l, -q) agrees with tar -tv without
+# reading the archive, and the parallel scan gives the same output
+
+rm -rf bin/test/qry.*
+d=bin/test/qry.d
+mkdir -p $d/sub $d/many
+seq 1 100000 >$d/big
+echo hi >$d/small
+ln -s small $d/link
+mkfifo $d/fifo
+# enough entries for an index of a few chunks
+for i in `seq 1 6000` ; do
+  echo $i >$d/many/a-file-with-a-rather-long-name-to-make-the-index-big-$i
+done
+long=$d/sub/a-directory-with-a-long-name-for-a-gnu-longname-record/and-then-a-file-with-a-long-name-too
+mkdir -p `dirname $long`
+seq 7 3000 >$long
+touch -d '2020-01-02 03:04:05' $d/small $d/sub
+
+for fmt in gnu posix ; do
+  tar -c -H $fmt -f bin/test/qry.tar -C bin/test qry.d
+  bin/tarix -i -f bin/test/qry.tarix -t bin/test/qry.tar
+  # the archive isn't needed
+  mv bin/test/qry.tar bin/test/qry.away
+
+  tar -t -v --numeric-owner -f bin/test/qry.away | sed -e 's/ -> .*//' \
+    | tr -s ' ' >bin/test/qry.tv
+  bin/tarix -l -f bin/test/qry.tarix | tr -s ' ' >bin/test/qry.l
+  diff bin/test/qry.tv bin/test/qry.l
+
+  # chunks are scanned in parallel, the output is still in index order
+  bin/tarix -ll -j 1 -f bin/test/qry.tarix >bin/test/qry.ll1
+  bin/tarix -ll -j 4 -f bin/test/qry.tarix >bin/test/qry.ll4
+  cmp bin/test/qry.ll1 bin/test/qry.ll4
+  test `wc -l <bin/test/qry.ll1` = `wc -l <bin/test/qry.tv`
+
+  # conditions
+  bin/tarix -l -q type=f,size\>100k -f bin/test/qry.tarix >bin/test/qry.out
+  test `wc -l <bin/test/qry.out` = 1
+  grep -q ' qry.d/big$' bin/test/qry.out
+  bin/tarix -ll -q type=d -f bin/test/qry.tarix | cut -f 9 >bin/test/qry.out
+  tar -t -v -f bin/test/qry.away | grep '^d' | awk '{print $6}' \
+    | diff - bin/test/qry.out
+  bin/tarix -ll -q 'mtime<2021-01-01 00:00' -f bin/test/qry.tarix \
+    | cut -f 9 | sort >bin/test/qry.out
+  printf 'qry.d/small\nqry.d/sub/\n' | diff - bin/test/qry.out
+  test `bin/tarix -l -q type=l,uid=$(id -u) -f bin/test/qry.tarix | wc -l` = 1
+  test `bin/tarix -l -q type=p,size=0 -f bin/test/qry.tarix | wc -l` = 1
+  test `bin/tarix -l -q uid\>$(id -u) -f bin/test/qry.tarix | wc -l` = 0
+
+  # with the usual name filters
+  test `bin/tarix -l -f bin/test/qry.tarix qry.d/many | wc -l` = 6001
+  test `bin/tarix -l -e -f bin/test/qry.tarix qry.d/many | wc -l` \
+    = $(( `wc -l <bin/test/qry.tv` - 6001 ))
+  test `bin/tarix -l -q size\>4 -f bin/test/qry.tarix qry.d/many | wc -l` = 5001
+  bin/tarix -ll -a -f bin/test/qry.tarix qry.d/small | cut -f 9 \
+    | grep -x qry.d/small
+
+  mv bin/test/qry.away bin/test/qry.tar
+done
+
+# indexes from before metadata was recorded still list, but conditions
+# can't be checked on them
+grep -v '^#:st ' bin/test/qry.tarix >bin/test/qry.old
+bin/tarix -l -f bin/test/qry.old >bin/test/qry.out
+test `wc -l <bin/test/qry.out` = `wc -l <bin/test/qry.tv`
+bin/tarix -l -q size\>=0 -f bin/test/qry.old >bin/test/qry.out \
+  2>bin/test/qry.err
+test `wc -l <bin/test/qry.out` = 0
+grep -q 'needs to be recreated' bin/test/qry.err
+
+# bad usage
+! bin/tarix -l -q size=lots -f bin/test/qry.tarix >/dev/null
+! bin/tarix -l -q color=red -f bin/test/qry.tarix >/dev/null
+! bin/tarix -x -q type=f -f bin/test/qry.tarix -t bin/test/qry.tar >/dev/null
+
+rm -rf bin/test/qry.*
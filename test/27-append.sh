@@ -0,0 +1,78 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# appending to an index (-A) after tar -r or cat added to the archive
+# gives the same index as indexing the whole archive again
+
+rm -rf bin/test/app.*
+d=bin/test/app.d
+for part in 1 2 3 ; do
+  mkdir -p $d/part$part
+  seq 1 $((part * 200000)) >$d/part$part/big
+  for i in `seq 1 200` ; do
+    echo $part $i >$d/part$part/small$i
+  done
+done
+long=$d/part2/a-directory-with-a-long-name-for-a-gnu-longname-record/and-then-a-file-with-a-long-name-too
+mkdir -p `dirname $long`
+seq 7 3000 >$long
+
+for fmt in gnu posix ; do
+  for jobs in "" "-j 4" ; do
+    # the parts go in as they are appended, with -j on bigger pieces
+    tar -c -H $fmt -f bin/test/app.tar -C bin/test app.d/part1
+    bin/tarix -i -f bin/test/app.tarix -t bin/test/app.tar
+    tar -r -H $fmt -f bin/test/app.tar -C bin/test app.d/part2
+    bin/tarix -A $jobs -f bin/test/app.tarix -t bin/test/app.tar
+    tar -r -H $fmt -f bin/test/app.tar -C bin/test app.d/part3
+    bin/tarix -A $jobs -f bin/test/app.tarix -t bin/test/app.tar
+    bin/tarix -i -f bin/test/app.full -t bin/test/app.tar
+    cmp bin/test/app.tarix bin/test/app.full
+
+    # nothing new, nothing added
+    bin/tarix -A $jobs -f bin/test/app.tarix -t bin/test/app.tar
+    cmp bin/test/app.tarix bin/test/app.full
+  done
+done
+
+# an index from before #:st records gets them for the new entries
+tar -c -f bin/test/app.tar -C bin/test app.d/part1
+bin/tarix -i -f bin/test/app.full -t bin/test/app.tar
+grep -v '^#:st ' bin/test/app.full >bin/test/app.tarix
+tar -r -f bin/test/app.tar -C bin/test app.d/part2
+bin/tarix -A -f bin/test/app.tarix -t bin/test/app.tar
+bin/tarix -i -f bin/test/app.full -t bin/test/app.tar
+grep -v '^#:st ' bin/test/app.full | diff - <(grep -v '^#:st ' bin/test/app.tarix)
+test `grep -c '^#:st ' bin/test/app.tarix` = `grep -c ' app.d/part2/' bin/test/app.full`
+
+# concatenated archives, with the end of archive blocks in between
+tar -c -f bin/test/app.tar -C bin/test app.d/part1
+tar -c -f bin/test/app.tar2 -C bin/test app.d/part2
+bin/tarix -i -f bin/test/app.tarix -t bin/test/app.tar
+cat bin/test/app.tar2 >>bin/test/app.tar
+bin/tarix -A -f bin/test/app.tarix -t bin/test/app.tar
+bin/tarix -i -f bin/test/app.full -t bin/test/app.tar
+cmp bin/test/app.tarix bin/test/app.full
+bin/tarix -x -f bin/test/app.tarix -t bin/test/app.tar app.d/part2/big \
+  | tar -x -O -f - >bin/test/app.x
+cmp $d/part2/big bin/test/app.x
+
+# not from some other archive, nor to a compressed one's index
+cp bin/test/app.tarix bin/test/app.save
+tar -c -f bin/test/app.tar2 -C bin/test app.d/part1
+! bin/tarix -A -f bin/test/app.tarix -t bin/test/app.tar2
+cmp bin/test/app.tarix bin/test/app.save
+for other in "app.d/part3 app.d/part1 app.d/part2" \
+    "app.d/part1 app.d/part3 app.d/part2" ; do
+  tar -c -f bin/test/app.tar2 -C bin/test $other
+  ! bin/tarix -A -f bin/test/app.tarix -t bin/test/app.tar2 \
+    2>bin/test/app.err
+  grep -q "doesn't match" bin/test/app.err
+  cmp bin/test/app.tarix bin/test/app.save
+done
+bin/tarix -z -f bin/test/app.tarix -t bin/test/app.tar >bin/test/app.gz
+! bin/tarix -A -f bin/test/app.tarix -t bin/test/app.tar
+! bin/tarix -A -z -f bin/test/app.tarix -t bin/test/app.gz
+
+rm -rf bin/test/app.*
@@ -0,0 +1,72 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# resumable creation (-P, -R): kill tarix part way through (by running
+# out of file size limit), resume, and get a good archive and index
+
+rm -rf bin/test/res.*
+d=bin/test/res.d
+mkdir -p $d
+for i in `seq 1 150` ; do
+  seq $i $((i * 50 + 10000)) >$d/file$i
+done
+tar -c -f bin/test/res.tar -C bin/test res.d
+
+# die after about 600k and then 1.5M of archive, then finish
+for opts in "" "-z" "-z -j 4" "-z -1 -k 64k" ; do
+  bin/tarix $opts -P 128k -o bin/test/res.ref -t bin/test/res.tar \
+    -f bin/test/res.refix
+  test ! -f bin/test/res.refix.resume
+
+  ! ( ulimit -f 600 ; exec bin/tarix $opts -P 128k -o bin/test/res.out \
+    -t bin/test/res.tar -f bin/test/res.tarix )
+  test -f bin/test/res.tarix.resume
+  ! ( ulimit -f 1500 ; exec bin/tarix $opts -R -o bin/test/res.out \
+    -t bin/test/res.tar -f bin/test/res.tarix )
+  test -f bin/test/res.tarix.resume
+  bin/tarix $opts -R -o bin/test/res.out -t bin/test/res.tar \
+    -f bin/test/res.tarix
+  test ! -f bin/test/res.tarix.resume
+
+  # the index is the same as from a run that never stopped, offsets and
+  # all; so is the archive, but for the gzip header's timestamp
+  cmp bin/test/res.tarix bin/test/res.refix
+  if [ -z "$opts" ]; then
+    cmp bin/test/res.out bin/test/res.tar
+  else
+    gzip -t bin/test/res.out
+    gzip -dc bin/test/res.out | cmp - bin/test/res.tar
+    cmp -i 10 bin/test/res.out bin/test/res.ref
+  fi
+  for i in 1 17 150 ; do
+    bin/tarix -x -a $opts -f bin/test/res.tarix -t bin/test/res.out \
+      res.d/file$i | tar -x -O -f - | cmp - $d/file$i
+  done
+  rm -f bin/test/res.out bin/test/res.tarix
+done
+
+# resuming needs the same compression, a progress file and a real tar file
+! ( ulimit -f 600 ; exec bin/tarix -z -P 128k -o bin/test/res.out \
+  -t bin/test/res.tar -f bin/test/res.tarix )
+! bin/tarix -z -2 -R -o bin/test/res.out -t bin/test/res.tar \
+  -f bin/test/res.tarix
+! bin/tarix -R -o bin/test/res.out -t bin/test/res.tar -f bin/test/res.tarix
+! bin/tarix -z -R -o bin/test/res.out -f bin/test/res.tarix \
+  <bin/test/res.tar
+test -f bin/test/res.tarix.resume
+! bin/tarix -z -R -o bin/test/res.out -t bin/test/res.tar \
+  -f bin/test/res.other
+! bin/tarix -z -P 128k -t bin/test/res.tar -f bin/test/res.tarix >/dev/null
+! bin/tarix -i -P 128k -o bin/test/res.out -t bin/test/res.tar \
+  -f bin/test/res.tarix
+bin/tarix -z -R -o bin/test/res.out -t bin/test/res.tar -f bin/test/res.tarix
+gzip -dc bin/test/res.out | cmp - bin/test/res.tar
+
+# a fresh start doesn't leave an old progress file around
+! ( ulimit -f 600 ; exec bin/tarix -z -P 128k -o bin/test/res.out \
+  -t bin/test/res.tar -f bin/test/res.tarix )
+bin/tarix -z -o bin/test/res.out -t bin/test/res.tar -f bin/test/res.tarix
+test ! -f bin/test/res.tarix.resume
+
+rm -rf bin/test/res.*
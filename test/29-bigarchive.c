@@ -0,0 +1,170 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/* writes (or adds to) a tar file that is terabytes long without taking up
+ * the space: big members whose data is left as holes in a sparse file,
+ * then one small member with some real contents.  Members of 8G and more
+ * get their size in base-256 (gnu) or in an extended header (posix). */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "portability.h"
+#include "tar.h"
+
+/* as big as a member can be with an octal size field, in whole blocks */
+#define BIG_SIZE 077777777000LL
+
+enum { FMT_USTAR, FMT_GNU, FMT_POSIX };
+
+static int write_block(int fd, union tar_block *blk) {
+  unsigned int sum = 0;
+  int i;
+  
+  memset(blk->header.chksum, ' ', sizeof(blk->header.chksum));
+  for (i = 0; i < TARBLKSZ; ++i)
+    sum += (unsigned char)blk->buffer[i];
+  sprintf(blk->header.chksum, "%06o", sum);
+  if (write(fd, blk, TARBLKSZ) != TARBLKSZ) {
+    perror("write header");
+    return 1;
+  }
+  return 0;
+}
+
+static void fill_header(union tar_block *blk, const char *name, char type,
+    long long size) {
+  char num[24];
+  
+  memset(blk, 0, sizeof(*blk));
+  memcpy(blk->header.name, name, strlen(name));
+  strcpy(blk->header.mode, "0000644");
+  strcpy(blk->header.uid, "0001750");
+  strcpy(blk->header.gid, "0001750");
+  sprintf(num, "%011llo", size);
+  memcpy(blk->header.size, num, sizeof(blk->header.size));
+  strcpy(blk->header.mtime, "14524770400");
+  blk->header.typeflag = type;
+  memcpy(blk->header.magic, TMAGIC, TMAGLEN);
+  memcpy(blk->header.version, TVERSION, TVERSLEN);
+}
+
+static int write_header(int fd, const char *name, long long size, int fmt) {
+  union tar_block blk;
+  int i;
+  
+  if (size <= 077777777777LL || fmt == FMT_USTAR) {
+    fill_header(&blk, name, REGTYPE, size);
+  } else if (fmt == FMT_GNU) {
+    fill_header(&blk, name, REGTYPE, 0);
+    memcpy(blk.buffer + offsetof(struct posix_header, magic), OLDGNU_MAGIC,
+      OLDGNU_MAGLEN + 1);
+    blk.header.size[0] = (char)0x80;
+    for (i = sizeof(blk.header.size) - 1; i > 0; --i, size >>= 8)
+      blk.header.size[i] = size & 0xff;
+  } else {
+    /* as GNU tar does it: the size in the header is 0 */
+    char rec[64], xname[100];
+    int body = snprintf(NULL, 0, " size=%lld\n", size), len = body;
+    /* the length counts its own digits */
+    while (len != body + snprintf(NULL, 0, "%d", len))
+      len = body + snprintf(NULL, 0, "%d", len);
+    sprintf(rec, "%d size=%lld\n", len, size);
+    sprintf(xname, "./PaxHeaders/%s", name);
+    fill_header(&blk, xname, XHDTYPE, len);
+    if (write_block(fd, &blk) != 0)
+      return 1;
+    memset(&blk, 0, sizeof(blk));
+    memcpy(blk.buffer, rec, len);
+    if (write(fd, &blk, TARBLKSZ) != TARBLKSZ) {
+      perror("write extended header");
+      return 1;
+    }
+    fill_header(&blk, name, REGTYPE, 0);
+  }
+  return write_block(fd, &blk);
+}
+
+int main(int argc, char **argv) {
+  char name[100], data[TARBLKSZ];
+  long long size = BIG_SIZE;
+  off64_t end;
+  int fd, i, n, fmt = FMT_USTAR;
+  
+  if (argc < 4 || argc > 6 || (n = atoi(argv[2])) < 0) {
+    fprintf(stderr, "usage: %s tarfile nbig name [ustar|gnu|posix [size]]\n",
+      argv[0]);
+    return 1;
+  }
+  if (argc > 4)
+    fmt = strcmp(argv[4], "gnu") == 0 ? FMT_GNU
+      : strcmp(argv[4], "posix") == 0 ? FMT_POSIX : FMT_USTAR;
+  if (argc > 5)
+    size = atoll(argv[5]);
+  if ((fd = open(argv[1], O_WRONLY | O_CREAT | P_O_LARGEFILE, 0666)) < 0) {
+    perror("open tarfile");
+    return 1;
+  }
+  /* add to an existing one over its end of archive blocks */
+  end = p_lseek64(fd, 0, SEEK_END);
+  if (end >= 2 * TARBLKSZ)
+    end -= 2 * TARBLKSZ;
+  if (p_lseek64(fd, end, SEEK_SET) != end) {
+    perror("seek tarfile");
+    return 1;
+  }
+  
+  for (i = 0; i < n; ++i) {
+    sprintf(name, "big/%s.%03d", argv[3], i);
+    if (write_header(fd, name, size, fmt) != 0)
+      return 1;
+    if (p_lseek64(fd, (size + TARBLKSZ - 1) / TARBLKSZ * TARBLKSZ,
+        SEEK_CUR) < 0) {
+      perror("seek tarfile");
+      return 1;
+    }
+  }
+  
+  memset(data, 0, sizeof(data));
+  sprintf(data, "%s is %lld bytes into the archive\n", argv[3],
+    (long long)p_lseek64(fd, 0, SEEK_CUR));
+  if (write_header(fd, argv[3], strlen(data), fmt) != 0)
+    return 1;
+  if (write(fd, data, TARBLKSZ) != TARBLKSZ) {
+    perror("write data");
+    return 1;
+  }
+  memset(data, 0, sizeof(data));
+  if (write(fd, data, TARBLKSZ) != TARBLKSZ
+      || write(fd, data, TARBLKSZ) != TARBLKSZ) {
+    perror("write end of archive");
+    return 1;
+  }
+  if (close(fd) != 0) {
+    perror("close tarfile");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,33 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# archives past 2T (2^32 blocks): a sparse tar file of big members whose
+# data is all holes, so it doesn't need the disk space
+
+rm -f bin/test/big.*
+# 300 members of 8G, then small1 2.4T into the archive
+bin/test/29-bigarchive bin/test/big.tar 300 small1
+blk=$((300 * 16777216))
+bin/tarix -i -f bin/test/big.tarix -t bin/test/big.tar
+grep -x "0 $blk $((blk * 512)) 2 small1" bin/test/big.tarix
+grep -x "#:st 644 1000 1000 8589934080 1700000000" bin/test/big.tarix \
+  | wc -l | grep -x 300
+
+bin/tarix -x -f bin/test/big.tarix -t bin/test/big.tar small1 \
+  | tar -x -O -f - | grep -x "small1 is $((blk * 512)) bytes into the archive"
+bin/tarix -x -c -f bin/test/big.tarix -t bin/test/big.tar small1 \
+  | grep -x "small1 is $((blk * 512)) bytes into the archive"
+bin/tarix -x -c -r -100 -f bin/test/big.tarix -t bin/test/big.tar \
+  big/small1.299 | cmp - <(head -c 100 /dev/zero)
+bin/tarix -l -f bin/test/big.tarix small1 | grep "small1$"
+
+# and adding another 2.4T to it
+bin/test/29-bigarchive bin/test/big.tar 300 small2
+bin/tarix -A -f bin/test/big.tarix -t bin/test/big.tar
+grep -x "0 $((blk * 2 + 2)) $(((blk * 2 + 2) * 512)) 2 small2" \
+  bin/test/big.tarix
+bin/tarix -x -c -f bin/test/big.tarix -t bin/test/big.tar small2 \
+  | grep -x "small2 is $(((blk * 2 + 2) * 512)) bytes into the archive"
+
+rm -f bin/test/big.*
@@ -0,0 +1,58 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# members of 8G and more: sizes in base-256 (gnu) or in an extended header
+# (posix), and GNU sparse maps with base-256 offsets
+
+size=214748364800
+for fmt in gnu posix ; do
+  rm -f bin/test/bignum.*
+  bin/test/29-bigarchive bin/test/bignum.tar 3 small $fmt $size
+  bin/tarix -i -f bin/test/bignum.tarix -t bin/test/bignum.tar
+  # posix members have a 2 block extended header before them
+  blk=$(((size / 512 + 1) * 3))
+  [ $fmt = posix ] && blk=$((blk + 6))
+  grep -x "0 $blk $((blk * 512)) 2 small" bin/test/bignum.tarix
+  # the extended headers are part of the entries, not entries of their own
+  grep -c "^0 " bin/test/bignum.tarix | grep -x 4
+  grep -x "#:st 644 1000 1000 $size 1700000000" bin/test/bignum.tarix \
+    | wc -l | grep -x 3
+  bin/tarix -x -f bin/test/bignum.tarix -t bin/test/bignum.tar small \
+    | tar -x -O -f - | grep -x "small is $((blk * 512)) bytes into the archive"
+  bin/tarix -x -c -r -100 -f bin/test/bignum.tarix -t bin/test/bignum.tar \
+    big/small.002 | cmp - <(head -c 100 /dev/zero)
+  # without #:st records (older indexes) the size is read from the archive
+  grep -v "^#:st " bin/test/bignum.tarix >bin/test/bignum.nost
+  bin/tarix -x -c -r -100 -f bin/test/bignum.nost -t bin/test/bignum.tar \
+    big/small.002 | cmp - <(head -c 100 /dev/zero)
+  bin/tarix -l -f bin/test/bignum.tarix big/small.001 | grep " $size "
+done
+
+if tar --version | grep GNU.tar ; then
+  rm -f bin/test/bignum.*
+  truncate -s 9G bin/test/bignum.sparse
+  echo "the end" >>bin/test/bignum.sparse
+  tar -c -S --format=gnu -f bin/test/bignum.tar bin/test/bignum.sparse
+  bin/tarix -i -f bin/test/bignum.tarix -t bin/test/bignum.tar
+  grep "^#:sparse 9663676424 " bin/test/bignum.tarix
+  bin/tarix -x -c -r -8 -f bin/test/bignum.tarix -t bin/test/bignum.tar \
+    bin/test/bignum.sparse | grep -x "the end"
+fi
+
+# a size field that is negative (all 0xff is -1 in base-256) or not a
+# number at all is a damaged header, not a member of some size
+rm -f bin/test/bignum.*
+echo "not so big" >bin/test/bignum.file
+tar -c -f bin/test/bignum.tar bin/test/bignum.file
+bin/tarix -i -f bin/test/bignum.tarix -t bin/test/bignum.tar
+for bad in '\377' 'x' ; do
+  cp bin/test/bignum.tar bin/test/bignum.bad
+  for i in $(seq 12) ; do printf "$bad" ; done \
+    | dd of=bin/test/bignum.bad bs=1 seek=124 conv=notrunc
+  ! bin/tarix -i -f bin/test/bignum.badix -t bin/test/bignum.bad
+  ! bin/tarix -x -c -f bin/test/bignum.tarix -t bin/test/bignum.bad \
+    bin/test/bignum.file
+done
+
+rm -f bin/test/bignum.*
@@ -0,0 +1,75 @@
+#!/usr/bin/env bash
+
+set -xe
+
+# extended headers (pax) go with the member after them: the index takes the
+# name and size from them, and extracting a member gets them along with it
+
+rm -rf bin/test/pax.*
+d=bin/test/pax.d
+mkdir -p $d
+# too long for the name and prefix fields of a ustar header
+long=$d/$(printf 'a-directory-with-a-name-of-sixty-characters-or-so-in-it-%03d/' \
+  1 2 3 4)file
+mkdir -p `dirname $long`
+seq 1 20000 >$long
+seq 5 500 >$d/short
+touch -d '2021-03-04 05:06:07.5' $d/short
+ln -s `printf 'x%.0s' $(seq 150)` $d/link
+# these fit a ustar header: all of the name field, and name and prefix
+full=$d/`printf 'n%.0s' $(seq 94)`
+mid=$d/`printf 'p%.0s' $(seq 60)`/`printf 'f%.0s' $(seq 80)`
+mkdir -p `dirname $mid`
+seq 3 3000 >$full
+seq 4 4000 >$mid
+
+for fmt in posix ustar ; do
+  if [ $fmt = posix ]; then
+    # a global header as well
+    tar -c -H $fmt --pax-option=comment=global -f bin/test/pax.tar \
+      -C bin/test pax.d
+  else
+    tar -c -H $fmt -f bin/test/pax.tar -C bin/test ${full#bin/test/} \
+      ${mid#bin/test/} pax.d/short
+  fi
+  bin/tarix -i -f bin/test/pax.tarix -t bin/test/pax.tar
+  ! grep -q "^[xg] " bin/test/pax.tarix
+  # the first entry starts at the start of the archive
+  sed -n 2p bin/test/pax.tarix | grep "^[05] 0 0 "
+  tar -t -v --numeric-owner -f bin/test/pax.tar | sed -e 's/ -> .*//' \
+    | tr -s ' ' >bin/test/pax.tv
+  bin/tarix -l -f bin/test/pax.tarix | tr -s ' ' | diff bin/test/pax.tv -
+  grep -x "#:st 644 [0-9]* [0-9]* 1884 1614834367" bin/test/pax.tarix
+  
+  gzip -c bin/test/pax.tar >bin/test/pax.tar.gz
+  for m in plain -z -Z ; do
+    case $m in
+      plain)
+        bin/tarix -i -f bin/test/pax.tarix -t bin/test/pax.tar
+        cp bin/test/pax.tar bin/test/pax.out
+        x= ;;
+      -Z)
+        bin/tarix -i -Z -f bin/test/pax.tarix -t bin/test/pax.tar.gz
+        cp bin/test/pax.tar.gz bin/test/pax.out
+        x=-Z ;;
+      -z)
+        bin/tarix -z -f bin/test/pax.tarix -t bin/test/pax.tar \
+          >bin/test/pax.out
+        x=-z ;;
+    esac
+    xt="bin/tarix -x $x -f bin/test/pax.tarix -t bin/test/pax.out"
+    
+    for f in $long $full $mid $d/short ; do
+      if [ $fmt = ustar -a $f = $long ]; then
+        continue
+      fi
+      # the extended header comes out with the member, so tar has the name
+      $xt ${f#bin/test/} | tar -t -f - | grep -x ${f#bin/test/}
+      $xt ${f#bin/test/} | tar -x -O -f - | cmp - $f
+      $xt -c ${f#bin/test/} | cmp - $f
+      $xt -c -r -100 ${f#bin/test/} | cmp - <(tail -c 100 $f)
+    done
+  done
+done
+
+rm -rf bin/test/pax.*
@@ -0,0 +1,205 @@
+/*
+ *  tarix - a GNU/POSIX tar indexer
+ *  Copyright (C) 2006 Matthew "Cheetah" Gabeler-Lee
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+/* test case for io_pipe: what goes through a reader or a writer thread
+ * comes out the same, whatever the sizes of the pieces, write errors come
+ * back to the caller, and a reader stuck on an idle pipe can be stopped */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "io_pipe.h"
+#include "portability.h"
+
+#define OFILE "bin/test/iopipe.out"
+#define DATASZ (3 << 20)
+#define BUFSZ 65536
+
+/* piece sizes to cycle through, below, around and above BUFSZ */
+static const int sizes[] = { 1, 512, 7, BUFSZ, 3000, BUFSZ + 1, 200000,
+  777, 65535, 13 };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static char *data, *back;
+
+/* read all of DATASZ through iop, in pieces, and check for the end */
+static int read_back(struct io_pipe *iop, int skip) {
+  int pos, n, i;
+  ssize_t rv;
+  
+  memset(back, 0, DATASZ);
+  for (pos = skip, i = 0; pos < DATASZ; pos += rv, ++i) {
+    n = sizes[i % NSIZES];
+    if (n > DATASZ - pos)
+      n = DATASZ - pos;
+    if ((rv = iop_read(iop, back + pos, n)) != n) {
+      printf("read %d at %d: got %d\n", n, pos, (int)rv);
+      return 1;
+    }
+  }
+  if ((rv = iop_read(iop, back, 100)) != 0) {
+    printf("read past the end: got %d\n", (int)rv);
+    return 1;
+  }
+  if (memcmp(data + skip, back + skip, DATASZ - skip) != 0) {
+    printf("read mismatch\n");
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  size_t align = sysconf(_SC_PAGESIZE);
+  struct io_pipe *iop;
+  int fd, pfd[2], i, pos, n;
+  pid_t pid;
+  
+  data = malloc(DATASZ);
+  back = malloc(DATASZ);
+  srandom(3);
+  for (i = 0; i < DATASZ; ++i)
+    data[i] = random();
+  
+  /* writer, to a file */
+  if ((fd = open(OFILE, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+    perror("open output");
+    return 1;
+  }
+  if ((iop = iop_start_writer(fd, BUFSZ, IOP_NBUFS, align)) == NULL) {
+    perror("start writer");
+    return 1;
+  }
+  for (pos = 0, i = 0; pos < DATASZ; pos += n, ++i) {
+    n = sizes[i % NSIZES];
+    if (n > DATASZ - pos)
+      n = DATASZ - pos;
+    if (iop_write(iop, data + pos, n) != n) {
+      perror("iop_write");
+      return 1;
+    }
+    /* a drain now and then, as ts_sync does */
+    if (i % 50 == 0 && iop_drain(iop) != 0) {
+      perror("iop_drain");
+      return 1;
+    }
+  }
+  if (iop_end(iop) != 0) {
+    perror("iop_end writer");
+    return 1;
+  }
+  close(fd);
+  
+  /* read back as a seekable file, from the start and from a block on */
+  if ((fd = open(OFILE, O_RDONLY)) < 0) {
+    perror("open input");
+    return 1;
+  }
+  for (pos = 0; pos <= 4096; pos += 4096) {
+    if ((iop = iop_start_reader(fd, 1, pos, BUFSZ, IOP_NBUFS, align))
+        == NULL) {
+      perror("start reader");
+      return 1;
+    }
+    if (read_back(iop, pos) != 0)
+      return 1;
+    iop_end(iop);
+  }
+  close(fd);
+  
+  /* and from a pipe, written in pieces that never line up */
+  if (pipe(pfd) != 0 || (pid = fork()) < 0) {
+    perror("pipe");
+    return 1;
+  }
+  if (pid == 0) {
+    close(pfd[0]);
+    for (pos = 0; pos < DATASZ; pos += n) {
+      n = DATASZ - pos < 777 ? DATASZ - pos : 777;
+      if (write(pfd[1], data + pos, n) != n)
+        _exit(1);
+    }
+    _exit(0);
+  }
+  close(pfd[1]);
+  if ((iop = iop_start_reader(pfd[0], 0, 0, BUFSZ, IOP_NBUFS, align))
+      == NULL) {
+    perror("start reader");
+    return 1;
+  }
+  if (read_back(iop, 0) != 0)
+    return 1;
+  iop_end(iop);
+  close(pfd[0]);
+  waitpid(pid, NULL, 0);
+  
+  /* a reader on a pipe that stays open but idle has to stop anyway */
+  alarm(30);
+  if (pipe(pfd) != 0) {
+    perror("pipe");
+    return 1;
+  }
+  if ((iop = iop_start_reader(pfd[0], 0, 0, BUFSZ, IOP_NBUFS, align))
+      == NULL) {
+    perror("start reader");
+    return 1;
+  }
+  if (write(pfd[1], data, 100) != 100) {
+    perror("write pipe");
+    return 1;
+  }
+  iop_end(iop);
+  close(pfd[0]);
+  close(pfd[1]);
+  
+  /* write errors show up on a later write, or at the end */
+  if ((fd = open("/dev/full", O_WRONLY)) >= 0) {
+    int failed = 0;
+    if ((iop = iop_start_writer(fd, BUFSZ, IOP_NBUFS, align)) == NULL) {
+      perror("start writer");
+      return 1;
+    }
+    for (pos = 0; pos < DATASZ && !failed; pos += BUFSZ)
+      failed = iop_write(iop, data + pos, BUFSZ) < 0;
+    if (!failed && iop_drain(iop) == 0) {
+      printf("no error writing to /dev/full\n");
+      return 1;
+    }
+    if (errno != ENOSPC) {
+      perror("expected ENOSPC");
+      return 1;
+    }
+    if (iop_end(iop) == 0) {
+      printf("iop_end didn't fail after the write error\n");
+      return 1;
+    }
+    close(fd);
+  }
+  
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,9 @@
+#!/usr/bin/env bash
+
+# test script for 32-iopipe.c
+
+set -xe
+
+rm -f bin/test/iopipe.*
+bin/test/32-iopipe
+rm -f bin/test/iopipe.*